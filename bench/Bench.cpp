@@ -0,0 +1,374 @@
+#include "../includes/Damage.hpp"
+#include "../includes/Convert.hpp"
+#include "../includes/Flv.hpp"
+#include "../includes/Instance.hpp"
+#include "../includes/Utils.hpp"
+#include "Harness.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#ifndef BENCH_REVISION
+# define BENCH_REVISION "unknown"
+#endif
+
+static const int kWidth = 1920;
+static const int kHeight = 1080;
+static const int kWarmupRuns = 3;
+static const int kTimedRuns = 50;
+static const int kSinkPort = 19350;
+static const long long kSinkListenTimeoutMs = 10000;
+static const long long kFirstPacketTimeoutMs = 60000;
+static const long long kCpuWindowMs = 10000;
+static const long long kChildrenGoneTimeoutMs = 15000;
+
+/**
+ * @brief Median and 95th percentile of repeated measurements
+ */
+struct Timing {
+    double median;
+    double p95;
+};
+
+/**
+ * @brief Returns a monotonic clock reading in microseconds
+ *
+ * @return long long Microseconds since an arbitrary fixed point
+ */
+static long long monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Summarizes samples in milliseconds
+ *
+ * @param samples The samples in microseconds, reordered
+ * @return Timing The median and 95th percentile in milliseconds
+ */
+static Timing summarize(std::vector<long long>& samples) {
+    Timing timing;
+    std::sort(samples.begin(), samples.end());
+    timing.median = samples[samples.size() / 2] / 1000.0;
+    timing.p95 = samples[(samples.size() * 95) / 100] / 1000.0;
+    return timing;
+}
+
+/**
+ * @brief Draws a deterministic stand-in for a rendered dashboard page
+ *
+ * Flat coloured cells with noisy "text" in them, so the conversion and
+ * hashing see the same data on every run and every machine.
+ *
+ * @param frame Receives a kWidth x kHeight bgr0 frame
+ */
+static void syntheticPage(std::vector<unsigned char>& frame) {
+    uint32_t seed = 42;
+    frame.resize(static_cast<size_t>(kWidth) * kHeight * 4);
+    for (int y = 0; y < kHeight; y++) {
+        for (int x = 0; x < kWidth; x++) {
+            unsigned char* p = &frame[(static_cast<size_t>(y) * kWidth + x) * 4];
+            int cell = (y / 120) * 16 + x / 120;
+            seed = seed * 1103515245 + 12345;
+            bool ink = (x % 120) > 30 && (x % 120) < 90 && (y % 120) > 40 && (y % 120) < 80
+                       && ((seed >> 16) & 3) == 0;
+            p[0] = ink ? 240 : static_cast<unsigned char>(40 + (cell * 37) % 180);
+            p[1] = ink ? 240 : static_cast<unsigned char>(30 + (cell * 53) % 190);
+            p[2] = ink ? 240 : static_cast<unsigned char>(20 + (cell * 71) % 200);
+            p[3] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Measures the per-frame cost of damage hashing and conversion
+ *
+ * Every available kernel is timed at the native and the 720p output
+ * size, and its output compared with the scalar reference.
+ *
+ * @param json Receives the "frame" object
+ */
+static void frameBenchmarks(std::ostringstream& json) {
+    std::vector<unsigned char> frame;
+    std::vector<long long> samples;
+    const int sizes[][2] = { { kWidth, kHeight }, { 1280, 720 } };
+    std::vector<ConvertKernel> kernels = availableConvertKernels();
+
+    syntheticPage(frame);
+    DamageTracker damage(kWidth, kHeight);
+    for (int i = 0; i < kWarmupRuns + kTimedRuns; i++) {
+        long long start = monotonicUs();
+        damage.update(&frame[0], kWidth * 4);
+        if (i >= kWarmupRuns) {
+            samples.push_back(monotonicUs() - start);
+        }
+    }
+    Timing hashing = summarize(samples);
+    json << "  \"frame\": {\n    \"width\": " << kWidth << ", \"height\": " << kHeight << ",\n"
+         << "    \"damage_hash_ms\": { \"median\": " << hashing.median << ", \"p95\": " << hashing.p95 << " },\n"
+         << "    \"convert\": [\n";
+    for (size_t s = 0; s < 2; s++) {
+        std::vector<unsigned char> reference;
+        for (size_t k = 0; k < kernels.size(); k++) {
+            FrameConverter converter(kWidth, kHeight, sizes[s][0], sizes[s][1], kernels[k]);
+            std::vector<unsigned char> out(converter.frameSize());
+            samples.clear();
+            for (int i = 0; i < kWarmupRuns + kTimedRuns; i++) {
+                long long start = monotonicUs();
+                converter.convert(&frame[0], kWidth * 4, &out[0]);
+                if (i >= kWarmupRuns) {
+                    samples.push_back(monotonicUs() - start);
+                }
+            }
+            if (k == 0) {
+                reference = out;
+            }
+            Timing timing = summarize(samples);
+            json << "      { \"kernel\": \"" << kernels[k].name << "\", \"output\": \"" << sizes[s][0] << "x"
+                 << sizes[s][1] << "\", \"median_ms\": " << timing.median << ", \"p95_ms\": " << timing.p95
+                 << ", \"bit_exact\": " << (out == reference ? "true" : "false") << " }"
+                 << (s == 1 && k + 1 == kernels.size() ? "\n" : ",\n");
+            std::cerr << "convert " << kernels[k].name << " " << sizes[s][0] << "x" << sizes[s][1]
+                      << ": " << timing.median << " ms" << std::endl;
+        }
+    }
+    json << "    ]\n  },\n";
+}
+
+/**
+ * @brief Finds the encoder among the supervisor's descendants
+ *
+ * @param tree The supervisor process tree
+ * @return pid_t The ffmpeg process running libx264, -1 if none
+ */
+static pid_t findEncoder(const std::set<pid_t>& tree) {
+    for (std::set<pid_t>::const_iterator it = tree.begin(); it != tree.end(); ++it) {
+        std::ostringstream path;
+        path << "/proc/" << *it << "/cmdline";
+        std::ifstream cmdline(path.str().c_str());
+        std::string content((std::istreambuf_iterator<char>(cmdline)), std::istreambuf_iterator<char>());
+        std::string program = content.substr(0, content.find('\0'));
+        program = program.substr(program.rfind('/') + 1);
+        if (program == "ffmpeg" && content.find("libx264") != std::string::npos) {
+            return *it;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Reads the sink until a deadline, tracking video timestamps
+ *
+ * @param fd The sink's stdout
+ * @param deadline Monotonic deadline in milliseconds
+ * @param parser The FLV parser for this sink
+ * @param first Receives the first video timestamp seen, if still unset
+ * @param last Receives the last video timestamp seen
+ * @return bool False if the sink closed its output
+ */
+static bool drainSink(int fd, long long deadline, FlvParser& parser, long long& first, long long& last) {
+    std::vector<unsigned char> buffer(65536);
+    std::vector<std::shared_ptr<FlvPacket> > packets;
+    for (long long now = monotonicMs(); now < deadline; now = monotonicMs()) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, static_cast<int>(deadline - now)) <= 0) {
+            continue;
+        }
+        ssize_t count = read(fd, &buffer[0], buffer.size());
+        if (count <= 0) {
+            return false;
+        }
+        packets.clear();
+        parser.feed(&buffer[0], static_cast<size_t>(count), packets);
+        for (size_t i = 0; i < packets.size(); i++) {
+            if (packets[i]->type == FLV_TAG_VIDEO && !packets[i]->sequenceHeader) {
+                if (first < 0) {
+                    first = packets[i]->timestamp;
+                }
+                last = packets[i]->timestamp;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Measures a full start and stop against a local RTMP sink
+ *
+ * Runs the real binary on a throwaway HOME with a named instance that
+ * streams bench/page.html to an ffmpeg listening on localhost. Reports
+ * the time from `start` to the first byte at the sink, the encoder CPU
+ * per second of output video, the duration of `stop` and the time until
+ * every process of the stream is gone.
+ *
+ * @param json Receives the "startup" object
+ * @param binary The pagestreamer binary
+ * @param capture The capture backend to configure
+ */
+static void startupBenchmark(std::ostringstream& json, const std::string& binary, const std::string& capture) {
+    std::string reason = streamPrerequisites(capture);
+    if (!reason.empty()) {
+        json << "  \"startup\": { \"status\": \"skipped\", \"reason\": \"" << reason << "\" }\n";
+        std::cerr << "startup: skipped, " << reason << std::endl;
+        return;
+    }
+
+    TestHome home;
+    std::ostringstream sinkUrl;
+    std::ostringstream result;
+    std::ostringstream platform;
+    std::vector<std::string> settings;
+    platform << "PLATFORM=rtmp://127.0.0.1:" << kSinkPort << "/live";
+    settings.push_back(platform.str());
+    settings.push_back("CAPTURE=" + capture);
+    if (!createTestHome(home, "bench", "bench/page.html", settings, reason) && home.path.empty()) {
+        json << "  \"startup\": { \"status\": \"failed\", \"reason\": \"" << reason << "\" }\n";
+        return;
+    }
+    Instance instance = openInstance("bench");
+
+    sinkUrl << "rtmp://127.0.0.1:" << kSinkPort << "/live/bench";
+    std::string url = sinkUrl.str();
+    const char* sinkArgs[] = { "ffmpeg", "-hide_banner", "-loglevel", "error", "-listen", "1",
+                               "-i", url.c_str(), "-c", "copy", "-f", "flv", "pipe:1" };
+    std::vector<std::string> sink(sinkArgs, sinkArgs + sizeof(sinkArgs) / sizeof(sinkArgs[0]));
+    int sinkFd = -1;
+    pid_t sinkPid = reason.empty() ? spawnProcess(sink, &sinkFd) : -1;
+    long long deadline = monotonicMs() + kSinkListenTimeoutMs;
+    while (sinkPid > 0 && !isListening(kSinkPort) && monotonicMs() < deadline) {
+        usleep(10000);
+    }
+    if (reason.empty() && (sinkPid < 0 || !isListening(kSinkPort))) {
+        reason = "local RTMP sink did not start";
+    }
+
+    std::vector<std::string> start;
+    start.push_back(binary);
+    start.push_back("-i");
+    start.push_back("bench");
+    start.push_back("start");
+    std::vector<std::string> stop(start);
+    stop.back() = "stop";
+
+    long long startedAt = monotonicMs();
+    FlvParser parser;
+    long long firstTimestamp = -1;
+    long long lastTimestamp = -1;
+    if (reason.empty() && runProcess(start) != 0) {
+        reason = "pagestreamer start failed";
+    }
+    long long firstPacketMs = -1;
+    if (reason.empty()) {
+        struct pollfd pfd = { sinkFd, POLLIN, 0 };
+        if (poll(&pfd, 1, static_cast<int>(kFirstPacketTimeoutMs)) > 0) {
+            firstPacketMs = monotonicMs() - startedAt;
+        } else {
+            reason = "no packet reached the sink";
+        }
+    }
+
+    std::ifstream pidFile(instance.pidPath().c_str());
+    pid_t supervisor = -1;
+    pidFile >> supervisor;
+    double encoderCpu = -1;
+    if (reason.empty() && supervisor > 0) {
+        pid_t encoder = findEncoder(processTree(supervisor));
+        double cpuBefore = cpuSeconds(encoder);
+        drainSink(sinkFd, monotonicMs() + kCpuWindowMs, parser, firstTimestamp, lastTimestamp);
+        double cpuAfter = cpuSeconds(encoder);
+        if (encoder > 0 && cpuBefore >= 0 && cpuAfter >= 0 && lastTimestamp > firstTimestamp) {
+            encoderCpu = (cpuAfter - cpuBefore) / ((lastTimestamp - firstTimestamp) / 1000.0);
+        }
+    }
+
+    std::set<pid_t> tree = supervisor > 0 ? processTree(supervisor) : std::set<pid_t>();
+    long long stoppingAt = monotonicMs();
+    runProcess(stop);
+    long long stopMs = monotonicMs() - stoppingAt;
+    long long goneMs = -1;
+    deadline = stoppingAt + kChildrenGoneTimeoutMs;
+    while (goneMs < 0 && monotonicMs() < deadline) {
+        bool alive = false;
+        for (std::set<pid_t>::const_iterator it = tree.begin(); it != tree.end() && !alive; ++it) {
+            alive = kill(*it, 0) == 0;
+        }
+        if (!alive) {
+            goneMs = monotonicMs() - stoppingAt;
+        } else {
+            usleep(5000);
+        }
+    }
+
+    if (sinkPid > 0) {
+        kill(sinkPid, SIGTERM);
+        waitpid(sinkPid, NULL, 0);
+    }
+    if (sinkFd >= 0) {
+        close(sinkFd);
+    }
+    removeTree(home.path);
+
+    result << "  \"startup\": { \"status\": \"" << (reason.empty() ? "ok" : "failed") << "\"";
+    if (!reason.empty()) {
+        result << ", \"reason\": \"" << reason << "\"";
+    }
+    result << ", \"capture\": \"" << capture << "\", \"first_packet_ms\": " << firstPacketMs
+           << ", \"encoder_cpu_per_output_second\": " << encoderCpu
+           << ", \"stop_ms\": " << stopMs << ", \"children_gone_ms\": " << goneMs
+           << ", \"processes\": " << tree.size() << " }\n";
+    json << result.str();
+    std::cerr << "startup: first packet " << firstPacketMs << " ms, stop " << stopMs
+              << " ms, children gone " << goneMs << " ms" << std::endl;
+}
+
+/**
+ * @brief Entry point of the benchmark suite
+ *
+ * Usage: pagestreamer-bench [--capture x11grab|fbdir] PAGESTREAMER_BINARY
+ * Prints one JSON document on stdout; progress goes to stderr.
+ *
+ * @return int 0 on success, 1 on usage error
+ */
+int main(int argc, char** argv) {
+    std::string capture = "fbdir";
+    std::string binary;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--capture" && i + 1 < argc) {
+            capture = argv[++i];
+        } else {
+            binary = arg;
+        }
+    }
+    if (binary.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--capture x11grab|fbdir] PAGESTREAMER_BINARY" << std::endl;
+        return 1;
+    }
+    if (binary[0] != '/') {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd))) {
+            binary = std::string(cwd) + "/" + binary;
+        }
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"revision\": \"" << BENCH_REVISION << "\",\n"
+         << "  \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << ",\n"
+         << "  \"convert_kernel\": \"" << bestConvertKernel().name << "\",\n";
+    frameBenchmarks(json);
+    startupBenchmark(json, binary, capture);
+    json << "}\n";
+    std::cout << json.str();
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "Harness.hpp"
+#include "../includes/Instance.hpp"
+#include "../includes/Utils.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/**
+ * @brief Finds an executable in PATH
+ *
+ * @param name The program name, or a path
+ * @return bool True if it can be executed
+ */
+bool haveTool(const std::string& name) {
+    if (name.find('/') != std::string::npos) {
+        return access(name.c_str(), X_OK) == 0;
+    }
+    const char* path = getenv("PATH");
+    std::istringstream dirs(path ? path : "");
+    std::string dir;
+    while (std::getline(dirs, dir, ':')) {
+        if (!dir.empty() && access((dir + "/" + name).c_str(), X_OK) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Checks that a real stream can run from the current directory
+ *
+ * The browser is taken from BROWSER_PATH when set. Xvfb is not needed
+ * with the screencast capture.
+ *
+ * @param capture The capture backend the stream will use
+ * @return string Why the stream cannot run, empty if it can
+ */
+std::string streamPrerequisites(const std::string& capture) {
+    const char* browser = getenv("BROWSER_PATH");
+    const char* tools[] = { "ffmpeg", "Xvfb", "pulseaudio", "node", browser ? browser : "/snap/bin/chromium" };
+    for (size_t i = 0; i < sizeof(tools) / sizeof(tools[0]); i++) {
+        if ((capture != "screencast" || std::string(tools[i]) != "Xvfb") && !haveTool(tools[i])) {
+            return std::string(tools[i]) + " not found";
+        }
+    }
+    if (access("scripts/stream.js", R_OK) != 0) {
+        return "must run from the repository root";
+    }
+    if (access("node_modules/puppeteer", R_OK) != 0) {
+        return "node modules not installed";
+    }
+    return "";
+}
+
+/**
+ * @brief Starts a program, optionally capturing its stdout
+ *
+ * @param argv The command line
+ * @param stdoutFd Receives the read end of its stdout, or NULL for /dev/null
+ * @return pid_t The process, -1 on failure
+ */
+pid_t spawnProcess(const std::vector<std::string>& argv, int* stdoutFd) {
+    int fds[2] = { -1, -1 };
+    if (stdoutFd && pipe2(fds, O_CLOEXEC) != 0) {
+        return -1;
+    }
+    std::vector<char*> args;
+    for (size_t i = 0; i < argv.size(); i++) {
+        args.push_back(const_cast<char*>(argv[i].c_str()));
+    }
+    args.push_back(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_RDWR);
+        dup2(devNull, STDIN_FILENO);
+        dup2(stdoutFd ? fds[1] : devNull, STDOUT_FILENO);
+        execvp(args[0], &args[0]);
+        _exit(127);
+    }
+    if (stdoutFd) {
+        close(fds[1]);
+        *stdoutFd = pid > 0 ? fds[0] : -1;
+        if (pid < 0) {
+            close(fds[0]);
+        }
+    }
+    return pid;
+}
+
+/**
+ * @brief Runs a program to completion
+ *
+ * @param argv The command line
+ * @return int Its exit code, -1 if it could not run or was killed
+ */
+int runProcess(const std::vector<std::string>& argv) {
+    int status = 0;
+    pid_t pid = spawnProcess(argv, NULL);
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+/**
+ * @brief Tells whether something listens on a local TCP port
+ *
+ * Reads /proc/net/tcp rather than connecting, since the sink accepts a
+ * single connection.
+ *
+ * @param port The port
+ * @return bool True if a socket is in LISTEN state on it
+ */
+bool isListening(int port) {
+    std::ifstream tcp("/proc/net/tcp");
+    std::string line;
+    std::getline(tcp, line);
+    while (std::getline(tcp, line)) {
+        unsigned int localPort = 0;
+        unsigned int state = 0;
+        if (sscanf(line.c_str(), " %*d: %*x:%x %*x:%*x %x", &localPort, &state) == 2
+            && static_cast<int>(localPort) == port && state == 0x0A) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Lists every live descendant of a process
+ *
+ * @param root The ancestor
+ * @return set<pid_t> The root and its descendants
+ */
+std::set<pid_t> processTree(pid_t root) {
+    std::vector<std::pair<pid_t, pid_t> > parents;
+    DIR* proc = opendir("/proc");
+    struct dirent* entry;
+    while (proc && (entry = readdir(proc)) != NULL) {
+        pid_t pid = static_cast<pid_t>(atoi(entry->d_name));
+        std::ifstream stat(("/proc/" + std::string(entry->d_name) + "/stat").c_str());
+        std::string content;
+        if (pid <= 0 || !std::getline(stat, content) || content.rfind(')') == std::string::npos) {
+            continue;
+        }
+        int ppid = 0;
+        sscanf(content.c_str() + content.rfind(')') + 1, " %*c %d", &ppid);
+        parents.push_back(std::make_pair(pid, static_cast<pid_t>(ppid)));
+    }
+    if (proc) {
+        closedir(proc);
+    }
+    std::set<pid_t> tree;
+    tree.insert(root);
+    for (size_t added = 1; added > 0;) {
+        added = 0;
+        for (size_t i = 0; i < parents.size(); i++) {
+            if (tree.count(parents[i].second) && !tree.count(parents[i].first)) {
+                tree.insert(parents[i].first);
+                added++;
+            }
+        }
+    }
+    return tree;
+}
+
+/**
+ * @brief Reads the CPU time used by a process
+ *
+ * @param pid The process
+ * @return double User plus system time in seconds, -1 if unavailable
+ */
+double cpuSeconds(pid_t pid) {
+    std::ostringstream path;
+    path << "/proc/" << pid << "/stat";
+    std::ifstream stat(path.str().c_str());
+    std::string content;
+    unsigned long user = 0;
+    unsigned long system = 0;
+    if (!std::getline(stat, content) || content.rfind(')') == std::string::npos
+        || sscanf(content.c_str() + content.rfind(')') + 1,
+                  " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &user, &system) != 2) {
+        return -1;
+    }
+    return static_cast<double>(user + system) / sysconf(_SC_CLK_TCK);
+}
+
+/**
+ * @brief Creates a throwaway HOME with one instance and switches to it
+ *
+ * The instance streams a page of the repository, the current directory,
+ * whose scripts directory is linked into the profile. BROWSER_PATH is
+ * carried over from the environment, as streamPrerequisites() checks it.
+ *
+ * @param home Receives the HOME, repository and instance name
+ * @param instanceName The instance to configure
+ * @param pagePath The page to stream, relative to the repository
+ * @param settings KEY=VALUE lines added to the instance profile
+ * @param reason Receives why the HOME could not be set up
+ * @return bool False on failure; the HOME may still need removeTree()
+ */
+bool createTestHome(TestHome& home, const std::string& instanceName, const std::string& pagePath,
+                    const std::vector<std::string>& settings, std::string& reason) {
+    std::string pattern = "/tmp/pagestreamer-" + instanceName + "-XXXXXX";
+    std::vector<char> path(pattern.begin(), pattern.end());
+    char cwd[4096];
+    path.push_back('\0');
+    if (!getcwd(cwd, sizeof(cwd)) || !mkdtemp(&path[0])) {
+        reason = "cannot create a temporary HOME";
+        return false;
+    }
+    home.path = &path[0];
+    home.repo = cwd;
+    home.instanceName = instanceName;
+    setenv("HOME", home.path.c_str(), 1);
+    mkdir(pagestreamerDir().c_str(), 0755);
+    if (symlink((home.repo + "/scripts").c_str(), (pagestreamerDir() + "/scripts").c_str()) != 0) {
+        reason = "cannot link the scripts directory";
+        return false;
+    }
+    Instance instance = openInstance(instanceName);
+    std::ofstream env(instance.envPath().c_str());
+    env << "STREAM_KEY=" << instanceName << "\n"
+        << "STREAM_URL=file://" << home.repo << "/" << pagePath << "\n";
+    if (getenv("BROWSER_PATH")) {
+        env << "BROWSER_PATH=" << getenv("BROWSER_PATH") << "\n";
+    }
+    for (size_t i = 0; i < settings.size(); i++) {
+        env << settings[i] << "\n";
+    }
+    env.close();
+    if (!env) {
+        reason = "cannot write the instance profile";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Removes a directory tree entry, used with nftw()
+ */
+static int removeEntry(const char* path, const struct stat* info, int type, struct FTW* ftw) {
+    (void)info;
+    (void)type;
+    (void)ftw;
+    remove(path);
+    return 0;
+}
+
+/**
+ * @brief Removes a directory and everything in it
+ *
+ * @param path The directory
+ */
+void removeTree(const std::string& path) {
+    nftw(path.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
@@ -0,0 +1,32 @@
+#ifndef HARNESS_HPP
+# define HARNESS_HPP
+
+# include <set>
+# include <string>
+# include <vector>
+# include <sys/types.h>
+
+/**
+ * @brief A throwaway HOME with one instance streaming a local page
+ *
+ * Used by the benchmark and the soak test to run the real binary
+ * against a local RTMP sink without touching the user's profile.
+ */
+struct TestHome {
+    std::string path;
+    std::string repo;
+    std::string instanceName;
+};
+
+bool haveTool(const std::string& name);
+std::string streamPrerequisites(const std::string& capture);
+pid_t spawnProcess(const std::vector<std::string>& argv, int* stdoutFd);
+int runProcess(const std::vector<std::string>& argv);
+bool isListening(int port);
+std::set<pid_t> processTree(pid_t root);
+double cpuSeconds(pid_t pid);
+bool createTestHome(TestHome& home, const std::string& instanceName, const std::string& pagePath,
+                    const std::vector<std::string>& settings, std::string& reason);
+void removeTree(const std::string& path);
+
+#endif
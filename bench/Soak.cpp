@@ -0,0 +1,764 @@
+#include "../includes/Flv.hpp"
+#include "../includes/Instance.hpp"
+#include "../includes/Status.hpp"
+#include "../includes/Telemetry.hpp"
+#include "../includes/Utils.hpp"
+#include "Harness.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#ifndef SOAK_REVISION
+# define SOAK_REVISION "unknown"
+#endif
+
+static const int kSinkPort = 19351;
+static const long long kSinkListenTimeoutMs = 10000;
+static const long long kFirstPacketTimeoutMs = 60000;
+static const long long kMaxWarmupMs = 10 * 60 * 1000;
+static const double kMiB = 1024.0 * 1024.0;
+static const double kHourMs = 3600.0 * 1000.0;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+/**
+ * @brief Limits past which a soak run fails; 0 turns a limit off
+ */
+struct SoakLimits {
+    int maxRestarts;
+    int maxReconnects;
+    double maxRssGrowthMiBPerHour;
+    double maxRssMiB;
+    double maxCpuPercent;
+    double minFps;
+    long long maxStallMs;
+    double maxDriftMs;
+    double maxDiskMiB;
+    double maxDiskGrowthMiBPerHour;
+};
+
+/**
+ * @brief Settings of one soak run
+ */
+struct SoakOptions {
+    std::string binary;
+    std::string capture;
+    std::string samplesPath;
+    std::vector<std::string> settings;
+    long long durationMs;
+    long long intervalMs;
+    double speed;
+    SoakLimits limits;
+};
+
+/**
+ * @brief What was measured for one child of the supervisor
+ *
+ * Memory and CPU are those of the child's whole process group, so the
+ * browser's helper processes count with it. rss holds (hours, MiB)
+ * samples taken after the warmup.
+ */
+struct ChildTrack {
+    pid_t pid;
+    double lastCpuSeconds;
+    double cpuSeconds;
+    double peakRssMiB;
+    unsigned int restarts;
+    std::vector<std::pair<double, double> > rss;
+};
+
+/**
+ * @brief Memory and CPU time of one process group
+ */
+struct GroupUsage {
+    double rssBytes;
+    double cpuSeconds;
+};
+
+/**
+ * @brief What the local RTMP sink received
+ */
+struct StreamTrack {
+    int reconnects;
+    unsigned long long frames;
+    unsigned long long bytes;
+    unsigned long long intervalFrames;
+    unsigned long long intervalBytes;
+    long long firstPacketMs;
+    long long lastVideoAtMs;
+    long long lastTimestamp;
+    long long maxStallMs;
+    long long maxTimestampGapMs;
+    double minFps;
+};
+
+/**
+ * @brief Stops the soak early, keeping what was measured
+ */
+static void requestStop(int signo) {
+    (void)signo;
+    stopRequested = 1;
+}
+
+/**
+ * @brief Parses a duration such as 90s, 30m or 8h
+ *
+ * @param text The duration; a plain number is in seconds
+ * @param ms Receives the duration in milliseconds
+ * @return bool False if text is not a positive duration
+ */
+static bool parseDuration(const std::string& text, long long& ms) {
+    char unit = 's';
+    char extra;
+    double value = 0;
+    int fields = sscanf(text.c_str(), "%lf%c%c", &value, &unit, &extra);
+    if (fields < 1 || fields > 2 || value <= 0) {
+        return false;
+    }
+    if (unit == 's') {
+        ms = static_cast<long long>(value * 1000);
+    } else if (unit == 'm') {
+        ms = static_cast<long long>(value * 60 * 1000);
+    } else if (unit == 'h') {
+        ms = static_cast<long long>(value * kHourMs);
+    } else {
+        return false;
+    }
+    return ms > 0;
+}
+
+/**
+ * @brief Computes the least-squares slope of (hours, value) samples
+ *
+ * @param samples The samples
+ * @return double The growth per hour, 0 with fewer than 3 samples
+ */
+static double slopePerHour(const std::vector<std::pair<double, double> >& samples) {
+    if (samples.size() < 3) {
+        return 0;
+    }
+    double n = static_cast<double>(samples.size());
+    double sumX = 0;
+    double sumY = 0;
+    double sumXY = 0;
+    double sumXX = 0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        sumX += samples[i].first;
+        sumY += samples[i].second;
+        sumXY += samples[i].first * samples[i].second;
+        sumXX += samples[i].first * samples[i].first;
+    }
+    double spread = n * sumXX - sumX * sumX;
+    return spread > 0 ? (n * sumXY - sumX * sumY) / spread : 0;
+}
+
+/**
+ * @brief Adds up the memory and CPU time of every process group
+ *
+ * One pass over /proc per sample, whatever the number of children.
+ * CPU time includes the waited-for children of each process.
+ *
+ * @return map<pid_t, GroupUsage> Usage by process group
+ */
+static std::map<pid_t, GroupUsage> groupUsage() {
+    std::map<pid_t, GroupUsage> groups;
+    long ticks = sysconf(_SC_CLK_TCK);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    DIR* proc = opendir("/proc");
+    struct dirent* entry;
+    while (proc && (entry = readdir(proc)) != NULL) {
+        if (atoi(entry->d_name) <= 0) {
+            continue;
+        }
+        std::ifstream stat(("/proc/" + std::string(entry->d_name) + "/stat").c_str());
+        std::string content;
+        if (!std::getline(stat, content) || content.rfind(')') == std::string::npos) {
+            continue;
+        }
+        int pgrp = 0;
+        unsigned long user = 0;
+        unsigned long system = 0;
+        long childUser = 0;
+        long childSystem = 0;
+        long rss = 0;
+        if (sscanf(content.c_str() + content.rfind(')') + 1,
+                   " %*c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld %*d %*d %*d %*d %*u %*u %ld",
+                   &pgrp, &user, &system, &childUser, &childSystem, &rss) != 6) {
+            continue;
+        }
+        GroupUsage& usage = groups[static_cast<pid_t>(pgrp)];
+        usage.rssBytes += static_cast<double>(rss) * pageSize;
+        usage.cpuSeconds += static_cast<double>(user + system + childUser + childSystem) / ticks;
+    }
+    if (proc) {
+        closedir(proc);
+    }
+    return groups;
+}
+
+/**
+ * @brief Adds up the disk space used under a directory
+ *
+ * @param path The directory
+ * @return double Allocated bytes, symbolic links not followed
+ */
+static double diskUsage(const std::string& path) {
+    struct stat info;
+    if (lstat(path.c_str(), &info) != 0) {
+        return 0;
+    }
+    double bytes = static_cast<double>(info.st_blocks) * 512;
+    DIR* dir = S_ISDIR(info.st_mode) ? opendir(path.c_str()) : NULL;
+    struct dirent* entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+            bytes += diskUsage(path + "/" + name);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    return bytes;
+}
+
+/**
+ * @brief Reads one sample from the Prometheus text of the instance
+ *
+ * @param metrics The /metrics body
+ * @param name The metric name
+ * @param value Receives the value of its first sample
+ * @return bool False if the metric is not there
+ */
+static bool metricValue(const std::string& metrics, const std::string& name, double& value) {
+    std::istringstream lines(metrics);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (line.compare(0, name.size(), name) == 0 && line.size() > name.size()
+            && (line[name.size()] == '{' || line[name.size()] == ' ')) {
+            return sscanf(line.c_str() + line.rfind(' '), "%lf", &value) == 1;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Starts the local RTMP sink and waits until it listens
+ *
+ * @param url The RTMP URL to listen on
+ * @param sinkFd Receives the read end of the FLV it writes
+ * @return pid_t The sink process, -1 if it did not start listening
+ */
+static pid_t startSink(const std::string& url, int& sinkFd) {
+    const char* sinkArgs[] = { "ffmpeg", "-hide_banner", "-loglevel", "error", "-listen", "1",
+                               "-i", url.c_str(), "-c", "copy", "-f", "flv", "pipe:1" };
+    std::vector<std::string> sink(sinkArgs, sinkArgs + sizeof(sinkArgs) / sizeof(sinkArgs[0]));
+    pid_t pid = spawnProcess(sink, &sinkFd);
+    long long deadline = monotonicMs() + kSinkListenTimeoutMs;
+    while (pid > 0 && !isListening(kSinkPort) && monotonicMs() < deadline) {
+        usleep(10000);
+    }
+    if (pid > 0 && !isListening(kSinkPort)) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        close(sinkFd);
+        sinkFd = -1;
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * @brief Stops the local RTMP sink
+ *
+ * @param pid The sink process
+ * @param fd Its output
+ */
+static void stopSink(pid_t pid, int fd) {
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Takes in what the sink wrote and tracks video continuity
+ *
+ * @param stream The stream measurements
+ * @param packets The packets just parsed
+ * @param nowMs The current monotonic time
+ */
+static void trackPackets(StreamTrack& stream, const std::vector<std::shared_ptr<FlvPacket> >& packets,
+                         long long nowMs) {
+    for (size_t i = 0; i < packets.size(); i++) {
+        stream.bytes += packets[i]->body.size();
+        stream.intervalBytes += packets[i]->body.size();
+        if (packets[i]->type != FLV_TAG_VIDEO || packets[i]->sequenceHeader) {
+            continue;
+        }
+        long long timestamp = packets[i]->timestamp;
+        if (stream.lastTimestamp >= 0 && timestamp - stream.lastTimestamp > stream.maxTimestampGapMs) {
+            stream.maxTimestampGapMs = timestamp - stream.lastTimestamp;
+        }
+        stream.lastTimestamp = timestamp;
+        stream.lastVideoAtMs = nowMs;
+        stream.frames++;
+        stream.intervalFrames++;
+    }
+}
+
+/**
+ * @brief Samples every child, the received stream, the sync and the disk
+ *
+ * @param options The run settings
+ * @param instance The soaked instance
+ * @param children The per-child measurements, by child name
+ * @param stream The stream measurements
+ * @param hours Time since the first packet, in hours
+ * @param warm True once the warmup is over
+ * @param maxDriftMs Receives the largest drift seen after the warmup
+ * @param encoderRestarts Receives the encoders replaced for drift so far
+ * @param disk Receives (hours, MiB) samples of the instance directory
+ * @param samples The CSV time series, or NULL
+ */
+static void takeSample(const SoakOptions& options, const Instance& instance,
+                       std::map<std::string, ChildTrack>& children, StreamTrack& stream, double hours,
+                       bool warm, double& maxDriftMs, double& encoderRestarts,
+                       std::vector<std::pair<double, double> >& disk, std::ofstream* samples) {
+    StatusBlock block;
+    std::map<pid_t, GroupUsage> groups = groupUsage();
+    double intervalSeconds = options.intervalMs / 1000.0;
+    bool haveBlock = readStatusBlock(instance.statusPath(), block);
+    for (uint32_t i = 0; haveBlock && i < block.childCount; i++) {
+        const StatusChild& child = block.children[i];
+        std::string name(child.name, strnlen(child.name, sizeof(child.name)));
+        if (child.pid <= 0 && !children.count(name)) {
+            continue;
+        }
+        ChildTrack& track = children[name];
+        GroupUsage usage = { 0, 0 };
+        if (child.pid > 0 && groups.count(child.pid)) {
+            usage = groups[child.pid];
+        }
+        if (child.pid > 0 && child.pid == track.pid) {
+            track.cpuSeconds += usage.cpuSeconds - track.lastCpuSeconds;
+        } else if (child.pid > 0) {
+            track.cpuSeconds += usage.cpuSeconds;
+        }
+        double cpuPercent = child.pid == track.pid ? (usage.cpuSeconds - track.lastCpuSeconds) * 100 / intervalSeconds : 0;
+        track.pid = child.pid;
+        track.lastCpuSeconds = usage.cpuSeconds;
+        track.restarts = child.restarts;
+        double rssMiB = usage.rssBytes / kMiB;
+        if (rssMiB > track.peakRssMiB) {
+            track.peakRssMiB = rssMiB;
+        }
+        if (warm && child.pid > 0) {
+            track.rss.push_back(std::make_pair(hours, rssMiB));
+        }
+        if (samples) {
+            *samples << hours * 3600 << "," << name << "," << child.pid << "," << rssMiB << "," << cpuPercent
+                     << "," << child.restarts << ",,,," << std::endl;
+        }
+    }
+
+    double fps = stream.intervalFrames / intervalSeconds;
+    double kbps = stream.intervalBytes * 8 / intervalSeconds / 1000;
+    stream.intervalFrames = 0;
+    stream.intervalBytes = 0;
+    if (warm && (stream.minFps < 0 || fps < stream.minFps)) {
+        stream.minFps = fps;
+    }
+
+    std::string metrics;
+    double driftSeconds = 0;
+    bool haveDrift = fetchMetricsPage(instance.metricsPort(), "/metrics", metrics)
+                     && metricValue(metrics, "pagestreamer_av_drift_seconds", driftSeconds);
+    metricValue(metrics, "pagestreamer_av_encoder_restarts_total", encoderRestarts);
+    if (warm && haveDrift && std::fabs(driftSeconds * 1000) > maxDriftMs) {
+        maxDriftMs = std::fabs(driftSeconds * 1000);
+    }
+
+    double diskMiB = diskUsage(instance.dir) / kMiB;
+    disk.push_back(std::make_pair(hours, diskMiB));
+    if (samples) {
+        *samples << hours * 3600 << ",stream,,,,," << fps << "," << kbps << ",";
+        if (haveDrift) {
+            *samples << driftSeconds * 1000;
+        }
+        *samples << "," << diskMiB << std::endl;
+    }
+    std::cerr << "soak: " << static_cast<long long>(hours * 3600) << " s, " << fps << " fps, "
+              << static_cast<long long>(kbps) << " kbit/s, disk " << static_cast<long long>(diskMiB) << " MiB"
+              << std::endl;
+}
+
+/**
+ * @brief Formats a measurement for a failure message
+ *
+ * @param value The measurement
+ * @return string The value with at most one decimal
+ */
+static std::string formatNumber(double value) {
+    std::ostringstream text;
+    text.setf(std::ios::fixed);
+    text.precision(std::fabs(value - std::floor(value + 0.5)) < 0.05 ? 0 : 1);
+    text << value;
+    return text.str();
+}
+
+/**
+ * @brief Checks a value against a limit and records a failure
+ *
+ * @param failures The failures so far
+ * @param exceeded True if the limit is on and exceeded
+ * @param what The failure, as reported
+ */
+static void checkLimit(std::vector<std::string>& failures, bool exceeded, const std::string& what) {
+    if (exceeded) {
+        failures.push_back(what);
+    }
+}
+
+/**
+ * @brief Runs the soak and prints its JSON report
+ *
+ * Streams bench/soak.html on a throwaway instance to a local RTMP sink
+ * for the configured duration. The sink is restarted whenever the relay
+ * reconnects. Every interval the memory and CPU time of each child's
+ * process group, the restart counts from the status block, the frames
+ * and bytes received, the A/V drift from the metrics and the disk used
+ * by the instance are sampled. Memory growth, frame rate and drift are
+ * judged after a warmup of a quarter of the run, at most ten minutes.
+ *
+ * @param options The run settings
+ * @return int 0 if every limit held, 1 if one was exceeded, 2 if the
+ *         soak could not run
+ */
+static int runSoak(const SoakOptions& options) {
+    std::string reason = streamPrerequisites(options.capture);
+    std::ostringstream json;
+    json << "{\n  \"revision\": \"" << SOAK_REVISION << "\",\n";
+    if (!reason.empty()) {
+        json << "  \"status\": \"skipped\",\n  \"reason\": \"" << reason << "\"\n}\n";
+        std::cout << json.str();
+        std::cerr << "soak: skipped, " << reason << std::endl;
+        return 2;
+    }
+
+    TestHome home;
+    std::ostringstream platform;
+    std::ostringstream page;
+    std::vector<std::string> settings;
+    platform << "PLATFORM=rtmp://127.0.0.1:" << kSinkPort << "/live";
+    page << "bench/soak.html?speed=" << options.speed;
+    settings.push_back(platform.str());
+    settings.push_back("CAPTURE=" + options.capture);
+    settings.insert(settings.end(), options.settings.begin(), options.settings.end());
+    if (!createTestHome(home, "soak", page.str(), settings, reason)) {
+        json << "  \"status\": \"error\",\n  \"reason\": \"" << reason << "\"\n}\n";
+        std::cout << json.str();
+        std::cerr << "soak: " << reason << std::endl;
+        if (!home.path.empty()) {
+            removeTree(home.path);
+        }
+        return 2;
+    }
+    Instance instance = openInstance("soak");
+
+    std::ofstream samplesFile;
+    std::ofstream* samples = NULL;
+    if (!options.samplesPath.empty()) {
+        samplesFile.open(options.samplesPath.c_str());
+        samplesFile << "elapsed_s,name,pid,rss_mib,cpu_percent,restarts,fps,kbps,drift_ms,disk_mib" << std::endl;
+        samples = &samplesFile;
+    }
+
+    std::string url = platform.str().substr(platform.str().find('=') + 1) + "/soak";
+    int sinkFd = -1;
+    pid_t sinkPid = startSink(url, sinkFd);
+    if (sinkPid < 0) {
+        reason = "local RTMP sink did not start";
+    }
+    std::vector<std::string> start;
+    start.push_back(options.binary);
+    start.push_back("-i");
+    start.push_back("soak");
+    start.push_back("start");
+    std::vector<std::string> stop(start);
+    stop.back() = "stop";
+
+    long long startedAt = monotonicMs();
+    StreamTrack stream = { 0, 0, 0, 0, 0, -1, -1, -1, 0, 0, -1 };
+    if (reason.empty() && runProcess(start) != 0) {
+        reason = "pagestreamer start failed";
+    }
+    if (reason.empty()) {
+        struct pollfd pfd = { sinkFd, POLLIN, 0 };
+        if (poll(&pfd, 1, static_cast<int>(kFirstPacketTimeoutMs)) > 0) {
+            stream.firstPacketMs = monotonicMs() - startedAt;
+            std::cerr << "soak: first packet after " << stream.firstPacketMs << " ms" << std::endl;
+        } else {
+            reason = "no packet reached the sink";
+        }
+    }
+    std::ifstream pidFile(instance.pidPath().c_str());
+    pid_t supervisor = -1;
+    if (reason.empty() && !(pidFile >> supervisor)) {
+        reason = "the supervisor pid file is missing";
+    }
+
+    std::map<std::string, ChildTrack> children;
+    std::vector<std::pair<double, double> > disk;
+    std::vector<std::string> failures;
+    FlvParser parser;
+    std::vector<std::shared_ptr<FlvPacket> > packets;
+    std::vector<unsigned char> buffer(65536);
+    long long soakStartedAt = monotonicMs();
+    long long warmupMs = options.durationMs / 4 < kMaxWarmupMs ? options.durationMs / 4 : kMaxWarmupMs;
+    long long endAt = soakStartedAt + options.durationMs;
+    long long nextSampleAt = soakStartedAt + options.intervalMs;
+    double maxDriftMs = 0;
+    double encoderRestarts = 0;
+    for (long long now = monotonicMs(); reason.empty() && !stopRequested && now < endAt; now = monotonicMs()) {
+        if (kill(supervisor, 0) != 0) {
+            failures.push_back("the supervisor exited");
+            break;
+        }
+        long long wakeAt = nextSampleAt < endAt ? nextSampleAt : endAt;
+        struct pollfd pfd = { sinkFd, POLLIN, 0 };
+        int ready = poll(&pfd, sinkFd >= 0 ? 1 : 0, static_cast<int>(wakeAt > now ? wakeAt - now : 0));
+        now = monotonicMs();
+        if (ready > 0) {
+            ssize_t count = read(sinkFd, &buffer[0], buffer.size());
+            if (count > 0) {
+                packets.clear();
+                parser.feed(&buffer[0], static_cast<size_t>(count), packets);
+                trackPackets(stream, packets, now);
+            } else {
+                stopSink(sinkPid, sinkFd);
+                stream.reconnects++;
+                stream.lastTimestamp = -1;
+                parser.reset();
+                std::cerr << "soak: the relay disconnected, restarting the sink" << std::endl;
+                sinkPid = startSink(url, sinkFd);
+            }
+        }
+        if (stream.lastVideoAtMs >= 0 && now - stream.lastVideoAtMs > stream.maxStallMs) {
+            stream.maxStallMs = now - stream.lastVideoAtMs;
+        }
+        if (now >= nextSampleAt) {
+            takeSample(options, instance, children, stream, (now - soakStartedAt) / kHourMs,
+                       now - soakStartedAt >= warmupMs, maxDriftMs, encoderRestarts, disk, samples);
+            nextSampleAt += options.intervalMs;
+        }
+    }
+    long long elapsedMs = monotonicMs() - soakStartedAt;
+    runProcess(stop);
+    stopSink(sinkPid, sinkFd);
+    removeTree(home.path);
+
+    const SoakLimits& limits = options.limits;
+    std::ostringstream childJson;
+    unsigned int restarts = 0;
+    double cpuPercent = 0;
+    double rssMiB = 0;
+    for (std::map<std::string, ChildTrack>::const_iterator it = children.begin(); it != children.end(); ++it) {
+        const ChildTrack& track = it->second;
+        double growth = slopePerHour(track.rss);
+        double cpu = elapsedMs > 0 ? track.cpuSeconds * 100 * 1000 / elapsedMs : 0;
+        restarts += track.restarts;
+        cpuPercent += cpu;
+        rssMiB += track.rss.empty() ? 0 : track.rss.back().second;
+        childJson << (it == children.begin() ? "" : ",\n") << "    { \"name\": \"" << it->first
+                  << "\", \"restarts\": " << track.restarts << ", \"peak_rss_mib\": " << track.peakRssMiB
+                  << ", \"rss_growth_mib_per_hour\": " << growth << ", \"cpu_percent\": " << cpu << " }";
+        checkLimit(failures, limits.maxRssGrowthMiBPerHour > 0 && growth > limits.maxRssGrowthMiBPerHour,
+                   it->first + " memory grows by " + formatNumber(growth) + " MiB per hour");
+    }
+    double diskGrowth = slopePerHour(disk);
+    double diskMiB = disk.empty() ? 0 : disk.back().second;
+    double peakDiskMiB = 0;
+    for (size_t i = 0; i < disk.size(); i++) {
+        peakDiskMiB = disk[i].second > peakDiskMiB ? disk[i].second : peakDiskMiB;
+    }
+    if (reason.empty()) {
+        checkLimit(failures, restarts > static_cast<unsigned int>(limits.maxRestarts),
+                   formatNumber(static_cast<double>(restarts)) + " child restarts");
+        checkLimit(failures, stream.reconnects > limits.maxReconnects,
+                   formatNumber(stream.reconnects) + " relay reconnections");
+        checkLimit(failures, limits.maxRssMiB > 0 && rssMiB > limits.maxRssMiB,
+                   "the stream uses " + formatNumber(rssMiB) + " MiB");
+        checkLimit(failures, limits.maxCpuPercent > 0 && cpuPercent > limits.maxCpuPercent,
+                   "the stream uses " + formatNumber(cpuPercent) + "% CPU");
+        checkLimit(failures, limits.minFps > 0 && stream.minFps >= 0 && stream.minFps < limits.minFps,
+                   "the frame rate fell to " + formatNumber(stream.minFps) + " fps");
+        checkLimit(failures, limits.maxStallMs > 0 && stream.maxStallMs > limits.maxStallMs,
+                   "no video for " + formatNumber(static_cast<double>(stream.maxStallMs)) + " ms");
+        checkLimit(failures, limits.maxDriftMs > 0 && maxDriftMs > limits.maxDriftMs,
+                   "A/V drift reached " + formatNumber(maxDriftMs) + " ms");
+        checkLimit(failures, limits.maxDiskMiB > 0 && peakDiskMiB > limits.maxDiskMiB,
+                   "the instance directory reached " + formatNumber(peakDiskMiB) + " MiB");
+        checkLimit(failures, limits.maxDiskGrowthMiBPerHour > 0 && diskGrowth > limits.maxDiskGrowthMiBPerHour,
+                   "disk usage grows by " + formatNumber(diskGrowth) + " MiB per hour");
+    }
+
+    const char* status = !reason.empty() ? "error" : failures.empty() ? "passed" : "failed";
+    json << "  \"status\": \"" << status << "\",\n";
+    if (!reason.empty()) {
+        json << "  \"reason\": \"" << reason << "\",\n";
+    }
+    json << "  \"capture\": \"" << options.capture << "\", \"speed\": " << options.speed << ",\n"
+         << "  \"duration_s\": " << options.durationMs / 1000 << ", \"elapsed_s\": " << elapsedMs / 1000
+         << ", \"interrupted\": " << (stopRequested ? "true" : "false") << ",\n"
+         << "  \"first_packet_ms\": " << stream.firstPacketMs << ",\n"
+         << "  \"children\": [\n" << childJson.str() << "\n  ],\n"
+         << "  \"stream\": { \"reconnects\": " << stream.reconnects << ", \"min_fps\": " << stream.minFps
+         << ", \"mean_fps\": " << (elapsedMs > 0 ? stream.frames * 1000.0 / elapsedMs : 0)
+         << ", \"mean_kbps\": " << (elapsedMs > 0 ? stream.bytes * 8.0 / elapsedMs : 0)
+         << ", \"max_stall_ms\": " << stream.maxStallMs
+         << ", \"max_timestamp_gap_ms\": " << stream.maxTimestampGapMs << " },\n"
+         << "  \"sync\": { \"max_drift_ms\": " << maxDriftMs << ", \"encoder_restarts\": " << encoderRestarts << " },\n"
+         << "  \"disk\": { \"final_mib\": " << diskMiB << ", \"peak_mib\": " << peakDiskMiB
+         << ", \"growth_mib_per_hour\": " << diskGrowth << " },\n"
+         << "  \"failures\": [";
+    for (size_t i = 0; i < failures.size(); i++) {
+        json << (i > 0 ? ", " : "") << "\"" << failures[i] << "\"";
+        std::cerr << "soak: FAILED, " << failures[i] << std::endl;
+    }
+    json << "]\n}\n";
+    std::cout << json.str();
+    if (!reason.empty()) {
+        std::cerr << "soak: " << reason << std::endl;
+        return 2;
+    }
+    return failures.empty() ? 0 : 1;
+}
+
+/**
+ * @brief Prints the command line help
+ *
+ * @param program The program name
+ */
+static void printUsage(const char* program) {
+    std::cerr << "Usage: " << program << " [options] PAGESTREAMER_BINARY\n"
+              << "  --duration D            how long to stream, e.g. 90s, 30m, 8h (default 8h)\n"
+              << "  --interval D            time between samples (default 10s)\n"
+              << "  --speed N               rebuild the test page N times as often (default 1)\n"
+              << "  --capture NAME          x11grab, fbdir or screencast (default fbdir)\n"
+              << "  --set KEY=VALUE         add a setting to the soaked instance, repeatable\n"
+              << "  --samples FILE          write every sample to a CSV file\n"
+              << "Limits, 0 to turn one off:\n"
+              << "  --max-restarts N        child restarts (default 0)\n"
+              << "  --max-reconnects N      relay reconnections to the sink (default 0)\n"
+              << "  --max-rss-growth MIB    memory growth of any child per hour (default 100)\n"
+              << "  --max-rss MIB           memory of the whole stream at the end (default 0)\n"
+              << "  --max-cpu PERCENT       average CPU of the whole stream (default 0)\n"
+              << "  --min-fps FPS           lowest frame rate received over an interval (default 25)\n"
+              << "  --max-stall MS          longest time without a video frame (default 2000)\n"
+              << "  --max-drift MS          largest A/V drift (default 100)\n"
+              << "  --max-disk MIB          size of the instance directory (default 1024)\n"
+              << "  --max-disk-growth MIB   disk growth per hour (default 100)" << std::endl;
+}
+
+/**
+ * @brief Entry point of the soak test
+ *
+ * Prints one JSON report on stdout; progress goes to stderr. SIGINT
+ * ends the run early and still reports what was measured.
+ *
+ * @return int 0 if the run passed, 1 if a limit was exceeded, 2 on a
+ *         usage error or if the soak could not run
+ */
+int main(int argc, char** argv) {
+    SoakOptions options;
+    SoakLimits defaults = { 0, 0, 100, 0, 0, 25, 2000, 100, 1024, 100 };
+    options.capture = "fbdir";
+    options.durationMs = static_cast<long long>(8 * kHourMs);
+    options.intervalMs = 10000;
+    options.speed = 1;
+    options.limits = defaults;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string value = i + 1 < argc ? argv[i + 1] : "";
+        double number = atof(value.c_str());
+        bool ok = true;
+        if (arg.compare(0, 2, "--") != 0) {
+            options.binary = arg;
+            continue;
+        }
+        i++;
+        if (arg == "--duration") {
+            ok = parseDuration(value, options.durationMs);
+        } else if (arg == "--interval") {
+            ok = parseDuration(value, options.intervalMs);
+        } else if (arg == "--speed") {
+            ok = number >= 1;
+            options.speed = number;
+        } else if (arg == "--capture") {
+            options.capture = value;
+        } else if (arg == "--set") {
+            ok = value.find('=') != std::string::npos;
+            options.settings.push_back(value);
+        } else if (arg == "--samples") {
+            options.samplesPath = value;
+        } else if (arg == "--max-restarts") {
+            options.limits.maxRestarts = static_cast<int>(number);
+        } else if (arg == "--max-reconnects") {
+            options.limits.maxReconnects = static_cast<int>(number);
+        } else if (arg == "--max-rss-growth") {
+            options.limits.maxRssGrowthMiBPerHour = number;
+        } else if (arg == "--max-rss") {
+            options.limits.maxRssMiB = number;
+        } else if (arg == "--max-cpu") {
+            options.limits.maxCpuPercent = number;
+        } else if (arg == "--min-fps") {
+            options.limits.minFps = number;
+        } else if (arg == "--max-stall") {
+            options.limits.maxStallMs = static_cast<long long>(number);
+        } else if (arg == "--max-drift") {
+            options.limits.maxDriftMs = number;
+        } else if (arg == "--max-disk") {
+            options.limits.maxDiskMiB = number;
+        } else if (arg == "--max-disk-growth") {
+            options.limits.maxDiskGrowthMiBPerHour = number;
+        } else {
+            ok = false;
+        }
+        if (!ok || value.empty()) {
+            std::cerr << "Invalid option: " << arg << " " << value << std::endl;
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.binary.empty()) {
+        printUsage(argv[0]);
+        return 2;
+    }
+    if (options.binary[0] != '/') {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd))) {
+            options.binary = std::string(cwd) + "/" + options.binary;
+        }
+    }
+    signal(SIGINT, requestStop);
+    signal(SIGTERM, requestStop);
+    return runSoak(options);
+}
@@ -0,0 +1,205 @@
+#ifndef CAPTURE_HPP
+# define CAPTURE_HPP
+
+# include <string>
+# include <vector>
+# include <mutex>
+# include <thread>
+# include <condition_variable>
+# include <sys/types.h>
+# include "Supervisor.hpp"
+# include "Damage.hpp"
+# include "Convert.hpp"
+# include "Telemetry.hpp"
+
+/**
+ * @brief Read-only mapping of the XWD framebuffer file written by Xvfb
+ *
+ * Xvfb started with -fbdir keeps its screen in a shared mapping of
+ * <dir>/Xvfb_screen0: a big-endian XWD header followed by the live
+ * pixels, so mapping the same file gives the frames without any X
+ * request.
+ */
+class XwdFramebuffer {
+private:
+    std::string path;
+    void* mapping;
+    size_t mappingSize;
+    const unsigned char* pixels;
+    int width;
+    int height;
+    size_t stride;
+
+public:
+    explicit XwdFramebuffer(const std::string& path);
+    ~XwdFramebuffer();
+
+    bool open(int expectedWidth, int expectedHeight, std::string& error);
+    void close();
+    void setPath(const std::string& newPath);
+    bool isOpen() const;
+    const unsigned char* data() const;
+    size_t rowBytes() const;
+};
+
+/**
+ * @brief Cumulative counters of a frame pacer
+ *
+ * slots counts frame periods, changedFrames those with a new frame and
+ * sentFrames those actually written to the encoder.
+ */
+struct CaptureStats {
+    unsigned long long slots;
+    unsigned long long changedFrames;
+    unsigned long long sentFrames;
+};
+
+/**
+ * @brief Supplies the frames a FramePacer writes to the encoder
+ *
+ * Every method is called on the pacing thread.
+ */
+class FrameProvider {
+public:
+    virtual ~FrameProvider() {}
+
+    /**
+     * @brief Called when an encoder connects while no session runs
+     */
+    virtual void sessionStarted() = 0;
+
+    /**
+     * @brief Looks for the frame of the current period
+     *
+     * @param changed Set to true if the frame is new since the last period
+     * @return bool False while there is no frame to send yet
+     */
+    virtual bool acquireFrame(bool& changed) = 0;
+
+    /**
+     * @brief Returns the acquired frame as the encoder reads it
+     *
+     * Only called for frames that are sent, so costly conversions can
+     * be done here.
+     *
+     * @return const vector<unsigned char>& The bytes to write
+     */
+    virtual const std::vector<unsigned char>& frameData() = 0;
+
+    /**
+     * @brief Formats the periodic report of the capture
+     *
+     * @param window The counters since the previous report
+     * @return string The line to log
+     */
+    virtual std::string describeWindow(const CaptureStats& window) = 0;
+
+    /**
+     * @brief Called once the last encoder of the session is gone
+     */
+    virtual void sessionEnded() = 0;
+};
+
+/**
+ * @brief Feeds the frames of a provider to the encoder at the output rate
+ *
+ * A pacing thread runs one session per encoder process, on absolute
+ * monotonic deadlines at the frame rate. It writes the provider's frame
+ * when it changed, plus a keepalive when it did not for a while, and
+ * logs the counters every minute. An encoder started during a session,
+ * to replace the current one, is fed alongside it; an encoder is dropped
+ * as soon as its pipe fails and the session ends with the last one.
+ */
+class FramePacer {
+private:
+    FrameProvider& provider;
+    std::string name;
+    int fps;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    int pendingFd;
+    bool shuttingDown;
+    CaptureStats counters;
+    std::thread thread;
+
+    void pacerLoop();
+    void runSession(int fd);
+
+public:
+    FramePacer(FrameProvider& provider, const std::string& name, int fps);
+    ~FramePacer();
+
+    void start();
+    void addEncoder(const std::vector<int>& fds);
+    CaptureStats stats();
+    void shutdown();
+};
+
+/**
+ * @brief Native capture engine feeding raw frames to the encoder
+ *
+ * Replaces x11grab: its frame pacer converts the framebuffer straight
+ * from the mapping to yuv420p at the output size and writes it to the
+ * encoder's stdin (-f rawvideo), so frames never travel through the X
+ * protocol and ffmpeg has no swscale pass left. Frames are only sent when
+ * a tile changed, plus a periodic keepalive; the encoder timestamps them
+ * on arrival and duplicates them back to a constant rate. It observes
+ * the encoder (its stdin pipe) and, through serverObserver(), the X
+ * servers, whose restarts recreate the framebuffer file. setSource()
+ * moves it to another X server between two frames.
+ */
+class FramebufferCapture : public ChildObserver, public MetricsSource, public FrameProvider {
+private:
+    /**
+     * @brief Forwards the X server lifecycle to the capture
+     */
+    class ServerObserver : public ChildObserver {
+    private:
+        FramebufferCapture& capture;
+
+    public:
+        explicit ServerObserver(FramebufferCapture& capture);
+        void childStarted(pid_t pid, const std::vector<int>& fds);
+        void childExited(int status);
+    };
+
+    XwdFramebuffer framebuffer;
+    DamageTracker damage;
+    FrameConverter converter;
+    ServerObserver server;
+    int width;
+    int height;
+    int outputWidth;
+    int outputHeight;
+    std::mutex mutex;
+    unsigned long serverGeneration;
+    std::string sourcePath;
+    unsigned long mappedGeneration;
+    int retryIn;
+    bool sentBlack;
+    std::string lastError;
+    std::vector<unsigned char> converted;
+    std::vector<unsigned char> blackFrame;
+    FramePacer pacer;
+
+public:
+    FramebufferCapture(const std::string& fbDir, int width, int height,
+                       int outputWidth, int outputHeight, int fps);
+    ~FramebufferCapture();
+
+    ChildObserver* serverObserver();
+    void setSource(const std::string& fbDir);
+    CaptureStats stats();
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+    void shutdown();
+    void writeMetrics(std::ostream& out, const std::string& labels);
+    void writeReport(std::ostream& out);
+    void sessionStarted();
+    bool acquireFrame(bool& changed);
+    const std::vector<unsigned char>& frameData();
+    std::string describeWindow(const CaptureStats& window);
+    void sessionEnded();
+};
+
+#endif
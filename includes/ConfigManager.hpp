@@ -2,31 +2,92 @@
 # define CONFIG_MANAGER_HPP
 
 # include <string>
+# include <vector>
+# include <map>
 # include "Colors.hpp"
 
+# define CAPTURE_X11GRAB "x11grab"
+# define CAPTURE_FBDIR "fbdir"
+# define CAPTURE_SCREENCAST "screencast"
+# define TUNING_AUTO "auto"
+# define TUNING_OFF "off"
+# define SCREEN_WIDTH 1920
+# define SCREEN_HEIGHT 1080
+# define MAX_SCREENCAST_WIDTH 3840
+# define MAX_SCREENCAST_HEIGHT 2160
+# define DEFAULT_FREEZE_TIMEOUT 300
+# define MAX_FREEZE_TIMEOUT 86400
+# define DEFAULT_BROWSER_MEMORY_LIMIT 2048
+# define MAX_BROWSER_MEMORY_LIMIT 65536
+# define MAX_BROWSER_RECYCLE_HOURS 168
+
+/**
+ * @brief Validated settings of one instance profile
+ *
+ * Built once from the .env file by ConfigManager::load(); every field
+ * holds either a checked value or its default, so consumers never parse
+ * the raw text themselves.
+ */
+struct StreamConfig {
+    std::string platform;
+    std::string streamKey;
+    std::string streamUrl;
+    std::vector<std::string> destinations;
+    std::string cpuSet;
+    std::string capture;
+    int outputWidth;
+    int outputHeight;
+    std::string browserPath;
+    bool encoderTuning;
+    int freezeTimeout;
+    int browserMemoryLimit;
+    int browserRecycleHours;
+
+    StreamConfig();
+
+    bool isComplete() const;
+    std::vector<std::string> destinationUrls() const;
+};
+
 /**
  * @brief Manages configuration settings for the streaming service
- * 
+ *
  * This class provides methods to read, write, and display configuration
- * settings, including platform, stream key and stream URL.
+ * settings, including platform, stream key and stream URL, of one
+ * instance profile. Changes are staged with setValue() and written
+ * together by commit(), under a lock and with a single fsync + rename,
+ * so a batch of keys is applied entirely or not at all.
  */
 class ConfigManager {
 private:
     std::string envPath;
-    
+    std::map<std::string, std::string> pending;
+
 public:
-    ConfigManager();
+    explicit ConfigManager(const std::string& envPath);
     ~ConfigManager();
-    
+
+    bool loadEnv(std::map<std::string, std::string>& values) const;
+    bool load(StreamConfig& config, std::vector<std::string>& errors) const;
+    bool setValue(const std::string& key, const std::string& value);
+    bool commit();
     bool showConfiguration();
-    bool updateEnvFile(const std::string& key, const std::string& value);
     bool handleConfig(const std::string& configType = "");
+    bool handleSet(const std::vector<std::string>& assignments);
 };
 
+bool parseConfig(const std::map<std::string, std::string>& values, StreamConfig& config,
+                 std::vector<std::string>& errors);
+bool validateConfigValue(const std::string& key, const std::string& value, std::string& error);
+
 // Function prototypes for configuration functions
-bool configurePlatform();
-bool configureStreamKey(bool inConfigSequence = false);
-bool configureStreamUrl();
+bool configurePlatform(ConfigManager& configManager);
+bool configureStreamKey(ConfigManager& configManager, bool inConfigSequence = false);
+bool configureStreamUrl(ConfigManager& configManager);
+bool configureCpuSet(ConfigManager& configManager);
+bool configureDestinations(ConfigManager& configManager);
+bool configureCapture(ConfigManager& configManager);
+bool configureOutputResolution(ConfigManager& configManager);
 std::string readPassword();
 
 #endif
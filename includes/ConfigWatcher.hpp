@@ -0,0 +1,59 @@
+#ifndef CONFIG_WATCHER_HPP
+# define CONFIG_WATCHER_HPP
+
+# include <string>
+# include <vector>
+# include <map>
+# include <mutex>
+# include <thread>
+# include "ConfigManager.hpp"
+
+/**
+ * @brief Receives the new configuration after the profile changed
+ *
+ * Called from the watcher thread.
+ */
+class ConfigListener {
+public:
+    virtual ~ConfigListener() {}
+
+    /**
+     * @brief Called once a changed profile has been read and validated
+     *
+     * @param config The new settings
+     * @param changedKeys The settings whose value differs from before
+     */
+    virtual void configChanged(const StreamConfig& config, const std::vector<std::string>& changedKeys) = 0;
+};
+
+/**
+ * @brief Watches an instance profile with inotify
+ *
+ * The directory is watched rather than the file, since commits replace
+ * the file by rename. A change is only reported when it is valid and
+ * actually alters a value; invalid profiles are logged and ignored.
+ */
+class ConfigWatcher {
+private:
+    ConfigManager manager;
+    std::string fileName;
+    std::string dirPath;
+    ConfigListener& listener;
+    std::map<std::string, std::string> current;
+    int inotifyFd;
+    std::mutex mutex;
+    bool shuttingDown;
+    std::thread watcher;
+
+    void watchLoop();
+    void reload();
+
+public:
+    ConfigWatcher(const std::string& envPath, ConfigListener& listener);
+    ~ConfigWatcher();
+
+    bool start();
+    void shutdown();
+};
+
+#endif
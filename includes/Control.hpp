@@ -0,0 +1,80 @@
+#ifndef CONTROL_HPP
+# define CONTROL_HPP
+
+# include <string>
+# include <vector>
+# include <mutex>
+# include <thread>
+# include "Supervisor.hpp"
+
+/**
+ * @brief Executes the commands received on the control socket
+ *
+ * Called from the control server thread, one command at a time.
+ */
+class ControlHandler {
+public:
+    virtual ~ControlHandler() {}
+
+    /**
+     * @brief Runs one command
+     *
+     * @param words The command line split on whitespace, never empty
+     * @param reply Receives a one-line message for the client
+     * @return bool True if the command was applied
+     */
+    virtual bool handleCommand(const std::vector<std::string>& words, std::string& reply) = 0;
+};
+
+/**
+ * @brief Unix domain socket taking commands for a running stream
+ *
+ * Each connection carries one command line and gets one reply line,
+ * "ok <message>" or "error <message>". The socket lives in the instance
+ * run directory, which only its owner can enter. Connections are served
+ * one at a time by a single thread.
+ */
+class ControlServer {
+private:
+    std::string path;
+    ControlHandler& handler;
+    int listenFd;
+    std::mutex mutex;
+    bool shuttingDown;
+    std::thread server;
+
+    void serverLoop();
+    void serve(int client);
+
+public:
+    ControlServer(const std::string& path, ControlHandler& handler);
+    ~ControlServer();
+
+    bool start();
+    void shutdown();
+};
+
+/**
+ * @brief Sends commands to the page driver through its stdin
+ *
+ * Observes the driver child, which reads one command per line. Writes
+ * never block: a driver that does not read its commands loses them
+ * rather than stalling the caller.
+ */
+class DriverControl : public ChildObserver {
+private:
+    std::mutex mutex;
+    int fd;
+
+public:
+    DriverControl();
+    ~DriverControl();
+
+    bool send(const std::string& command);
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+};
+
+bool sendControlCommand(const std::string& path, const std::string& command, std::string& reply);
+
+#endif
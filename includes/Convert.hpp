@@ -0,0 +1,78 @@
+#ifndef CONVERT_HPP
+# define CONVERT_HPP
+
+# include <string>
+# include <vector>
+# include <cstddef>
+# include <stdint.h>
+
+/**
+ * @brief Converts two BGRA rows to two luma rows and one row of each chroma
+ *
+ * width is even; u and v receive width / 2 samples.
+ */
+typedef void (*ConvertRowsFunction)(const unsigned char* row0, const unsigned char* row1, int width,
+                                    unsigned char* y0, unsigned char* y1,
+                                    unsigned char* u, unsigned char* v);
+
+/**
+ * @brief Blends two rows of bytes: (a * (256 - weight) + b * weight + 128) >> 8
+ */
+typedef void (*BlendRowsFunction)(const unsigned char* a, const unsigned char* b, size_t length,
+                                  int weight, unsigned char* out);
+
+/**
+ * @brief One implementation of the conversion primitives
+ *
+ * Every kernel produces exactly the same bytes as the scalar reference;
+ * the SIMD ones only differ in speed.
+ */
+struct ConvertKernel {
+    const char* name;
+    ConvertRowsFunction convertRows;
+    BlendRowsFunction blendRows;
+};
+
+std::vector<ConvertKernel> availableConvertKernels();
+bool verifyConvertKernel(const ConvertKernel& kernel);
+const ConvertKernel& bestConvertKernel();
+
+/**
+ * @brief Converts bgr0 frames to yuv420p, optionally scaling them
+ *
+ * Uses BT.601 limited range like ffmpeg's default RGB to YUV conversion.
+ * Scaling is bilinear: source rows are resampled horizontally, then
+ * blended vertically with the kernel, before the colour conversion.
+ * Sizes are even.
+ */
+class FrameConverter {
+private:
+    static const int kCachedRows = 4;
+
+    int sourceWidth;
+    int sourceHeight;
+    int width;
+    int height;
+    ConvertKernel kernel;
+    std::vector<int> columnIndex;
+    std::vector<int> columnWeight;
+    std::vector<int> rowIndex;
+    std::vector<int> rowWeight;
+    std::vector<unsigned char> cache[kCachedRows];
+    int cachedRow[kCachedRows];
+    int nextCacheSlot;
+    std::vector<unsigned char> blended[2];
+
+    const unsigned char* sourceRow(const unsigned char* pixels, size_t stride, int index);
+    const unsigned char* scaleRow(const unsigned char* pixels, size_t stride, int row, int slot);
+
+public:
+    FrameConverter(int sourceWidth, int sourceHeight, int width, int height,
+                   const ConvertKernel& kernel = bestConvertKernel());
+
+    size_t frameSize() const;
+    const char* kernelName() const;
+    void convert(const unsigned char* pixels, size_t stride, unsigned char* out);
+};
+
+#endif
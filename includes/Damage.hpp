@@ -0,0 +1,34 @@
+#ifndef DAMAGE_HPP
+# define DAMAGE_HPP
+
+# include <vector>
+# include <cstddef>
+# include <stdint.h>
+
+/**
+ * @brief Finds the parts of a 32 bpp frame that changed since the last one
+ *
+ * The frame is split into square tiles whose contents are hashed on each
+ * update and compared with the previous hashes. This replaces XDamage,
+ * which needs an X connection, with a single streaming read of the
+ * mapped framebuffer.
+ */
+class DamageTracker {
+private:
+    int width;
+    int height;
+    int columns;
+    int rows;
+    bool primed;
+    std::vector<uint64_t> previous;
+    std::vector<uint64_t> current;
+
+public:
+    DamageTracker(int width, int height);
+
+    void reset();
+    size_t update(const unsigned char* pixels, size_t stride);
+    size_t tileCount() const;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef FANOUT_HPP
+# define FANOUT_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <mutex>
+# include <thread>
+# include <condition_variable>
+# include "Flv.hpp"
+# include "Supervisor.hpp"
+
+/**
+ * @brief Consumer of the encoded packet stream
+ *
+ * push() is called from the fan-out reader thread for every packet and
+ * must never block on I/O.
+ */
+class PacketSink {
+public:
+    virtual ~PacketSink() {}
+    virtual void push(const FlvPacketPtr& packet) = 0;
+};
+
+/**
+ * @brief One RTMP output fed from its own bounded packet queue
+ *
+ * A relay process (ffmpeg -c copy) per destination does the RTMP
+ * handshake; this class feeds its stdin from a dedicated writer thread.
+ * When the queue exceeds its byte budget it is flushed and the writer
+ * resumes at the next keyframe, so a slow destination only hurts itself.
+ *
+ * While the relay reconnects, the queue keeps the last few seconds of
+ * the stream, whole GOPs only, and the packets the failed relay may not
+ * have sent are put back in front of it. The next relay then resumes at
+ * a keyframe without a gap while the encoder keeps running.
+ */
+class RtmpDestination : public PacketSink, public ChildObserver {
+private:
+    std::string name;
+    std::string url;
+    size_t maxQueueBytes;
+    long long bufferMs;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::deque<FlvPacketPtr> queue;
+    size_t queuedBytes;
+    int pendingFd;
+    bool sessionActive;
+    bool resync;
+    bool overflowing;
+    bool shuttingDown;
+    unsigned long droppedPackets;
+    FlvPacketPtr metadata;
+    FlvPacketPtr videoHeader;
+    FlvPacketPtr audioHeader;
+    std::thread writer;
+
+    void trimBacklog();
+    void writerLoop();
+    void runSession(int fd);
+
+public:
+    RtmpDestination(const std::string& name, const std::string& url, size_t maxQueueBytes, long long bufferMs);
+    ~RtmpDestination();
+
+    const std::string& label() const;
+    std::string currentUrl();
+    void setUrl(const std::string& newUrl);
+    ChildSpec relaySpec(const std::string& logDir);
+    double queueFill();
+    void push(const FlvPacketPtr& packet);
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+    void shutdown();
+};
+
+/**
+ * @brief Reads the single encoder's FLV output and fans it out
+ *
+ * Observes the encoder child: every (re)start hands over a new stdout
+ * pipe, whose packets are re-timestamped to continue the previous
+ * session and pushed to every registered sink. When a new encoder
+ * starts while the previous one still runs, the previous output keeps
+ * being forwarded until the new one delivers its first keyframe.
+ */
+class Fanout : public ChildObserver {
+private:
+    struct Session {
+        int fd;
+        FlvParser parser;
+        uint32_t offset;
+        uint32_t base;
+        bool haveBase;
+    };
+
+    std::vector<PacketSink*> sinks;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    int pendingFd;
+    bool shuttingDown;
+    uint32_t nextTimestamp;
+    long long createdAtMs;
+    bool published;
+    std::thread reader;
+
+    void readerLoop();
+    void openSession(Session& session, int fd);
+    bool readPackets(Session& session, std::vector<std::shared_ptr<FlvPacket> >& packets);
+    void publish(Session& session, const std::shared_ptr<FlvPacket>& packet);
+    void readSession(int fd);
+
+public:
+    Fanout();
+    ~Fanout();
+
+    void addSink(PacketSink* sink);
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+    void shutdown();
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef FLV_HPP
+# define FLV_HPP
+
+# include <string>
+# include <vector>
+# include <stdint.h>
+# include <memory>
+
+# define FLV_TAG_AUDIO  8
+# define FLV_TAG_VIDEO  9
+# define FLV_TAG_SCRIPT 18
+# define FLV_HEADER_SIZE 13
+# define FLV_TAG_HEADER_SIZE 11
+
+/**
+ * @brief One FLV tag as produced by the encoder
+ *
+ * Only the tag body is stored; the tag header is rebuilt when the packet
+ * is written so each output can rewrite timestamps. Packets are shared
+ * read-only between every output through FlvPacketPtr.
+ */
+struct FlvPacket {
+    unsigned char type;
+    uint32_t timestamp;
+    bool keyframe;
+    bool sequenceHeader;
+    std::vector<unsigned char> body;
+
+    FlvPacket();
+    bool isVideoKeyframe() const;
+    size_t wireSize() const;
+};
+
+typedef std::shared_ptr<const FlvPacket> FlvPacketPtr;
+
+/**
+ * @brief Incremental parser turning an FLV byte stream into packets
+ *
+ * Bytes are fed as they arrive from a pipe; complete tags are returned
+ * as soon as they are available.
+ */
+class FlvParser {
+private:
+    std::vector<unsigned char> buffer;
+    size_t offset;
+    bool headerParsed;
+
+public:
+    FlvParser();
+
+    void reset();
+    bool feed(const unsigned char* data, size_t length,
+              std::vector<std::shared_ptr<FlvPacket> >& packets);
+};
+
+std::string flvFileHeader();
+std::string serializeFlvTag(const FlvPacket& packet, uint32_t timestamp);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef INSTANCE_HPP
+# define INSTANCE_HPP
+
+# include <string>
+# include <vector>
+
+# define DEFAULT_INSTANCE "default"
+
+/**
+ * @brief Resources allocated to one named stream instance
+ *
+ * The default instance lives directly in ~/.pagestreamer, named ones in
+ * ~/.pagestreamer/instances/<name>. Each instance owns a slot number
+ * from which its X displays, DevTools and metrics ports are derived, and
+ * has its own .env profile, schedule, PID file, log directory, PulseAudio
+ * server and control socket.
+ */
+struct Instance {
+    std::string name;
+    std::string dir;
+    int slot;
+
+    std::string envPath() const;
+    std::string logDir() const;
+    std::string runDir() const;
+    std::string pidPath() const;
+    std::string controlPath() const;
+    std::string statusPath() const;
+    std::string schedulePath() const;
+    std::string display(int buffer = 0) const;
+    int debugPort(int buffer = 0) const;
+    int metricsPort() const;
+};
+
+Instance openInstance(const std::string& name);
+std::vector<Instance> listInstances();
+bool applyCpuSet(const Instance& instance, const std::string& cpus);
+
+#endif
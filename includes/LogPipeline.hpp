@@ -0,0 +1,138 @@
+#ifndef LOG_PIPELINE_HPP
+# define LOG_PIPELINE_HPP
+
+# include <string>
+# include <vector>
+# include <list>
+# include <deque>
+# include <atomic>
+# include <mutex>
+# include <thread>
+# include <condition_variable>
+# include <sys/types.h>
+# include "Supervisor.hpp"
+
+/**
+ * @brief Bounded single-producer single-consumer queue of log lines
+ *
+ * Lock-free: the producer only moves tail and the consumer only moves
+ * head. Slots keep their string buffers, so a warmed-up ring copies
+ * lines without allocating. push() fails instead of waiting when full.
+ */
+class LineRing {
+private:
+    std::vector<std::string> slots;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+
+public:
+    explicit LineRing(size_t capacity);
+
+    bool push(const std::string& line);
+    bool pop(std::string& line);
+};
+
+/**
+ * @brief Writes the output of the supervised processes to rotated logs
+ *
+ * Children write to pipes instead of their log files. A reader thread
+ * splits the output into lines, folds repeated lines, rate-limits noisy
+ * children and queues the lines in one LineRing per log file; a writer
+ * thread drains the rings in batches. A full ring drops lines rather
+ * than blocking, so a slow disk never stalls a child or the supervisor.
+ *
+ * Logs are rotated by rename when they grow too large or too old, and
+ * the rotated files are compressed and pruned by a third thread running
+ * at idle CPU and I/O priority.
+ */
+class LogPipeline : public LogRouter {
+private:
+    struct LogFile;
+
+    class Source : public ChildObserver {
+    private:
+        LogPipeline& pipeline;
+        LogFile& file;
+
+    public:
+        Source(LogPipeline& pipeline, LogFile& file);
+
+        void childStarted(pid_t pid, const std::vector<int>& fds);
+        void childExited(int status);
+    };
+
+    struct LogFile {
+        std::string path;
+        int fd;
+        bool external;
+        long long size;
+        time_t openedAt;
+        LineRing ring;
+        std::atomic<unsigned long> dropped;
+        Source source;
+        std::string lastLine;
+        unsigned long repeats;
+        long long repeatSince;
+        double tokens;
+        long long refilledAt;
+        unsigned long limited;
+
+        LogFile(LogPipeline& pipeline, const std::string& path, bool external);
+    };
+
+    /**
+     * @brief What one read of a child pipe found
+     */
+    enum StreamRead {
+        STREAM_DATA,
+        STREAM_EMPTY,
+        STREAM_CLOSED
+    };
+
+    struct Stream {
+        int fd;
+        LogFile* file;
+        std::string partial;
+    };
+
+    std::string logDir;
+    std::list<LogFile> files;
+    std::vector<Stream> streams;
+    std::mutex mutex;
+    std::vector<Stream> pendingStreams;
+    std::deque<std::string> compressQueue;
+    std::condition_variable compressWakeup;
+    std::atomic<bool> stopping;
+    std::atomic<bool> writerStopping;
+    std::atomic<bool> compressStopping;
+    int epollFd;
+    int wakeFd;
+    std::thread reader;
+    std::thread writer;
+    std::thread compressor;
+
+    LogFile& fileFor(const std::string& path, bool external);
+    void attach(LogFile& file, const std::vector<int>& fds);
+    void readerLoop();
+    StreamRead readStream(Stream& stream, long long nowMs);
+    void submit(LogFile& file, const std::string& line, long long nowMs);
+    void flushNotices(LogFile& file, long long nowMs, bool force);
+    void writerLoop();
+    void drain(LogFile& file);
+    void rotate(LogFile& file);
+    void compressorLoop();
+    void queueLeftovers();
+    bool compress(const std::string& path);
+    void prune(const std::string& path);
+
+public:
+    explicit LogPipeline(const std::string& logDir);
+    ~LogPipeline();
+
+    void route(ChildSpec& spec);
+    void watchOutput(const std::string& path);
+    void start();
+    void shutdown();
+};
+
+#endif
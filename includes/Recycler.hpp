@@ -0,0 +1,127 @@
+#ifndef RECYCLER_HPP
+# define RECYCLER_HPP
+
+# include <string>
+# include <mutex>
+# include <thread>
+# include <condition_variable>
+# include <sys/types.h>
+# include "Supervisor.hpp"
+# include "Telemetry.hpp"
+
+/**
+ * @brief Starts, captures and stops the two display buffers
+ *
+ * Each buffer is an X display with its own sound sink, browser and page
+ * driver; the capture follows the active one. Implemented by the stream
+ * controller, which owns the specs.
+ */
+class BufferControl {
+public:
+    virtual ~BufferControl() {}
+
+    /**
+     * @brief Starts the spare display, browser and driver on the current page
+     */
+    virtual void startSpare() = 0;
+
+    /**
+     * @brief Captures the spare buffer, which becomes the active one
+     *
+     * The previous buffer keeps running until stopSpare().
+     */
+    virtual void switchToSpare() = 0;
+
+    /**
+     * @brief Stops the display, browser and driver of the spare buffer
+     */
+    virtual void stopSpare() = 0;
+};
+
+/**
+ * @brief Replaces a browser that grew too big without a visible cut
+ *
+ * Every half minute the recycler adds up the memory of the streamed
+ * browser's processes from /proc. Past BROWSER_MEMORY_LIMIT, or after
+ * BROWSER_RECYCLE_HOURS, but never within ten minutes of its start, it
+ * starts a fresh browser on the spare display and waits for the
+ * supervisor to report its driver ready, i.e. the page rendered. The
+ * capture then moves to the spare display: between two frames for
+ * the framebuffer capture, at the new encoder's first keyframe for
+ * x11grab. Once the old encoder has been handed over, the old display
+ * and browser are stopped, so memory stays bounded however long the
+ * stream runs.
+ */
+class BrowserRecycler : public MetricsSource {
+private:
+    /**
+     * @brief Tracks the browser process of one buffer
+     */
+    class BrowserWatch : public ChildObserver {
+    private:
+        BrowserRecycler& recycler;
+        int buffer;
+    public:
+        BrowserWatch(BrowserRecycler& recycler, int buffer);
+        void childStarted(pid_t pid, const std::vector<int>& fds);
+        void childExited(int status);
+    };
+
+    /**
+     * @brief Tracks whether the page of one buffer's driver is rendered
+     */
+    class DriverWatch : public ChildObserver {
+    private:
+        BrowserRecycler& recycler;
+        int buffer;
+    public:
+        DriverWatch(BrowserRecycler& recycler, int buffer);
+        void childStarted(pid_t pid, const std::vector<int>& fds);
+        void childExited(int status);
+        void childReady();
+    };
+
+    enum Phase {
+        PHASE_IDLE,
+        PHASE_LOADING,
+        PHASE_SETTLING,
+        PHASE_HANDOVER
+    };
+
+    BufferControl& control;
+    long long memoryLimitBytes;
+    long long maxAgeMs;
+    BrowserWatch browsers[2];
+    DriverWatch drivers[2];
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool shuttingDown;
+    int active;
+    pid_t browserPids[2];
+    long long browserStartedMs[2];
+    bool pagesReady[2];
+    long long memoryBytes;
+    unsigned long recycles;
+    Phase phase;
+    long long phaseStartedMs;
+    long long nextSampleMs;
+    long long retryAtMs;
+    std::thread worker;
+
+    void workerLoop();
+    void advance(long long nowMs, bool ready);
+    void sampleMemory();
+
+public:
+    BrowserRecycler(BufferControl& control, int memoryLimitMiB, int maxAgeHours);
+    ~BrowserRecycler();
+
+    ChildObserver* browserObserver(int buffer);
+    ChildObserver* driverObserver(int buffer);
+    void start();
+    void shutdown();
+    void writeMetrics(std::ostream& out, const std::string& labels);
+    void writeReport(std::ostream& out);
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef SCHEDULE_HPP
+# define SCHEDULE_HPP
+
+# include <string>
+# include <vector>
+# include <list>
+# include <map>
+# include <ctime>
+# include "Instance.hpp"
+
+# define SCHEDULE_STOPPED 0
+# define SCHEDULE_STANDBY 1
+# define SCHEDULE_LIVE 2
+
+/**
+ * @brief One weekly streaming window
+ *
+ * days is a bitmask indexed like tm_wday (bit 0 is Sunday). A window
+ * whose end is not after its start ends on the following day.
+ */
+struct ScheduleWindow {
+    unsigned int days;
+    int startMinute;
+    int endMinute;
+};
+
+/**
+ * @brief Streaming windows of one instance
+ *
+ * Read from the instance's schedule file. Window times are local times
+ * of timezone (an IANA name, empty for the system zone). The stream is
+ * put in standby leadMinutes before each window starts.
+ */
+struct Schedule {
+    std::string timezone;
+    int leadMinutes;
+    std::vector<ScheduleWindow> windows;
+
+    Schedule();
+
+    int stateAt(time_t now, time_t& liveAt) const;
+    time_t nextBoundary(time_t now) const;
+    std::string format(time_t when) const;
+};
+
+/**
+ * @brief Hashed timing wheel with one second slots
+ *
+ * Timers are filed under their expiry second modulo the wheel size, so
+ * adding a timer is O(1) and advancing by one second only looks at one
+ * slot; timers more than a turn ahead stay in their slot until the turn
+ * in which they expire.
+ */
+class TimerWheel {
+private:
+    struct Timer {
+        std::string key;
+        time_t expiry;
+    };
+
+    std::vector<std::list<Timer> > slots;
+    time_t current;
+
+public:
+    explicit TimerWheel(size_t size);
+
+    void add(const std::string& key, time_t expiry);
+    void advance(time_t now, std::vector<std::string>& expired);
+};
+
+/**
+ * @brief Starts, puts in standby and stops instances on their schedules
+ *
+ * Every instance with a schedule file is reconciled at each window
+ * boundary: put in standby lead minutes before a window, live at its
+ * start and stopped at its end. At startup, and when a schedule changes,
+ * instances that should run are started but running ones are not
+ * stopped, so a stream started by hand outside its windows is left
+ * alone until the next boundary.
+ */
+class Scheduler {
+private:
+    struct Entry {
+        Instance instance;
+        Schedule schedule;
+        time_t modified;
+        time_t boundary;
+    };
+
+    std::map<std::string, Entry> entries;
+    TimerWheel wheel;
+
+    void rescan(time_t now);
+    void reconcile(Entry& entry, time_t now, bool allowStop);
+    void arm(Entry& entry, time_t now);
+
+public:
+    Scheduler();
+
+    void run();
+};
+
+bool loadSchedule(const std::string& path, Schedule& schedule, std::vector<std::string>& errors);
+bool writeDefaultSchedule(const std::string& path);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SCREENCAST_HPP
+# define SCREENCAST_HPP
+
+# include <string>
+# include <vector>
+# include <mutex>
+# include <thread>
+# include <sys/types.h>
+# include "Supervisor.hpp"
+# include "Telemetry.hpp"
+# include "Capture.hpp"
+
+class StreamWatchdog;
+
+/**
+ * @brief Cumulative counters of the screencast capture
+ *
+ * receivedFrames counts the frames rendered by the browser, slots the
+ * output frame periods and sentFrames the frames written to the encoder;
+ * skippedFrames were replaced by a newer one before being sent.
+ */
+struct ScreencastStats {
+    unsigned long long receivedFrames;
+    unsigned long long skippedFrames;
+    unsigned long long slots;
+    unsigned long long sentFrames;
+    unsigned long long receivedBytes;
+};
+
+/**
+ * @brief Capture engine for a headless browser, without any X server
+ *
+ * The page driver starts the DevTools screencast of the page, which
+ * renders a JPEG of the page at the output size whenever it changes,
+ * and passes each frame on a pipe, prefixed with its length in 4
+ * big-endian bytes. A reader thread keeps the newest frame of each
+ * display buffer; its frame pacer writes the newest frame of the
+ * captured buffer to the encoder's stdin (-f image2pipe) on a fixed
+ * output-rate schedule, at most one per frame period, plus a keepalive
+ * when the page does not change. The encoder decodes the JPEGs,
+ * timestamps them on arrival and duplicates them back to a constant
+ * rate. setSource() moves it to the other buffer between two frames.
+ * Since the browser only renders changed pages, each new frame of the
+ * captured buffer tells the watchdog that the picture changed.
+ */
+class ScreencastCapture : public ChildObserver, public MetricsSource, public FrameProvider {
+private:
+    /**
+     * @brief Receives the frame pipe of the driver of one buffer
+     */
+    class FrameSource : public ChildObserver {
+    private:
+        ScreencastCapture& capture;
+        int buffer;
+
+    public:
+        FrameSource(ScreencastCapture& capture, int buffer);
+        void childStarted(pid_t pid, const std::vector<int>& fds);
+        void childExited(int status);
+    };
+
+    FrameSource sources[2];
+    StreamWatchdog& watchdog;
+    std::mutex mutex;
+    int pendingSourceFds[2];
+    bool shuttingDown;
+    int active;
+    std::vector<unsigned char> frames[2];
+    unsigned long long frameNumbers[2];
+    ScreencastStats counters;
+    int source;
+    unsigned long long sentNumber;
+    std::vector<unsigned char> frame;
+    std::thread reader;
+    FramePacer pacer;
+
+    void readerLoop();
+    bool readFrames(int buffer, int fd, std::string& data);
+
+public:
+    ScreencastCapture(int fps, StreamWatchdog& watchdog);
+    ~ScreencastCapture();
+
+    ChildObserver* frameObserver(int buffer);
+    void setSource(int buffer);
+    ScreencastStats stats();
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+    void shutdown();
+    void writeMetrics(std::ostream& out, const std::string& labels);
+    void writeReport(std::ostream& out);
+    void sessionStarted();
+    bool acquireFrame(bool& changed);
+    const std::vector<unsigned char>& frameData();
+    std::string describeWindow(const CaptureStats& window);
+    void sessionEnded();
+};
+
+#endif
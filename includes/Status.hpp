@@ -0,0 +1,109 @@
+#ifndef STATUS_HPP
+# define STATUS_HPP
+
+# include <string>
+# include <ostream>
+# include <mutex>
+# include <thread>
+# include <condition_variable>
+# include <stdint.h>
+# include "Supervisor.hpp"
+# include "Telemetry.hpp"
+
+# define STATUS_MAGIC 0x50535354
+# define STATUS_VERSION 1
+# define STATUS_MAX_CHILDREN 32
+# define STATUS_NAME_SIZE 24
+# define STATUS_ERROR_SIZE 200
+
+/**
+ * @brief Whether the stream is encoding, per the status block
+ */
+enum StreamPhase {
+    STREAM_LIVE,
+    STREAM_STANDBY,
+    STREAM_STOPPING
+};
+
+/**
+ * @brief One child in the status block
+ */
+struct StatusChild {
+    char name[STATUS_NAME_SIZE];
+    int32_t pid;
+    uint32_t state;
+    uint32_t restarts;
+    uint32_t reserved;
+    int64_t startedAtMs;
+};
+
+/**
+ * @brief Fixed layout of the status block shared by the supervisor
+ *
+ * Times are Unix epoch milliseconds so readers need no clock of the
+ * supervisor; 0 means never. Encoder rates are -1 until reported.
+ * sequence is odd while the supervisor writes the block: a reader
+ * copies the block and retries if sequence was odd or changed.
+ */
+struct StatusBlock {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sequence;
+    int32_t supervisorPid;
+    int64_t startedAtMs;
+    int64_t updatedAtMs;
+    uint32_t phase;
+    uint32_t childCount;
+    double fps;
+    double bitrateKbps;
+    double speed;
+    int64_t encoderReportAtMs;
+    int64_t lastErrorAtMs;
+    uint32_t errors;
+    uint32_t reserved;
+    char lastError[STATUS_ERROR_SIZE];
+    StatusChild children[STATUS_MAX_CHILDREN];
+};
+
+/**
+ * @brief Publishes the state of the running stream in shared memory
+ *
+ * The block is a small file under the instance run directory mapped
+ * into the supervisor, so pagestreamer status and external health
+ * checks read it with one open and one mmap, without forking or talking
+ * to the supervisor. The children are updated by the supervisor as they
+ * change, the encoder rates and a heartbeat once a second. Writers go
+ * through a seqlock, so readers never wait for the supervisor and never
+ * see a half-written block.
+ */
+class StatusBoard : public StatusListener {
+private:
+    std::string path;
+    EncoderTelemetry& telemetry;
+    std::string encoderName;
+    StatusBlock* shared;
+    StatusBlock local;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool shuttingDown;
+    std::thread worker;
+
+    void workerLoop();
+    void publish();
+
+public:
+    StatusBoard(const std::string& path, EncoderTelemetry& telemetry, const std::string& encoderName);
+    ~StatusBoard();
+
+    bool start();
+    void shutdown();
+    void childrenChanged(const std::vector<ChildStatus>& children);
+    void childFailed(const std::string& message);
+};
+
+bool readStatusBlock(const std::string& path, StatusBlock& block);
+const char* childStateName(uint32_t state);
+void writeStatusText(std::ostream& out, const StatusBlock& block);
+void writeStatusJson(std::ostream& out, const std::string& instanceName, const StatusBlock* block);
+
+#endif
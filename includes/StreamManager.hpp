@@ -2,28 +2,65 @@
 # define STREAM_MANAGER_HPP
 
 # include <string>
+# include <vector>
 # include <stdexcept>
 # include <iostream>
 # include <cstdlib>
+# include <sys/types.h>
 # include "Colors.hpp"
+# include "Instance.hpp"
+
+class Supervisor;
+class Fanout;
+class FramebufferCapture;
+class ScreencastCapture;
+class EncoderTelemetry;
+class StreamWatchdog;
+class BrowserRecycler;
+class SyncMonitor;
+class StreamController;
+struct StreamConfig;
 
 /**
  * @brief Manages the streaming service to various platforms
- * 
+ *
  * This class provides methods to control the streaming process,
- * including starting, stopping and checking the status.
+ * including starting, stopping and checking the status of one instance.
+ * Starting forks a background supervisor that owns the instance's Xvfb,
+ * PulseAudio, browser, page driver and ffmpeg, and takes live changes
+ * on the instance control socket. A stream can also be started in
+ * standby, with everything but the encoder running, and go live later.
  */
 class StreamManager {
 private:
+    Instance instance;
     std::string scriptPath;
-    
+    std::string logDir;
+    std::string pidPath;
+
+    pid_t readSupervisorPid() const;
+    void addStreamChildren(Supervisor& supervisor, const StreamConfig& config,
+                           Fanout& fanout, EncoderTelemetry& telemetry,
+                           FramebufferCapture* capture, ScreencastCapture* screencast,
+                           StreamWatchdog& watchdog,
+                           BrowserRecycler* recycler, SyncMonitor& sync,
+                           StreamController& controller, bool standby, bool syncTest) const;
+    void runSupervisor(const StreamConfig& config, long long liveInMs, bool syncTest) const;
+    void launch(long long liveInMs, bool syncTest = false);
+
 public:
-    StreamManager();
+    explicit StreamManager(const Instance& instance);
     ~StreamManager();
-    
+
     bool startStream();
+    bool startStandby(const std::string& liveAt);
+    bool startStandby(long long liveInMs);
+    bool startSyncTest();
     bool stopStream();
-    bool getStreamStatus();
+    bool getStreamStatus(bool json = false);
+    std::string streamState() const;
+    bool printStats();
+    bool sendCommand(const std::vector<std::string>& words);
 };
 
 #endif
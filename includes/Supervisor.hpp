@@ -0,0 +1,276 @@
+#ifndef SUPERVISOR_HPP
+# define SUPERVISOR_HPP
+
+# include <string>
+# include <vector>
+# include <mutex>
+# include <sys/types.h>
+# include <signal.h>
+
+/**
+ * @brief Receives the lifecycle events of a supervised child
+ *
+ * Callbacks run on the supervisor thread and must not block.
+ */
+class ChildObserver {
+public:
+    virtual ~ChildObserver() {}
+
+    /**
+     * @brief Called after each (re)start of the child
+     *
+     * @param pid The new process
+     * @param fds Our ends of the pipes routed to this observer, in
+     *            ChildSpec::pipes order. The observer owns and must close them.
+     */
+    virtual void childStarted(pid_t pid, const std::vector<int>& fds) = 0;
+
+    /**
+     * @brief Called once the child has exited and been reaped
+     *
+     * @param status The wait status
+     */
+    virtual void childExited(int status) = 0;
+
+    /**
+     * @brief Called once the started child reported itself ready
+     *
+     * Only children with a readiness signal report it; see ChildSpec.
+     */
+    virtual void childReady() {}
+};
+
+/**
+ * @brief A pipe connected to a file descriptor of a child
+ *
+ * Our end goes to observer, or to the spec's observer when NULL, so
+ * different subsystems can own different pipes of the same child.
+ */
+struct ChildPipe {
+    int childFd;
+    bool childWrites;
+    ChildObserver* observer;
+};
+
+/**
+ * @brief Describes a process managed by the Supervisor
+ *
+ * argv[0] is resolved through PATH. env entries (KEY=VALUE) are added
+ * to, or override, the supervisor's own environment. A oneshot child is
+ * considered done once it exits with status 0. Each entry of pipes
+ * connects one child descriptor to the observer, replacing the log or
+ * /dev/null redirection for that descriptor. maxBackoffMs, when set,
+ * caps the restart delay below the supervisor's default.
+ *
+ * A child is ready once it wrote a line on readyFd, when set, once
+ * readySocket ("unix:PATH" or "tcp:PORT" on the loopback) accepts a
+ * connection, when set, or else as soon as it started; a oneshot child
+ * is ready once done. It stops being ready when it exits. A child is
+ * only started, and restarted, while every child named in after is
+ * ready.
+ */
+struct ChildSpec {
+    std::string name;
+    std::vector<std::string> argv;
+    std::vector<std::string> env;
+    std::string workDir;
+    std::string logPath;
+    bool oneshot;
+    int maxBackoffMs;
+    std::vector<ChildPipe> pipes;
+    ChildObserver* observer;
+    std::vector<std::string> after;
+    int readyFd;
+    std::string readySocket;
+
+    ChildSpec();
+};
+
+/**
+ * @brief Takes over the log output of children
+ *
+ * route() is called on the supervisor thread with a copy of the spec
+ * before every start, and may replace its logPath with pipes.
+ */
+class LogRouter {
+public:
+    virtual ~LogRouter() {}
+
+    /**
+     * @brief Rewrites a spec whose logPath is set
+     *
+     * @param spec The copy of the spec about to be started
+     */
+    virtual void route(ChildSpec& spec) = 0;
+};
+
+/**
+ * @brief What a supervised child is currently doing
+ *
+ * CHILD_STARTING is running but not ready yet, CHILD_WAITING due to
+ * start but waiting for the children it starts after.
+ */
+enum ChildState {
+    CHILD_RUNNING,
+    CHILD_RESTARTING,
+    CHILD_HELD,
+    CHILD_DONE,
+    CHILD_STOPPED,
+    CHILD_STARTING,
+    CHILD_WAITING
+};
+
+/**
+ * @brief Snapshot of one supervised child
+ *
+ * startedAt is the monotonic time of the last start, 0 if never started.
+ */
+struct ChildStatus {
+    std::string name;
+    pid_t pid;
+    ChildState state;
+    unsigned int restarts;
+    long long startedAt;
+};
+
+/**
+ * @brief Receives the state of the children as it changes
+ *
+ * Both methods are called on the supervisor thread and must not block.
+ */
+class StatusListener {
+public:
+    virtual ~StatusListener() {}
+
+    /**
+     * @brief Called after every batch of starts, exits and requests
+     *
+     * @param children Every registered child, in registration order
+     */
+    virtual void childrenChanged(const std::vector<ChildStatus>& children) = 0;
+
+    /**
+     * @brief Called when a child failed unexpectedly
+     *
+     * @param message What happened, as logged
+     */
+    virtual void childFailed(const std::string& message) = 0;
+};
+
+/**
+ * @brief How Supervisor::replaceChild() applies a new spec
+ *
+ * REPLACE_ON_RESTART keeps the running process and uses the spec from
+ * its next restart on. REPLACE_NOW stops the process and starts the new
+ * spec as soon as it exited. REPLACE_OVERLAPPING starts the new process
+ * right away and lets the old one run until it exits by itself, which
+ * its observers can use to hand over without a gap.
+ */
+enum ReplaceMode {
+    REPLACE_ON_RESTART,
+    REPLACE_NOW,
+    REPLACE_OVERLAPPING
+};
+
+/**
+ * @brief Runs and watches the processes that make up a stream
+ *
+ * Every child is fork/exec'd into its own process group and watched
+ * through a pidfd (or SIGCHLD when pidfds are unavailable) in a single
+ * epoll loop. A child that dies is restarted after a bounded exponential
+ * backoff starting at a few milliseconds. Stopping signals every child
+ * at once and waits for all of them against a shared deadline. Specs
+ * can be replaced, children restarted, held and released from other
+ * threads while the supervisor runs.
+ *
+ * Children start in parallel as soon as the children they start after
+ * are ready, so startup follows the dependency graph instead of fixed
+ * delays. The time each child took to become ready is logged.
+ */
+class Supervisor {
+private:
+    struct Child {
+        ChildSpec spec;
+        pid_t pid;
+        int pidfd;
+        unsigned int restarts;
+        long long startedAt;
+        long long restartAt;
+        int backoffMs;
+        bool done;
+        bool replacing;
+        bool held;
+        bool ready;
+        bool readyWarned;
+        int readyPipe;
+        long long readyProbeAt;
+        std::string readyLine;
+    };
+
+    struct Retired {
+        std::string name;
+        pid_t pid;
+        long long deadline;
+    };
+
+    struct Replacement {
+        ChildSpec spec;
+        ReplaceMode mode;
+    };
+
+    struct Release {
+        std::string name;
+        long long delayMs;
+    };
+
+    std::vector<Child> children;
+    std::vector<Retired> retired;
+    int epollFd;
+    int signalFd;
+    int wakeFd;
+    sigset_t savedMask;
+    bool stopping;
+    long long runStartedAt;
+    bool startupLogged;
+    std::mutex mutex;
+    std::vector<Replacement> replacements;
+    std::vector<Release> releases;
+    std::vector<std::string> restartRequests;
+    std::vector<std::string> holdRequests;
+    LogRouter* logRouter;
+    StatusListener* statusListener;
+
+    bool spawn(Child& child);
+    void reapChildren();
+    void handleExit(Child& child, int status);
+    void wake();
+    void applyRequests();
+    void stopOverdueRetired();
+    void restartDueChildren();
+    int nextTimeoutMs() const;
+    bool dependenciesReady(const Child& child) const;
+    void markReady(Child& child);
+    void readReadyPipe(Child& child);
+    void closeReadyPipe(Child& child);
+    void probeReadiness();
+    bool waitEvents(int timeoutMs);
+    size_t runningCount() const;
+    void publishStatus();
+    void reportFailure(const std::string& message);
+
+public:
+    Supervisor();
+    ~Supervisor();
+
+    void setLogRouter(LogRouter* router);
+    void setStatusListener(StatusListener* listener);
+    void addChild(const ChildSpec& spec, bool held = false);
+    void replaceChild(const ChildSpec& spec, ReplaceMode mode);
+    void release(const std::string& name, long long delayMs);
+    void restart(const std::string& name);
+    void hold(const std::string& name);
+    void run();
+    void stopAll(int deadlineMs);
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef SYNC_HPP
+# define SYNC_HPP
+
+# include <string>
+# include <vector>
+# include <mutex>
+# include <thread>
+# include <sys/types.h>
+# include "Supervisor.hpp"
+# include "Telemetry.hpp"
+# include "Tuner.hpp"
+
+/**
+ * @brief Measures the audio/video sync of the encoder
+ *
+ * Probes at the end of the encoder's audio and video filter chains print
+ * the timestamp of every frame to a pipe. Both inputs are timestamped at
+ * capture, so for each stream the time between a frame's timestamp and
+ * its report is the pipeline latency plus jitter; its minimum over a few
+ * seconds is the latency alone. A change of the audio latency against
+ * the video latency since the encoder started is drift: the audio of a
+ * moment no longer goes out with its picture. The audio resampler
+ * stretches the sound to its capture timestamps to prevent it. Drift it
+ * leaves is corrected at runtime: the monitor plays the sound slightly
+ * faster or slower through the encoder's atempo filter, commanded over
+ * its azmq socket, until the sound has caught up. Only drift that
+ * correction cannot absorb, or an encoder without those filters, makes
+ * the monitor start a fresh encoder, which the fan-out takes over at a
+ * keyframe.
+ *
+ * In the sync test the streamed page flashes white and beeps at the same
+ * time every two seconds. The probes then report the picture brightness
+ * and the sound level, and the time from each flash to its beep in the
+ * encoded timeline is the offset viewers get.
+ */
+class SyncMonitor : public ChildObserver, public MetricsSource {
+private:
+    /**
+     * @brief Minimum latency of one stream over the current bucket
+     */
+    struct Latency {
+        long long minMs;
+        unsigned long frames;
+    };
+
+    EncoderControl& control;
+    std::string commandPath;
+    bool testMode;
+    std::mutex mutex;
+    bool shuttingDown;
+    std::vector<int> pendingFds;
+    long long startedMs;
+    long long bucketEndMs;
+    Latency audio;
+    Latency video;
+    std::vector<long long> offsets;
+    std::vector<long long> baseline;
+    bool measuring;
+    long long driftMs;
+    long long driftSinceMs;
+    long long lastRestartMs;
+    unsigned long restarts;
+    double tempo;
+    double appliedTempo;
+    long long correctionEndMs;
+    unsigned long corrections;
+    bool commandFailed;
+    long long framePtsMs;
+    double lastLuma;
+    double lastLevel;
+    long long flashPtsMs;
+    long long beepPtsMs;
+    unsigned long flashes;
+    long long lastOffsetMs;
+    long long offsetSumMs;
+    long long offsetMinMs;
+    long long offsetMaxMs;
+    std::thread worker;
+
+    void workerLoop();
+    bool readReports(int fd, std::string& pending, bool current);
+    void handleLine(const std::string& line, long long nowMs);
+    bool closeBucket(long long nowMs);
+    void startCorrection(long long nowMs);
+    void applyTempo(double value);
+    void matchFlash();
+
+public:
+    SyncMonitor(EncoderControl& control, const std::string& commandPath, bool testMode);
+    ~SyncMonitor();
+
+    std::string tempoFilter() const;
+    void start();
+    void shutdown();
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+    void writeMetrics(std::ostream& out, const std::string& labels);
+    void writeReport(std::ostream& out);
+};
+
+std::string syncAudioProbe(int fd, bool testMode);
+std::string syncVideoProbe(int fd, bool testMode);
+
+#endif
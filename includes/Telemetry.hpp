@@ -0,0 +1,158 @@
+#ifndef TELEMETRY_HPP
+# define TELEMETRY_HPP
+
+# include <string>
+# include <vector>
+# include <ostream>
+# include <mutex>
+# include <thread>
+# include <condition_variable>
+# include "Supervisor.hpp"
+
+/**
+ * @brief One progress report of the encoder
+ *
+ * Rates are -1 when ffmpeg reports N/A (e.g. before the first packet).
+ * Counters are cumulative over the whole supervisor lifetime, including
+ * previous encoder processes.
+ */
+struct EncoderSample {
+    long long timeMs;
+    double fps;
+    double bitrateKbps;
+    double speed;
+    unsigned long long frames;
+    unsigned long long outputBytes;
+    unsigned long long dupFrames;
+    unsigned long long dropFrames;
+};
+
+/**
+ * @brief Distribution of one field over a time window
+ */
+struct WindowSummary {
+    size_t count;
+    double min;
+    double p5;
+    double p50;
+    double p95;
+    double max;
+};
+
+/**
+ * @brief Fixed-size ring of the most recent encoder samples
+ *
+ * Memory use is bounded by the capacity whatever the stream duration;
+ * the oldest sample is overwritten once the ring is full.
+ */
+class SampleRing {
+private:
+    std::vector<EncoderSample> samples;
+    size_t next;
+    size_t count;
+
+public:
+    explicit SampleRing(size_t capacity);
+
+    void push(const EncoderSample& sample);
+    size_t size() const;
+    const EncoderSample& latest() const;
+    WindowSummary summarize(double EncoderSample::*field, long long sinceMs) const;
+};
+
+/**
+ * @brief Something that can describe itself on the metrics endpoint
+ *
+ * Both methods are called from the metrics server thread.
+ */
+class MetricsSource {
+public:
+    virtual ~MetricsSource() {}
+
+    /**
+     * @brief Writes Prometheus text exposition lines
+     *
+     * @param out The response body
+     * @param labels Label pairs to add to every sample, e.g. instance="x"
+     */
+    virtual void writeMetrics(std::ostream& out, const std::string& labels) = 0;
+
+    /**
+     * @brief Writes a human-readable summary for pagestreamer stats
+     *
+     * @param out The response body
+     */
+    virtual void writeReport(std::ostream& out) = 0;
+};
+
+/**
+ * @brief Collects the encoder's -progress reports into a time series
+ *
+ * Observes the encoder: every (re)start hands over the pipe ffmpeg
+ * writes its key=value progress blocks to, which a reader thread parses
+ * into EncoderSample entries of a SampleRing.
+ */
+class EncoderTelemetry : public ChildObserver, public MetricsSource {
+private:
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    int pendingFd;
+    bool shuttingDown;
+    SampleRing ring;
+    unsigned long sessions;
+    EncoderSample last;
+    std::thread reader;
+
+    void readerLoop();
+    void readSession(int fd);
+    void addSample(const EncoderSample& sample);
+
+public:
+    EncoderTelemetry();
+    ~EncoderTelemetry();
+
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+    void shutdown();
+    WindowSummary summary(double EncoderSample::*field, long long sinceMs);
+    bool latest(EncoderSample& sample);
+    void writeMetrics(std::ostream& out, const std::string& labels);
+    void writeReport(std::ostream& out);
+};
+
+/**
+ * @brief Plain HTTP endpoint on localhost serving the metrics
+ *
+ * GET /metrics returns the Prometheus text format and GET /stats the
+ * report shown by pagestreamer stats. Requests are served one at a time
+ * by a single thread; it only listens on the loopback interface.
+ */
+class MetricsServer {
+private:
+    std::string instanceName;
+    int port;
+    std::vector<MetricsSource*> sources;
+    int listenFd;
+    std::mutex mutex;
+    bool shuttingDown;
+    std::thread server;
+
+    void serverLoop();
+    void serve(int client);
+
+public:
+    MetricsServer(const std::string& instanceName, int port);
+    ~MetricsServer();
+
+    void addSource(MetricsSource* source);
+    bool start();
+    void shutdown();
+};
+
+void writeMetricHeader(std::ostream& out, const std::string& name, const char* type, const char* help);
+void writeMetricSample(std::ostream& out, const std::string& name, const std::string& labels, double value);
+void writeMetricSample(std::ostream& out, const std::string& name, const std::string& labels,
+                       unsigned long long value);
+bool fetchMetricsPage(int port, const std::string& path, std::string& body);
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef TUNER_HPP
+# define TUNER_HPP
+
+# include <string>
+# include <vector>
+# include <deque>
+# include <mutex>
+# include <thread>
+# include <condition_variable>
+# include "Telemetry.hpp"
+# include "Fanout.hpp"
+
+/**
+ * @brief Restarts the encoder, with other x264 settings or not
+ *
+ * Implemented by the stream controller, which owns the encoder spec.
+ */
+class EncoderControl {
+public:
+    virtual ~EncoderControl() {}
+
+    /**
+     * @brief Switches the running encoder to new settings without a gap
+     *
+     * @param preset The x264 preset, e.g. veryfast
+     * @param bitrateKbps The video bitrate
+     */
+    virtual void applyEncoderSettings(const std::string& preset, int bitrateKbps) = 0;
+
+    /**
+     * @brief Replaces the running encoder by a fresh one with the same settings
+     */
+    virtual void restartEncoder() = 0;
+};
+
+/**
+ * @brief Bitrate range the tuner may use for one platform
+ */
+struct TuningBounds {
+    int minBitrateKbps;
+    int defaultBitrateKbps;
+    int maxBitrateKbps;
+};
+
+/**
+ * @brief Closed-loop tuning of the encoder preset and bitrate
+ *
+ * Every few seconds the tuner looks at the encoder speed reported by
+ * the telemetry, the CPU usage of the CPUs the stream may run on and
+ * the fill level of the destination queues:
+ *
+ * - an encoder below real time, or saturated CPUs, move to a faster
+ *   x264 preset, and to a lower bitrate once at ultrafast;
+ * - destination queues filling up lower the bitrate;
+ * - minutes of real-time encoding with idle CPUs first restore the
+ *   platform's default bitrate, then move to slower presets, then raise
+ *   the bitrate up to the platform maximum.
+ *
+ * Lowering reacts within seconds while raising needs minutes of
+ * headroom, and nothing changes while the last switch settles, so the
+ * settings do not oscillate. Each switch starts a second encoder that
+ * the fan-out hands over to at its first keyframe, and is logged.
+ */
+class EncoderTuner : public MetricsSource {
+private:
+    struct CpuReading {
+        long long timeMs;
+        double busy;
+    };
+
+    EncoderTelemetry& telemetry;
+    EncoderControl& control;
+    std::vector<RtmpDestination*> destinations;
+    TuningBounds bounds;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool shuttingDown;
+    size_t preset;
+    int bitrateKbps;
+    long long changedAtMs;
+    unsigned long changes;
+    std::string lastReason;
+    unsigned long long lastBusy;
+    unsigned long long lastTotal;
+    std::deque<CpuReading> cpu;
+    std::thread worker;
+
+    void workerLoop();
+    void sampleCpu(long long nowMs);
+    double averageCpu(long long sinceMs) const;
+    double maxQueueFill() const;
+    void evaluate(long long nowMs);
+    void change(size_t newPreset, int newBitrateKbps, const std::string& reason);
+
+public:
+    EncoderTuner(EncoderTelemetry& telemetry, EncoderControl& control, const TuningBounds& bounds,
+                 int bitrateKbps);
+    ~EncoderTuner();
+
+    void addDestination(RtmpDestination* destination);
+    void start();
+    void shutdown();
+    void setBitrate(int kbps);
+    void writeMetrics(std::ostream& out, const std::string& labels);
+    void writeReport(std::ostream& out);
+};
+
+TuningBounds platformBounds(const std::string& platform, int outputHeight);
+const char* defaultPreset();
+
+#endif
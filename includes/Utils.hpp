@@ -0,0 +1,13 @@
+#ifndef UTILS_HPP
+# define UTILS_HPP
+
+# include <string>
+
+// Small helpers shared by the supervisor and its subsystems
+long long monotonicMs();
+std::string isoTimestamp();
+std::string pagestreamerDir();
+void logMessage(const std::string& message);
+bool writeFully(int fd, const char* data, size_t length);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef WATCHDOG_HPP
+# define WATCHDOG_HPP
+
+# include <string>
+# include <vector>
+# include <mutex>
+# include <thread>
+# include <sys/types.h>
+# include "Capture.hpp"
+# include "Supervisor.hpp"
+# include "Telemetry.hpp"
+
+/**
+ * @brief Recovery actions of the watchdog, from the mildest
+ *
+ * Implemented by the stream controller, which knows the children.
+ */
+class RecoveryControl {
+public:
+    virtual ~RecoveryControl() {}
+
+    /**
+     * @brief Asks the page driver to load the page again
+     *
+     * @return bool False if the driver could not be reached
+     */
+    virtual bool reloadPage() = 0;
+
+    /**
+     * @brief Restarts the browser; the driver reconnects and loads the page
+     */
+    virtual void restartBrowser() = 0;
+
+    /**
+     * @brief Restarts every process of the stream except the relays
+     */
+    virtual void restartStream() = 0;
+};
+
+/**
+ * @brief Detects a broken page in the streamed picture and sound
+ *
+ * Once a second a thread maps the Xvfb framebuffer and reduces the
+ * frame to the mean luma of a grid of tiles, reading one pixel in 16.
+ * A picture whose tiles all stay within a small threshold for
+ * FREEZE_TIMEOUT is frozen; a uniform black or white picture is a
+ * crashed or blank tab. The encoder's silencedetect filter reports on
+ * a pipe when the sound goes silent, which counts once the page has
+ * played sound. Without an X server (screencast capture) the capture
+ * reports each new frame instead, so only a frozen picture is detected.
+ *
+ * A problem triggers a page reload, then a browser restart if it comes
+ * back, then restarts of the whole stream. The level returns to a
+ * reload after a quarter of an hour without problem. Only a running
+ * encoder is watched, so a standby page is left alone.
+ */
+class StreamWatchdog : public ChildObserver, public MetricsSource {
+private:
+    enum Problem {
+        PROBLEM_NONE,
+        PROBLEM_FROZEN,
+        PROBLEM_BLACK,
+        PROBLEM_WHITE,
+        PROBLEM_SILENT
+    };
+
+    XwdFramebuffer framebuffer;
+    bool sampled;
+    std::string framebufferPath;
+    std::string sourcePath;
+    RecoveryControl& control;
+    int width;
+    int height;
+    long long freezeMs;
+    std::mutex mutex;
+    int pendingFd;
+    bool shuttingDown;
+    ino_t framebufferInode;
+    std::string lastError;
+    std::vector<unsigned char> previous;
+    std::vector<unsigned char> current;
+    long long watchingSinceMs;
+    long long changedAtMs;
+    long long blankSinceMs;
+    Problem blank;
+    long long silentSinceMs;
+    bool audioHeard;
+    std::string audioLine;
+    int level;
+    long long lastActionMs;
+    unsigned long recoveries[3];
+    std::thread worker;
+
+    void workerLoop();
+    bool readAudio(int fd, long long nowMs);
+    void sampleFrame(long long nowMs);
+    Problem detect(long long nowMs, long long& sinceMs);
+    void recover(Problem problem, long long sinceMs, long long nowMs);
+
+public:
+    StreamWatchdog(const std::string& fbDir, int width, int height, RecoveryControl& control,
+                   int freezeTimeoutSeconds);
+    ~StreamWatchdog();
+
+    void start();
+    void shutdown();
+    void setFramebuffer(const std::string& fbDir);
+    void pictureChanged();
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+    void writeMetrics(std::ostream& out, const std::string& labels);
+    void writeReport(std::ostream& out);
+};
+
+std::string silenceFilter(int fd);
+
+#endif
@@ -46,6 +46,7 @@ install_dependencies() {
             ffmpeg \
             build-essential \
             g++ \
+            zlib1g-dev \
             curl \
             git \
             xvfb
@@ -60,6 +61,7 @@ install_dependencies() {
             ffmpeg \
             gcc-c++ \
             make \
+            zlib-devel \
             curl \
             git
     else
@@ -70,7 +72,7 @@ install_dependencies() {
         echo "- PulseAudio"
         echo "- FFmpeg"
         echo "- Chromium or Chrome"
-        echo "- g++ and make"
+        echo "- g++, make and zlib"
         exit 1
     fi
 
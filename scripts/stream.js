@@ -1,26 +1,27 @@
 const puppeteer = require('puppeteer');
-const { spawn, execSync } = require('child_process');
-const fs = require('fs');
+const readline = require('readline');
 const dotenv = require('dotenv');
 const path = require('path');
+const fs = require('fs');
 
 // Load environment variables from parent directory .env file
 dotenv.config({ path: path.join(__dirname, '..', '.env') });
 
-const STREAM_KEY = process.env.STREAM_KEY;
-const PLATFORM = process.env.PLATFORM || 'rtmp://a.rtmp.youtube.com/live2';
 // Ajouter la variable pour l'URL du site à streamer avec une valeur par défaut
 const STREAM_URL = process.env.STREAM_URL || 'https://roulette-tv.vercel.app/history';
-
-if (!STREAM_KEY) {
-  console.error("ERROR: Streaming key not defined in .env file!");
-  process.exit(1);
-}
-
-const WIDTH = 1920;
-const HEIGHT = 1080;
-const MAX_RETRY_COUNT = 3;
-const RETRY_DELAY_MS = 30000; // 30 seconds
+const ZOOM = process.env.PAGESTREAMER_ZOOM || '1.1';
+const STANDBY_REFRESH_MS = parseInt(process.env.PAGESTREAMER_STANDBY_REFRESH_MS || '0', 10);
+const READY_FD = parseInt(process.env.PAGESTREAMER_READY_FD || '-1', 10);
+const FRAME_FD = parseInt(process.env.PAGESTREAMER_FRAME_FD || '-1', 10);
+const FRAME_SIZE = (process.env.PAGESTREAMER_FRAME_SIZE || '1920x1080').split('x').map(Number);
+const FRAME_QUALITY = 85;
+
+// Le screencast rend la page directement à la taille de sortie
+const WIDTH = FRAME_FD >= 0 ? FRAME_SIZE[0] : 1920;
+const HEIGHT = FRAME_FD >= 0 ? FRAME_SIZE[1] : 1080;
+const DEBUG_PORT = process.env.PAGESTREAMER_DEBUG_PORT || '9222';
+const CONNECT_RETRY_MS = 100;
+const CONNECT_TIMEOUT_MS = 30000;
 
 /**
  * @brief Logs a message with ISO timestamp
@@ -36,238 +37,246 @@ function logWithTimestamp(message) {
 }
 
 /**
- * @brief Starts the ffmpeg process for streaming
+ * @brief Attaches to the browser started by the pagestreamer supervisor
  * 
- * This function launches ffmpeg with appropriate parameters for capturing
- * the screen and audio, then streaming to YouTube. It also sets up event
- * handlers for process output and handles automatic restart on failure.
+ * The supervisor starts this driver once the DevTools endpoint accepts
+ * connections; it is polled again in case the browser restarted since.
  * 
- * @return {ChildProcess} The ffmpeg child process
+ * @return {Browser} The connected puppeteer browser
  */
-function startFFmpeg() {
-  logWithTimestamp("Starting ffmpeg...");
-
-  if (!STREAM_KEY) {
-    logWithTimestamp("ERROR: STREAM_KEY not defined. Check .env file in parent directory.");
-    process.exit(1);
+async function connectBrowser() {
+  const deadline = Date.now() + CONNECT_TIMEOUT_MS;
+  for (;;) {
+    try {
+      return await puppeteer.connect({
+        browserURL: `http://127.0.0.1:${DEBUG_PORT}`,
+        defaultViewport: null
+      });
+    } catch (err) {
+      if (Date.now() > deadline) {
+        throw err;
+      }
+      await new Promise(resolve => setTimeout(resolve, CONNECT_RETRY_MS));
+    }
   }
+}
 
-  // Check if we're streaming to Twitch
-  const isTwitch = PLATFORM.includes('twitch.tv');
-
-  const ffmpeg = spawn('ffmpeg', [
-    // Audio input with larger thread queue and sync options
-    '-thread_queue_size', '4096',
-    '-f', 'pulse',
-    '-i', 'virt_output.monitor',
-
-    // Video input with increased thread queue
-    '-thread_queue_size', '4096',
-    '-f', 'x11grab',
-    '-probesize', '10M',
-    '-s', `${WIDTH}x${HEIGHT}`,
-    '-r', '30',
-    '-i', ':99.0',
-
-    // Filter complex for synchronization
-    '-filter_complex', 'aresample=async=1000',
-
-    // Video codec settings
-    '-c:v', 'libx264',
-    '-preset', 'veryfast',
-    '-tune', 'zerolatency',
-    '-pix_fmt', 'yuv420p',
-    '-b:v', isTwitch ? '6000k' : '4000k',
-    '-maxrate', isTwitch ? '6000k' : '4000k',
-    '-bufsize', '7000k',
-    '-g', '60',
-    '-keyint_min', '30',
-    '-crf', '23',
-    '-profile:v', 'main',
-    '-level', '4.1',
-
-    // Audio codec settings
-    '-c:a', 'aac',
-    '-b:a', '160k',
-    '-ar', '48000',
-    '-ac', '2',
+/**
+ * @brief Hides the cursor and clicks into the page so it gets focus
+ * 
+ * @param {Page} page - The streamed page
+ */
+async function actions(page) {
+  // Masquer le curseur via CSS de façon robuste
+  try {
+    await page.evaluate(() => {
+      const style = document.createElement('style');
+      style.innerHTML = 'body, * { cursor: none !important; }';
+      document.head.appendChild(style);
+    });
+  } catch (e) {
+    logWithTimestamp('Warning: Could not inject cursor CSS: ' + e.message);
+  }
+  // Effectuer le clic et déplacer la souris
+  await page.mouse.click(1106, 822);
+  await page.mouse.move(1, 1);
+}
 
-    // Force audio/video sync - crucial for Twitch
-    '-vsync', 'cfr',
-    '-async', '1',
+/**
+ * @brief Applies a zoom factor to the page content
+ * 
+ * @param {Page} page - The streamed page
+ * @param {string} zoom - The zoom factor, e.g. '1.25'
+ */
+async function applyZoom(page, zoom) {
+  await page.evaluate(z => {
+    document.body.style.zoom = z;
+  }, zoom);
+}
 
-    // Stream output settings
-    '-fflags', '+genpts',
-    '-max_interleave_delta', '0',
-    '-shortest',
-    '-movflags', '+faststart',
-    '-f', 'flv',
-    '-flvflags', 'no_duration_filesize',
-    `-xerror`,
-    `${PLATFORM}/${STREAM_KEY}`
-  ]);
+/**
+ * @brief Loads a page in place and prepares it for streaming
+ * 
+ * @param {Page} page - The streamed page
+ * @param {string} url - The page to load
+ * @param {string} zoom - The zoom factor to apply once loaded
+ */
+async function showPage(page, url, zoom) {
+  logWithTimestamp("Navigating to page...");
+  await page.goto(url, { waitUntil: 'networkidle2' });
+  logWithTimestamp(`Page loaded: ${url}`);
+  await actions(page);
+  await applyZoom(page, zoom);
+}
 
-  ffmpeg.stdout.on('data', data => logWithTimestamp(`ffmpeg stdout: ${data}`));
+/**
+ * @brief Tells the supervisor that the page is rendered
+ * 
+ * Waits for two animation frames so the loaded page has been painted,
+ * then reports on PAGESTREAMER_READY_FD. The supervisor starts the
+ * encoder on this report, and the browser recycler waits for it before
+ * it captures a fresh browser.
+ * 
+ * @param {Page} page - The streamed page
+ */
+async function reportReady(page) {
+  if (READY_FD < 0) {
+    return;
+  }
+  await page.evaluate(() => new Promise(resolve => {
+    requestAnimationFrame(() => requestAnimationFrame(resolve));
+  }));
+  try {
+    fs.writeSync(READY_FD, 'ready\n');
+  } catch (err) {
+    logWithTimestamp(`Could not report the page ready: ${err.message}`);
+  }
+}
 
-  ffmpeg.stderr.on('data', data => {
-    const dataStr = data.toString();
-    if (!dataStr.match(/^frame=\s*\d+/)) {
-      logWithTimestamp(`ffmpeg stderr: ${dataStr}`);
-    }
+/**
+ * @brief Passes the screencast frames of the page to the supervisor
+ * 
+ * With CAPTURE=screencast the browser is headless and the supervisor
+ * reads the page from PAGESTREAMER_FRAME_FD instead of an X display.
+ * The browser renders a JPEG at the output size whenever the page
+ * changes; each one is written with its length in 4 big-endian bytes
+ * first. While a write is pending only the newest frame is kept, so a
+ * slow reader gets fewer frames, never late ones.
+ * 
+ * @param {Page} page - The streamed page
+ */
+async function startScreencast(page) {
+  if (FRAME_FD < 0) {
+    return;
+  }
+  const output = fs.createWriteStream(null, { fd: FRAME_FD });
+  const session = await page.target().createCDPSession();
+  let writing = false;
+  let pending = null;
+  const write = frame => {
+    writing = true;
+    output.write(frame, () => {
+      writing = pending !== null;
+      if (writing) {
+        const next = pending;
+        pending = null;
+        write(next);
+      }
+    });
+  };
+  output.on('error', err => {
+    logWithTimestamp(`Frame output failed: ${err.message}`);
+    process.exit(1);
   });
-
-  ffmpeg.on('close', (code, signal) => {
-    logWithTimestamp(`ffmpeg stopped with code: ${code}, signal: ${signal}`);
-
-    if (code !== 0 && !process.exitCode) {
-      logWithTimestamp("Attempting to restart ffmpeg in 30 seconds...");
-      setTimeout(startFFmpeg, RETRY_DELAY_MS);
+  session.on('Page.screencastFrame', event => {
+    session.send('Page.screencastFrameAck', { sessionId: event.sessionId }).catch(() => {});
+    const jpeg = Buffer.from(event.data, 'base64');
+    const frame = Buffer.alloc(4 + jpeg.length);
+    frame.writeUInt32BE(jpeg.length, 0);
+    jpeg.copy(frame, 4);
+    if (writing) {
+      pending = frame;
+    } else {
+      write(frame);
     }
   });
+  await session.send('Page.startScreencast', {
+    format: 'jpeg',
+    quality: FRAME_QUALITY,
+    maxWidth: FRAME_SIZE[0],
+    maxHeight: FRAME_SIZE[1],
+    everyNthFrame: 1
+  });
+  logWithTimestamp(`Screencast started at ${FRAME_SIZE[0]}x${FRAME_SIZE[1]}.`);
+}
 
-  return ffmpeg;
+/**
+ * @brief Executes the commands the supervisor writes to stdin
+ * 
+ * One command per line: "navigate URL" loads another page in the same
+ * tab, "reload" loads the current page again, "zoom FACTOR" changes the
+ * zoom and "live" ends the standby page refreshes. Commands run one after the other; a failing command is
+ * logged and does not stop the driver.
+ * 
+ * In standby the page is reloaded every STANDBY_REFRESH_MS so it is
+ * fresh when the stream goes live; nothing is captured meanwhile.
+ * 
+ * @param {Page} page - The streamed page
+ */
+function listenForCommands(page) {
+  let zoom = ZOOM;
+  let url = STREAM_URL;
+  let queue = Promise.resolve();
+  const refresh = STANDBY_REFRESH_MS > 0 ? setInterval(() => {
+    queue = queue.then(() => showPage(page, url, zoom)).catch(err => {
+      logWithTimestamp(`Standby refresh failed: ${err.message}`);
+    });
+  }, STANDBY_REFRESH_MS) : null;
+  readline.createInterface({ input: process.stdin }).on('line', line => {
+    const separator = line.indexOf(' ');
+    const command = separator < 0 ? line : line.slice(0, separator);
+    const argument = separator < 0 ? '' : line.slice(separator + 1).trim();
+    queue = queue.then(async () => {
+      if (command === 'navigate' && argument) {
+        url = argument;
+        await showPage(page, url, zoom);
+      } else if (command === 'reload') {
+        logWithTimestamp('Reloading the page.');
+        await showPage(page, url, zoom);
+      } else if (command === 'zoom' && argument) {
+        zoom = argument;
+        await applyZoom(page, zoom);
+        logWithTimestamp(`Zoom set to ${zoom}`);
+      } else if (command === 'live') {
+        clearInterval(refresh);
+        logWithTimestamp('Stream is live, standby refreshes stopped.');
+      } else {
+        logWithTimestamp(`Ignoring unknown command: ${command}`);
+      }
+    }).catch(err => {
+      logWithTimestamp(`Command ${command} failed: ${err.message}`);
+    });
+  });
 }
 
 /**
- * @brief Main function that initializes and manages the streaming process
+ * @brief Main function that drives the page shown on the virtual display
  * 
- * This function sets up the virtual display, launches the browser, navigates
- * to the streaming page, and starts ffmpeg for streaming. It also handles
- * cleanup and monitoring of the stream status.
+ * The supervisor owns Xvfb, PulseAudio, Chromium and ffmpeg. This driver
+ * only attaches to the browser, loads the configured page, streams its
+ * screencast frames when the browser is headless, applies the
+ * live changes received on stdin and exits as soon as the browser goes
+ * away so the supervisor can restart it.
  */
 (async () => {
-  let retryCount = 0;
-  let browser;
-  let ffmpegProcess;
-
   try {
-    logWithTimestamp("Initializing environment...");
-    execSync('bash ./create_screen.sh', { stdio: 'inherit' });
+    logWithTimestamp("Connecting to browser...");
+    const browser = await connectBrowser();
 
-    logWithTimestamp("Waiting for environment stabilization...");
-    await new Promise(resolve => setTimeout(resolve, 2000));
-
-    /**
-     * @brief Cleans up resources before shutdown
-     * 
-     * This function properly terminates all child processes and browser
-     * instances when the application is shutting down.
-     */
-    const cleanup = () => {
-      logWithTimestamp("Cleaning up resources...");
-      if (ffmpegProcess) {
-        try {
-          ffmpegProcess.kill('SIGTERM');
-        } catch (e) {
-          logWithTimestamp(`Error stopping ffmpeg: ${e.message}`);
-        }
-      }
-
-      if (browser) {
-        try {
-          browser.close();
-        } catch (e) {
-          logWithTimestamp(`Error closing browser: ${e.message}`);
-        }
-      }
-    };
-
-    process.on('SIGINT', () => {
-      logWithTimestamp("SIGINT received, shutting down...");
-      cleanup();
-      process.exit(0);
+    browser.on('disconnected', () => {
+      logWithTimestamp("Browser disconnected, exiting.");
+      process.exit(1);
     });
 
     process.on('SIGTERM', () => {
       logWithTimestamp("SIGTERM received, shutting down...");
-      cleanup();
+      browser.disconnect();
       process.exit(0);
     });
 
-    logWithTimestamp("Launching browser...");
-    browser = await puppeteer.launch({
-      headless: false,
-      executablePath: '/snap/bin/chromium',
-      ignoreDefaultArgs: ['--enable-automation'],
-      args: [
-        '--no-sandbox',
-        '--disable-setuid-sandbox',
-        `--window-size=${WIDTH},${HEIGHT}`,
-        '--start-fullscreen',
-        '--autoplay-policy=no-user-gesture-required',
-        '--disable-infobars'
-      ]
-    });
-
-    const page = await browser.newPage();
+    const pages = await browser.pages();
+    const page = pages.length > 0 ? pages[0] : await browser.newPage();
     await page.setViewport({ width: WIDTH, height: HEIGHT });
 
     await page.evaluateOnNewDocument(() => {
       Object.defineProperty(navigator, 'webdriver', { get: () => false });
     });
 
-    logWithTimestamp("Navigating to page...");
-    // Utiliser l'URL configurée au lieu de l'URL codée en dur
-    await page.goto(STREAM_URL, { waitUntil: 'networkidle2' });
-    logWithTimestamp(`Page loaded: ${STREAM_URL}`);
-
-    // Fonction auxiliaire pour les actions souris et cacher le curseur
-    async function actions(page) {
-      // Masquer le curseur via CSS de façon robuste
-      try {
-        await page.evaluate(() => {
-          const style = document.createElement('style');
-          style.innerHTML = 'body, * { cursor: none !important; }';
-          document.head.appendChild(style);
-        });
-      } catch (e) {
-        logWithTimestamp('Warning: Could not inject cursor CSS: ' + e.message);
-      }
-      // Effectuer le clic et déplacer la souris
-      await page.mouse.click(1106, 822);
-      await page.mouse.move(1, 1);
-    }
-    await actions(page);
-      
-    await page.evaluate(() => {
-      document.body.style.zoom = '1.1';
-    });
-
-    ffmpegProcess = startFFmpeg();
-
-    logWithTimestamp('Stream started...');
-
-    const pingInterval = setInterval(() => {
-      try {
-        if (!browser || !browser.isConnected()) {
-          logWithTimestamp("Browser disconnected, attempting restart...");
-          clearInterval(pingInterval);
-          throw new Error("Browser disconnected");
-        }
-
-        logWithTimestamp(`Stream running for ${process.uptime().toFixed(2)} seconds`);
-
-        try {
-          const ffmpegRunning = execSync('pgrep -f "ffmpeg.*rtmp"').toString().trim() !== '';
-          if (!ffmpegRunning) {
-            logWithTimestamp("FFmpeg not running, restarting...");
-            ffmpegProcess = startFFmpeg();
-          }
-        } catch (error) {
-          logWithTimestamp("FFmpeg not running, restarting...");
-          ffmpegProcess = startFFmpeg();
-        }
-
-        execSync('bash ./rotate_logs.sh', { stdio: 'ignore' });
-      } catch (err) {
-        logWithTimestamp(`Error during ping: ${err.message}`);
-        if (++retryCount > MAX_RETRY_COUNT) {
-          logWithTimestamp(`Maximum retry count (${MAX_RETRY_COUNT}) reached, shutting down.`);
-          clearInterval(pingInterval);
-          process.exit(1);
-        }
-      }
-    }, 30000);
+    await showPage(page, STREAM_URL, ZOOM);
+    logWithTimestamp('Page ready.');
+    await startScreencast(page);
+    await reportReady(page);
+    listenForCommands(page);
   } catch (err) {
     logWithTimestamp(`Error during startup: ${err.message}`);
     logWithTimestamp(err.stack);
@@ -0,0 +1,602 @@
+#include "../includes/Capture.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const size_t kXwdHeaderFields = 25;
+static const size_t kXwdColorSize = 12;
+static const uint32_t kXwdVersion = 7;
+static const uint32_t kZPixmap = 2;
+static const uint32_t kLsbFirst = 0;
+static const int kPipeBytes = 1024 * 1024;
+static const int kRetryFrames = 30;
+static const long long kKeepaliveMs = 200;
+static const long long kReportMs = 60000;
+
+/**
+ * @brief Reads a big-endian 32 bit field of the XWD header
+ *
+ * @param header Start of the header
+ * @param index Index of the field
+ * @return uint32_t The field value
+ */
+static uint32_t xwdField(const unsigned char* header, size_t index) {
+    const unsigned char* p = header + index * 4;
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16)
+           | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param path The framebuffer file, e.g. <fbdir>/Xvfb_screen0
+ */
+XwdFramebuffer::XwdFramebuffer(const std::string& path)
+    : path(path), mapping(NULL), mappingSize(0), pixels(NULL), width(0), height(0), stride(0) {
+}
+
+/**
+ * @brief Destructor
+ */
+XwdFramebuffer::~XwdFramebuffer() {
+    close();
+}
+
+/**
+ * @brief Maps the framebuffer file and validates its layout
+ *
+ * Only 32 bits per pixel, LSB first ZPixmaps are accepted, which is
+ * what Xvfb produces for a 24 bit screen on little-endian hosts and
+ * matches ffmpeg's bgr0.
+ *
+ * @param expectedWidth The screen width the encoder is configured for
+ * @param expectedHeight The screen height the encoder is configured for
+ * @param error Receives the reason on failure
+ * @return bool True if the pixels are available
+ */
+bool XwdFramebuffer::open(int expectedWidth, int expectedHeight, std::string& error) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        error = path + ": " + strerror(errno);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    if (static_cast<size_t>(info.st_size) < kXwdHeaderFields * 4) {
+        ::close(fd);
+        error = path + " is not initialized yet";
+        return false;
+    }
+    mappingSize = static_cast<size_t>(info.st_size);
+    mapping = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = NULL;
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    const unsigned char* header = static_cast<const unsigned char*>(mapping);
+    size_t offset = xwdField(header, 0) + static_cast<size_t>(xwdField(header, 19)) * kXwdColorSize;
+    width = static_cast<int>(xwdField(header, 4));
+    height = static_cast<int>(xwdField(header, 5));
+    stride = xwdField(header, 12);
+    if (xwdField(header, 1) != kXwdVersion || xwdField(header, 2) != kZPixmap
+        || xwdField(header, 7) != kLsbFirst || xwdField(header, 11) != 32) {
+        error = path + " is not a 32 bpp little-endian XWD framebuffer";
+    } else if (width != expectedWidth || height != expectedHeight) {
+        std::ostringstream msg;
+        msg << path << " is " << width << "x" << height << ", expected "
+            << expectedWidth << "x" << expectedHeight;
+        error = msg.str();
+    } else if (stride < static_cast<size_t>(width) * 4 || offset + stride * height > mappingSize) {
+        error = path + " is truncated";
+    } else {
+        pixels = header + offset;
+        return true;
+    }
+    close();
+    return false;
+}
+
+/**
+ * @brief Unmaps the framebuffer
+ */
+void XwdFramebuffer::close() {
+    if (mapping) {
+        munmap(mapping, mappingSize);
+    }
+    mapping = NULL;
+    mappingSize = 0;
+    pixels = NULL;
+}
+
+/**
+ * @brief Unmaps the framebuffer and maps another file from now on
+ *
+ * @param newPath The framebuffer file of another X server
+ */
+void XwdFramebuffer::setPath(const std::string& newPath) {
+    close();
+    path = newPath;
+}
+
+/**
+ * @brief Tells whether the framebuffer is mapped
+ *
+ * @return bool True after a successful open()
+ */
+bool XwdFramebuffer::isOpen() const {
+    return pixels != NULL;
+}
+
+/**
+ * @brief Returns the first pixel row
+ *
+ * @return const unsigned char* The pixels, bgr0 rows of rowBytes()
+ */
+const unsigned char* XwdFramebuffer::data() const {
+    return pixels;
+}
+
+/**
+ * @brief Returns the distance between two rows
+ *
+ * @return size_t The stride in bytes
+ */
+size_t XwdFramebuffer::rowBytes() const {
+    return stride;
+}
+/**
+ * @brief Constructor
+ *
+ * The pacing thread is only started by start(), once the provider is
+ * fully constructed.
+ *
+ * @param provider Supplies the frames
+ * @param name Names the capture in the logs, e.g. "Framebuffer"
+ * @param fps The frame rate the encoder expects
+ */
+FramePacer::FramePacer(FrameProvider& provider, const std::string& name, int fps)
+    : provider(provider), name(name), fps(fps), pendingFd(-1), shuttingDown(false) {
+    memset(&counters, 0, sizeof(counters));
+}
+
+/**
+ * @brief Destructor
+ */
+FramePacer::~FramePacer() {
+    shutdown();
+}
+
+/**
+ * @brief Starts the pacing thread, which idles until an encoder starts
+ */
+void FramePacer::start() {
+    thread = std::thread(&FramePacer::pacerLoop, this);
+}
+
+/**
+ * @brief Hands the stdin pipe of a freshly started encoder to the pacer
+ *
+ * @param fds Our end of the encoder's stdin
+ */
+void FramePacer::addEncoder(const std::vector<int>& fds) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pendingFd >= 0) {
+            ::close(pendingFd);
+        }
+        pendingFd = fds.empty() ? -1 : fds[0];
+    }
+    wakeup.notify_one();
+}
+
+/**
+ * @brief Returns the pacing counters since the supervisor started
+ *
+ * @return CaptureStats A consistent snapshot of the counters
+ */
+CaptureStats FramePacer::stats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+/**
+ * @brief Stops the pacing thread and closes any unused pipe
+ */
+void FramePacer::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        if (pendingFd >= 0) {
+            ::close(pendingFd);
+            pendingFd = -1;
+        }
+    }
+    wakeup.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+/**
+ * @brief Body of the pacing thread: one session per encoder process
+ */
+void FramePacer::pacerLoop() {
+    for (;;) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!shuttingDown && pendingFd < 0) {
+                wakeup.wait(lock);
+            }
+            if (shuttingDown) {
+                return;
+            }
+            fd = pendingFd;
+            pendingFd = -1;
+        }
+        runSession(fd);
+    }
+}
+
+/**
+ * @brief Feeds the encoders until none is left
+ *
+ * The provider is polled on absolute monotonic deadlines at the output
+ * frame rate; when the encoder falls behind by more than a frame the
+ * schedule skips ahead instead of bursting. A frame is written only when
+ * it changed, or after kKeepaliveMs without one so the encoder never
+ * starves. The provider's report is logged every kReportMs.
+ *
+ * An encoder started meanwhile is fed alongside the current one, from
+ * the next frame, so a replacement can take over without a gap; an
+ * encoder is dropped as soon as its pipe fails.
+ *
+ * @param fd Our end of the first encoder's stdin
+ */
+void FramePacer::runSession(int fd) {
+    std::vector<int> outputs(1, fd);
+    long long periodNs = 1000000000LL / fps;
+    unsigned long skipped = 0;
+    long long lastSentMs = -1;
+    long long reportAt = monotonicMs() + kReportMs;
+    CaptureStats window;
+    struct timespec next;
+
+    memset(&window, 0, sizeof(window));
+    fcntl(fd, F_SETPIPE_SZ, kPipeBytes);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    provider.sessionStarted();
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                break;
+            }
+            if (pendingFd >= 0) {
+                fcntl(pendingFd, F_SETPIPE_SZ, kPipeBytes);
+                outputs.push_back(pendingFd);
+                pendingFd = -1;
+                lastSentMs = -1;
+            }
+        }
+        bool changed = false;
+        bool available = provider.acquireFrame(changed);
+        long long nowMs = monotonicMs();
+        bool send = available && (changed || lastSentMs < 0 || nowMs - lastSentMs >= kKeepaliveMs);
+        if (send) {
+            const std::vector<unsigned char>& frame = provider.frameData();
+            for (size_t i = 0; i < outputs.size();) {
+                if (writeFully(outputs[i], reinterpret_cast<const char*>(&frame[0]), frame.size())) {
+                    i++;
+                    continue;
+                }
+                ::close(outputs[i]);
+                outputs.erase(outputs.begin() + i);
+            }
+            if (outputs.empty()) {
+                break;
+            }
+            lastSentMs = nowMs;
+        }
+        window.slots++;
+        window.changedFrames += changed;
+        window.sentFrames += send;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.slots++;
+            counters.changedFrames += changed;
+            counters.sentFrames += send;
+        }
+        if (nowMs >= reportAt) {
+            logMessage(provider.describeWindow(window));
+            memset(&window, 0, sizeof(window));
+            reportAt = nowMs + kReportMs;
+        }
+
+        struct timespec now;
+        long long nextNs = static_cast<long long>(next.tv_sec) * 1000000000LL + next.tv_nsec + periodNs;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long nowNs = static_cast<long long>(now.tv_sec) * 1000000000LL + now.tv_nsec;
+        if (nowNs - nextNs > periodNs) {
+            skipped += static_cast<unsigned long>((nowNs - nextNs) / periodNs);
+            nextNs = nowNs;
+        }
+        next.tv_sec = static_cast<time_t>(nextNs / 1000000000LL);
+        next.tv_nsec = static_cast<long>(nextNs % 1000000000LL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+    }
+    provider.sessionEnded();
+    for (size_t i = 0; i < outputs.size(); i++) {
+        ::close(outputs[i]);
+    }
+    std::ostringstream msg;
+    msg << name << " capture disconnected, " << skipped << " frame periods skipped";
+    logMessage(msg.str());
+}
+
+
+/**
+ * @brief Constructor
+ *
+ * @param capture The capture notified of X server restarts
+ */
+FramebufferCapture::ServerObserver::ServerObserver(FramebufferCapture& capture) : capture(capture) {
+}
+
+/**
+ * @brief Called when the X server (re)starts: the pacer maps the new file
+ *
+ * @param pid The X server process
+ * @param fds Unused, the X server has no pipes
+ */
+void FramebufferCapture::ServerObserver::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    (void)fds;
+    std::lock_guard<std::mutex> lock(capture.mutex);
+    capture.serverGeneration++;
+}
+
+/**
+ * @brief Called when the X server exits: the old mapping is dropped
+ *
+ * The restarted server truncates the file, so the pacer must not keep
+ * reading the previous mapping.
+ *
+ * @param status The wait status
+ */
+void FramebufferCapture::ServerObserver::childExited(int status) {
+    (void)status;
+    std::lock_guard<std::mutex> lock(capture.mutex);
+    capture.serverGeneration++;
+}
+
+/**
+ * @brief Constructor
+ *
+ * Starts the frame pacer, which idles until the encoder starts.
+ *
+ * @param fbDir The directory given to Xvfb with -fbdir
+ * @param width The screen width
+ * @param height The screen height
+ * @param outputWidth The width of the frames sent to the encoder
+ * @param outputHeight The height of the frames sent to the encoder
+ * @param fps The frame rate the encoder expects
+ */
+FramebufferCapture::FramebufferCapture(const std::string& fbDir, int width, int height,
+                                       int outputWidth, int outputHeight, int fps)
+    : framebuffer(fbDir + "/Xvfb_screen0"), damage(width, height),
+      converter(width, height, outputWidth, outputHeight), server(*this), width(width), height(height),
+      outputWidth(outputWidth), outputHeight(outputHeight), serverGeneration(0),
+      sourcePath(fbDir + "/Xvfb_screen0"), mappedGeneration(0), retryIn(0), sentBlack(false),
+      pacer(*this, "Framebuffer", fps) {
+    converted.resize(converter.frameSize());
+    pacer.start();
+}
+
+/**
+ * @brief Destructor
+ */
+FramebufferCapture::~FramebufferCapture() {
+    shutdown();
+}
+
+/**
+ * @brief Returns the observer to attach to the X server child
+ *
+ * @return ChildObserver* The observer, owned by the capture
+ */
+ChildObserver* FramebufferCapture::serverObserver() {
+    return &server;
+}
+
+/**
+ * @brief Captures another X server from the next frame on
+ *
+ * The pacer maps the new framebuffer between two frames, so the encoder
+ * gets the last frame of one screen followed by the first of the other.
+ *
+ * @param fbDir The directory that X server was given with -fbdir
+ */
+void FramebufferCapture::setSource(const std::string& fbDir) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sourcePath = fbDir + "/Xvfb_screen0";
+    serverGeneration++;
+}
+
+/**
+ * @brief Returns the capture counters since the supervisor started
+ *
+ * @return CaptureStats A consistent snapshot of the counters
+ */
+CaptureStats FramebufferCapture::stats() {
+    return pacer.stats();
+}
+
+/**
+ * @brief Hands the stdin pipe of a freshly started encoder to the pacer
+ *
+ * @param pid The encoder process
+ * @param fds Our end of the encoder's stdin
+ */
+void FramebufferCapture::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    pacer.addEncoder(fds);
+}
+
+/**
+ * @brief Called when the encoder exits; the pacer sees EPIPE on its own
+ *
+ * @param status The wait status
+ */
+void FramebufferCapture::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Stops the pacing thread and closes any unused pipe
+ */
+void FramebufferCapture::shutdown() {
+    pacer.shutdown();
+}
+
+/**
+ * @brief Writes the capture counters
+ *
+ * @param out The response body
+ * @param labels Label pairs added to every sample
+ */
+void FramebufferCapture::writeMetrics(std::ostream& out, const std::string& labels) {
+    CaptureStats snapshot = stats();
+    writeMetricHeader(out, "pagestreamer_capture_slots_total", "counter", "Frame periods of the capture");
+    writeMetricSample(out, "pagestreamer_capture_slots_total", labels, snapshot.slots);
+    writeMetricHeader(out, "pagestreamer_capture_changed_frames_total", "counter", "Frames where the screen changed");
+    writeMetricSample(out, "pagestreamer_capture_changed_frames_total", labels, snapshot.changedFrames);
+    writeMetricHeader(out, "pagestreamer_capture_sent_frames_total", "counter", "Frames written to the encoder");
+    writeMetricSample(out, "pagestreamer_capture_sent_frames_total", labels, snapshot.sentFrames);
+}
+
+/**
+ * @brief Writes the capture section of pagestreamer stats
+ *
+ * @param out The response body
+ */
+void FramebufferCapture::writeReport(std::ostream& out) {
+    CaptureStats snapshot = stats();
+    out << "Capture: framebuffer, " << converter.kernelName() << " conversion\n";
+    out << "  " << snapshot.changedFrames << " of " << snapshot.slots << " frames changed ("
+        << (snapshot.slots ? snapshot.changedFrames * 100 / snapshot.slots : 0) << "%), "
+        << snapshot.sentFrames << " sent to the encoder\n";
+}
+
+/**
+ * @brief Starts tracking damage for a new encoder session
+ *
+ * The framebuffer is mapped again on the first frame.
+ */
+void FramebufferCapture::sessionStarted() {
+    mappedGeneration = 0;
+    retryIn = 0;
+    sentBlack = false;
+    lastError.clear();
+    damage.reset();
+    logMessage(std::string("Framebuffer capture connected to the encoder, converting with ")
+               + converter.kernelName());
+}
+
+/**
+ * @brief Checks the screen for changed tiles
+ *
+ * X server restarts are seen through serverGeneration before the new
+ * server can truncate the file; the mapping is retried every
+ * kRetryFrames while it is not available, and black frames stand in
+ * meanwhile.
+ *
+ * @param changed Set to true if a tile changed, or on the first black frame
+ * @return bool Always true, there is always a frame to send
+ */
+bool FramebufferCapture::acquireFrame(bool& changed) {
+    unsigned long generation;
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation = serverGeneration;
+        if (generation != mappedGeneration) {
+            path = sourcePath;
+        }
+    }
+    if (generation != mappedGeneration) {
+        framebuffer.setPath(path);
+        mappedGeneration = generation;
+        retryIn = 0;
+    }
+    if (!framebuffer.isOpen() && retryIn-- <= 0) {
+        std::string error;
+        if (framebuffer.open(width, height, error)) {
+            logMessage("Framebuffer mapped");
+            damage.reset();
+            lastError.clear();
+        } else if (error != lastError) {
+            logMessage("Framebuffer not available: " + error);
+            lastError = error;
+        }
+        retryIn = kRetryFrames;
+    }
+    const unsigned char* frame = framebuffer.data();
+    changed = frame ? damage.update(frame, framebuffer.rowBytes()) > 0 : !sentBlack;
+    return true;
+}
+
+/**
+ * @brief Converts the mapped frame, straight from the mapping
+ *
+ * @return const vector<unsigned char>& The yuv420p frame, black while
+ *         the framebuffer is not mapped
+ */
+const std::vector<unsigned char>& FramebufferCapture::frameData() {
+    const unsigned char* frame = framebuffer.data();
+    sentBlack = !frame;
+    if (!frame) {
+        if (blackFrame.empty()) {
+            size_t luma = static_cast<size_t>(outputWidth) * outputHeight;
+            blackFrame.assign(converter.frameSize(), 128);
+            memset(&blackFrame[0], 16, luma);
+        }
+        return blackFrame;
+    }
+    converter.convert(frame, framebuffer.rowBytes(), &converted[0]);
+    return converted;
+}
+
+/**
+ * @brief Formats the changed-frame ratio of the last report window
+ *
+ * @param window The counters since the previous report
+ * @return string The line to log
+ */
+std::string FramebufferCapture::describeWindow(const CaptureStats& window) {
+    std::ostringstream msg;
+    msg << "Capture: " << (window.changedFrames * 100 / window.slots) << "% of frames changed ("
+        << window.changedFrames << "/" << window.slots << "), "
+        << window.sentFrames << " sent to the encoder";
+    return msg.str();
+}
+
+/**
+ * @brief Unmaps the framebuffer once the last encoder is gone
+ */
+void FramebufferCapture::sessionEnded() {
+    framebuffer.close();
+}
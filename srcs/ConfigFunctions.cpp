@@ -30,9 +30,10 @@ std::string readPassword() {
  * 
  * Displays a list of platforms and prompts the user to select one
  * 
+ * @param configManager The profile to update
  * @return bool True if configuration was successful
  */
-bool configurePlatform() {
+bool configurePlatform(ConfigManager& configManager) {
     struct PlatformInfo {
         std::string name;
         std::string rtmpUrl;
@@ -66,17 +67,17 @@ bool configurePlatform() {
         std::getline(std::cin, rtmpUrl);
     }
     std::cout << "Setting platform to: " << platforms[selection - 1].name << std::endl;
-    ConfigManager configManager;
-    return configManager.updateEnvFile("PLATFORM", rtmpUrl);
+    return configManager.setValue("PLATFORM", rtmpUrl);
 }
 
 /**
  * @brief Configures the streaming key by prompting the user
  * 
+ * @param configManager The profile to update
  * @param inConfigSequence Flag to indicate if this is part of a full config sequence
  * @return bool True if configuration was successful
  */
-bool configureStreamKey(bool inConfigSequence) {
+bool configureStreamKey(ConfigManager& configManager, bool inConfigSequence) {
     std::string streamKey;
     if (!inConfigSequence) {
         std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
@@ -91,8 +92,7 @@ bool configureStreamKey(bool inConfigSequence) {
         std::cout << RED "Stream key cannot be empty" RESET << std::endl;
         return false;
     }
-    ConfigManager configManager;
-    return configManager.updateEnvFile("STREAM_KEY", streamKey);
+    return configManager.setValue("STREAM_KEY", streamKey);
 }
 
 /**
@@ -100,9 +100,10 @@ bool configureStreamKey(bool inConfigSequence) {
  * 
  * Prompts the user to enter the URL of the website they want to stream
  * 
+ * @param configManager The profile to update
  * @return bool True if configuration was successful
  */
-bool configureStreamUrl() {
+bool configureStreamUrl(ConfigManager& configManager) {
     std::string streamUrl;
     std::cout << B CYAN "Stream URL Configuration" RESET << std::endl;
     std::cout << YELLOW "Enter the URL of the website you want to stream: " RESET;
@@ -115,6 +116,96 @@ bool configureStreamUrl() {
         std::cout << YELLOW "URL should start with http:// or https://, adding https://" RESET << std::endl;
         streamUrl = "https://" + streamUrl;
     }
-    ConfigManager configManager;
-    return configManager.updateEnvFile("STREAM_URL", streamUrl);
+    return configManager.setValue("STREAM_URL", streamUrl);
+}
+
+/**
+ * @brief Configures the CPUs the instance is pinned to
+ * 
+ * Accepts a CPU list such as 0-3,8. An empty answer removes the pinning.
+ * 
+ * @param configManager The profile to update
+ * @return bool True if configuration was successful
+ */
+bool configureCpuSet(ConfigManager& configManager) {
+    std::string cpus;
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    std::cout << B CYAN "CPU Set Configuration" RESET << std::endl;
+    std::cout << YELLOW "Enter the CPUs for this instance (e.g. 0-3,8), empty for all: " RESET;
+    std::getline(std::cin, cpus);
+    return configManager.setValue("CPUSET", cpus);
+}
+
+/**
+ * @brief Configures additional destinations for simulcasting
+ * 
+ * The stream is encoded once and sent to PLATFORM/STREAM_KEY plus each
+ * of these full RTMP URLs. An empty answer removes them.
+ * 
+ * @param configManager The profile to update
+ * @return bool True if configuration was successful
+ */
+bool configureDestinations(ConfigManager& configManager) {
+    std::string destinations;
+    std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    std::cout << B CYAN "Additional Destinations Configuration" RESET << std::endl;
+    std::cout << YELLOW "Enter extra RTMP URLs including their stream key, separated by commas" << std::endl;
+    std::cout << "(e.g. rtmp://live.twitch.tv/app/KEY), empty for none: " RESET;
+    std::getline(std::cin, destinations);
+    return configManager.setValue("DESTINATIONS", destinations);
+}
+
+/**
+ * @brief Configures how the display is captured
+ * 
+ * x11grab reads the screen through the X protocol; fbdir maps the Xvfb
+ * framebuffer directly, which saves a full frame copy per frame;
+ * screencast runs the browser headless, without any X server, and takes
+ * the frames it renders.
+ * 
+ * @param configManager The profile to update
+ * @return bool True if configuration was successful
+ */
+bool configureCapture(ConfigManager& configManager) {
+    size_t selection = 0;
+    std::cout << B CYAN "Capture Configuration" RESET << std::endl;
+    std::cout << CYAN "1. x11grab (X11 protocol, default)" RESET << std::endl;
+    std::cout << CYAN "2. fbdir (memory-mapped Xvfb framebuffer, less CPU)" RESET << std::endl;
+    std::cout << CYAN "3. screencast (headless browser frames, no X server)" RESET << std::endl;
+    std::cout << YELLOW "Enter number (1-3): " RESET;
+    std::cin >> selection;
+    if (std::cin.fail() || selection < 1 || selection > 3) {
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::cout << RED "Invalid selection. Using x11grab as default." RESET << std::endl;
+        selection = 1;
+    }
+    const char* captures[] = { CAPTURE_X11GRAB, CAPTURE_FBDIR, CAPTURE_SCREENCAST };
+    return configManager.setValue("CAPTURE", captures[selection - 1]);
+}
+
+/**
+ * @brief Configures the resolution of the streamed video
+ * 
+ * x11grab and fbdir render the page at 1080p and scale a smaller output
+ * down before encoding; the screencast renders it at the output size.
+ * Other sizes are set with --config set OUTPUT_RESOLUTION=WIDTHxHEIGHT.
+ * 
+ * @param configManager The profile to update
+ * @return bool True if configuration was successful
+ */
+bool configureOutputResolution(ConfigManager& configManager) {
+    size_t selection = 0;
+    std::cout << B CYAN "Output Resolution Configuration" RESET << std::endl;
+    std::cout << CYAN "1. 1920x1080 (default)" RESET << std::endl;
+    std::cout << CYAN "2. 1280x720 (less bandwidth and CPU)" RESET << std::endl;
+    std::cout << YELLOW "Enter number (1-2): " RESET;
+    std::cin >> selection;
+    if (std::cin.fail() || selection < 1 || selection > 2) {
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::cout << RED "Invalid selection. Using 1920x1080 as default." RESET << std::endl;
+        selection = 1;
+    }
+    return configManager.setValue("OUTPUT_RESOLUTION", selection == 2 ? "1280x720" : "1920x1080");
 }
@@ -1,21 +1,35 @@
 #include "../includes/ConfigManager.hpp"
+#include "../includes/Utils.hpp"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
+#include <cstdio>
 #include <cstdlib>
 #include <cerrno>
 #include <cstring>
 #include <limits>
+#include <fcntl.h>
 #include <unistd.h>
 #include <termios.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+static const char* kKnownKeys[] = {
+    "PLATFORM", "STREAM_KEY", "STREAM_URL", "DESTINATIONS", "CPUSET",
+    "CAPTURE", "OUTPUT_RESOLUTION", "BROWSER_PATH", "ENCODER_TUNING",
+    "FREEZE_TIMEOUT", "BROWSER_MEMORY_LIMIT", "BROWSER_RECYCLE_HOURS"
+};
 
 /**
  * @brief Constructor
  * 
  * Initializes the ConfigManager with the path to the .env file.
+ * 
+ * @param envPath The .env profile of the instance
  */
-ConfigManager::ConfigManager() {
-    envPath = std::string(getenv("HOME")) + "/.pagestreamer/.env";
+ConfigManager::ConfigManager(const std::string& envPath) : envPath(envPath) {
 }
 
 /**
@@ -25,116 +39,535 @@ ConfigManager::~ConfigManager() {
 }
 
 /**
- * @brief Updates a value in the .env file
- * 
- * This function reads the .env file, finds the specified key,
- * and updates its value. If the key doesn't exist, it adds it.
- * 
- * @param key The environment variable name to update
- * @param value The new value to set
- * @return bool True if successful, false otherwise
+ * @brief Constructor
+ *
+ * Every field starts at its default; platform and stream key have none.
  */
-bool ConfigManager::updateEnvFile(const std::string& key, const std::string& value) {
-    std::string tempPath = envPath + ".tmp";
-    std::string dirPath = std::string(getenv("HOME")) + "/.pagestreamer";
-    std::string mkdirCmd = "mkdir -p \"" + dirPath + "\"";
-    std::string chmodCmd = "chmod 755 \"" + dirPath + "\"";
-    system(mkdirCmd.c_str());
-    system(chmodCmd.c_str());
-    if (access(envPath.c_str(), F_OK) != 0) {
-        std::ofstream createEnv(envPath.c_str());
-        if (!createEnv.is_open()) {
-            std::cerr << RED "Error: Could not create .env file. Check permissions for " 
-                     << dirPath << RESET << std::endl;
-            std::cerr << YELLOW "Try running: mkdir -p ~/.pagestreamer && touch ~/.pagestreamer/.env "
-                     << "&& chmod 644 ~/.pagestreamer/.env" RESET << std::endl;
+StreamConfig::StreamConfig()
+    : capture(CAPTURE_X11GRAB), outputWidth(SCREEN_WIDTH), outputHeight(SCREEN_HEIGHT), encoderTuning(true),
+      freezeTimeout(DEFAULT_FREEZE_TIMEOUT), browserMemoryLimit(DEFAULT_BROWSER_MEMORY_LIMIT),
+      browserRecycleHours(0) {
+}
+
+/**
+ * @brief Tells whether the profile has everything needed to stream
+ *
+ * @return bool True once the platform and stream key are configured
+ */
+bool StreamConfig::isComplete() const {
+    return !platform.empty() && !streamKey.empty();
+}
+
+/**
+ * @brief Lists the RTMP URLs the stream is sent to
+ *
+ * The primary destination is PLATFORM/STREAM_KEY, followed by the
+ * DESTINATIONS URLs (which include their own key).
+ *
+ * @return vector<string> The destination URLs
+ */
+std::vector<std::string> StreamConfig::destinationUrls() const {
+    std::vector<std::string> urls(1, platform + "/" + streamKey);
+    urls.insert(urls.end(), destinations.begin(), destinations.end());
+    return urls;
+}
+
+/**
+ * @brief Removes leading and trailing blanks
+ *
+ * @param text The text to trim
+ * @return string The trimmed text
+ */
+static std::string trim(const std::string& text) {
+    size_t first = text.find_first_not_of(" \t");
+    size_t last = text.find_last_not_of(" \t");
+    return first == std::string::npos ? "" : text.substr(first, last - first + 1);
+}
+
+/**
+ * @brief Splits a comma-separated list, skipping empty entries
+ *
+ * @param list The list
+ * @return vector<string> The trimmed entries
+ */
+static std::vector<std::string> splitList(const std::string& list) {
+    std::vector<std::string> entries;
+    std::istringstream stream(list);
+    std::string entry;
+    while (std::getline(stream, entry, ',')) {
+        entry = trim(entry);
+        if (!entry.empty()) {
+            entries.push_back(entry);
+        }
+    }
+    return entries;
+}
+
+/**
+ * @brief Checks that a URL is an RTMP(S) URL
+ *
+ * @param url The URL
+ * @return bool True for rtmp://host... or rtmps://host...
+ */
+static bool isRtmpUrl(const std::string& url) {
+    return (url.compare(0, 7, "rtmp://") == 0 && url.length() > 7)
+           || (url.compare(0, 8, "rtmps://") == 0 && url.length() > 8);
+}
+
+/**
+ * @brief Checks a CPU list such as 0-3,8
+ *
+ * @param cpus The list
+ * @return bool True if every entry is a CPU number or an ascending range
+ */
+static bool isCpuList(const std::string& cpus) {
+    std::vector<std::string> entries = splitList(cpus);
+    for (size_t i = 0; i < entries.size(); i++) {
+        unsigned int first = 0;
+        unsigned int last = 0;
+        char extra = 0;
+        int fields = sscanf(entries[i].c_str(), "%u-%u%c", &first, &last, &extra);
+        if (entries[i].find_first_not_of("0123456789-") != std::string::npos
+            || (fields != 1 && fields != 2) || (fields == 2 && last < first)) {
             return false;
         }
-        createEnv.close();
-        std::string chmodFileCmd = "chmod 644 \"" + envPath + "\"";
-        system(chmodFileCmd.c_str());
     }
-    std::ifstream inFile(envPath.c_str());
-    std::ofstream outFile(tempPath.c_str());
-    bool keyFound = false;
+    return !entries.empty();
+}
+
+/**
+ * @brief Parses an output resolution such as 1280x720
+ *
+ * @param value The resolution
+ * @param width Receives the width
+ * @param height Receives the height
+ * @return bool True for even sizes no larger than the screen
+ */
+static bool parseResolution(const std::string& value, int& width, int& height) {
+    char extra = 0;
+    return sscanf(value.c_str(), "%dx%d%c", &width, &height, &extra) == 2
+           && width > 0 && height > 0 && width % 2 == 0 && height % 2 == 0
+           && width <= MAX_SCREENCAST_WIDTH && height <= MAX_SCREENCAST_HEIGHT;
+}
+
+/**
+ * @brief Parses a whole number setting such as FREEZE_TIMEOUT
+ *
+ * @param value The text of the setting
+ * @param maximum The largest accepted value
+ * @param number Receives the number
+ * @return bool True for a whole number up to maximum, 0 included
+ */
+static bool parseWholeNumber(const std::string& value, int maximum, int& number) {
+    char extra = 0;
+    return value.size() <= 9 && sscanf(value.c_str(), "%d%c", &number, &extra) == 1
+           && value.find_first_not_of("0123456789") == std::string::npos
+           && number >= 0 && number <= maximum;
+}
+
+/**
+ * @brief Checks one setting before it is stored
+ *
+ * An empty value is always accepted and removes the setting.
+ *
+ * @param key The setting name
+ * @param value The new value
+ * @param error Receives the reason when the value is rejected
+ * @return bool True if the value can be stored
+ */
+bool validateConfigValue(const std::string& key, const std::string& value, std::string& error) {
+    int width;
+    int height;
+    int number;
+    bool known = false;
+    for (size_t i = 0; i < sizeof(kKnownKeys) / sizeof(kKnownKeys[0]); i++) {
+        known = known || key == kKnownKeys[i];
+    }
+    if (!known) {
+        error = "unknown setting " + key;
+    } else if (value.empty()) {
+        return true;
+    } else if (value.find_first_of("\r\n") != std::string::npos) {
+        error = key + " cannot contain a line break";
+    } else if (key == "PLATFORM" && !isRtmpUrl(value)) {
+        error = "PLATFORM must be an rtmp:// or rtmps:// URL";
+    } else if (key == "STREAM_KEY" && value.find_first_of(" \t") != std::string::npos) {
+        error = "STREAM_KEY cannot contain spaces";
+    } else if (key == "STREAM_URL" && value.find("://") == std::string::npos) {
+        error = "STREAM_URL must be a full URL, e.g. https://example.com/";
+    } else if (key == "CPUSET" && !isCpuList(value)) {
+        error = "CPUSET must be a CPU list such as 0-3,8";
+    } else if (key == "CAPTURE" && value != CAPTURE_X11GRAB && value != CAPTURE_FBDIR
+               && value != CAPTURE_SCREENCAST) {
+        error = "CAPTURE must be " CAPTURE_X11GRAB ", " CAPTURE_FBDIR " or " CAPTURE_SCREENCAST;
+    } else if (key == "OUTPUT_RESOLUTION" && !parseResolution(value, width, height)) {
+        std::ostringstream msg;
+        msg << "OUTPUT_RESOLUTION must be an even WIDTHxHEIGHT up to " << MAX_SCREENCAST_WIDTH << "x"
+            << MAX_SCREENCAST_HEIGHT;
+        error = msg.str();
+    } else if (key == "BROWSER_PATH" && value[0] != '/') {
+        error = "BROWSER_PATH must be an absolute path";
+    } else if (key == "ENCODER_TUNING" && value != TUNING_AUTO && value != TUNING_OFF) {
+        error = "ENCODER_TUNING must be " TUNING_AUTO " or " TUNING_OFF;
+    } else if (key == "FREEZE_TIMEOUT" && !parseWholeNumber(value, MAX_FREEZE_TIMEOUT, number)) {
+        std::ostringstream msg;
+        msg << "FREEZE_TIMEOUT must be a number of seconds up to " << MAX_FREEZE_TIMEOUT << ", 0 to turn it off";
+        error = msg.str();
+    } else if (key == "BROWSER_MEMORY_LIMIT" && !parseWholeNumber(value, MAX_BROWSER_MEMORY_LIMIT, number)) {
+        std::ostringstream msg;
+        msg << "BROWSER_MEMORY_LIMIT must be a number of MiB up to " << MAX_BROWSER_MEMORY_LIMIT
+            << ", 0 to turn it off";
+        error = msg.str();
+    } else if (key == "BROWSER_RECYCLE_HOURS" && !parseWholeNumber(value, MAX_BROWSER_RECYCLE_HOURS, number)) {
+        std::ostringstream msg;
+        msg << "BROWSER_RECYCLE_HOURS must be a number of hours up to " << MAX_BROWSER_RECYCLE_HOURS
+            << ", 0 to turn it off";
+        error = msg.str();
+    } else {
+        std::vector<std::string> urls = key == "DESTINATIONS" ? splitList(value) : std::vector<std::string>();
+        for (size_t i = 0; i < urls.size(); i++) {
+            if (!isRtmpUrl(urls[i])) {
+                error = "DESTINATIONS entry " + urls[i] + " is not an rtmp:// or rtmps:// URL";
+                return false;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Builds the typed configuration from raw .env entries
+ *
+ * Invalid values are reported and replaced by their default; unknown
+ * keys are ignored. Only the screencast renders the page at the output
+ * size, so the other captures stream at most SCREEN_WIDTHxSCREEN_HEIGHT.
+ *
+ * @param values The KEY=VALUE entries
+ * @param config Receives the settings
+ * @param errors Receives one message per invalid value
+ * @return bool True if every value was valid
+ */
+bool parseConfig(const std::map<std::string, std::string>& values, StreamConfig& config,
+                 std::vector<std::string>& errors) {
+    config = StreamConfig();
+    for (std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it) {
+        const std::string& key = it->first;
+        const std::string& value = it->second;
+        std::string error;
+        if (!validateConfigValue(key, value, error)) {
+            if (error.compare(0, 7, "unknown") != 0) {
+                errors.push_back(error);
+            }
+        } else if (key == "PLATFORM") {
+            config.platform = value;
+        } else if (key == "STREAM_KEY") {
+            config.streamKey = value;
+        } else if (key == "STREAM_URL") {
+            config.streamUrl = value;
+        } else if (key == "DESTINATIONS") {
+            config.destinations = splitList(value);
+        } else if (key == "CPUSET") {
+            config.cpuSet = value;
+        } else if (key == "CAPTURE") {
+            config.capture = value;
+        } else if (key == "OUTPUT_RESOLUTION") {
+            parseResolution(value, config.outputWidth, config.outputHeight);
+        } else if (key == "BROWSER_PATH") {
+            config.browserPath = value;
+        } else if (key == "ENCODER_TUNING") {
+            config.encoderTuning = value == TUNING_AUTO;
+        } else if (key == "FREEZE_TIMEOUT") {
+            parseWholeNumber(value, MAX_FREEZE_TIMEOUT, config.freezeTimeout);
+        } else if (key == "BROWSER_MEMORY_LIMIT") {
+            parseWholeNumber(value, MAX_BROWSER_MEMORY_LIMIT, config.browserMemoryLimit);
+        } else if (key == "BROWSER_RECYCLE_HOURS") {
+            parseWholeNumber(value, MAX_BROWSER_RECYCLE_HOURS, config.browserRecycleHours);
+        }
+    }
+    if (config.capture != CAPTURE_SCREENCAST
+        && (config.outputWidth > SCREEN_WIDTH || config.outputHeight > SCREEN_HEIGHT)) {
+        std::ostringstream msg;
+        msg << "OUTPUT_RESOLUTION above " << SCREEN_WIDTH << "x" << SCREEN_HEIGHT << " needs CAPTURE="
+            << CAPTURE_SCREENCAST;
+        errors.push_back(msg.str());
+        config.outputWidth = SCREEN_WIDTH;
+        config.outputHeight = SCREEN_HEIGHT;
+    }
+    return errors.empty();
+}
+
+/**
+ * @brief Reads and validates the profile
+ *
+ * @param config Receives the settings, defaults if the file is missing
+ * @param errors Receives one message per invalid value
+ * @return bool True if the file was read and every value is valid
+ */
+bool ConfigManager::load(StreamConfig& config, std::vector<std::string>& errors) const {
+    std::map<std::string, std::string> values;
+    bool found = loadEnv(values);
+    return parseConfig(values, config, errors) && found;
+}
+
+/**
+ * @brief Stages a setting for the next commit()
+ *
+ * @param key The setting name
+ * @param value The new value, empty to remove the setting
+ * @return bool False if the value is invalid, nothing is staged then
+ */
+bool ConfigManager::setValue(const std::string& key, const std::string& value) {
+    std::string error;
+    if (!validateConfigValue(key, value, error)) {
+        std::cerr << RED "Error: " << error << RESET << std::endl;
+        return false;
+    }
+    pending[key] = value;
+    return true;
+}
+
+/**
+ * @brief Writes every staged setting to the .env file at once
+ *
+ * The file is rewritten under an exclusive lock on .env.lock so
+ * concurrent writers never lose each other's keys. Other lines are kept
+ * as they are. The new content goes to a temporary file that is synced
+ * and renamed over the profile, then the directory is synced, so readers
+ * see either the old or the new profile and never a partial one.
+ *
+ * @return bool True if successful, false otherwise
+ */
+bool ConfigManager::commit() {
+    std::string dirPath = envPath.substr(0, envPath.rfind('/'));
+    std::string tempPath = envPath + ".tmp";
+    std::string lockPath = envPath + ".lock";
+    std::ostringstream content;
+    std::map<std::string, std::string> remaining(pending);
+    struct stat info;
+    mode_t mode = 0644;
     std::string line;
-    if (!outFile.is_open()) {
-        std::cerr << RED "Error: Could not open .env file for writing" RESET << std::endl;
-        std::cerr << YELLOW "Debug: Check if ~/.pagestreamer directory is writable with 'ls -la ~/.pagestreamer'" RESET << std::endl;
-        std::cerr << YELLOW "Try running: sudo chown -R $USER:$USER ~/.pagestreamer" RESET << std::endl;
+
+    if (pending.empty()) {
+        return true;
+    }
+    if (mkdir(dirPath.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << RED "Error: Could not create " << dirPath << ": " << strerror(errno) << RESET << std::endl;
         return false;
     }
-    if (inFile.is_open()) {
-        while (std::getline(inFile, line)) {
-            if (line.find(key + "=") == 0) {
-                outFile << key << "=" << value << std::endl;
-                keyFound = true;
-            } else {
-                outFile << line << std::endl;
+    chmod(dirPath.c_str(), 0755);
+    int lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX) != 0) {
+        std::cerr << RED "Error: Could not lock " << lockPath << ": " << strerror(errno) << RESET << std::endl;
+        if (lockFd >= 0) {
+            close(lockFd);
+        }
+        return false;
+    }
+    if (stat(envPath.c_str(), &info) == 0) {
+        mode = info.st_mode & 07777;
+    }
+    std::ifstream inFile(envPath.c_str());
+    while (std::getline(inFile, line)) {
+        size_t separator = line.find('=');
+        std::string key = separator == std::string::npos ? "" : line.substr(0, separator);
+        if (!pending.count(key)) {
+            content << line << "\n";
+        } else if (remaining.count(key)) {
+            if (!remaining[key].empty()) {
+                content << key << "=" << remaining[key] << "\n";
             }
+            remaining.erase(key);
+        }
+    }
+    inFile.close();
+    for (std::map<std::string, std::string>::const_iterator it = remaining.begin(); it != remaining.end(); ++it) {
+        if (!it->second.empty()) {
+            content << it->first << "=" << it->second << "\n";
         }
-        inFile.close();
     }
-    if (!keyFound) {
-        outFile << key << "=" << value << std::endl;
+    std::string text = content.str();
+    int tempFd = open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, mode);
+    bool written = tempFd >= 0 && fchmod(tempFd, mode) == 0 && writeFully(tempFd, text.c_str(), text.size())
+                   && fsync(tempFd) == 0;
+    if (tempFd >= 0) {
+        close(tempFd);
     }
-    outFile.close();
-    if (rename(tempPath.c_str(), envPath.c_str()) != 0) {
-        std::cerr << RED "Error: Could not update .env file" RESET << std::endl;
-        std::cerr << YELLOW "Debug: Temporary file exists: " << (access(tempPath.c_str(), F_OK) == 0 ? "Yes" : "No") << RESET << std::endl;
-        std::cerr << YELLOW "Debug: Error code: " << errno << " (" << strerror(errno) << ")" RESET << std::endl;
+    if (!written || rename(tempPath.c_str(), envPath.c_str()) != 0) {
+        std::cerr << RED "Error: Could not update " << envPath << ": " << strerror(errno) << RESET << std::endl;
+        std::cerr << YELLOW "Try running: sudo chown -R $USER:$USER ~/.pagestreamer" RESET << std::endl;
+        unlink(tempPath.c_str());
+        close(lockFd);
         return false;
     }
+    int dirFd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    close(lockFd);
+    pending.clear();
     return true;
 }
 
+/**
+ * @brief Reads every KEY=VALUE pair of the .env file
+ * 
+ * Lines without '=' and keys with an empty value are skipped.
+ * 
+ * @param values Map filled with the parsed entries
+ * @return bool False if the file cannot be opened
+ */
+bool ConfigManager::loadEnv(std::map<std::string, std::string>& values) const {
+    std::ifstream envFile(envPath.c_str());
+    if (!envFile.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(envFile, line)) {
+        size_t separator = line.find('=');
+        if (separator != std::string::npos && separator > 0 && separator + 1 < line.length()) {
+            values[line.substr(0, separator)] = line.substr(separator + 1);
+        }
+    }
+    envFile.close();
+    return true;
+}
+
+/**
+ * @brief Masks a secret, keeping a few characters to recognize it
+ *
+ * @param secret The secret
+ * @return string The masked value
+ */
+static std::string maskSecret(const std::string& secret) {
+    if (secret.length() > 8) {
+        return secret.substr(0, 4) + std::string(secret.length() - 8, '*') + secret.substr(secret.length() - 4);
+    } else if (secret.length() > 1) {
+        return secret.substr(0, 1) + std::string(secret.length() - 2, '*') + secret.substr(secret.length() - 1);
+    }
+    return secret;
+}
+
 /**
  * @brief Displays the current configuration values
  * 
- * Shows the platform, stream URL, and masked stream key
+ * Shows the platform, stream URL, and masked stream key, followed by
+ * any value that failed validation.
  * 
  * @return bool Always returns true
  */
 bool ConfigManager::showConfiguration() {
-    std::ifstream envFile(envPath.c_str());
-    std::string platform = "Not configured";
-    std::string streamKey = "Not configured";
-    std::string streamUrl = "Not configured";
-    if (envFile.is_open()) {
-        std::string line;
-        while (std::getline(envFile, line)) {
-            if (line.find("PLATFORM=") == 0 && line.length() > 9) {
-                platform = line.substr(9);
-            } else if (line.find("STREAM_KEY=") == 0 && line.length() > 11) {
-                streamKey = line.substr(11);
-                if (streamKey.length() > 8) {
-                    streamKey = streamKey.substr(0, 4) + 
-                                std::string(streamKey.length() - 8, '*') + 
-                                streamKey.substr(streamKey.length() - 4);
-                } else if (streamKey.length() > 0) {
-                    streamKey = streamKey.substr(0, 1) + 
-                                std::string(streamKey.length() - 2, '*') + 
-                                streamKey.substr(streamKey.length() - 1);
-                }
-            } else if (line.find("STREAM_URL=") == 0 && line.length() > 11) {
-                streamUrl = line.substr(11);
-            }
-        }
-        envFile.close();
-    } else {
+    StreamConfig config;
+    std::vector<std::string> errors;
+    std::string notConfigured = "Not configured";
+    if (!load(config, errors) && errors.empty()) {
         std::cout << YELLOW "Configuration file not found or cannot be opened." RESET << std::endl;
         return true;
     }
     std::cout << B CYAN "Current Configuration:" RESET << std::endl;
-    std::cout << CYAN "Platform: " RESET << platform << std::endl;
-    std::cout << CYAN "Stream Key: " RESET << streamKey << std::endl;
-    std::cout << CYAN "Stream URL: " RESET << streamUrl << std::endl;
+    std::cout << CYAN "Platform: " RESET << (config.platform.empty() ? notConfigured : config.platform) << std::endl;
+    std::cout << CYAN "Stream Key: " RESET
+              << (config.streamKey.empty() ? notConfigured : maskSecret(config.streamKey)) << std::endl;
+    std::cout << CYAN "Stream URL: " RESET << (config.streamUrl.empty() ? notConfigured : config.streamUrl) << std::endl;
+    for (size_t i = 0; i < config.destinations.size(); i++) {
+        const std::string& url = config.destinations[i];
+        std::cout << CYAN "Also streaming to: " RESET << url.substr(0, url.rfind('/') + 1) << "****" << std::endl;
+    }
+    if (!config.cpuSet.empty()) {
+        std::cout << CYAN "CPU set: " RESET << config.cpuSet << std::endl;
+    }
+    std::cout << CYAN "Capture: " RESET << config.capture << std::endl;
+    std::cout << CYAN "Output resolution: " RESET << config.outputWidth << "x" << config.outputHeight << std::endl;
+    if (!config.browserPath.empty()) {
+        std::cout << CYAN "Browser: " RESET << config.browserPath << std::endl;
+    }
+    std::cout << CYAN "Encoder tuning: " RESET << (config.encoderTuning ? TUNING_AUTO : TUNING_OFF) << std::endl;
+    std::cout << CYAN "Frozen page after: " RESET;
+    if (config.freezeTimeout > 0) {
+        std::cout << config.freezeTimeout << " s" << std::endl;
+    } else {
+        std::cout << "never" << std::endl;
+    }
+    std::cout << CYAN "Browser recycled: " RESET;
+    if (config.browserMemoryLimit > 0) {
+        std::cout << "above " << config.browserMemoryLimit << " MiB";
+    }
+    if (config.browserRecycleHours > 0) {
+        std::cout << (config.browserMemoryLimit > 0 ? " or " : "") << "every " << config.browserRecycleHours << " h";
+    }
+    if (config.browserMemoryLimit == 0 && config.browserRecycleHours == 0) {
+        std::cout << "never";
+    }
+    std::cout << std::endl;
+    for (size_t i = 0; i < errors.size(); i++) {
+        std::cout << YELLOW "Invalid value ignored: " << errors[i] << RESET << std::endl;
+    }
+    return true;
+}
+
+/**
+ * @brief Applies KEY=VALUE assignments given on the command line
+ *
+ * Meant for scripts: nothing is prompted, and either every assignment
+ * is valid and written in one commit, or none is. Assignments are also
+ * refused when they make the profile as a whole invalid, such as an
+ * output size the configured capture cannot stream.
+ *
+ * @param assignments The KEY=VALUE arguments
+ * @return bool True if every setting was saved
+ */
+bool ConfigManager::handleSet(const std::vector<std::string>& assignments) {
+    if (assignments.empty()) {
+        std::cerr << RED "Usage: pagestreamer --config set KEY=VALUE [KEY=VALUE...]" RESET << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < assignments.size(); i++) {
+        size_t separator = assignments[i].find('=');
+        if (separator == std::string::npos || separator == 0) {
+            std::cerr << RED "Error: expected KEY=VALUE, got " << assignments[i] << RESET << std::endl;
+            pending.clear();
+            return false;
+        }
+        if (!setValue(assignments[i].substr(0, separator), assignments[i].substr(separator + 1))) {
+            pending.clear();
+            return false;
+        }
+    }
+    std::map<std::string, std::string> values;
+    loadEnv(values);
+    StreamConfig config;
+    std::vector<std::string> before;
+    std::vector<std::string> after;
+    parseConfig(values, config, before);
+    for (std::map<std::string, std::string>::const_iterator it = pending.begin(); it != pending.end(); ++it) {
+        if (it->second.empty()) {
+            values.erase(it->first);
+        } else {
+            values[it->first] = it->second;
+        }
+    }
+    parseConfig(values, config, after);
+    for (size_t i = 0; i < after.size(); i++) {
+        if (std::find(before.begin(), before.end(), after[i]) == before.end()) {
+            std::cerr << RED "Error: " << after[i] << RESET << std::endl;
+            pending.clear();
+            return false;
+        }
+    }
+    if (!commit()) {
+        return false;
+    }
+    std::cout << GREEN "Updated " << assignments.size() << (assignments.size() > 1 ? " settings" : " setting")
+              << " in " << envPath << RESET << std::endl;
     return true;
 }
 
 /**
  * @brief Handles the configuration of stream settings
  * 
+ * The answers are written together once every question succeeded.
+ * 
  * @param configType The specific setting to configure (optional)
  * @return bool True if configuration was successful
  */
@@ -144,18 +577,31 @@ bool ConfigManager::handleConfig(const std::string& configType) {
         return showConfiguration();
     }
     if (configType.empty() || configType == "PLATFORM") {
-        success = configurePlatform() && success;
+        success = configurePlatform(*this) && success;
     }
     if (configType.empty() || configType == "STREAM_KEY") {
         if (configType.empty()) {
-            success = configureStreamKey(true) && success;
+            success = configureStreamKey(*this, true) && success;
         } else {
-            success = configureStreamKey(false) && success;
+            success = configureStreamKey(*this, false) && success;
         }
     }
     if (configType.empty() || configType == "STREAM_URL") {
-        success = configureStreamUrl() && success;
+        success = configureStreamUrl(*this) && success;
+    }
+    if (configType == "CPUSET") {
+        success = configureCpuSet(*this) && success;
+    }
+    if (configType == "DESTINATIONS") {
+        success = configureDestinations(*this) && success;
+    }
+    if (configType == "CAPTURE") {
+        success = configureCapture(*this) && success;
+    }
+    if (configType == "OUTPUT_RESOLUTION") {
+        success = configureOutputResolution(*this) && success;
     }
+    success = success && commit();
     if (success) {
         std::cout << GREEN "Configuration saved successfully!" RESET << std::endl;
         std::cout << "You can change settings anytime with: pagestreamer --config" << std::endl;
@@ -0,0 +1,137 @@
+#include "../includes/ConfigWatcher.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+static const int kPollIntervalMs = 250;
+static const int kSettleMs = 100;
+static const size_t kEventBufferSize = 4096;
+
+/**
+ * @brief Constructor
+ *
+ * @param envPath The profile to watch
+ * @param listener Notified of every valid change
+ */
+ConfigWatcher::ConfigWatcher(const std::string& envPath, ConfigListener& listener)
+    : manager(envPath), fileName(envPath.substr(envPath.rfind('/') + 1)),
+      dirPath(envPath.substr(0, envPath.rfind('/'))), listener(listener), inotifyFd(-1), shuttingDown(false) {
+}
+
+/**
+ * @brief Destructor
+ */
+ConfigWatcher::~ConfigWatcher() {
+    shutdown();
+}
+
+/**
+ * @brief Reads the current profile and starts watching it
+ *
+ * @return bool False if inotify is unavailable; changes are then only
+ *         seen at the next start
+ */
+bool ConfigWatcher::start() {
+    manager.loadEnv(current);
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0 || inotify_add_watch(inotifyFd, dirPath.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        logMessage("Cannot watch " + dirPath + ": " + strerror(errno));
+        if (inotifyFd >= 0) {
+            close(inotifyFd);
+            inotifyFd = -1;
+        }
+        return false;
+    }
+    watcher = std::thread(&ConfigWatcher::watchLoop, this);
+    return true;
+}
+
+/**
+ * @brief Stops the watcher thread
+ */
+void ConfigWatcher::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+    }
+    if (watcher.joinable()) {
+        watcher.join();
+    }
+    if (inotifyFd >= 0) {
+        close(inotifyFd);
+        inotifyFd = -1;
+    }
+}
+
+/**
+ * @brief Body of the watcher thread
+ *
+ * Events for the profile are coalesced: the profile is read once the
+ * directory has been quiet for kSettleMs, so an editor saving in several
+ * steps triggers a single reload.
+ */
+void ConfigWatcher::watchLoop() {
+    char buffer[kEventBufferSize] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool dirty = false;
+    for (;;) {
+        struct pollfd pfd = { inotifyFd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, dirty ? kSettleMs : kPollIntervalMs);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                return;
+            }
+        }
+        if (ready == 0 && dirty) {
+            dirty = false;
+            reload();
+            continue;
+        }
+        ssize_t count;
+        while ((count = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+            for (char* p = buffer; p < buffer + count;) {
+                struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+                if (event->len > 0 && fileName == event->name) {
+                    dirty = true;
+                }
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Reads the changed profile and notifies the listener
+ */
+void ConfigWatcher::reload() {
+    std::map<std::string, std::string> values;
+    std::vector<std::string> changedKeys;
+    std::vector<std::string> errors;
+    StreamConfig config;
+    if (!manager.loadEnv(values)) {
+        return;
+    }
+    for (std::map<std::string, std::string>::const_iterator it = values.begin(); it != values.end(); ++it) {
+        std::map<std::string, std::string>::const_iterator old = current.find(it->first);
+        if (old == current.end() || old->second != it->second) {
+            changedKeys.push_back(it->first);
+        }
+    }
+    for (std::map<std::string, std::string>::const_iterator it = current.begin(); it != current.end(); ++it) {
+        if (!values.count(it->first)) {
+            changedKeys.push_back(it->first);
+        }
+    }
+    if (changedKeys.empty()) {
+        return;
+    }
+    if (!parseConfig(values, config, errors)) {
+        logMessage("Ignoring the changed configuration: " + errors[0]);
+        return;
+    }
+    current = values;
+    listener.configChanged(config, changedKeys);
+}
@@ -0,0 +1,285 @@
+#include "../includes/Control.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+static const int kPollIntervalMs = 250;
+static const size_t kReadBufferSize = 1024;
+static const size_t kMaxCommandBytes = 4096;
+static const int kClientTimeoutMs = 2000;
+static const int kListenBacklog = 4;
+
+/**
+ * @brief Fills a Unix socket address
+ *
+ * @param path The socket path
+ * @param address Receives the address
+ * @return bool False if the path does not fit in sun_path
+ */
+static bool unixAddress(const std::string& path, struct sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+/**
+ * @brief Applies send and receive timeouts to a connection
+ *
+ * @param fd The connected socket
+ */
+static void setTimeouts(int fd) {
+    struct timeval timeout = { kClientTimeoutMs / 1000, (kClientTimeoutMs % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+/**
+ * @brief Reads from a connection up to the first newline
+ *
+ * @param fd The connected socket
+ * @param line Receives the line without its newline
+ * @return bool False if the peer closed or timed out before a full line
+ */
+static bool readLine(int fd, std::string& line) {
+    std::string data;
+    char buffer[kReadBufferSize];
+    while (data.find('\n') == std::string::npos && data.size() < kMaxCommandBytes) {
+        ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        data.append(buffer, static_cast<size_t>(count));
+    }
+    size_t end = data.find('\n');
+    if (end == std::string::npos) {
+        return false;
+    }
+    line = data.substr(0, end);
+    return true;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param path The socket path, usually Instance::controlPath()
+ * @param handler Runs the received commands
+ */
+ControlServer::ControlServer(const std::string& path, ControlHandler& handler)
+    : path(path), handler(handler), listenFd(-1), shuttingDown(false) {
+}
+
+/**
+ * @brief Destructor
+ */
+ControlServer::~ControlServer() {
+    shutdown();
+}
+
+/**
+ * @brief Binds the socket and starts the server thread
+ *
+ * A socket left behind by a crashed supervisor is replaced. Failing to
+ * listen is logged and leaves the stream running without live control.
+ *
+ * @return bool True if the socket is listening
+ */
+bool ControlServer::start() {
+    struct sockaddr_un address;
+    if (!unixAddress(path, address)) {
+        logMessage("Live control disabled, the socket path is too long: " + path);
+        return false;
+    }
+    unlink(path.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0
+        || bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0
+        || chmod(path.c_str(), 0600) != 0
+        || listen(listenFd, kListenBacklog) != 0) {
+        logMessage("Live control disabled, cannot listen on " + path + ": " + strerror(errno));
+        if (listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+        return false;
+    }
+    server = std::thread(&ControlServer::serverLoop, this);
+    return true;
+}
+
+/**
+ * @brief Stops the server thread and removes the socket
+ */
+void ControlServer::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+    }
+    if (server.joinable()) {
+        server.join();
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+        unlink(path.c_str());
+    }
+}
+
+/**
+ * @brief Body of the server thread
+ */
+void ControlServer::serverLoop() {
+    for (;;) {
+        struct pollfd pfd = { listenFd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, kPollIntervalMs);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                return;
+            }
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        int client = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if (client >= 0) {
+            serve(client);
+            close(client);
+        }
+    }
+}
+
+/**
+ * @brief Answers one command
+ *
+ * Only the command name is logged, since arguments can hold stream
+ * keys. Both directions time out after kClientTimeoutMs so a stuck
+ * client cannot block the socket.
+ *
+ * @param client The accepted connection
+ */
+void ControlServer::serve(int client) {
+    std::string line;
+    std::string word;
+    std::vector<std::string> words;
+    std::string reply;
+    setTimeouts(client);
+    if (!readLine(client, line)) {
+        return;
+    }
+    std::istringstream input(line);
+    while (input >> word) {
+        words.push_back(word);
+    }
+    bool ok = false;
+    if (words.empty()) {
+        reply = "empty command";
+    } else {
+        ok = handler.handleCommand(words, reply);
+        logMessage("Control command " + words[0] + (ok ? " applied" : " refused: " + reply));
+    }
+    std::string text = (ok ? "ok " : "error ") + reply + "\n";
+    writeFully(client, text.c_str(), text.size());
+}
+
+/**
+ * @brief Constructor
+ */
+DriverControl::DriverControl() : fd(-1) {
+}
+
+/**
+ * @brief Destructor
+ */
+DriverControl::~DriverControl() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/**
+ * @brief Writes one command line to the running driver
+ *
+ * @param command The command, without newline
+ * @return bool False if no driver runs or its pipe is full
+ */
+bool DriverControl::send(const std::string& command) {
+    std::string line = command + "\n";
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t written = write(fd, line.c_str(), line.size());
+    return written == static_cast<ssize_t>(line.size());
+}
+
+/**
+ * @brief Takes the stdin pipe of a freshly started driver
+ *
+ * @param pid The driver process
+ * @param fds Our end of the driver's stdin
+ */
+void DriverControl::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd >= 0) {
+        close(fd);
+    }
+    fd = fds.empty() ? -1 : fds[0];
+    if (fd >= 0) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+}
+
+/**
+ * @brief Drops the pipe of the exited driver
+ *
+ * @param status The wait status
+ */
+void DriverControl::childExited(int status) {
+    (void)status;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+/**
+ * @brief Sends one command to the control socket of a running instance
+ *
+ * @param path The socket path
+ * @param command The command line, without newline
+ * @param reply Receives the reply line
+ * @return bool False if the socket cannot be reached or did not reply
+ */
+bool sendControlCommand(const std::string& path, const std::string& command, std::string& reply) {
+    struct sockaddr_un address;
+    if (!unixAddress(path, address)) {
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    setTimeouts(fd);
+    std::string line = command + "\n";
+    bool ok = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0
+              && writeFully(fd, line.c_str(), line.size())
+              && readLine(fd, reply);
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,589 @@
+#include "../includes/Convert.hpp"
+#include "../includes/Utils.hpp"
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define PAGESTREAMER_X86 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define PAGESTREAMER_NEON 1
+#endif
+
+// BT.601 limited range in 8.8 fixed point; the offsets fold the rounding
+// and the +16 / +128 biases so every intermediate fits an unsigned 16 bit lane.
+static const int kLumaOffset = 128 + (16 << 8);
+static const int kChromaOffset = 128 + (128 << 8);
+static const int kVerifyWidth = 198;
+static const int kVerifyRounds = 16;
+
+/**
+ * @brief Computes the luma of one pixel
+ *
+ * @param p The bgr0 pixel
+ * @return unsigned char The Y sample
+ */
+static inline unsigned char luma(const unsigned char* p) {
+    return static_cast<unsigned char>((66 * p[2] + 129 * p[1] + 25 * p[0] + kLumaOffset) >> 8);
+}
+
+/**
+ * @brief Reference implementation of ConvertRowsFunction
+ *
+ * Chroma is computed from the rounded average of each 2x2 block.
+ */
+static void convertRowsScalar(const unsigned char* row0, const unsigned char* row1, int width,
+                              unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v) {
+    for (int x = 0; x < width; x += 2) {
+        const unsigned char* a = row0 + x * 4;
+        const unsigned char* b = row1 + x * 4;
+        int blue = (a[0] + a[4] + b[0] + b[4] + 2) >> 2;
+        int green = (a[1] + a[5] + b[1] + b[5] + 2) >> 2;
+        int red = (a[2] + a[6] + b[2] + b[6] + 2) >> 2;
+        y0[x] = luma(a);
+        y0[x + 1] = luma(a + 4);
+        y1[x] = luma(b);
+        y1[x + 1] = luma(b + 4);
+        u[x / 2] = static_cast<unsigned char>((112 * blue - 38 * red - 74 * green + kChromaOffset) >> 8);
+        v[x / 2] = static_cast<unsigned char>((112 * red - 94 * green - 18 * blue + kChromaOffset) >> 8);
+    }
+}
+
+/**
+ * @brief Reference implementation of BlendRowsFunction
+ */
+static void blendRowsScalar(const unsigned char* a, const unsigned char* b, size_t length,
+                            int weight, unsigned char* out) {
+    for (size_t i = 0; i < length; i++) {
+        out[i] = static_cast<unsigned char>((a[i] * (256 - weight) + b[i] * weight + 128) >> 8);
+    }
+}
+
+#ifdef PAGESTREAMER_X86
+
+/**
+ * @brief Splits 8 bgr0 pixels into 16 bit blue, green and red lanes
+ */
+static inline void splitChannelsSse2(const unsigned char* p, __m128i& blue, __m128i& green, __m128i& red) {
+    const __m128i mask = _mm_set1_epi32(0xff);
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    blue = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+    green = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+                            _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+    red = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+                          _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+}
+
+/**
+ * @brief Computes 8 luma samples from 16 bit channel lanes
+ */
+static inline __m128i lumaSse2(__m128i blue, __m128i green, __m128i red) {
+    __m128i sum = _mm_add_epi16(_mm_mullo_epi16(red, _mm_set1_epi16(66)),
+                                _mm_mullo_epi16(green, _mm_set1_epi16(129)));
+    sum = _mm_add_epi16(sum, _mm_mullo_epi16(blue, _mm_set1_epi16(25)));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(static_cast<short>(kLumaOffset))), 8);
+}
+
+/**
+ * @brief Averages horizontal pairs of two rows of 16 bit lanes
+ *
+ * @return __m128i The 4 rounded 2x2 averages, as 32 bit lanes
+ */
+static inline __m128i averageBlocksSse2(__m128i top, __m128i bottom) {
+    __m128i pairs = _mm_madd_epi16(_mm_add_epi16(top, bottom), _mm_set1_epi16(1));
+    return _mm_srli_epi32(_mm_add_epi32(pairs, _mm_set1_epi32(2)), 2);
+}
+
+/**
+ * @brief Computes chroma from 16 bit averaged channel lanes
+ */
+static inline __m128i chromaSse2(__m128i plus, __m128i minus1, __m128i minus2, short c1, short c2) {
+    __m128i sum = _mm_mullo_epi16(plus, _mm_set1_epi16(112));
+    sum = _mm_sub_epi16(sum, _mm_mullo_epi16(minus1, _mm_set1_epi16(c1)));
+    sum = _mm_sub_epi16(sum, _mm_mullo_epi16(minus2, _mm_set1_epi16(c2)));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(static_cast<short>(kChromaOffset))), 8);
+}
+
+/**
+ * @brief Stores the low 4 bytes of a vector of 16 bit samples
+ */
+static inline void storeFourSse2(unsigned char* out, __m128i samples) {
+    int packed = _mm_cvtsi128_si32(_mm_packus_epi16(samples, samples));
+    memcpy(out, &packed, 4);
+}
+
+/**
+ * @brief Computes and stores 4 U and 4 V samples from averaged blocks
+ */
+static inline void storeChromaSse2(__m128i blue, __m128i green, __m128i red,
+                                   unsigned char* u, unsigned char* v) {
+    blue = _mm_packs_epi32(blue, blue);
+    green = _mm_packs_epi32(green, green);
+    red = _mm_packs_epi32(red, red);
+    storeFourSse2(u, chromaSse2(blue, red, green, 38, 74));
+    storeFourSse2(v, chromaSse2(red, green, blue, 94, 18));
+}
+
+/**
+ * @brief SSE2 implementation of ConvertRowsFunction, 8 pixels per step
+ */
+static void convertRowsSse2(const unsigned char* row0, const unsigned char* row1, int width,
+                            unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i b0, g0, r0, b1, g1, r1;
+        splitChannelsSse2(row0 + x * 4, b0, g0, r0);
+        splitChannelsSse2(row1 + x * 4, b1, g1, r1);
+        __m128i luma0 = lumaSse2(b0, g0, r0);
+        __m128i luma1 = lumaSse2(b1, g1, r1);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y0 + x), _mm_packus_epi16(luma0, luma0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(y1 + x), _mm_packus_epi16(luma1, luma1));
+        storeChromaSse2(averageBlocksSse2(b0, b1), averageBlocksSse2(g0, g1), averageBlocksSse2(r0, r1),
+                        u + x / 2, v + x / 2);
+    }
+    convertRowsScalar(row0 + x * 4, row1 + x * 4, width - x, y0 + x, y1 + x, u + x / 2, v + x / 2);
+}
+
+/**
+ * @brief SSE2 implementation of BlendRowsFunction, 16 bytes per step
+ */
+static void blendRowsSse2(const unsigned char* a, const unsigned char* b, size_t length,
+                          int weight, unsigned char* out) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wa = _mm_set1_epi16(static_cast<short>(256 - weight));
+    const __m128i wb = _mm_set1_epi16(static_cast<short>(weight));
+    const __m128i round = _mm_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                   _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb));
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, round), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(lo, hi));
+    }
+    blendRowsScalar(a + i, b + i, length - i, weight, out + i);
+}
+
+/**
+ * @brief Splits 16 bgr0 pixels into 16 bit blue, green and red lanes
+ *
+ * The in-lane packs are put back in pixel order with a cross-lane permute.
+ */
+__attribute__((target("avx2")))
+static inline void splitChannelsAvx2(const unsigned char* p, __m256i& blue, __m256i& green, __m256i& red) {
+    const __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + 32));
+    blue = _mm256_packs_epi32(_mm256_and_si256(lo, mask), _mm256_and_si256(hi, mask));
+    green = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(lo, 8), mask),
+                               _mm256_and_si256(_mm256_srli_epi32(hi, 8), mask));
+    red = _mm256_packs_epi32(_mm256_and_si256(_mm256_srli_epi32(lo, 16), mask),
+                             _mm256_and_si256(_mm256_srli_epi32(hi, 16), mask));
+    blue = _mm256_permute4x64_epi64(blue, 0xD8);
+    green = _mm256_permute4x64_epi64(green, 0xD8);
+    red = _mm256_permute4x64_epi64(red, 0xD8);
+}
+
+/**
+ * @brief Computes 16 luma samples and stores them
+ */
+__attribute__((target("avx2")))
+static inline void storeLumaAvx2(unsigned char* out, __m256i blue, __m256i green, __m256i red) {
+    __m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(red, _mm256_set1_epi16(66)),
+                                   _mm256_mullo_epi16(green, _mm256_set1_epi16(129)));
+    sum = _mm256_add_epi16(sum, _mm256_mullo_epi16(blue, _mm256_set1_epi16(25)));
+    sum = _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_set1_epi16(static_cast<short>(kLumaOffset))), 8);
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(sum, sum), 0xD8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+}
+
+/**
+ * @brief Averages the 2x2 blocks of two rows of 16 pixels
+ *
+ * @return __m128i The 8 rounded averages, as 16 bit lanes
+ */
+__attribute__((target("avx2")))
+static inline __m128i averageBlocksAvx2(__m256i top, __m256i bottom) {
+    __m256i pairs = _mm256_madd_epi16(_mm256_add_epi16(top, bottom), _mm256_set1_epi16(1));
+    pairs = _mm256_srli_epi32(_mm256_add_epi32(pairs, _mm256_set1_epi32(2)), 2);
+    pairs = _mm256_permute4x64_epi64(_mm256_packs_epi32(pairs, pairs), 0xD8);
+    return _mm256_castsi256_si128(pairs);
+}
+
+/**
+ * @brief AVX2 implementation of ConvertRowsFunction, 16 pixels per step
+ *
+ * The chroma of the 8 resulting blocks is finished with SSE2.
+ */
+__attribute__((target("avx2")))
+static void convertRowsAvx2(const unsigned char* row0, const unsigned char* row1, int width,
+                            unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        __m256i b0, g0, r0, b1, g1, r1;
+        splitChannelsAvx2(row0 + x * 4, b0, g0, r0);
+        splitChannelsAvx2(row1 + x * 4, b1, g1, r1);
+        storeLumaAvx2(y0 + x, b0, g0, r0);
+        storeLumaAvx2(y1 + x, b1, g1, r1);
+        __m128i blue = averageBlocksAvx2(b0, b1);
+        __m128i green = averageBlocksAvx2(g0, g1);
+        __m128i red = averageBlocksAvx2(r0, r1);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x / 2),
+                         _mm_packus_epi16(chromaSse2(blue, red, green, 38, 74), _mm_setzero_si128()));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x / 2),
+                         _mm_packus_epi16(chromaSse2(red, green, blue, 94, 18), _mm_setzero_si128()));
+    }
+    convertRowsSse2(row0 + x * 4, row1 + x * 4, width - x, y0 + x, y1 + x, u + x / 2, v + x / 2);
+}
+
+/**
+ * @brief AVX2 implementation of BlendRowsFunction, 32 bytes per step
+ */
+__attribute__((target("avx2")))
+static void blendRowsAvx2(const unsigned char* a, const unsigned char* b, size_t length,
+                          int weight, unsigned char* out) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i wa = _mm256_set1_epi16(static_cast<short>(256 - weight));
+    const __m256i wb = _mm256_set1_epi16(static_cast<short>(weight));
+    const __m256i round = _mm256_set1_epi16(128);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+                                      _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb));
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+                                      _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb));
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, round), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, round), 8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_packus_epi16(lo, hi));
+    }
+    blendRowsSse2(a + i, b + i, length - i, weight, out + i);
+}
+
+#endif
+
+#ifdef PAGESTREAMER_NEON
+
+/**
+ * @brief Computes 8 luma samples from deinterleaved channels
+ */
+static inline uint8x8_t lumaNeon(uint8x8x4_t pixels) {
+    uint16x8_t sum = vmull_u8(pixels.val[2], vdup_n_u8(66));
+    sum = vmlal_u8(sum, pixels.val[1], vdup_n_u8(129));
+    sum = vmlal_u8(sum, pixels.val[0], vdup_n_u8(25));
+    return vshrn_n_u16(vaddq_u16(sum, vdupq_n_u16(kLumaOffset)), 8);
+}
+
+/**
+ * @brief Averages the 2x2 blocks of one channel of two rows of 8 pixels
+ */
+static inline uint16x4_t averageBlocksNeon(uint8x8_t top, uint8x8_t bottom) {
+    uint16x8_t sum = vaddl_u8(top, bottom);
+    uint16x4_t pairs = vpadd_u16(vget_low_u16(sum), vget_high_u16(sum));
+    return vshr_n_u16(vadd_u16(pairs, vdup_n_u16(2)), 2);
+}
+
+/**
+ * @brief Computes 4 chroma samples and stores them
+ */
+static inline void storeChromaNeon(unsigned char* out, uint16x4_t plus, uint16x4_t minus1,
+                                   uint16x4_t minus2, uint16_t c1, uint16_t c2) {
+    uint16x4_t sum = vmul_n_u16(plus, 112);
+    sum = vmls_n_u16(sum, minus1, c1);
+    sum = vmls_n_u16(sum, minus2, c2);
+    sum = vshr_n_u16(vadd_u16(sum, vdup_n_u16(kChromaOffset)), 8);
+    uint8x8_t packed = vmovn_u16(vcombine_u16(sum, sum));
+    vst1_lane_u32(reinterpret_cast<uint32_t*>(out), vreinterpret_u32_u8(packed), 0);
+}
+
+/**
+ * @brief NEON implementation of ConvertRowsFunction, 8 pixels per step
+ */
+static void convertRowsNeon(const unsigned char* row0, const unsigned char* row1, int width,
+                            unsigned char* y0, unsigned char* y1, unsigned char* u, unsigned char* v) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x4_t top = vld4_u8(row0 + x * 4);
+        uint8x8x4_t bottom = vld4_u8(row1 + x * 4);
+        vst1_u8(y0 + x, lumaNeon(top));
+        vst1_u8(y1 + x, lumaNeon(bottom));
+        uint16x4_t blue = averageBlocksNeon(top.val[0], bottom.val[0]);
+        uint16x4_t green = averageBlocksNeon(top.val[1], bottom.val[1]);
+        uint16x4_t red = averageBlocksNeon(top.val[2], bottom.val[2]);
+        storeChromaNeon(u + x / 2, blue, red, green, 38, 74);
+        storeChromaNeon(v + x / 2, red, green, blue, 94, 18);
+    }
+    convertRowsScalar(row0 + x * 4, row1 + x * 4, width - x, y0 + x, y1 + x, u + x / 2, v + x / 2);
+}
+
+/**
+ * @brief NEON implementation of BlendRowsFunction, 16 bytes per step
+ */
+static void blendRowsNeon(const unsigned char* a, const unsigned char* b, size_t length,
+                          int weight, unsigned char* out) {
+    const uint16x8_t wa = vdupq_n_u16(static_cast<uint16_t>(256 - weight));
+    const uint16x8_t wb = vdupq_n_u16(static_cast<uint16_t>(weight));
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        uint8x16_t va = vld1q_u8(a + i);
+        uint8x16_t vb = vld1q_u8(b + i);
+        uint16x8_t lo = vmlaq_u16(vmulq_u16(vmovl_u8(vget_low_u8(va)), wa), vmovl_u8(vget_low_u8(vb)), wb);
+        uint16x8_t hi = vmlaq_u16(vmulq_u16(vmovl_u8(vget_high_u8(va)), wa), vmovl_u8(vget_high_u8(vb)), wb);
+        vst1q_u8(out + i, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+    }
+    blendRowsScalar(a + i, b + i, length - i, weight, out + i);
+}
+
+#endif
+
+/**
+ * @brief Lists the kernels this CPU can run, from slowest to fastest
+ *
+ * @return vector<ConvertKernel> The scalar reference first
+ */
+std::vector<ConvertKernel> availableConvertKernels() {
+    std::vector<ConvertKernel> kernels;
+    ConvertKernel scalar = { "scalar", convertRowsScalar, blendRowsScalar };
+    kernels.push_back(scalar);
+#ifdef PAGESTREAMER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        ConvertKernel sse2 = { "sse2", convertRowsSse2, blendRowsSse2 };
+        kernels.push_back(sse2);
+        if (__builtin_cpu_supports("avx2")) {
+            ConvertKernel avx2 = { "avx2", convertRowsAvx2, blendRowsAvx2 };
+            kernels.push_back(avx2);
+        }
+    }
+#endif
+#ifdef PAGESTREAMER_NEON
+    ConvertKernel neon = { "neon", convertRowsNeon, blendRowsNeon };
+    kernels.push_back(neon);
+#endif
+    return kernels;
+}
+
+/**
+ * @brief Checks that a kernel is bit-exact with the scalar reference
+ *
+ * Runs both on pseudo-random rows whose width is not a multiple of any
+ * vector size, so the SIMD bodies and their scalar tails are covered,
+ * with every edge weight of the blend.
+ *
+ * @param kernel The kernel to check
+ * @return bool True if every output byte matches
+ */
+bool verifyConvertKernel(const ConvertKernel& kernel) {
+    const int weights[] = { 0, 1, 77, 128, 255, 256 };
+    size_t rowBytes = kVerifyWidth * 4;
+    std::vector<unsigned char> rows(rowBytes * 2);
+    std::vector<unsigned char> expected(kVerifyWidth * 3 + rowBytes);
+    std::vector<unsigned char> actual(expected.size());
+    uint32_t seed = 0x12345678;
+
+    for (int round = 0; round < kVerifyRounds; round++) {
+        for (size_t i = 0; i < rows.size(); i++) {
+            seed = seed * 1103515245 + 12345;
+            rows[i] = round == 0 ? 0 : round == 1 ? 255 : static_cast<unsigned char>(seed >> 16);
+        }
+        unsigned char* out[2] = { &expected[0], &actual[0] };
+        ConvertRowsFunction convert[2] = { convertRowsScalar, kernel.convertRows };
+        BlendRowsFunction blend[2] = { blendRowsScalar, kernel.blendRows };
+        for (int k = 0; k < 2; k++) {
+            unsigned char* p = out[k];
+            convert[k](&rows[0], &rows[rowBytes], kVerifyWidth, p, p + kVerifyWidth,
+                       p + kVerifyWidth * 2, p + kVerifyWidth * 2 + kVerifyWidth / 2);
+            blend[k](&rows[0], &rows[rowBytes], rowBytes, weights[round % 6], p + kVerifyWidth * 3);
+        }
+        if (expected != actual) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the fastest kernel that passes verifyConvertKernel()
+ *
+ * Selected once per process; a kernel that does not match the reference
+ * is logged and skipped.
+ *
+ * @return const ConvertKernel& The kernel to use
+ */
+const ConvertKernel& bestConvertKernel() {
+    static const ConvertKernel best = []() {
+        std::vector<ConvertKernel> kernels = availableConvertKernels();
+        for (size_t i = kernels.size() - 1; i > 0; i--) {
+            if (verifyConvertKernel(kernels[i])) {
+                return kernels[i];
+            }
+            logMessage(std::string("Conversion kernel ") + kernels[i].name + " does not match the reference, skipped");
+        }
+        return kernels[0];
+    }();
+    return best;
+}
+
+/**
+ * @brief Computes the bilinear sampling table of one axis
+ *
+ * Source positions are centre-aligned in 16.16 fixed point; the weight
+ * keeps the 8 fraction bits that follow the index.
+ *
+ * @param source The source size
+ * @param size The destination size
+ * @param index Receives the first source sample of each output
+ * @param weight Receives the weight (0-256) of the second sample
+ */
+static void samplingTable(int source, int size, std::vector<int>& index, std::vector<int>& weight) {
+    index.resize(size);
+    weight.resize(size);
+    for (int i = 0; i < size; i++) {
+        long long position = (2LL * i + 1) * source * 32768 / size - 32768;
+        if (position < 0) {
+            position = 0;
+        }
+        index[i] = static_cast<int>(position >> 16);
+        weight[i] = static_cast<int>((position >> 8) & 0xff);
+        if (index[i] >= source - 1) {
+            index[i] = source - 2;
+            weight[i] = 256;
+        }
+    }
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param sourceWidth The captured width
+ * @param sourceHeight The captured height
+ * @param width The output width, at most sourceWidth
+ * @param height The output height, at most sourceHeight
+ * @param kernel The conversion kernel, the best verified one by default
+ */
+FrameConverter::FrameConverter(int sourceWidth, int sourceHeight, int width, int height,
+                               const ConvertKernel& kernel)
+    : sourceWidth(sourceWidth), sourceHeight(sourceHeight), width(width), height(height),
+      kernel(kernel), nextCacheSlot(0) {
+    samplingTable(sourceWidth, width, columnIndex, columnWeight);
+    samplingTable(sourceHeight, height, rowIndex, rowWeight);
+    for (int i = 0; i < kCachedRows; i++) {
+        cache[i].resize(static_cast<size_t>(width) * 4);
+        cachedRow[i] = -1;
+    }
+    blended[0].resize(static_cast<size_t>(width) * 4);
+    blended[1].resize(static_cast<size_t>(width) * 4);
+}
+
+/**
+ * @brief Returns the size of one converted frame
+ *
+ * @return size_t The yuv420p frame size in bytes
+ */
+size_t FrameConverter::frameSize() const {
+    return static_cast<size_t>(width) * height * 3 / 2;
+}
+
+/**
+ * @brief Returns the name of the kernel in use
+ *
+ * @return const char* e.g. "avx2"
+ */
+const char* FrameConverter::kernelName() const {
+    return kernel.name;
+}
+
+/**
+ * @brief Returns a source row resampled to the output width
+ *
+ * Resampled rows are cached, since consecutive output rows share source
+ * rows. Pixels are blended two channels at a time in 16 bit fields of a
+ * 32 bit word, which gives the same bytes as one channel at a time.
+ *
+ * @param pixels The first source row
+ * @param stride The distance between two source rows
+ * @param index The source row
+ * @return const unsigned char* The row, valid for the next three calls
+ */
+const unsigned char* FrameConverter::sourceRow(const unsigned char* pixels, size_t stride, int index) {
+    const unsigned char* source = pixels + static_cast<size_t>(index) * stride;
+    if (sourceWidth == width) {
+        return source;
+    }
+    for (int i = 0; i < kCachedRows; i++) {
+        if (cachedRow[i] == index) {
+            return &cache[i][0];
+        }
+    }
+    int slot = nextCacheSlot;
+    nextCacheSlot = (nextCacheSlot + 1) % kCachedRows;
+    cachedRow[slot] = index;
+    unsigned char* out = &cache[slot][0];
+    for (int x = 0; x < width; x++) {
+        uint32_t a;
+        uint32_t b;
+        uint32_t weight = static_cast<uint32_t>(columnWeight[x]);
+        memcpy(&a, source + columnIndex[x] * 4, 4);
+        memcpy(&b, source + columnIndex[x] * 4 + 4, 4);
+        uint32_t blueRed = (((a & 0xff00ff) * (256 - weight) + (b & 0xff00ff) * weight + 0x800080) >> 8) & 0xff00ff;
+        uint32_t greenPad = ((((a >> 8) & 0xff00ff) * (256 - weight) + ((b >> 8) & 0xff00ff) * weight
+                             + 0x800080)) & 0xff00ff00;
+        uint32_t pixel = blueRed | greenPad;
+        memcpy(out + x * 4, &pixel, 4);
+    }
+    return out;
+}
+
+/**
+ * @brief Produces one scaled bgr0 output row
+ *
+ * @param pixels The first source row
+ * @param stride The distance between two source rows
+ * @param row The output row
+ * @param slot Which of the two output row buffers to use
+ * @return const unsigned char* The row, valid until the slot is reused
+ */
+const unsigned char* FrameConverter::scaleRow(const unsigned char* pixels, size_t stride, int row, int slot) {
+    const unsigned char* top = sourceRow(pixels, stride, rowIndex[row]);
+    if (rowWeight[row] == 0) {
+        return top;
+    }
+    const unsigned char* bottom = sourceRow(pixels, stride, rowIndex[row] + 1);
+    kernel.blendRows(top, bottom, static_cast<size_t>(width) * 4, rowWeight[row], &blended[slot][0]);
+    return &blended[slot][0];
+}
+
+/**
+ * @brief Converts (and scales) one frame
+ *
+ * @param pixels The first row of the bgr0 source frame
+ * @param stride The distance between two source rows
+ * @param out Receives frameSize() bytes: the Y, U and V planes
+ */
+void FrameConverter::convert(const unsigned char* pixels, size_t stride, unsigned char* out) {
+    bool scaling = sourceWidth != width || sourceHeight != height;
+    unsigned char* planeY = out;
+    unsigned char* planeU = out + static_cast<size_t>(width) * height;
+    unsigned char* planeV = planeU + static_cast<size_t>(width / 2) * (height / 2);
+
+    for (int i = 0; i < kCachedRows; i++) {
+        cachedRow[i] = -1;
+    }
+    for (int row = 0; row < height; row += 2) {
+        const unsigned char* row0 = pixels + static_cast<size_t>(row) * stride;
+        const unsigned char* row1 = row0 + stride;
+        if (scaling) {
+            row0 = scaleRow(pixels, stride, row, 0);
+            row1 = scaleRow(pixels, stride, row + 1, 1);
+        }
+        size_t chroma = static_cast<size_t>(row / 2) * (width / 2);
+        kernel.convertRows(row0, row1, width, planeY + static_cast<size_t>(row) * width,
+                           planeY + static_cast<size_t>(row + 1) * width, planeU + chroma, planeV + chroma);
+    }
+}
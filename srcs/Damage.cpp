@@ -0,0 +1,88 @@
+#include "../includes/Damage.hpp"
+#include <algorithm>
+#include <cstring>
+
+static const int kTileSize = 64;
+static const uint64_t kHashSeed = 0xcbf29ce484222325ULL;
+static const uint64_t kHashPrime = 0x100000001b3ULL;
+
+/**
+ * @brief Folds bytes into a running hash, eight at a time
+ *
+ * Every step is a bijection of the running value, so a single changed
+ * word always changes the result.
+ *
+ * @param hash The running hash
+ * @param data The bytes, a multiple of 8 long
+ * @param length The number of bytes
+ * @return uint64_t The updated hash
+ */
+static uint64_t hashWords(uint64_t hash, const unsigned char* data, size_t length) {
+    for (size_t i = 0; i + 8 <= length; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * kHashPrime;
+        hash ^= hash >> 32;
+    }
+    return hash;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param width The frame width in pixels
+ * @param height The frame height in pixels
+ */
+DamageTracker::DamageTracker(int width, int height)
+    : width(width), height(height), columns((width + kTileSize - 1) / kTileSize),
+      rows((height + kTileSize - 1) / kTileSize), primed(false),
+      previous(static_cast<size_t>(columns) * rows), current(static_cast<size_t>(columns) * rows) {
+}
+
+/**
+ * @brief Forgets the previous frame, so the next update reports everything
+ */
+void DamageTracker::reset() {
+    primed = false;
+}
+
+/**
+ * @brief Hashes a frame and compares it with the previous one
+ *
+ * Rows are read once, in memory order, each row feeding the hashes of
+ * the tiles it crosses.
+ *
+ * @param pixels The first row of the frame
+ * @param stride The distance between two rows in bytes
+ * @return size_t The number of changed tiles, all of them after reset()
+ */
+size_t DamageTracker::update(const unsigned char* pixels, size_t stride) {
+    std::fill(current.begin(), current.end(), kHashSeed);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = pixels + static_cast<size_t>(y) * stride;
+        uint64_t* hashes = &current[static_cast<size_t>(y / kTileSize) * columns];
+        for (int x = 0; x < columns; x++) {
+            int tileWidth = std::min(kTileSize, width - x * kTileSize);
+            hashes[x] = hashWords(hashes[x], row + x * kTileSize * 4, static_cast<size_t>(tileWidth) * 4);
+        }
+    }
+    size_t changed = current.size();
+    if (primed) {
+        changed = 0;
+        for (size_t i = 0; i < current.size(); i++) {
+            changed += current[i] != previous[i];
+        }
+    }
+    previous.swap(current);
+    primed = true;
+    return changed;
+}
+
+/**
+ * @brief Returns the number of tiles a frame is split into
+ *
+ * @return size_t The tile count
+ */
+size_t DamageTracker::tileCount() const {
+    return current.size();
+}
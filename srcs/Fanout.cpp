@@ -0,0 +1,595 @@
+#include "../includes/Fanout.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <sstream>
+#include <poll.h>
+#include <unistd.h>
+
+static const int kPollIntervalMs = 250;
+static const uint32_t kSessionGapMs = 33;
+static const size_t kReadBufferSize = 65536;
+static const long long kConfirmedSessionMs = 3000;
+static const int kRelayMaxBackoffMs = 1000;
+
+/**
+ * @brief Constructor
+ *
+ * Starts the writer thread, which idles until a relay is connected.
+ *
+ * @param name Name used in logs (never the URL, which holds the key)
+ * @param url The full RTMP URL including the stream key
+ * @param maxQueueBytes Budget of queued packets before dropping
+ * @param bufferMs How much of the stream to keep while reconnecting
+ */
+RtmpDestination::RtmpDestination(const std::string& name, const std::string& url, size_t maxQueueBytes,
+                                 long long bufferMs)
+    : name(name), url(url), maxQueueBytes(maxQueueBytes), bufferMs(bufferMs), queuedBytes(0), pendingFd(-1),
+      sessionActive(false), resync(false), overflowing(false), shuttingDown(false),
+      droppedPackets(0) {
+    writer = std::thread(&RtmpDestination::writerLoop, this);
+}
+
+/**
+ * @brief Destructor
+ */
+RtmpDestination::~RtmpDestination() {
+    shutdown();
+}
+
+/**
+ * @brief Returns the name used for this destination in logs and specs
+ *
+ * @return const string& The destination name
+ */
+const std::string& RtmpDestination::label() const {
+    return name;
+}
+
+/**
+ * @brief Returns the RTMP URL the relay pushes to
+ *
+ * @return string The full RTMP URL including the stream key
+ */
+std::string RtmpDestination::currentUrl() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return url;
+}
+
+/**
+ * @brief Changes the RTMP URL used by the next relaySpec()
+ *
+ * @param newUrl The full RTMP URL including the stream key
+ */
+void RtmpDestination::setUrl(const std::string& newUrl) {
+    std::lock_guard<std::mutex> lock(mutex);
+    url = newUrl;
+}
+
+/**
+ * @brief Describes the relay process pushing this destination
+ *
+ * The relay only remuxes (-c copy) the packets written to its stdin. A
+ * connection that stalls makes it fail after a few seconds instead of
+ * the TCP timeout, and it is restarted quickly to reconnect.
+ *
+ * @param logDir Directory for the relay log
+ * @return ChildSpec The spec to register with the supervisor
+ */
+ChildSpec RtmpDestination::relaySpec(const std::string& logDir) {
+    const char* args[] = {
+        "ffmpeg", "-hide_banner", "-nostats", "-loglevel", "warning",
+        "-f", "flv", "-i", "pipe:0", "-c", "copy",
+        "-f", "flv", "-flvflags", "no_duration_filesize", "-rw_timeout", "5000000"
+    };
+    ChildSpec spec;
+    ChildPipe input = { STDIN_FILENO, false, this };
+    spec.name = name;
+    spec.logPath = logDir + "/" + name + ".log";
+    spec.maxBackoffMs = kRelayMaxBackoffMs;
+    spec.argv.assign(args, args + sizeof(args) / sizeof(args[0]));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        spec.argv.push_back(url);
+    }
+    spec.pipes.push_back(input);
+    spec.observer = this;
+    return spec;
+}
+
+/**
+ * @brief Tells how full the packet queue is
+ *
+ * A queue filling up while the relay reconnects says nothing about the
+ * bandwidth, so it only counts with a relay connected.
+ *
+ * @return double The queued bytes as a fraction of the budget
+ */
+double RtmpDestination::queueFill() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return sessionActive ? static_cast<double>(queuedBytes) / maxQueueBytes : 0;
+}
+
+/**
+ * @brief Drops the oldest GOPs of the queue while no relay is connected
+ *
+ * Keeps at most bufferMs of stream within the byte budget, always
+ * starting at a keyframe. Must be called with the mutex held.
+ */
+void RtmpDestination::trimBacklog() {
+    while (!queue.empty() && (queue.back()->timestamp - queue.front()->timestamp > bufferMs
+                              || queuedBytes > maxQueueBytes)) {
+        size_t next = 1;
+        while (next < queue.size() && !queue[next]->isVideoKeyframe()) {
+            next++;
+        }
+        if (next == queue.size() && queuedBytes <= maxQueueBytes) {
+            return;
+        }
+        for (size_t i = 0; i < next; i++) {
+            queuedBytes -= queue[i]->wireSize();
+        }
+        queue.erase(queue.begin(), queue.begin() + next);
+        droppedPackets += next;
+    }
+}
+
+/**
+ * @brief Queues a packet for this destination
+ *
+ * While no relay is connected the queue keeps the last bufferMs of the
+ * stream from a keyframe on, for the next relay to resume from. When
+ * the byte budget is exceeded with a relay connected, the queue is
+ * flushed and the writer resumes at a keyframe.
+ *
+ * @param packet The packet to queue
+ */
+void RtmpDestination::push(const FlvPacketPtr& packet) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (packet->sequenceHeader) {
+            if (packet->type == FLV_TAG_SCRIPT) {
+                metadata = packet;
+            } else if (packet->type == FLV_TAG_VIDEO) {
+                videoHeader = packet;
+            } else {
+                audioHeader = packet;
+            }
+        }
+        if (!sessionActive) {
+            if (queue.empty() && !packet->isVideoKeyframe()) {
+                return;
+            }
+            queue.push_back(packet);
+            queuedBytes += packet->wireSize();
+            trimBacklog();
+            return;
+        }
+        if (queuedBytes + packet->wireSize() > maxQueueBytes) {
+            droppedPackets += queue.size();
+            queue.clear();
+            queuedBytes = 0;
+            resync = true;
+            if (!overflowing) {
+                overflowing = true;
+                logMessage(name + " is falling behind, dropping packets until the next keyframe");
+            }
+        }
+        queue.push_back(packet);
+        queuedBytes += packet->wireSize();
+    }
+    wakeup.notify_one();
+}
+
+/**
+ * @brief Hands the stdin pipe of a freshly started relay to the writer
+ *
+ * @param pid The relay process
+ * @param fds Our end of the relay's stdin
+ */
+void RtmpDestination::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pendingFd >= 0) {
+            close(pendingFd);
+        }
+        pendingFd = fds.empty() ? -1 : fds[0];
+    }
+    wakeup.notify_one();
+}
+
+/**
+ * @brief Called when the relay exits
+ *
+ * Nothing to do: the writer notices through EPIPE and waits for the
+ * restarted relay.
+ *
+ * @param status The wait status
+ */
+void RtmpDestination::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Stops the writer thread and closes any unused pipe
+ */
+void RtmpDestination::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        if (pendingFd >= 0) {
+            close(pendingFd);
+            pendingFd = -1;
+        }
+    }
+    wakeup.notify_all();
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+/**
+ * @brief Body of the writer thread: one session per relay process
+ */
+void RtmpDestination::writerLoop() {
+    for (;;) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!shuttingDown && pendingFd < 0) {
+                wakeup.wait(lock);
+            }
+            if (shuttingDown) {
+                return;
+            }
+            fd = pendingFd;
+            pendingFd = -1;
+        }
+        runSession(fd);
+        close(fd);
+    }
+}
+
+/**
+ * @brief Streams queued packets to one relay until it fails or is replaced
+ *
+ * The relay first receives an FLV header and the cached codec headers,
+ * then packets starting at a keyframe with timestamps rebased to zero.
+ * Packets written to a relay are not known to have left the host, so
+ * the ones written since the last keyframe (or since the start, until
+ * the relay has run for a few seconds) are kept and queued again when
+ * the relay fails.
+ *
+ * @param fd Our end of the relay's stdin
+ */
+void RtmpDestination::runSession(int fd) {
+    std::string init = flvFileHeader();
+    std::deque<FlvPacketPtr> unconfirmed;
+    long long startedMs = monotonicMs();
+    bool waitingKeyframe = true;
+    bool haveBase = false;
+    uint32_t base = 0;
+    uint32_t lastTimestamp = 0;
+    uint32_t backlogMs = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const FlvPacketPtr headers[] = { metadata, videoHeader, audioHeader };
+        for (size_t i = 0; i < 3; i++) {
+            if (headers[i]) {
+                init += serializeFlvTag(*headers[i], 0);
+            }
+        }
+        sessionActive = true;
+        resync = false;
+        if (!queue.empty()) {
+            backlogMs = queue.back()->timestamp - queue.front()->timestamp;
+        }
+    }
+    std::ostringstream connected;
+    connected << name << " connected";
+    if (backlogMs >= 1000) {
+        connected << ", sending the " << backlogMs / 1000.0 << " s of stream buffered meanwhile";
+    }
+    logMessage(connected.str());
+    bool ok = writeFully(fd, init.data(), init.size());
+    while (ok) {
+        FlvPacketPtr packet;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!shuttingDown && pendingFd < 0 && queue.empty()) {
+                wakeup.wait(lock);
+            }
+            if (shuttingDown || pendingFd >= 0) {
+                break;
+            }
+            packet = queue.front();
+            queue.pop_front();
+            queuedBytes -= packet->wireSize();
+            if (resync) {
+                resync = false;
+                waitingKeyframe = true;
+                unconfirmed.clear();
+            }
+        }
+        if (waitingKeyframe && !packet->sequenceHeader) {
+            if (!packet->isVideoKeyframe()) {
+                continue;
+            }
+            waitingKeyframe = false;
+            if (!haveBase) {
+                base = packet->timestamp;
+                haveBase = true;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (overflowing) {
+                std::ostringstream msg;
+                msg << name << " resumed at a keyframe after dropping " << droppedPackets << " packets";
+                logMessage(msg.str());
+                overflowing = false;
+            }
+        }
+        if (!waitingKeyframe) {
+            lastTimestamp = packet->timestamp >= base ? packet->timestamp - base : 0;
+            if (packet->isVideoKeyframe() && monotonicMs() - startedMs >= kConfirmedSessionMs) {
+                unconfirmed.clear();
+            }
+            unconfirmed.push_back(packet);
+        }
+        std::string tag = serializeFlvTag(*packet, lastTimestamp);
+        ok = writeFully(fd, tag.data(), tag.size());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        sessionActive = false;
+        for (size_t i = 0; i < unconfirmed.size(); i++) {
+            queuedBytes += unconfirmed[i]->wireSize();
+        }
+        queue.insert(queue.begin(), unconfirmed.begin(), unconfirmed.end());
+        trimBacklog();
+    }
+    logMessage(name + " disconnected");
+}
+
+/**
+ * @brief Constructor
+ *
+ * Starts the reader thread, which idles until the encoder starts.
+ */
+Fanout::Fanout() : pendingFd(-1), shuttingDown(false), nextTimestamp(0), createdAtMs(monotonicMs()),
+                   published(false) {
+    reader = std::thread(&Fanout::readerLoop, this);
+}
+
+/**
+ * @brief Destructor
+ */
+Fanout::~Fanout() {
+    shutdown();
+}
+
+/**
+ * @brief Registers a sink; must be called before the encoder starts
+ *
+ * @param sink The sink, which must outlive the fan-out
+ */
+void Fanout::addSink(PacketSink* sink) {
+    sinks.push_back(sink);
+}
+
+/**
+ * @brief Hands the stdout pipe of a freshly started encoder to the reader
+ *
+ * @param pid The encoder process
+ * @param fds Our end of the encoder's stdout
+ */
+void Fanout::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pendingFd >= 0) {
+            close(pendingFd);
+        }
+        pendingFd = fds.empty() ? -1 : fds[0];
+    }
+    wakeup.notify_one();
+}
+
+/**
+ * @brief Called when the encoder exits; the reader sees EOF on its own
+ *
+ * @param status The wait status
+ */
+void Fanout::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Stops the reader thread
+ */
+void Fanout::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        if (pendingFd >= 0) {
+            close(pendingFd);
+            pendingFd = -1;
+        }
+    }
+    wakeup.notify_all();
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+
+/**
+ * @brief Body of the reader thread: one session per encoder process
+ */
+void Fanout::readerLoop() {
+    for (;;) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!shuttingDown && pendingFd < 0) {
+                wakeup.wait(lock);
+            }
+            if (shuttingDown) {
+                return;
+            }
+            fd = pendingFd;
+            pendingFd = -1;
+        }
+        readSession(fd);
+    }
+}
+
+/**
+ * @brief Prepares the reading state of one encoder's output
+ *
+ * @param session The state to reset
+ * @param fd Our end of the encoder's stdout
+ */
+void Fanout::openSession(Session& session, int fd) {
+    session.fd = fd;
+    session.parser.reset();
+    session.offset = nextTimestamp;
+    session.base = 0;
+    session.haveBase = false;
+}
+
+/**
+ * @brief Reads the available output of an encoder
+ *
+ * @param session The encoder output to read
+ * @param packets Receives the complete packets read
+ * @return bool False on EOF or invalid FLV; the descriptor is then closed
+ */
+bool Fanout::readPackets(Session& session, std::vector<std::shared_ptr<FlvPacket> >& packets) {
+    std::vector<unsigned char> buffer(kReadBufferSize);
+    packets.clear();
+    ssize_t count = read(session.fd, &buffer[0], buffer.size());
+    if (count < 0 && errno == EINTR) {
+        return true;
+    }
+    if (count > 0 && session.parser.feed(&buffer[0], static_cast<size_t>(count), packets)) {
+        return true;
+    }
+    if (count > 0) {
+        logMessage("Encoder output is not valid FLV, dropping it");
+    }
+    close(session.fd);
+    session.fd = -1;
+    return false;
+}
+
+/**
+ * @brief Re-timestamps a packet and pushes it to every sink
+ *
+ * Timestamps are shifted so each session continues where the previous
+ * one stopped instead of starting again at zero. The time from startup
+ * to the first video packet is logged.
+ *
+ * @param session The session the packet belongs to
+ * @param packet The packet to forward
+ */
+void Fanout::publish(Session& session, const std::shared_ptr<FlvPacket>& packet) {
+    if (!session.haveBase && packet->type != FLV_TAG_SCRIPT) {
+        session.base = packet->timestamp;
+        session.haveBase = true;
+    }
+    packet->timestamp = (packet->timestamp >= session.base ? packet->timestamp - session.base : 0) + session.offset;
+    if (packet->timestamp + kSessionGapMs > nextTimestamp) {
+        nextTimestamp = packet->timestamp + kSessionGapMs;
+    }
+    if (!published && packet->type == FLV_TAG_VIDEO && !packet->sequenceHeader) {
+        std::ostringstream msg;
+        msg << "First video packet " << monotonicMs() - createdAtMs << " ms after the supervisor started";
+        logMessage(msg.str());
+        published = true;
+    }
+    FlvPacketPtr shared(packet);
+    for (size_t i = 0; i < sinks.size(); i++) {
+        sinks[i]->push(shared);
+    }
+}
+
+/**
+ * @brief Forwards encoder output until no encoder is left to read
+ *
+ * A new encoder handed over meanwhile is read alongside the current one:
+ * its codec headers are held back and its packets dropped until its
+ * first keyframe, at which point the current output is closed (its
+ * encoder then exits on EPIPE) and the new one takes over with the held
+ * headers. The switch is thus seamless and keyframe-aligned.
+ *
+ * @param fd Our end of the first encoder's stdout
+ */
+void Fanout::readSession(int fd) {
+    Session current;
+    Session next;
+    std::vector<std::shared_ptr<FlvPacket> > held;
+    std::vector<std::shared_ptr<FlvPacket> > packets;
+
+    openSession(current, fd);
+    next.fd = -1;
+    while (current.fd >= 0 || next.fd >= 0) {
+        struct pollfd pfds[2] = { { current.fd, POLLIN, 0 }, { next.fd, POLLIN, 0 } };
+        int ready = poll(pfds, 2, kPollIntervalMs);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                break;
+            }
+            if (pendingFd >= 0) {
+                if (next.fd >= 0) {
+                    close(next.fd);
+                }
+                openSession(next, pendingFd);
+                pendingFd = -1;
+                held.clear();
+                continue;
+            }
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        if (pfds[0].revents && readPackets(current, packets)) {
+            for (size_t i = 0; i < packets.size(); i++) {
+                publish(current, packets[i]);
+            }
+        }
+        if (!pfds[1].revents || !readPackets(next, packets)) {
+            continue;
+        }
+        size_t i = 0;
+        for (; i < packets.size() && !packets[i]->isVideoKeyframe(); i++) {
+            if (packets[i]->sequenceHeader) {
+                held.push_back(packets[i]);
+            }
+        }
+        if (i == packets.size()) {
+            continue;
+        }
+        if (current.fd >= 0) {
+            close(current.fd);
+            logMessage("Switched to the new encoder at a keyframe");
+        }
+        current = next;
+        current.offset = nextTimestamp;
+        current.base = packets[i]->timestamp;
+        current.haveBase = true;
+        next.fd = -1;
+        for (size_t j = 0; j < held.size(); j++) {
+            publish(current, held[j]);
+        }
+        held.clear();
+        for (; i < packets.size(); i++) {
+            publish(current, packets[i]);
+        }
+    }
+    if (current.fd >= 0) {
+        close(current.fd);
+    }
+    if (next.fd >= 0) {
+        close(next.fd);
+    }
+}
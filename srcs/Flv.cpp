@@ -0,0 +1,175 @@
+#include "../includes/Flv.hpp"
+#include <cstring>
+
+static const size_t kMaxTagBodySize = 16 * 1024 * 1024;
+
+/**
+ * @brief Constructor
+ */
+FlvPacket::FlvPacket() : type(0), timestamp(0), keyframe(false), sequenceHeader(false) {
+}
+
+/**
+ * @brief Tells whether the packet starts a decodable video GOP
+ *
+ * @return bool True for a video keyframe that is not a codec header
+ */
+bool FlvPacket::isVideoKeyframe() const {
+    return type == FLV_TAG_VIDEO && keyframe && !sequenceHeader;
+}
+
+/**
+ * @brief Returns the packet size once serialized with its tag header
+ *
+ * @return size_t Header, body and trailing previous-tag-size bytes
+ */
+size_t FlvPacket::wireSize() const {
+    return FLV_TAG_HEADER_SIZE + body.size() + 4;
+}
+
+/**
+ * @brief Constructor
+ */
+FlvParser::FlvParser() : offset(0), headerParsed(false) {
+}
+
+/**
+ * @brief Restarts parsing at a new FLV file header
+ *
+ * Called whenever the encoder is restarted and a new stream begins.
+ */
+void FlvParser::reset() {
+    buffer.clear();
+    offset = 0;
+    headerParsed = false;
+}
+
+/**
+ * @brief Reads a big-endian integer of up to four bytes
+ *
+ * @param data The first byte
+ * @param size The number of bytes
+ * @return uint32_t The decoded value
+ */
+static uint32_t readBigEndian(const unsigned char* data, size_t size) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+/**
+ * @brief Classifies a tag from the first bytes of its body
+ *
+ * @param packet The packet to update
+ */
+static void classifyPacket(FlvPacket& packet) {
+    const std::vector<unsigned char>& body = packet.body;
+    if (packet.type == FLV_TAG_SCRIPT) {
+        packet.sequenceHeader = true;
+    } else if (packet.type == FLV_TAG_VIDEO && !body.empty()) {
+        packet.keyframe = (body[0] >> 4) == 1;
+        packet.sequenceHeader = (body[0] & 0x0f) == 7 && body.size() > 1 && body[1] == 0;
+    } else if (packet.type == FLV_TAG_AUDIO && !body.empty()) {
+        packet.sequenceHeader = (body[0] >> 4) == 10 && body.size() > 1 && body[1] == 0;
+    }
+}
+
+/**
+ * @brief Appends bytes and extracts every complete tag
+ *
+ * @param data The received bytes
+ * @param length The number of bytes
+ * @param packets Receives the parsed packets
+ * @return bool False if the stream is not valid FLV
+ */
+bool FlvParser::feed(const unsigned char* data, size_t length,
+                     std::vector<std::shared_ptr<FlvPacket> >& packets) {
+    buffer.insert(buffer.end(), data, data + length);
+    for (;;) {
+        size_t available = buffer.size() - offset;
+        const unsigned char* cursor = buffer.empty() ? NULL : &buffer[offset];
+        if (!headerParsed) {
+            if (available < FLV_HEADER_SIZE) {
+                break;
+            }
+            if (memcmp(cursor, "FLV", 3) != 0) {
+                return false;
+            }
+            uint32_t headerSize = readBigEndian(cursor + 5, 4);
+            if (headerSize < 9) {
+                return false;
+            }
+            if (available < headerSize + 4) {
+                break;
+            }
+            offset += headerSize + 4;
+            headerParsed = true;
+            continue;
+        }
+        if (available < FLV_TAG_HEADER_SIZE) {
+            break;
+        }
+        uint32_t bodySize = readBigEndian(cursor + 1, 3);
+        if (bodySize > kMaxTagBodySize) {
+            return false;
+        }
+        if (available < FLV_TAG_HEADER_SIZE + bodySize + 4) {
+            break;
+        }
+        FlvPacket* packet = new FlvPacket();
+        packet->type = cursor[0] & 0x1f;
+        packet->timestamp = readBigEndian(cursor + 4, 3) | (static_cast<uint32_t>(cursor[7]) << 24);
+        packet->body.assign(cursor + FLV_TAG_HEADER_SIZE, cursor + FLV_TAG_HEADER_SIZE + bodySize);
+        classifyPacket(*packet);
+        packets.push_back(std::shared_ptr<FlvPacket>(packet));
+        offset += FLV_TAG_HEADER_SIZE + bodySize + 4;
+    }
+    if (offset > 0 && offset * 2 >= buffer.size()) {
+        buffer.erase(buffer.begin(), buffer.begin() + offset);
+        offset = 0;
+    }
+    return true;
+}
+
+/**
+ * @brief Returns an FLV file header announcing audio and video
+ *
+ * @return string The 9 byte header followed by PreviousTagSize0
+ */
+std::string flvFileHeader() {
+    static const unsigned char header[FLV_HEADER_SIZE] = {
+        'F', 'L', 'V', 1, 0x05, 0, 0, 0, 9, 0, 0, 0, 0
+    };
+    return std::string(reinterpret_cast<const char*>(header), FLV_HEADER_SIZE);
+}
+
+/**
+ * @brief Serializes a packet as an FLV tag with the given timestamp
+ *
+ * @param packet The packet
+ * @param timestamp The timestamp to write, in milliseconds
+ * @return string The tag header, body and previous tag size
+ */
+std::string serializeFlvTag(const FlvPacket& packet, uint32_t timestamp) {
+    std::string tag;
+    uint32_t bodySize = static_cast<uint32_t>(packet.body.size());
+    uint32_t tagSize = FLV_TAG_HEADER_SIZE + bodySize;
+    tag.reserve(packet.wireSize());
+    tag.push_back(static_cast<char>(packet.type));
+    tag.push_back(static_cast<char>(bodySize >> 16));
+    tag.push_back(static_cast<char>(bodySize >> 8));
+    tag.push_back(static_cast<char>(bodySize));
+    tag.push_back(static_cast<char>(timestamp >> 16));
+    tag.push_back(static_cast<char>(timestamp >> 8));
+    tag.push_back(static_cast<char>(timestamp));
+    tag.push_back(static_cast<char>(timestamp >> 24));
+    tag.append(3, '\0');
+    tag.append(reinterpret_cast<const char*>(packet.body.data()), bodySize);
+    tag.push_back(static_cast<char>(tagSize >> 24));
+    tag.push_back(static_cast<char>(tagSize >> 16));
+    tag.push_back(static_cast<char>(tagSize >> 8));
+    tag.push_back(static_cast<char>(tagSize));
+    return tag;
+}
@@ -0,0 +1,371 @@
+#include "../includes/Instance.hpp"
+#include "../includes/Utils.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+static const int kBaseDisplay = 99;
+static const int kBaseDebugPort = 9222;
+static const int kBaseMetricsPort = 9464;
+static const int kSpareOffset = 100;
+// Slots stop below the spare offset so a spare display or DevTools port
+// never lands on another instance's, and the metrics ports stay clear of
+// every DevTools port.
+static const int kMaxSlots = kSpareOffset;
+static const size_t kMaxNameLength = 32;
+static const char* kCgroupRoot = "/sys/fs/cgroup";
+
+/**
+ * @brief Returns the path of the instance .env profile
+ */
+std::string Instance::envPath() const {
+    return dir + "/.env";
+}
+
+/**
+ * @brief Returns the directory holding the instance logs
+ */
+std::string Instance::logDir() const {
+    return dir + "/logs";
+}
+
+/**
+ * @brief Returns the directory holding runtime sockets of the instance
+ */
+std::string Instance::runDir() const {
+    return dir + "/run";
+}
+
+/**
+ * @brief Returns the Unix socket the running supervisor takes commands on
+ */
+std::string Instance::controlPath() const {
+    return runDir() + "/control.sock";
+}
+
+/**
+ * @brief Returns the shared status block the running supervisor publishes
+ */
+std::string Instance::statusPath() const {
+    return runDir() + "/status";
+}
+
+/**
+ * @brief Returns the path of the streaming schedule file
+ */
+std::string Instance::schedulePath() const {
+    return dir + "/schedule";
+}
+
+/**
+ * @brief Returns the path of the supervisor PID file
+ */
+std::string Instance::pidPath() const {
+    return dir + "/stream.pid";
+}
+
+/**
+ * @brief Returns the X display allocated to the instance, e.g. ":99"
+ *
+ * @param buffer 0 for the streamed display, 1 for the spare one that a
+ *        fresh browser starts on while the browser is recycled
+ */
+std::string Instance::display(int buffer) const {
+    std::ostringstream result;
+    result << ":" << (kBaseDisplay + slot + buffer * kSpareOffset);
+    return result.str();
+}
+
+/**
+ * @brief Returns the DevTools port allocated to the instance
+ *
+ * @param buffer 0 for the streamed browser, 1 for the spare one
+ */
+int Instance::debugPort(int buffer) const {
+    return kBaseDebugPort + slot + buffer * kSpareOffset;
+}
+
+/**
+ * @brief Returns the loopback port of the instance metrics endpoint
+ */
+int Instance::metricsPort() const {
+    return kBaseMetricsPort + slot;
+}
+
+/**
+ * @brief Checks that an instance name is safe to use as a directory name
+ *
+ * @param name The requested name
+ * @return bool True for 1 to 32 characters of [A-Za-z0-9_-]
+ */
+static bool isValidName(const std::string& name) {
+    if (name.empty() || name.length() > kMaxNameLength) {
+        return false;
+    }
+    for (size_t i = 0; i < name.length(); i++) {
+        char c = name[i];
+        if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Returns the directory of an instance
+ *
+ * @param name The instance name
+ * @return string The absolute directory path
+ */
+static std::string instanceDir(const std::string& name) {
+    if (name == DEFAULT_INSTANCE) {
+        return pagestreamerDir();
+    }
+    return pagestreamerDir() + "/instances/" + name;
+}
+
+/**
+ * @brief Reads the slot recorded for an instance directory
+ *
+ * @param dir The instance directory
+ * @return int The slot, -1 if none was allocated yet or the recorded
+ *         one is out of range
+ */
+static int readSlot(const std::string& dir) {
+    std::ifstream slotFile((dir + "/slot").c_str());
+    int slot = -1;
+    if (!slotFile.is_open() || !(slotFile >> slot) || slot < 0 || slot >= kMaxSlots) {
+        return -1;
+    }
+    return slot;
+}
+
+/**
+ * @brief Lists the names of every instance that has a directory
+ *
+ * @return vector<string> The names, default first
+ */
+static std::vector<std::string> instanceNames() {
+    std::vector<std::string> names;
+    std::string instancesDir = pagestreamerDir() + "/instances";
+    DIR* dir = opendir(instancesDir.c_str());
+    names.push_back(DEFAULT_INSTANCE);
+    if (!dir) {
+        return names;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        struct stat info;
+        if (isValidName(name) && name != DEFAULT_INSTANCE
+            && stat((instancesDir + "/" + name).c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            names.push_back(name);
+        }
+    }
+    closedir(dir);
+    return names;
+}
+
+/**
+ * @brief Opens an instance, creating it and allocating its slot if needed
+ *
+ * Slots are allocated under an exclusive lock on instances.lock so two
+ * instances created concurrently never share a display. Slot 0 (display
+ * :99) is reserved for the default instance, and at most kMaxSlots
+ * instances exist at once.
+ *
+ * @param name The instance name
+ * @return Instance The opened instance
+ * @throws std::runtime_error If the name is invalid, the instance
+ *         directory cannot be created or every slot is taken
+ */
+Instance openInstance(const std::string& name) {
+    if (!isValidName(name)) {
+        throw std::runtime_error("Invalid instance name '" + name + "' (use letters, digits, '-' and '_').");
+    }
+    Instance instance;
+    instance.name = name;
+    instance.dir = instanceDir(name);
+    mkdir(pagestreamerDir().c_str(), 0755);
+    mkdir((pagestreamerDir() + "/instances").c_str(), 0755);
+    bool created = mkdir(instance.dir.c_str(), 0755) == 0;
+    if (!created && errno != EEXIST) {
+        throw std::runtime_error("Cannot create " + instance.dir + ": " + strerror(errno));
+    }
+    instance.slot = readSlot(instance.dir);
+    if (instance.slot >= 0) {
+        return instance;
+    }
+    std::string lockPath = pagestreamerDir() + "/instances.lock";
+    int lockFd = open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lockFd < 0 || flock(lockFd, LOCK_EX) != 0) {
+        throw std::runtime_error("Cannot lock " + lockPath + ": " + strerror(errno));
+    }
+    instance.slot = readSlot(instance.dir);
+    if (instance.slot < 0) {
+        std::vector<std::string> names = instanceNames();
+        std::set<int> used;
+        for (size_t i = 0; i < names.size(); i++) {
+            used.insert(readSlot(instanceDir(names[i])));
+        }
+        instance.slot = name == DEFAULT_INSTANCE ? 0 : 1;
+        while (used.count(instance.slot)) {
+            instance.slot++;
+        }
+        if (instance.slot >= kMaxSlots) {
+            close(lockFd);
+            if (created) {
+                rmdir(instance.dir.c_str());
+            }
+            std::ostringstream message;
+            message << "Cannot create instance '" << name << "': all " << kMaxSlots
+                    << " instance slots are in use.";
+            throw std::runtime_error(message.str());
+        }
+        std::ofstream slotFile((instance.dir + "/slot").c_str());
+        slotFile << instance.slot << std::endl;
+    }
+    close(lockFd);
+    return instance;
+}
+
+/**
+ * @brief Lists every existing instance
+ *
+ * The default instance is only listed once it has a profile or a slot.
+ *
+ * @return vector<Instance> The instances, default first
+ */
+std::vector<Instance> listInstances() {
+    std::vector<std::string> names = instanceNames();
+    std::vector<Instance> instances;
+    for (size_t i = 0; i < names.size(); i++) {
+        Instance instance;
+        instance.name = names[i];
+        instance.dir = instanceDir(names[i]);
+        instance.slot = readSlot(instance.dir);
+        if (names[i] == DEFAULT_INSTANCE && instance.slot < 0
+            && access(instance.envPath().c_str(), F_OK) != 0) {
+            continue;
+        }
+        instances.push_back(instance);
+    }
+    return instances;
+}
+
+/**
+ * @brief Parses a CPU list such as "0-3,8,10-11"
+ *
+ * @param cpus The list
+ * @param set Filled with the CPUs of the list
+ * @return bool False if the list is empty or malformed
+ */
+static bool parseCpuList(const std::string& cpus, cpu_set_t& set) {
+    std::istringstream stream(cpus);
+    std::string range;
+    bool any = false;
+    CPU_ZERO(&set);
+    while (std::getline(stream, range, ',')) {
+        char* end = NULL;
+        long first = strtol(range.c_str(), &end, 10);
+        long last = first;
+        if (end == range.c_str()) {
+            return false;
+        }
+        if (*end == '-') {
+            const char* lastStart = end + 1;
+            last = strtol(lastStart, &end, 10);
+            if (end == lastStart) {
+                return false;
+            }
+        }
+        if (*end != '\0' || first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, &set);
+            any = true;
+        }
+    }
+    return any;
+}
+
+/**
+ * @brief Writes a value to a cgroup control file
+ *
+ * @param path The control file
+ * @param value The value to write
+ * @return bool True if the kernel accepted the value
+ */
+static bool writeCgroupFile(const std::string& path, const std::string& value) {
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, value.c_str(), value.length()) == static_cast<ssize_t>(value.length());
+    close(fd);
+    return ok;
+}
+
+/**
+ * @brief Moves the calling process into a cpuset cgroup of the instance
+ *
+ * Uses /sys/fs/cgroup/pagestreamer/<name>, which requires root or a
+ * delegated pagestreamer subtree.
+ *
+ * @param instance The instance
+ * @param cpus The CPU list
+ * @return bool True if the process now runs in the cgroup
+ */
+static bool joinCpusetCgroup(const Instance& instance, const std::string& cpus) {
+    std::string parent = std::string(kCgroupRoot) + "/pagestreamer";
+    std::string group = parent + "/" + instance.name;
+    std::ostringstream pid;
+    pid << getpid();
+    writeCgroupFile(std::string(kCgroupRoot) + "/cgroup.subtree_control", "+cpuset");
+    mkdir(parent.c_str(), 0755);
+    writeCgroupFile(parent + "/cgroup.subtree_control", "+cpuset");
+    mkdir(group.c_str(), 0755);
+    return writeCgroupFile(group + "/cpuset.cpus", cpus)
+        && writeCgroupFile(group + "/cgroup.procs", pid.str());
+}
+
+/**
+ * @brief Pins the calling process, and every child it spawns, to CPUs
+ *
+ * A cgroup v2 cpuset is preferred because it also binds processes that
+ * reset their own affinity. When cgroups are not writable the CPU
+ * affinity mask is set instead, which children inherit.
+ *
+ * @param instance The instance being pinned
+ * @param cpus The CPU list, e.g. "0-3"
+ * @return bool True if either mechanism was applied
+ */
+bool applyCpuSet(const Instance& instance, const std::string& cpus) {
+    cpu_set_t set;
+    if (!parseCpuList(cpus, set)) {
+        logMessage("Ignoring invalid CPUSET '" + cpus + "'");
+        return false;
+    }
+    if (joinCpusetCgroup(instance, cpus)) {
+        logMessage("Pinned to CPUs " + cpus + " through cgroup pagestreamer/" + instance.name);
+        return true;
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        logMessage("Cannot pin to CPUs " + cpus + ": " + strerror(errno));
+        return false;
+    }
+    logMessage("Pinned to CPUs " + cpus + " through CPU affinity");
+    return true;
+}
@@ -0,0 +1,741 @@
+#include "../includes/LogPipeline.hpp"
+#include "../includes/Utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <stdint.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
+
+static const size_t kRingLines = 1024;
+static const size_t kReadBufferSize = 16384;
+static const size_t kMaxLineBytes = 8192;
+static const size_t kWriteBatchBytes = 65536;
+static const int kNoticeIntervalMs = 1000;
+static const int kFlushIntervalMs = 200;
+static const long long kRepeatNoticeMs = 10000;
+static const double kLinesPerSecond = 50;
+static const double kLineBurst = 500;
+static const long long kMaxLogBytes = 20LL * 1024 * 1024;
+static const time_t kMaxLogAgeSeconds = 24 * 3600;
+static const size_t kMaxRotatedFiles = 15;
+static const time_t kMaxRotatedAgeSeconds = 14 * 24 * 3600;
+static const time_t kLowDiskAgeSeconds = 24 * 3600;
+static const int kLowDiskPercent = 85;
+static const uint64_t kWakeTag = ~static_cast<uint64_t>(0);
+static const int kIoprioWhoProcess = 1;
+static const int kIoprioClassIdle = 3;
+static const int kIoprioClassShift = 13;
+
+/**
+ * @brief Constructor
+ *
+ * @param capacity Maximum number of queued lines
+ */
+LineRing::LineRing(size_t capacity) : slots(capacity), head(0), tail(0) {
+}
+
+/**
+ * @brief Queues a line; producer side only
+ *
+ * @param line The line
+ * @return bool False if the ring is full and the line was not queued
+ */
+bool LineRing::push(const std::string& line) {
+    size_t position = tail.load(std::memory_order_relaxed);
+    if (position - head.load(std::memory_order_acquire) >= slots.size()) {
+        return false;
+    }
+    slots[position % slots.size()].assign(line);
+    tail.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Takes the oldest line; consumer side only
+ *
+ * @param line Receives the line
+ * @return bool False if the ring is empty
+ */
+bool LineRing::pop(std::string& line) {
+    size_t position = head.load(std::memory_order_relaxed);
+    if (position == tail.load(std::memory_order_acquire)) {
+        return false;
+    }
+    line.assign(slots[position % slots.size()]);
+    head.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param pipeline The pipeline the output goes to
+ * @param file The log file of the observed child
+ */
+LogPipeline::Source::Source(LogPipeline& pipeline, LogFile& file) : pipeline(pipeline), file(file) {
+}
+
+/**
+ * @brief Hands the output pipes of a started child to the reader thread
+ *
+ * @param pid The child process
+ * @param fds Our ends of the child's stdout and stderr pipes
+ */
+void LogPipeline::Source::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    pipeline.attach(file, fds);
+}
+
+/**
+ * @brief Called when the child exits; its pipes reach EOF on their own
+ *
+ * @param status The wait status
+ */
+void LogPipeline::Source::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param pipeline The owning pipeline
+ * @param path The log file
+ * @param external True for the supervisor's own stdout, which is
+ *        written directly and only rotated here
+ */
+LogPipeline::LogFile::LogFile(LogPipeline& pipeline, const std::string& path, bool external)
+    : path(path), fd(-1), external(external), size(0), openedAt(time(NULL)), ring(kRingLines),
+      dropped(0), source(pipeline, *this), repeats(0), repeatSince(0), tokens(kLineBurst),
+      refilledAt(monotonicMs()), limited(0) {
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param logDir The directory holding the logs, scanned at start for
+ *        rotated files that were never compressed
+ */
+LogPipeline::LogPipeline(const std::string& logDir)
+    : logDir(logDir), stopping(false), writerStopping(false), compressStopping(false), epollFd(-1), wakeFd(-1) {
+}
+
+/**
+ * @brief Destructor
+ */
+LogPipeline::~LogPipeline() {
+    shutdown();
+}
+
+/**
+ * @brief Finds or creates the state of a log file
+ *
+ * @param path The log file
+ * @param external True for a file written by the supervisor itself
+ * @return LogFile& The state, which lives as long as the pipeline
+ */
+LogPipeline::LogFile& LogPipeline::fileFor(const std::string& path, bool external) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (std::list<LogFile>::iterator it = files.begin(); it != files.end(); ++it) {
+        if (it->path == path) {
+            return *it;
+        }
+    }
+    files.emplace_back(*this, path, external);
+    return files.back();
+}
+
+/**
+ * @brief Replaces the log file of a child by pipes to the pipeline
+ *
+ * stderr always goes through a pipe; stdout too unless the spec already
+ * pipes it elsewhere (the encoder's output goes to the fanout).
+ *
+ * @param spec The copy of the spec about to be started
+ */
+void LogPipeline::route(ChildSpec& spec) {
+    LogFile& file = fileFor(spec.logPath, false);
+    bool stdoutTaken = false;
+    for (size_t i = 0; i < spec.pipes.size(); i++) {
+        stdoutTaken = stdoutTaken || spec.pipes[i].childFd == STDOUT_FILENO;
+    }
+    ChildPipe output = { STDOUT_FILENO, true, &file.source };
+    ChildPipe errors = { STDERR_FILENO, true, &file.source };
+    if (!stdoutTaken) {
+        spec.pipes.push_back(output);
+    }
+    spec.pipes.push_back(errors);
+    spec.logPath.clear();
+}
+
+/**
+ * @brief Rotates a log the supervisor writes on its stdout and stderr
+ *
+ * The file stays open on descriptors 1 and 2; rotation swaps them to the
+ * new file with dup2(), which never loses a line.
+ *
+ * @param path The file currently open on stdout
+ */
+void LogPipeline::watchOutput(const std::string& path) {
+    fileFor(path, true);
+}
+
+/**
+ * @brief Starts the reader, writer and compression threads
+ *
+ * @throws std::runtime_error If the reader cannot poll
+ */
+void LogPipeline::start() {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        throw std::runtime_error(std::string("Cannot set up logging: ") + strerror(errno));
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = kWakeTag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+    reader = std::thread(&LogPipeline::readerLoop, this);
+    writer = std::thread(&LogPipeline::writerLoop, this);
+    compressor = std::thread(&LogPipeline::compressorLoop, this);
+}
+
+/**
+ * @brief Writes what the children printed so far and stops the threads
+ *
+ * Meant to run once the children have exited. A compression in progress
+ * is abandoned; the rotated file is compressed at the next start.
+ */
+void LogPipeline::shutdown() {
+    stopping = true;
+    if (wakeFd >= 0) {
+        uint64_t one = 1;
+        if (write(wakeFd, &one, sizeof(one)) < 0) {
+            logMessage(std::string("Cannot wake the log reader: ") + strerror(errno));
+        }
+    }
+    if (reader.joinable()) {
+        reader.join();
+    }
+    writerStopping = true;
+    if (writer.joinable()) {
+        writer.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compressStopping = true;
+    }
+    compressWakeup.notify_one();
+    if (compressor.joinable()) {
+        compressor.join();
+    }
+    for (std::list<LogFile>::iterator it = files.begin(); it != files.end(); ++it) {
+        if (it->fd >= 0) {
+            close(it->fd);
+            it->fd = -1;
+        }
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+        epollFd = -1;
+    }
+    if (wakeFd >= 0) {
+        close(wakeFd);
+        wakeFd = -1;
+    }
+}
+
+/**
+ * @brief Queues the output pipes of a child for the reader thread
+ *
+ * Runs on the supervisor thread, so it only takes the lock briefly.
+ *
+ * @param file The log file the pipes write to
+ * @param fds Our ends of the pipes
+ */
+void LogPipeline::attach(LogFile& file, const std::vector<int>& fds) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < fds.size(); i++) {
+            Stream stream;
+            stream.fd = fds[i];
+            stream.file = &file;
+            fcntl(stream.fd, F_SETFL, fcntl(stream.fd, F_GETFL) | O_NONBLOCK);
+            pendingStreams.push_back(stream);
+        }
+    }
+    uint64_t one = 1;
+    if (wakeFd < 0 || write(wakeFd, &one, sizeof(one)) < 0) {
+        logMessage("Cannot wake the log reader, output of the child is lost");
+    }
+}
+
+/**
+ * @brief Body of the reader thread
+ *
+ * Reads every child pipe through one epoll set. Once shutting down, the
+ * pipes are read until they are empty and the partial lines are kept.
+ */
+void LogPipeline::readerLoop() {
+    for (;;) {
+        struct epoll_event events[16];
+        int count = epoll_wait(epollFd, events, 16, kNoticeIntervalMs);
+        long long nowMs = monotonicMs();
+        bool finishing = stopping;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < pendingStreams.size(); i++) {
+                struct epoll_event ev;
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN;
+                ev.data.u64 = static_cast<uint64_t>(pendingStreams[i].fd);
+                epoll_ctl(epollFd, EPOLL_CTL_ADD, pendingStreams[i].fd, &ev);
+                streams.push_back(pendingStreams[i]);
+            }
+            pendingStreams.clear();
+        }
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.u64 == kWakeTag) {
+                uint64_t value;
+                if (read(wakeFd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+                    logMessage(std::string("Cannot read the log wake-up: ") + strerror(errno));
+                }
+                continue;
+            }
+            int fd = static_cast<int>(events[i].data.u64);
+            for (size_t j = 0; j < streams.size(); j++) {
+                if (streams[j].fd == fd && readStream(streams[j], nowMs) == STREAM_CLOSED) {
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+                    close(fd);
+                    streams.erase(streams.begin() + static_cast<long>(j));
+                    break;
+                }
+            }
+        }
+        if (finishing) {
+            for (size_t i = 0; i < streams.size(); i++) {
+                while (readStream(streams[i], nowMs) == STREAM_DATA) {
+                }
+                if (!streams[i].partial.empty()) {
+                    submit(*streams[i].file, streams[i].partial, nowMs);
+                }
+                close(streams[i].fd);
+            }
+            streams.clear();
+        }
+        std::vector<LogFile*> current;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::list<LogFile>::iterator it = files.begin(); it != files.end(); ++it) {
+                current.push_back(&*it);
+            }
+        }
+        for (size_t i = 0; i < current.size(); i++) {
+            flushNotices(*current[i], nowMs, finishing);
+        }
+        if (finishing) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Reads what a pipe holds and submits the complete lines
+ *
+ * Both \n and \r end a line, so progress lines redrawn in place are
+ * split too. Overlong lines are cut at kMaxLineBytes.
+ *
+ * A readiness event with nothing to read, or an interrupted read, is
+ * STREAM_EMPTY: only end of file or a read error closes the pipe.
+ *
+ * @param stream The pipe
+ * @param nowMs The current monotonic time
+ * @return StreamRead STREAM_CLOSED once the pipe is closed
+ */
+LogPipeline::StreamRead LogPipeline::readStream(Stream& stream, long long nowMs) {
+    char buffer[kReadBufferSize];
+    ssize_t count = read(stream.fd, buffer, sizeof(buffer));
+    if (count < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return STREAM_EMPTY;
+    }
+    if (count <= 0) {
+        if (!stream.partial.empty()) {
+            submit(*stream.file, stream.partial, nowMs);
+            stream.partial.clear();
+        }
+        return STREAM_CLOSED;
+    }
+    for (ssize_t i = 0; i < count; i++) {
+        char c = buffer[i];
+        if (c == '\n' || c == '\r') {
+            if (!stream.partial.empty()) {
+                submit(*stream.file, stream.partial, nowMs);
+                stream.partial.clear();
+            }
+        } else {
+            stream.partial += c;
+            if (stream.partial.size() >= kMaxLineBytes) {
+                submit(*stream.file, stream.partial, nowMs);
+                stream.partial.clear();
+            }
+        }
+    }
+    return STREAM_DATA;
+}
+
+/**
+ * @brief Queues a notice written by the pipeline itself
+ *
+ * @param ring The ring of the log file
+ * @param dropped The drop counter of the log file
+ * @param text The notice, without timestamp
+ */
+static void pushNotice(LineRing& ring, std::atomic<unsigned long>& dropped, const std::string& text) {
+    if (!ring.push("[" + isoTimestamp() + "] pagestreamer: " + text)) {
+        dropped++;
+    }
+}
+
+/**
+ * @brief Filters one line and queues it for the writer
+ *
+ * A line equal to the previous one is only counted, like syslog does;
+ * the count is written when another line comes or every
+ * kRepeatNoticeMs. Past a burst of kLineBurst lines, a child may only
+ * log kLinesPerSecond lines per second; the excess is counted and
+ * reported once it calms down.
+ *
+ * @param file The log file of the child
+ * @param line The line, without end of line
+ * @param nowMs The current monotonic time
+ */
+void LogPipeline::submit(LogFile& file, const std::string& line, long long nowMs) {
+    if (line == file.lastLine) {
+        if (file.repeats++ == 0) {
+            file.repeatSince = nowMs;
+        }
+        flushNotices(file, nowMs, false);
+        return;
+    }
+    if (file.repeats > 0) {
+        char text[64];
+        snprintf(text, sizeof(text), "previous line repeated %lu times", file.repeats);
+        pushNotice(file.ring, file.dropped, text);
+        file.repeats = 0;
+    }
+    flushNotices(file, nowMs, false);
+    file.lastLine = line;
+    if (file.tokens < 1) {
+        file.limited++;
+        return;
+    }
+    file.tokens -= 1;
+    if (!file.ring.push(line)) {
+        file.dropped++;
+    }
+}
+
+/**
+ * @brief Writes the pending repeat and rate limit counts of a file
+ *
+ * @param file The log file
+ * @param nowMs The current monotonic time
+ * @param force True to write the counts whatever their age, when the
+ *        pipeline shuts down
+ */
+void LogPipeline::flushNotices(LogFile& file, long long nowMs, bool force) {
+    char text[96];
+    file.tokens = std::min(kLineBurst, file.tokens + (nowMs - file.refilledAt) * kLinesPerSecond / 1000.0);
+    file.refilledAt = nowMs;
+    if (file.repeats > 0 && (force || nowMs - file.repeatSince >= kRepeatNoticeMs)) {
+        snprintf(text, sizeof(text), "previous line repeated %lu times", file.repeats);
+        pushNotice(file.ring, file.dropped, text);
+        file.repeats = 0;
+    }
+    if (file.limited > 0 && (force || file.tokens >= kLinesPerSecond)) {
+        snprintf(text, sizeof(text), "%lu lines dropped, more than %.0f lines per second", file.limited,
+                 kLinesPerSecond);
+        pushNotice(file.ring, file.dropped, text);
+        file.limited = 0;
+    }
+}
+
+/**
+ * @brief Body of the writer thread
+ *
+ * Drains every ring each kFlushIntervalMs, so the children's lines
+ * reach the disk in a few large writes instead of one per line.
+ */
+void LogPipeline::writerLoop() {
+    for (;;) {
+        bool finishing = writerStopping;
+        std::vector<LogFile*> current;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (std::list<LogFile>::iterator it = files.begin(); it != files.end(); ++it) {
+                current.push_back(&*it);
+            }
+        }
+        for (size_t i = 0; i < current.size(); i++) {
+            drain(*current[i]);
+        }
+        if (finishing) {
+            return;
+        }
+        usleep(kFlushIntervalMs * 1000);
+    }
+}
+
+/**
+ * @brief Writes the queued lines of a file and rotates it when due
+ *
+ * @param file The log file
+ */
+void LogPipeline::drain(LogFile& file) {
+    struct stat info;
+    if (file.external) {
+        if (fstat(STDOUT_FILENO, &info) == 0) {
+            file.size = info.st_size;
+        }
+    } else {
+        std::string line;
+        std::string batch;
+        unsigned long dropped = file.dropped.exchange(0);
+        if (file.fd < 0) {
+            file.fd = open(file.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+            file.size = file.fd >= 0 && fstat(file.fd, &info) == 0 ? info.st_size : 0;
+            file.openedAt = time(NULL);
+        }
+        if (dropped > 0) {
+            char text[96];
+            snprintf(text, sizeof(text), "%lu lines dropped, log queue full", dropped);
+            batch = "[" + isoTimestamp() + "] pagestreamer: " + text + "\n";
+        }
+        for (;;) {
+            bool more = file.ring.pop(line);
+            if (more) {
+                batch += line;
+                batch += '\n';
+            }
+            if (!batch.empty() && (!more || batch.size() >= kWriteBatchBytes)) {
+                if (file.fd >= 0 && writeFully(file.fd, batch.data(), batch.size())) {
+                    file.size += static_cast<long long>(batch.size());
+                }
+                batch.clear();
+            }
+            if (!more) {
+                break;
+            }
+        }
+    }
+    if (file.size >= kMaxLogBytes || (file.size > 0 && time(NULL) - file.openedAt >= kMaxLogAgeSeconds)) {
+        rotate(file);
+    }
+}
+
+/**
+ * @brief Renames a log aside and starts a new one in its place
+ *
+ * The renamed file gets the local time as suffix, e.g.
+ * ffmpeg.log.20250131_205500, and is queued for compression.
+ *
+ * @param file The log file
+ */
+void LogPipeline::rotate(LogFile& file) {
+    char stamp[32];
+    time_t now = time(NULL);
+    struct tm local;
+    struct stat info;
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+    std::string rotated = file.path + "." + stamp;
+    for (int i = 1; stat(rotated.c_str(), &info) == 0 || stat((rotated + ".gz").c_str(), &info) == 0; i++) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "-%d", i);
+        rotated = file.path + "." + stamp + suffix;
+    }
+    if (rename(file.path.c_str(), rotated.c_str()) != 0) {
+        logMessage("Cannot rotate " + file.path + ": " + strerror(errno));
+        file.openedAt = now;
+        return;
+    }
+    int fd = open(file.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (file.external && fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    } else if (!file.external) {
+        if (file.fd >= 0) {
+            close(file.fd);
+        }
+        file.fd = fd;
+    }
+    file.size = 0;
+    file.openedAt = now;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        compressQueue.push_back(rotated);
+    }
+    compressWakeup.notify_one();
+}
+
+/**
+ * @brief Body of the compression thread
+ *
+ * Runs with the idle CPU scheduling class and I/O priority, so gzip
+ * only gets the time the encoder does not need.
+ */
+void LogPipeline::compressorLoop() {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+    pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+    setpriority(PRIO_PROCESS, static_cast<id_t>(tid), 19);
+    syscall(SYS_ioprio_set, kIoprioWhoProcess, tid, kIoprioClassIdle << kIoprioClassShift);
+    queueLeftovers();
+    for (;;) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!compressStopping && compressQueue.empty()) {
+                compressWakeup.wait(lock);
+            }
+            if (compressStopping) {
+                return;
+            }
+            path = compressQueue.front();
+            compressQueue.pop_front();
+        }
+        if (compress(path)) {
+            prune(path.substr(0, path.rfind('.')));
+        }
+    }
+}
+
+/**
+ * @brief Tells whether a file name is a rotated log, e.g. x.log.20250131_205500
+ *
+ * @param name The file name
+ * @param compressed True to match the .gz files instead
+ * @return bool True if it is a rotated log of the wanted kind
+ */
+static bool isRotatedLog(const std::string& name, bool compressed) {
+    size_t marker = name.find(".log.");
+    bool gz = name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0;
+    return marker != std::string::npos && name.find(".part") == std::string::npos && gz == compressed;
+}
+
+/**
+ * @brief Queues the rotated logs a previous supervisor did not compress
+ */
+void LogPipeline::queueLeftovers() {
+    DIR* dir = opendir(logDir.c_str());
+    struct dirent* entry;
+    if (!dir) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        if (name.size() > 5 && name.compare(name.size() - 5, 5, ".part") == 0) {
+            unlink((logDir + "/" + name).c_str());
+        } else if (isRotatedLog(name, false)) {
+            compressQueue.push_back(logDir + "/" + name);
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ * @brief Compresses a rotated log to path.gz and removes it
+ *
+ * Gives up as soon as the pipeline shuts down, so stopping the stream
+ * is never delayed by a large file.
+ *
+ * @param path The rotated log
+ * @return bool True if the file was compressed
+ */
+bool LogPipeline::compress(const std::string& path) {
+    std::string target = path + ".gz";
+    std::string partial = target + ".part";
+    char buffer[kReadBufferSize];
+    int input = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    gzFile output = input >= 0 ? gzopen(partial.c_str(), "wb6") : NULL;
+    bool ok = output != NULL;
+    while (ok) {
+        ssize_t count = read(input, buffer, sizeof(buffer));
+        if (count <= 0) {
+            ok = count == 0;
+            break;
+        }
+        ok = !compressStopping && gzwrite(output, buffer, static_cast<unsigned int>(count)) == count;
+    }
+    if (output && gzclose(output) != Z_OK) {
+        ok = false;
+    }
+    if (input >= 0) {
+        close(input);
+    }
+    if (ok && rename(partial.c_str(), target.c_str()) == 0) {
+        unlink(path.c_str());
+        return true;
+    }
+    unlink(partial.c_str());
+    return false;
+}
+
+/**
+ * @brief Removes the old rotated files of a log
+ *
+ * Keeps at most kMaxRotatedFiles files of kMaxRotatedAgeDays, and only
+ * the last day when the disk is more than kLowDiskPercent full.
+ *
+ * @param path The live log whose rotated files to prune
+ */
+void LogPipeline::prune(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dirPath = path.substr(0, slash);
+    std::string prefix = path.substr(slash + 1) + ".";
+    std::vector<std::pair<time_t, std::string> > rotated;
+    struct statvfs disk;
+    time_t maxAge = kMaxRotatedAgeSeconds;
+    time_t now = time(NULL);
+    DIR* dir = opendir(dirPath.c_str());
+    struct dirent* entry;
+    if (!dir) {
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        std::string name = entry->d_name;
+        struct stat info;
+        if (name.compare(0, prefix.size(), prefix) == 0 && isRotatedLog(name, true)
+            && stat((dirPath + "/" + name).c_str(), &info) == 0) {
+            rotated.push_back(std::make_pair(info.st_mtime, dirPath + "/" + name));
+        }
+    }
+    closedir(dir);
+    if (statvfs(dirPath.c_str(), &disk) == 0 && disk.f_blocks > 0
+        && 100 - disk.f_bavail * 100 / disk.f_blocks > static_cast<unsigned long>(kLowDiskPercent)) {
+        maxAge = kLowDiskAgeSeconds;
+    }
+    std::sort(rotated.begin(), rotated.end());
+    for (size_t i = 0; i < rotated.size(); i++) {
+        if (now - rotated[i].first > maxAge || rotated.size() - i > kMaxRotatedFiles) {
+            unlink(rotated[i].second.c_str());
+        }
+    }
+}
@@ -0,0 +1,380 @@
+#include "../includes/Recycler.hpp"
+#include "../includes/Utils.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <dirent.h>
+#include <unistd.h>
+
+static const int kTickMs = 500;
+static const long long kSampleIntervalMs = 30 * 1000;
+static const long long kReadyTimeoutMs = 90 * 1000;
+static const long long kSettleMs = 2000;
+static const long long kHandoverMs = 10 * 1000;
+static const long long kRetryMs = 10 * 60 * 1000;
+static const long long kMinAgeMs = 10 * 60 * 1000;
+static const long long kMiB = 1024 * 1024;
+
+/**
+ * @brief Reads the memory used by one process
+ *
+ * Uses the proportional set size, which splits the pages the browser
+ * processes share between them instead of counting them in each, and
+ * falls back to the resident set size on kernels without smaps_rollup.
+ *
+ * @param pid The process
+ * @return long long The memory in bytes, 0 if the process is gone
+ */
+static long long processMemory(pid_t pid) {
+    std::ostringstream path;
+    path << "/proc/" << pid << "/smaps_rollup";
+    std::ifstream rollup(path.str().c_str());
+    std::string key;
+    long long kib = 0;
+    while (rollup >> key) {
+        if (key == "Pss:" && rollup >> kib) {
+            return kib * 1024;
+        }
+        rollup.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    path.str("");
+    path << "/proc/" << pid << "/statm";
+    std::ifstream statm(path.str().c_str());
+    long long size = 0;
+    long long resident = 0;
+    if (statm >> size >> resident) {
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+    return 0;
+}
+
+/**
+ * @brief Adds up the memory of every process in a process group
+ *
+ * The supervisor starts the browser as a group leader, and its GPU,
+ * renderer and utility processes stay in its group.
+ *
+ * @param group The process group, i.e. the browser's PID
+ * @return long long The memory in bytes
+ */
+static long long processGroupMemory(pid_t group) {
+    DIR* proc = opendir("/proc");
+    struct dirent* entry;
+    long long total = 0;
+    if (!proc) {
+        return 0;
+    }
+    while ((entry = readdir(proc)) != NULL) {
+        pid_t pid = static_cast<pid_t>(atoi(entry->d_name));
+        if (pid <= 0) {
+            continue;
+        }
+        std::ostringstream path;
+        path << "/proc/" << pid << "/stat";
+        std::ifstream statFile(path.str().c_str());
+        std::string stat;
+        if (!std::getline(statFile, stat) || stat.rfind(')') == std::string::npos) {
+            continue;
+        }
+        std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+        char state;
+        pid_t ppid;
+        pid_t pgrp;
+        if (fields >> state >> ppid >> pgrp && pgrp == group) {
+            total += processMemory(pid);
+        }
+    }
+    closedir(proc);
+    return total;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param recycler The recycler to inform
+ * @param buffer The buffer of the browser, 0 or 1
+ */
+BrowserRecycler::BrowserWatch::BrowserWatch(BrowserRecycler& recycler, int buffer)
+    : recycler(recycler), buffer(buffer) {
+}
+
+/**
+ * @brief Records the new browser process and when it started
+ *
+ * @param pid The browser process, leader of its process group
+ * @param fds Unused, the browser has no pipes
+ */
+void BrowserRecycler::BrowserWatch::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)fds;
+    std::lock_guard<std::mutex> lock(recycler.mutex);
+    recycler.browserPids[buffer] = pid;
+    recycler.browserStartedMs[buffer] = monotonicMs();
+}
+
+/**
+ * @brief Forgets the browser process
+ *
+ * @param status The wait status
+ */
+void BrowserRecycler::BrowserWatch::childExited(int status) {
+    (void)status;
+    std::lock_guard<std::mutex> lock(recycler.mutex);
+    recycler.browserPids[buffer] = -1;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param recycler The recycler to inform
+ * @param buffer The buffer of the driver, 0 or 1
+ */
+BrowserRecycler::DriverWatch::DriverWatch(BrowserRecycler& recycler, int buffer)
+    : recycler(recycler), buffer(buffer) {
+}
+
+/**
+ * @brief Forgets the page of the previous driver
+ *
+ * @param pid The driver process
+ * @param fds Unused, the driver has no pipes for the recycler
+ */
+void BrowserRecycler::DriverWatch::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    (void)fds;
+    std::lock_guard<std::mutex> lock(recycler.mutex);
+    recycler.pagesReady[buffer] = false;
+}
+
+/**
+ * @brief Forgets the page of the driver
+ *
+ * @param status The wait status
+ */
+void BrowserRecycler::DriverWatch::childExited(int status) {
+    (void)status;
+    std::lock_guard<std::mutex> lock(recycler.mutex);
+    recycler.pagesReady[buffer] = false;
+}
+
+/**
+ * @brief Records that the driver rendered its page and wakes the worker
+ */
+void BrowserRecycler::DriverWatch::childReady() {
+    {
+        std::lock_guard<std::mutex> lock(recycler.mutex);
+        recycler.pagesReady[buffer] = true;
+    }
+    recycler.wakeup.notify_one();
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param control Starts, captures and stops the buffers
+ * @param memoryLimitMiB Memory of the browser that triggers a recycle, 0 for none
+ * @param maxAgeHours Age of the browser that triggers a recycle, 0 for none
+ */
+BrowserRecycler::BrowserRecycler(BufferControl& control, int memoryLimitMiB, int maxAgeHours)
+    : control(control), memoryLimitBytes(memoryLimitMiB * kMiB), maxAgeMs(maxAgeHours * 3600 * 1000LL),
+      browsers{ BrowserWatch(*this, 0), BrowserWatch(*this, 1) },
+      drivers{ DriverWatch(*this, 0), DriverWatch(*this, 1) }, shuttingDown(false), active(0),
+      memoryBytes(-1), recycles(0), phase(PHASE_IDLE), phaseStartedMs(0), nextSampleMs(0), retryAtMs(0) {
+    for (int i = 0; i < 2; i++) {
+        browserPids[i] = -1;
+        browserStartedMs[i] = -1;
+        pagesReady[i] = false;
+    }
+}
+
+/**
+ * @brief Destructor
+ */
+BrowserRecycler::~BrowserRecycler() {
+    shutdown();
+}
+
+/**
+ * @brief Returns the observer to attach to the browser of a buffer
+ *
+ * @param buffer 0 or 1
+ * @return ChildObserver* The observer, owned by the recycler
+ */
+ChildObserver* BrowserRecycler::browserObserver(int buffer) {
+    return &browsers[buffer];
+}
+
+/**
+ * @brief Returns the observer to attach to the driver of a buffer
+ *
+ * @param buffer 0 or 1
+ * @return ChildObserver* The observer, owned by the recycler
+ */
+ChildObserver* BrowserRecycler::driverObserver(int buffer) {
+    return &drivers[buffer];
+}
+
+/**
+ * @brief Starts the recycling thread
+ */
+void BrowserRecycler::start() {
+    worker = std::thread(&BrowserRecycler::workerLoop, this);
+}
+
+/**
+ * @brief Stops the recycling thread, leaving the buffers as they are
+ */
+void BrowserRecycler::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+    }
+    wakeup.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Body of the recycling thread
+ *
+ * Wakes up twice a second, and right away when a driver is ready.
+ */
+void BrowserRecycler::workerLoop() {
+    for (;;) {
+        bool ready;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!shuttingDown) {
+                wakeup.wait_for(lock, std::chrono::milliseconds(kTickMs));
+            }
+            if (shuttingDown) {
+                break;
+            }
+            ready = phase == PHASE_LOADING && pagesReady[1 - active];
+        }
+        advance(monotonicMs(), ready);
+    }
+}
+
+/**
+ * @brief Moves the recycling forward, one step at a time
+ *
+ * A browser younger than kMinAgeMs is left alone, so a limit below what
+ * a fresh browser needs cannot recycle it over and over.
+ *
+ * @param nowMs The current monotonic time
+ * @param ready True if the fresh driver just reported its page rendered
+ */
+void BrowserRecycler::advance(long long nowMs, bool ready) {
+    std::ostringstream msg;
+    if (phase == PHASE_IDLE) {
+        if (nowMs < nextSampleMs) {
+            return;
+        }
+        nextSampleMs = nowMs + kSampleIntervalMs;
+        sampleMemory();
+        std::unique_lock<std::mutex> lock(mutex);
+        long long startedMs = browserStartedMs[active];
+        if (browserPids[active] <= 0 || nowMs - startedMs < kMinAgeMs) {
+            return;
+        }
+        if (memoryLimitBytes > 0 && memoryBytes > memoryLimitBytes) {
+            msg << "the browser uses " << memoryBytes / kMiB << " MiB";
+        } else if (maxAgeMs > 0 && nowMs - startedMs >= maxAgeMs) {
+            msg << "the browser has run for " << (nowMs - startedMs) / 3600000 << " h";
+        }
+        if (msg.str().empty() || nowMs < retryAtMs) {
+            return;
+        }
+        lock.unlock();
+        logMessage("Browser recycling: " + msg.str() + ", starting a fresh one on the spare display");
+        phase = PHASE_LOADING;
+        phaseStartedMs = nowMs;
+        control.startSpare();
+    } else if (phase == PHASE_LOADING) {
+        if (ready) {
+            msg << "Browser recycling: the fresh page is ready after " << (nowMs - phaseStartedMs) / 1000 << " s";
+            logMessage(msg.str());
+            phase = PHASE_SETTLING;
+            phaseStartedMs = nowMs;
+        } else if (nowMs - phaseStartedMs >= kReadyTimeoutMs) {
+            msg << "Browser recycling: the fresh page is not ready after " << kReadyTimeoutMs / 1000
+                << " s, keeping the current browser";
+            logMessage(msg.str());
+            control.stopSpare();
+            phase = PHASE_IDLE;
+            retryAtMs = nowMs + kRetryMs;
+        }
+    } else if (phase == PHASE_SETTLING) {
+        if (nowMs - phaseStartedMs < kSettleMs) {
+            return;
+        }
+        control.switchToSpare();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active = 1 - active;
+            recycles++;
+            memoryBytes = -1;
+        }
+        phase = PHASE_HANDOVER;
+        phaseStartedMs = nowMs;
+    } else if (nowMs - phaseStartedMs >= kHandoverMs) {
+        logMessage("Browser recycling: stopping the previous browser and display");
+        control.stopSpare();
+        phase = PHASE_IDLE;
+        nextSampleMs = nowMs + kSampleIntervalMs;
+    }
+}
+
+/**
+ * @brief Measures the memory of the streamed browser
+ */
+void BrowserRecycler::sampleMemory() {
+    pid_t pid;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pid = browserPids[active];
+    }
+    long long bytes = pid > 0 ? processGroupMemory(pid) : -1;
+    std::lock_guard<std::mutex> lock(mutex);
+    memoryBytes = bytes;
+}
+
+/**
+ * @brief Writes the browser memory and the recycles as metrics
+ *
+ * @param out The response body
+ * @param labels Label pairs to add to every sample
+ */
+void BrowserRecycler::writeMetrics(std::ostream& out, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (memoryBytes >= 0) {
+        writeMetricHeader(out, "pagestreamer_browser_memory_bytes", "gauge",
+                          "Memory used by the streamed browser's processes");
+        writeMetricSample(out, "pagestreamer_browser_memory_bytes", labels, static_cast<double>(memoryBytes));
+    }
+    writeMetricHeader(out, "pagestreamer_browser_recycles_total", "counter",
+                      "Browsers replaced by a fresh one on the spare display");
+    writeMetricSample(out, "pagestreamer_browser_recycles_total", labels, static_cast<unsigned long long>(recycles));
+}
+
+/**
+ * @brief Writes the browser memory for pagestreamer stats
+ *
+ * @param out The response body
+ */
+void BrowserRecycler::writeReport(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    long long nowMs = monotonicMs();
+    out << "Browser: ";
+    if (memoryBytes >= 0) {
+        out << memoryBytes / kMiB << " MiB";
+    } else {
+        out << "memory not measured yet";
+    }
+    if (browserPids[active] > 0) {
+        out << ", running for " << (nowMs - browserStartedMs[active]) / 60000 << " min";
+    }
+    out << ", recycled " << recycles << (recycles == 1 ? " time" : " times") << "\n";
+}
@@ -0,0 +1,505 @@
+#include "../includes/Schedule.hpp"
+#include "../includes/StreamManager.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static const size_t kWheelSlots = 3600;
+static const int kRescanSeconds = 10;
+static const int kMaxLeadMinutes = 24 * 60;
+static const int kLookAheadDays = 8;
+static const char* kZoneInfoDir = "/usr/share/zoneinfo/";
+static const char* kDayNames[] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+/**
+ * @brief Switches the process timezone for the lifetime of the object
+ *
+ * localtime_r() and mktime() follow TZ, so window times are converted
+ * in the schedule's zone without forking date. Not thread-safe: only
+ * the CLI and the scheduler loop use it.
+ */
+class ZoneScope {
+private:
+    bool hadZone;
+    std::string savedZone;
+
+public:
+    explicit ZoneScope(const std::string& zone) : hadZone(getenv("TZ") != NULL) {
+        if (hadZone) {
+            savedZone = getenv("TZ");
+        }
+        if (!zone.empty()) {
+            setenv("TZ", zone.c_str(), 1);
+        }
+        tzset();
+    }
+
+    ~ZoneScope() {
+        if (hadZone) {
+            setenv("TZ", savedZone.c_str(), 1);
+        } else {
+            unsetenv("TZ");
+        }
+        tzset();
+    }
+};
+
+/**
+ * @brief Constructor
+ *
+ * Initializes an empty schedule in the system timezone without lead time.
+ */
+Schedule::Schedule() : leadMinutes(0) {
+}
+
+/**
+ * @brief Lists the windows around a point in time as absolute intervals
+ *
+ * Covers the day before (for windows crossing midnight) up to
+ * kLookAheadDays after. Each start and end is converted on its own
+ * local date, so windows keep their wall-clock times across DST changes.
+ *
+ * @param schedule The schedule
+ * @param now The reference time
+ * @param result Receives [start, end) pairs
+ */
+static void windowIntervals(const Schedule& schedule, time_t now,
+                            std::vector<std::pair<time_t, time_t> >& result) {
+    ZoneScope zone(schedule.timezone);
+    struct tm today;
+    localtime_r(&now, &today);
+    for (int offset = -1; offset <= kLookAheadDays; offset++) {
+        struct tm day = today;
+        day.tm_mday += offset;
+        day.tm_hour = 12;
+        day.tm_min = 0;
+        day.tm_sec = 0;
+        day.tm_isdst = -1;
+        mktime(&day);
+        for (size_t i = 0; i < schedule.windows.size(); i++) {
+            const ScheduleWindow& window = schedule.windows[i];
+            if (!(window.days & (1u << day.tm_wday))) {
+                continue;
+            }
+            struct tm start = day;
+            struct tm end = day;
+            start.tm_hour = window.startMinute / 60;
+            start.tm_min = window.startMinute % 60;
+            start.tm_isdst = -1;
+            end.tm_mday += window.endMinute <= window.startMinute ? 1 : 0;
+            end.tm_hour = window.endMinute / 60;
+            end.tm_min = window.endMinute % 60;
+            end.tm_isdst = -1;
+            result.push_back(std::make_pair(mktime(&start), mktime(&end)));
+        }
+    }
+}
+
+/**
+ * @brief Tells what state the stream should be in at a given time
+ *
+ * @param now The time to look at
+ * @param liveAt Receives the window start when in standby
+ * @return int SCHEDULE_LIVE inside a window, SCHEDULE_STANDBY in the
+ *         lead time before one, SCHEDULE_STOPPED otherwise
+ */
+int Schedule::stateAt(time_t now, time_t& liveAt) const {
+    std::vector<std::pair<time_t, time_t> > intervals;
+    int state = SCHEDULE_STOPPED;
+    windowIntervals(*this, now, intervals);
+    for (size_t i = 0; i < intervals.size(); i++) {
+        if (intervals[i].first <= now && now < intervals[i].second) {
+            return SCHEDULE_LIVE;
+        }
+        if (intervals[i].first - leadMinutes * 60 <= now && now < intervals[i].first) {
+            state = SCHEDULE_STANDBY;
+            liveAt = intervals[i].first;
+        }
+    }
+    return state;
+}
+
+/**
+ * @brief Finds the next time the desired state may change
+ *
+ * @param now The reference time
+ * @return time_t The next standby, start or end time after now, 0 if
+ *         the schedule has no window
+ */
+time_t Schedule::nextBoundary(time_t now) const {
+    std::vector<std::pair<time_t, time_t> > intervals;
+    time_t next = 0;
+    windowIntervals(*this, now, intervals);
+    for (size_t i = 0; i < intervals.size(); i++) {
+        time_t candidates[] = { intervals[i].first - leadMinutes * 60, intervals[i].first, intervals[i].second };
+        for (size_t j = 0; j < 3; j++) {
+            if (candidates[j] > now && (next == 0 || candidates[j] < next)) {
+                next = candidates[j];
+            }
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Formats a time in the schedule's timezone
+ *
+ * @param when The time
+ * @return string e.g. "Fri 20:55 CET"
+ */
+std::string Schedule::format(time_t when) const {
+    ZoneScope zone(timezone);
+    struct tm local;
+    char text[32];
+    localtime_r(&when, &local);
+    strftime(text, sizeof(text), "%a %H:%M %Z", &local);
+    return text;
+}
+
+/**
+ * @brief Parses a time of day
+ *
+ * @param text The time, as HH:MM
+ * @param minute Receives the minutes since midnight
+ * @return bool False if the text is not a valid time
+ */
+static bool parseTimeOfDay(const std::string& text, int& minute) {
+    int hour = -1;
+    int minutes = -1;
+    char extra;
+    if (sscanf(text.c_str(), "%d:%d%c", &hour, &minutes, &extra) != 2
+        || hour < 0 || hour > 23 || minutes < 0 || minutes > 59) {
+        return false;
+    }
+    minute = hour * 60 + minutes;
+    return true;
+}
+
+/**
+ * @brief Looks up a day name
+ *
+ * @param name Three-letter English day name, e.g. fri
+ * @return int The tm_wday index, -1 if unknown
+ */
+static int dayIndex(const std::string& name) {
+    for (int i = 0; i < 7; i++) {
+        if (name == kDayNames[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Parses a list of days
+ *
+ * Accepts "daily", single days and ranges separated by commas, e.g.
+ * "mon,wed" or "fri-sun". Ranges may wrap around the week ("sat-mon").
+ *
+ * @param text The day list
+ * @param days Receives the tm_wday bitmask
+ * @return bool False if a day name is unknown
+ */
+static bool parseDays(const std::string& text, unsigned int& days) {
+    std::istringstream list(text);
+    std::string item;
+    days = 0;
+    if (text == "daily") {
+        days = 0x7f;
+        return true;
+    }
+    while (std::getline(list, item, ',')) {
+        size_t dash = item.find('-');
+        int first = dayIndex(item.substr(0, dash));
+        int last = dash == std::string::npos ? first : dayIndex(item.substr(dash + 1));
+        if (first < 0 || last < 0) {
+            return false;
+        }
+        for (int day = first;; day = (day + 1) % 7) {
+            days |= 1u << day;
+            if (day == last) {
+                break;
+            }
+        }
+    }
+    return days != 0;
+}
+
+/**
+ * @brief Reads and validates a schedule file
+ *
+ * One directive per line, # starts a comment:
+ *   timezone Europe/Paris
+ *   lead 5
+ *   fri-sun 20:55-03:30
+ *
+ * @param path The schedule file
+ * @param schedule Receives the schedule
+ * @param errors Receives one message per invalid line
+ * @return bool False if the file cannot be read or has errors
+ */
+bool loadSchedule(const std::string& path, Schedule& schedule, std::vector<std::string>& errors) {
+    std::ifstream file(path.c_str());
+    std::string line;
+    int number = 0;
+    schedule = Schedule();
+    if (!file.is_open()) {
+        errors.push_back("cannot read " + path);
+        return false;
+    }
+    while (std::getline(file, line)) {
+        std::istringstream fields(line.substr(0, line.find('#')));
+        std::string first;
+        std::string second;
+        std::string extra;
+        std::ostringstream where;
+        number++;
+        where << path << ":" << number << ": ";
+        if (!(fields >> first)) {
+            continue;
+        }
+        fields >> second;
+        if (second.empty() || fields >> extra) {
+            errors.push_back(where.str() + "expected two fields");
+        } else if (first == "timezone") {
+            struct stat info;
+            if (second.find("..") != std::string::npos
+                || stat((kZoneInfoDir + second).c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+                errors.push_back(where.str() + "unknown timezone " + second);
+            }
+            schedule.timezone = second;
+        } else if (first == "lead") {
+            char* end = NULL;
+            long minutes = strtol(second.c_str(), &end, 10);
+            if (*end != '\0' || minutes < 0 || minutes > kMaxLeadMinutes) {
+                errors.push_back(where.str() + "lead must be a number of minutes up to one day");
+            }
+            schedule.leadMinutes = static_cast<int>(minutes);
+        } else {
+            ScheduleWindow window;
+            size_t dash = second.find('-');
+            if (!parseDays(first, window.days)) {
+                errors.push_back(where.str() + "unknown days " + first + ", use e.g. mon,wed or fri-sun or daily");
+            } else if (dash == std::string::npos || !parseTimeOfDay(second.substr(0, dash), window.startMinute)
+                       || !parseTimeOfDay(second.substr(dash + 1), window.endMinute)) {
+                errors.push_back(where.str() + "expected a time range such as 20:55-03:30");
+            } else {
+                schedule.windows.push_back(window);
+            }
+        }
+    }
+    return errors.empty();
+}
+
+/**
+ * @brief Creates a schedule file with the historical weekend slot
+ *
+ * @param path The schedule file, left alone if it already exists
+ * @return bool False if the file could not be created
+ */
+bool writeDefaultSchedule(const std::string& path) {
+    struct stat info;
+    if (stat(path.c_str(), &info) == 0) {
+        return true;
+    }
+    std::ofstream file(path.c_str());
+    file << "# PageStreamer schedule, read by 'pagestreamer scheduler'\n"
+         << "# Windows: DAYS HH:MM-HH:MM, days as mon..sun, ranges (fri-sun) or daily.\n"
+         << "# A window ending before it starts ends the next day.\n"
+         << "timezone Europe/Paris\n"
+         << "# Minutes of standby before each window, with the page already loaded\n"
+         << "lead 5\n"
+         << "fri-sun 20:55-03:30\n";
+    return file.good();
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param size Number of one second slots
+ */
+TimerWheel::TimerWheel(size_t size) : slots(size), current(time(NULL)) {
+}
+
+/**
+ * @brief Sets a timer
+ *
+ * @param key Returned by advance() once the timer expired
+ * @param expiry The expiry time; past times expire at the next advance
+ */
+void TimerWheel::add(const std::string& key, time_t expiry) {
+    Timer timer;
+    timer.key = key;
+    timer.expiry = expiry > current ? expiry : current + 1;
+    slots[static_cast<size_t>(timer.expiry) % slots.size()].push_back(timer);
+}
+
+/**
+ * @brief Moves the wheel forward and collects the expired timers
+ *
+ * After a long pause (e.g. a suspended machine) every slot is visited
+ * once instead of replaying each missed second.
+ *
+ * @param now The current time
+ * @param expired Receives the keys of expired timers
+ */
+void TimerWheel::advance(time_t now, std::vector<std::string>& expired) {
+    time_t steps = now - current;
+    if (steps > static_cast<time_t>(slots.size())) {
+        steps = static_cast<time_t>(slots.size());
+    }
+    for (time_t step = 1; step <= steps; step++) {
+        std::list<Timer>& slot = slots[static_cast<size_t>(current + step) % slots.size()];
+        for (std::list<Timer>::iterator it = slot.begin(); it != slot.end();) {
+            if (it->expiry <= now) {
+                expired.push_back(it->key);
+                it = slot.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (now > current) {
+        current = now;
+    }
+}
+
+/**
+ * @brief Constructor
+ */
+Scheduler::Scheduler() : wheel(kWheelSlots) {
+}
+
+/**
+ * @brief Arms the timer of the next boundary of an instance
+ *
+ * @param entry The instance
+ * @param now The current time
+ */
+void Scheduler::arm(Entry& entry, time_t now) {
+    entry.boundary = entry.schedule.nextBoundary(now);
+    if (entry.boundary > 0) {
+        wheel.add(entry.instance.name, entry.boundary);
+        logMessage(entry.instance.name + ": next change at " + entry.schedule.format(entry.boundary));
+    }
+}
+
+/**
+ * @brief Brings an instance to the state its schedule asks for
+ *
+ * @param entry The instance
+ * @param now The current time
+ * @param allowStop False to only start streams, never stop them
+ */
+void Scheduler::reconcile(Entry& entry, time_t now, bool allowStop) {
+    StreamManager manager(entry.instance);
+    time_t liveAt = 0;
+    int desired = entry.schedule.stateAt(now, liveAt);
+    std::string state = manager.streamState();
+    try {
+        if (desired == SCHEDULE_LIVE && state != "live") {
+            logMessage(entry.instance.name + ": window started, going live");
+            manager.startStream();
+        } else if (desired == SCHEDULE_STANDBY && state == "stopped") {
+            struct timespec clock;
+            clock_gettime(CLOCK_REALTIME, &clock);
+            long long delayMs = static_cast<long long>(liveAt) * 1000
+                                - (static_cast<long long>(clock.tv_sec) * 1000 + clock.tv_nsec / 1000000);
+            logMessage(entry.instance.name + ": standby until " + entry.schedule.format(liveAt));
+            manager.startStandby(delayMs > 0 ? delayMs : 1);
+        } else if (desired == SCHEDULE_STOPPED && state != "stopped" && allowStop) {
+            logMessage(entry.instance.name + ": window ended, stopping");
+            manager.stopStream();
+        }
+    } catch (const std::exception& e) {
+        logMessage(entry.instance.name + ": " + e.what());
+    }
+}
+
+/**
+ * @brief Picks up new, changed and removed schedule files
+ *
+ * @param now The current time
+ */
+void Scheduler::rescan(time_t now) {
+    std::vector<Instance> instances = listInstances();
+    std::map<std::string, bool> seen;
+    for (size_t i = 0; i < instances.size(); i++) {
+        struct stat info;
+        std::string path = instances[i].schedulePath();
+        if (instances[i].slot < 0 || stat(path.c_str(), &info) != 0) {
+            continue;
+        }
+        seen[instances[i].name] = true;
+        std::map<std::string, Entry>::iterator it = entries.find(instances[i].name);
+        if (it != entries.end() && it->second.modified == info.st_mtime) {
+            continue;
+        }
+        Entry entry;
+        std::vector<std::string> errors;
+        if (!loadSchedule(path, entry.schedule, errors)) {
+            logMessage(instances[i].name + ": ignoring the schedule, " + errors[0]);
+            entries.erase(instances[i].name);
+            continue;
+        }
+        logMessage(instances[i].name + (it == entries.end() ? ": schedule loaded" : ": schedule changed"));
+        entry.instance = instances[i];
+        entry.modified = info.st_mtime;
+        Entry& stored = entries[instances[i].name] = entry;
+        reconcile(stored, now, false);
+        arm(stored, now);
+    }
+    for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end();) {
+        if (!seen.count(it->first)) {
+            logMessage(it->first + ": schedule removed");
+            entries.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief Runs the scheduler until it is killed
+ *
+ * Wakes up once a second to advance the timer wheel; schedule files are
+ * checked for changes every kRescanSeconds. Supervisors started from
+ * here are reaped as they exit.
+ */
+void Scheduler::run() {
+    time_t nextRescan = 0;
+    logMessage("Scheduler started");
+    for (;;) {
+        std::vector<std::string> expired;
+        struct timespec clock;
+        clock_gettime(CLOCK_REALTIME, &clock);
+        time_t now = clock.tv_sec;
+        if (now >= nextRescan) {
+            rescan(now);
+            nextRescan = now + kRescanSeconds;
+        }
+        wheel.advance(now, expired);
+        for (size_t i = 0; i < expired.size(); i++) {
+            std::map<std::string, Entry>::iterator it = entries.find(expired[i]);
+            if (it == entries.end() || it->second.boundary == 0 || it->second.boundary > now) {
+                continue;
+            }
+            reconcile(it->second, now, true);
+            arm(it->second, now);
+        }
+        while (waitpid(-1, NULL, WNOHANG) > 0) {
+        }
+        struct timespec next;
+        clock_gettime(CLOCK_REALTIME, &next);
+        next.tv_sec++;
+        next.tv_nsec = 0;
+        while (clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+    }
+}
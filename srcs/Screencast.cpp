@@ -0,0 +1,342 @@
+#include "../includes/Screencast.hpp"
+#include "../includes/Watchdog.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+static const int kPipeBytes = 1024 * 1024;
+static const int kPollIntervalMs = 250;
+static const size_t kMaxFrameBytes = 16 * 1024 * 1024;
+
+/**
+ * @brief Constructor
+ *
+ * @param capture The capture to hand the pipe to
+ * @param buffer The display buffer of the driver
+ */
+ScreencastCapture::FrameSource::FrameSource(ScreencastCapture& capture, int buffer)
+    : capture(capture), buffer(buffer) {
+}
+
+/**
+ * @brief Hands the frame pipe of a freshly started driver to the reader
+ *
+ * @param pid The driver process
+ * @param fds Our end of the driver's frame pipe
+ */
+void ScreencastCapture::FrameSource::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    std::lock_guard<std::mutex> lock(capture.mutex);
+    if (capture.pendingSourceFds[buffer] >= 0) {
+        ::close(capture.pendingSourceFds[buffer]);
+    }
+    capture.pendingSourceFds[buffer] = fds.empty() ? -1 : fds[0];
+}
+
+/**
+ * @brief Called when the driver exits; the reader sees EOF on its own
+ *
+ * @param status The wait status
+ */
+void ScreencastCapture::FrameSource::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param fps The output frame rate
+ * @param watchdog Told about every new frame of the captured page
+ */
+ScreencastCapture::ScreencastCapture(int fps, StreamWatchdog& watchdog)
+    : sources{ FrameSource(*this, 0), FrameSource(*this, 1) }, watchdog(watchdog), shuttingDown(false),
+      active(0), source(-1), sentNumber(0), pacer(*this, "Screencast", fps) {
+    pendingSourceFds[0] = -1;
+    pendingSourceFds[1] = -1;
+    frameNumbers[0] = 0;
+    frameNumbers[1] = 0;
+    memset(&counters, 0, sizeof(counters));
+    reader = std::thread(&ScreencastCapture::readerLoop, this);
+    pacer.start();
+}
+
+/**
+ * @brief Destructor
+ */
+ScreencastCapture::~ScreencastCapture() {
+    shutdown();
+}
+
+/**
+ * @brief Returns the observer to attach to the frame pipe of a driver
+ *
+ * @param buffer The display buffer of the driver, 0 or 1
+ * @return ChildObserver* The observer, owned by the capture
+ */
+ChildObserver* ScreencastCapture::frameObserver(int buffer) {
+    return &sources[buffer];
+}
+
+/**
+ * @brief Captures the page of another buffer from the next frame on
+ *
+ * @param buffer The display buffer, 0 or 1
+ */
+void ScreencastCapture::setSource(int buffer) {
+    std::lock_guard<std::mutex> lock(mutex);
+    active = buffer;
+}
+
+/**
+ * @brief Returns the capture counters since the supervisor started
+ *
+ * @return ScreencastStats A consistent snapshot of the counters
+ */
+ScreencastStats ScreencastCapture::stats() {
+    CaptureStats paced = pacer.stats();
+    std::lock_guard<std::mutex> lock(mutex);
+    ScreencastStats snapshot = counters;
+    snapshot.slots = paced.slots;
+    snapshot.sentFrames = paced.sentFrames;
+    return snapshot;
+}
+
+/**
+ * @brief Hands the stdin pipe of a freshly started encoder to the pacer
+ *
+ * @param pid The encoder process
+ * @param fds Our end of the encoder's stdin
+ */
+void ScreencastCapture::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    pacer.addEncoder(fds);
+}
+
+/**
+ * @brief Called when the encoder exits; the pacer sees EPIPE on its own
+ *
+ * @param status The wait status
+ */
+void ScreencastCapture::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Stops both threads and closes any unused pipe
+ */
+void ScreencastCapture::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        for (int i = 0; i < 2; i++) {
+            if (pendingSourceFds[i] >= 0) {
+                ::close(pendingSourceFds[i]);
+                pendingSourceFds[i] = -1;
+            }
+        }
+    }
+    if (reader.joinable()) {
+        reader.join();
+    }
+    pacer.shutdown();
+}
+
+/**
+ * @brief Writes the capture counters
+ *
+ * @param out The response body
+ * @param labels Label pairs added to every sample
+ */
+void ScreencastCapture::writeMetrics(std::ostream& out, const std::string& labels) {
+    ScreencastStats snapshot = stats();
+    writeMetricHeader(out, "pagestreamer_screencast_received_frames_total", "counter",
+                      "Frames rendered by the browser");
+    writeMetricSample(out, "pagestreamer_screencast_received_frames_total", labels, snapshot.receivedFrames);
+    writeMetricHeader(out, "pagestreamer_screencast_skipped_frames_total", "counter",
+                      "Browser frames replaced by a newer one before being sent");
+    writeMetricSample(out, "pagestreamer_screencast_skipped_frames_total", labels, snapshot.skippedFrames);
+    writeMetricHeader(out, "pagestreamer_capture_slots_total", "counter", "Frame periods of the capture");
+    writeMetricSample(out, "pagestreamer_capture_slots_total", labels, snapshot.slots);
+    writeMetricHeader(out, "pagestreamer_capture_sent_frames_total", "counter", "Frames written to the encoder");
+    writeMetricSample(out, "pagestreamer_capture_sent_frames_total", labels, snapshot.sentFrames);
+}
+
+/**
+ * @brief Writes the capture section of pagestreamer stats
+ *
+ * @param out The response body
+ */
+void ScreencastCapture::writeReport(std::ostream& out) {
+    ScreencastStats snapshot = stats();
+    out << "Capture: screencast, " << snapshot.receivedFrames << " frames from the browser ("
+        << (snapshot.receivedFrames ? snapshot.receivedBytes / snapshot.receivedFrames / 1024 : 0)
+        << " KiB each), " << snapshot.skippedFrames << " skipped\n";
+    out << "  " << snapshot.sentFrames << " of " << snapshot.slots << " frame periods sent to the encoder\n";
+}
+
+/**
+ * @brief Body of the reader thread: keeps the newest frame of each buffer
+ *
+ * A driver that restarts hands over a new pipe, which replaces the old
+ * one; a pipe carrying a malformed frame is dropped until then.
+ */
+void ScreencastCapture::readerLoop() {
+    int fds[2] = { -1, -1 };
+    std::string data[2];
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                break;
+            }
+            for (int i = 0; i < 2; i++) {
+                if (pendingSourceFds[i] < 0) {
+                    continue;
+                }
+                if (fds[i] >= 0) {
+                    ::close(fds[i]);
+                }
+                fds[i] = pendingSourceFds[i];
+                pendingSourceFds[i] = -1;
+                data[i].clear();
+                fcntl(fds[i], F_SETPIPE_SZ, kPipeBytes);
+            }
+        }
+        struct pollfd pfds[2];
+        for (int i = 0; i < 2; i++) {
+            pfds[i].fd = fds[i];
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+        poll(pfds, 2, kPollIntervalMs);
+        for (int i = 0; i < 2; i++) {
+            if (fds[i] >= 0 && pfds[i].revents && !readFrames(i, fds[i], data[i])) {
+                ::close(fds[i]);
+                fds[i] = -1;
+            }
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (fds[i] >= 0) {
+            ::close(fds[i]);
+        }
+    }
+}
+
+/**
+ * @brief Reads the frames sent by one driver
+ *
+ * @param buffer The display buffer of the driver
+ * @param fd Our end of the frame pipe
+ * @param data Bytes of the frame being received
+ * @return bool False once the driver closed the pipe or sent garbage
+ */
+bool ScreencastCapture::readFrames(int buffer, int fd, std::string& data) {
+    char chunk[65536];
+    ssize_t count = read(fd, chunk, sizeof(chunk));
+    if (count < 0 && errno == EINTR) {
+        return true;
+    }
+    if (count <= 0) {
+        return false;
+    }
+    data.append(chunk, static_cast<size_t>(count));
+    while (data.size() >= 4) {
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(data.data());
+        size_t length = static_cast<size_t>(header[0]) << 24 | static_cast<size_t>(header[1]) << 16
+                        | static_cast<size_t>(header[2]) << 8 | header[3];
+        if (length == 0 || length > kMaxFrameBytes) {
+            logMessage("Screencast: malformed frame from the page driver, ignoring it until it restarts");
+            return false;
+        }
+        if (data.size() < 4 + length) {
+            break;
+        }
+        bool captured;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            frames[buffer].assign(data.begin() + 4, data.begin() + 4 + length);
+            frameNumbers[buffer]++;
+            counters.receivedFrames++;
+            counters.receivedBytes += length;
+            captured = buffer == active;
+        }
+        data.erase(0, 4 + length);
+        if (captured) {
+            watchdog.pictureChanged();
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Starts a new encoder session from the captured buffer
+ *
+ * Nothing is sent before the first frame of that buffer arrives.
+ */
+void ScreencastCapture::sessionStarted() {
+    source = -1;
+    sentNumber = 0;
+    frame.clear();
+    logMessage("Screencast capture connected to the encoder");
+}
+
+/**
+ * @brief Takes the newest frame of the captured buffer, if it is new
+ *
+ * Frames the browser rendered since the previous period but that were
+ * replaced before being sent are counted as skipped.
+ *
+ * @param changed Set to true if the browser rendered a frame since the last period
+ * @return bool False until the captured buffer has sent a frame
+ */
+bool ScreencastCapture::acquireFrame(bool& changed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (active != source) {
+        source = active;
+        sentNumber = 0;
+    }
+    changed = false;
+    if (frameNumbers[source] != sentNumber && !frames[source].empty()) {
+        if (sentNumber > 0 && frameNumbers[source] - sentNumber > 1) {
+            counters.skippedFrames += frameNumbers[source] - sentNumber - 1;
+        }
+        frame = frames[source];
+        sentNumber = frameNumbers[source];
+        changed = true;
+    }
+    return !frame.empty();
+}
+
+/**
+ * @brief Returns the JPEG taken by the last acquireFrame()
+ *
+ * @return const vector<unsigned char>& The frame as the browser sent it
+ */
+const std::vector<unsigned char>& ScreencastCapture::frameData() {
+    return frame;
+}
+
+/**
+ * @brief Formats the frame counts of the last report window
+ *
+ * @param window The counters since the previous report
+ * @return string The line to log
+ */
+std::string ScreencastCapture::describeWindow(const CaptureStats& window) {
+    std::ostringstream msg;
+    msg << "Capture: " << window.changedFrames << " new frames from the browser in " << window.slots
+        << " frame periods, " << window.sentFrames << " sent to the encoder";
+    return msg.str();
+}
+
+/**
+ * @brief Drops the last frame once the last encoder is gone
+ */
+void ScreencastCapture::sessionEnded() {
+    frame.clear();
+}
@@ -0,0 +1,426 @@
+#include "../includes/Status.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const int kHeartbeatMs = 1000;
+static const int kReadAttempts = 1000;
+static const long long kStaleMs = 5000;
+
+/**
+ * @brief Returns the Unix epoch time in milliseconds
+ */
+static long long epochMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return static_cast<long long>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Converts a monotonic time of this process to epoch time
+ *
+ * @param monotonic A monotonicMs() value, 0 for never
+ * @return long long The epoch time, 0 for never
+ */
+static long long toEpochMs(long long monotonic) {
+    return monotonic > 0 ? epochMs() - (monotonicMs() - monotonic) : 0;
+}
+
+/**
+ * @brief Copies a string into a fixed-size, NUL-terminated field
+ *
+ * @param field The field
+ * @param size Its size
+ * @param value The string, truncated if needed
+ */
+static void copyField(char* field, size_t size, const std::string& value) {
+    size_t length = value.size() < size - 1 ? value.size() : size - 1;
+    memcpy(field, value.c_str(), length);
+    memset(field + length, 0, size - length);
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param path The status block file
+ * @param telemetry Gives the encoder rates
+ * @param encoderName The child whose being held means standby
+ */
+StatusBoard::StatusBoard(const std::string& path, EncoderTelemetry& telemetry, const std::string& encoderName)
+    : path(path), telemetry(telemetry), encoderName(encoderName), shared(NULL), shuttingDown(false) {
+    memset(&local, 0, sizeof(local));
+    local.magic = STATUS_MAGIC;
+    local.version = STATUS_VERSION;
+    local.supervisorPid = getpid();
+    local.startedAtMs = epochMs();
+    local.phase = STREAM_LIVE;
+    local.fps = -1;
+    local.bitrateKbps = -1;
+    local.speed = -1;
+}
+
+/**
+ * @brief Destructor: stops the heartbeat and removes the block
+ */
+StatusBoard::~StatusBoard() {
+    shutdown();
+    if (shared) {
+        munmap(shared, sizeof(StatusBlock));
+        unlink(path.c_str());
+    }
+}
+
+/**
+ * @brief Creates the status block file, maps it and starts the heartbeat
+ *
+ * The block is prepared under a temporary name and renamed into place,
+ * so a reader never maps a file of the wrong size.
+ *
+ * @return bool False if the file cannot be created or mapped; the
+ *         stream then runs without a status block
+ */
+bool StatusBoard::start() {
+    std::string tempPath = path + ".tmp";
+    int fd = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, sizeof(StatusBlock)) != 0) {
+        logMessage("Cannot create the status block " + tempPath + ": " + strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    void* mapping = mmap(NULL, sizeof(StatusBlock), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED || rename(tempPath.c_str(), path.c_str()) != 0) {
+        logMessage("Cannot publish the status block " + path + ": " + strerror(errno));
+        if (mapping != MAP_FAILED) {
+            munmap(mapping, sizeof(StatusBlock));
+        }
+        unlink(tempPath.c_str());
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shared = static_cast<StatusBlock*>(mapping);
+        publish();
+    }
+    worker = std::thread(&StatusBoard::workerLoop, this);
+    return true;
+}
+
+/**
+ * @brief Stops the heartbeat thread and marks the stream as stopping
+ */
+void StatusBoard::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (shuttingDown) {
+            return;
+        }
+        shuttingDown = true;
+        local.phase = STREAM_STOPPING;
+        publish();
+    }
+    wakeup.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Copies the local block to the shared one, with the mutex held
+ *
+ * The sequence is made odd before the copy and even again after it,
+ * with release ordering so a reader that sees the final sequence also
+ * sees the data.
+ */
+void StatusBoard::publish() {
+    if (!shared) {
+        return;
+    }
+    uint32_t sequence = __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED);
+    local.updatedAtMs = epochMs();
+    local.sequence = sequence + 1;
+    __atomic_store_n(&shared->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(shared, &local, sizeof(local));
+    __atomic_store_n(&shared->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Body of the heartbeat thread: encoder rates once a second
+ */
+void StatusBoard::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!shuttingDown) {
+        EncoderSample sample;
+        lock.unlock();
+        bool reported = telemetry.latest(sample);
+        lock.lock();
+        if (reported) {
+            local.fps = sample.fps;
+            local.bitrateKbps = sample.bitrateKbps;
+            local.speed = sample.speed;
+            local.encoderReportAtMs = toEpochMs(sample.timeMs);
+        }
+        publish();
+        wakeup.wait_for(lock, std::chrono::milliseconds(kHeartbeatMs));
+    }
+}
+
+/**
+ * @brief Publishes the children reported by the supervisor
+ *
+ * The stream is in standby while the encoder is held.
+ *
+ * @param children Every registered child
+ */
+void StatusBoard::childrenChanged(const std::vector<ChildStatus>& children) {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = children.size() < STATUS_MAX_CHILDREN ? children.size() : STATUS_MAX_CHILDREN;
+    for (size_t i = 0; i < count; i++) {
+        StatusChild& child = local.children[i];
+        copyField(child.name, sizeof(child.name), children[i].name);
+        child.pid = children[i].pid > 0 ? children[i].pid : 0;
+        child.state = children[i].state;
+        child.restarts = children[i].restarts;
+        child.startedAtMs = toEpochMs(children[i].startedAt);
+        if (children[i].name == encoderName && !shuttingDown) {
+            local.phase = children[i].state == CHILD_HELD ? STREAM_STANDBY : STREAM_LIVE;
+        }
+    }
+    local.childCount = static_cast<uint32_t>(count);
+    publish();
+}
+
+/**
+ * @brief Publishes the last unexpected failure
+ *
+ * @param message What happened
+ */
+void StatusBoard::childFailed(const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    copyField(local.lastError, sizeof(local.lastError), message);
+    local.lastErrorAtMs = epochMs();
+    local.errors++;
+    publish();
+}
+
+/**
+ * @brief Reads a consistent copy of a status block without locking
+ *
+ * @param path The status block file
+ * @param block Receives the copy
+ * @return bool False if there is no valid block, or the supervisor kept
+ *         writing for kReadAttempts attempts
+ */
+bool readStatusBlock(const std::string& path, StatusBlock& block) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &info) != 0 || info.st_size != static_cast<off_t>(sizeof(StatusBlock))) {
+        close(fd);
+        return false;
+    }
+    void* mapping = mmap(NULL, sizeof(StatusBlock), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    const StatusBlock* shared = static_cast<const StatusBlock*>(mapping);
+    bool consistent = false;
+    for (int attempt = 0; attempt < kReadAttempts && !consistent; attempt++) {
+        uint32_t before = __atomic_load_n(&shared->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue;
+        }
+        memcpy(&block, shared, sizeof(block));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        consistent = __atomic_load_n(&shared->sequence, __ATOMIC_RELAXED) == before;
+    }
+    munmap(mapping, sizeof(StatusBlock));
+    return consistent && block.magic == STATUS_MAGIC && block.version == STATUS_VERSION
+           && block.childCount <= STATUS_MAX_CHILDREN;
+}
+
+/**
+ * @brief Returns the name of a ChildState
+ *
+ * @param state The state
+ * @return const char* e.g. "running"
+ */
+const char* childStateName(uint32_t state) {
+    switch (state) {
+        case CHILD_RUNNING: return "running";
+        case CHILD_RESTARTING: return "restarting";
+        case CHILD_HELD: return "held";
+        case CHILD_DONE: return "done";
+        case CHILD_STARTING: return "starting";
+        case CHILD_WAITING: return "waiting";
+        default: return "stopped";
+    }
+}
+
+/**
+ * @brief Returns the name of a StreamPhase
+ *
+ * @param phase The phase
+ * @return const char* e.g. "live"
+ */
+static const char* phaseName(uint32_t phase) {
+    switch (phase) {
+        case STREAM_LIVE: return "live";
+        case STREAM_STANDBY: return "standby";
+        default: return "stopping";
+    }
+}
+
+/**
+ * @brief Formats a duration for people, e.g. 2h05m or 42s
+ *
+ * @param ms The duration
+ * @return string The formatted duration
+ */
+static std::string formatDuration(long long ms) {
+    char buffer[32];
+    long long seconds = ms > 0 ? ms / 1000 : 0;
+    if (seconds >= 3600) {
+        snprintf(buffer, sizeof(buffer), "%lldh%02lldm", seconds / 3600, seconds / 60 % 60);
+    } else if (seconds >= 60) {
+        snprintf(buffer, sizeof(buffer), "%lldm%02llds", seconds / 60, seconds % 60);
+    } else {
+        snprintf(buffer, sizeof(buffer), "%llds", seconds);
+    }
+    return buffer;
+}
+
+/**
+ * @brief Writes a status block for pagestreamer status
+ *
+ * @param out The output
+ * @param block A block read with readStatusBlock()
+ */
+void writeStatusText(std::ostream& out, const StatusBlock& block) {
+    long long now = epochMs();
+    unsigned int restarts = 0;
+    out << "State: " << phaseName(block.phase) << ", up " << formatDuration(now - block.startedAtMs);
+    if (now - block.updatedAtMs > kStaleMs) {
+        out << ", no update for " << formatDuration(now - block.updatedAtMs);
+    }
+    out << std::endl;
+    if (block.encoderReportAtMs > 0) {
+        char rates[96];
+        snprintf(rates, sizeof(rates), "%.1f fps, %.0f kbit/s, %.2fx", block.fps, block.bitrateKbps, block.speed);
+        out << "Encoder: " << rates << ", reported " << formatDuration(now - block.encoderReportAtMs)
+            << " ago" << std::endl;
+    }
+    out << "Processes:" << std::endl;
+    for (uint32_t i = 0; i < block.childCount; i++) {
+        const StatusChild& child = block.children[i];
+        std::string name(child.name, strnlen(child.name, sizeof(child.name)));
+        restarts += child.restarts;
+        out << "  " << name << ": " << childStateName(child.state);
+        if (child.state == CHILD_RUNNING || child.state == CHILD_STARTING) {
+            out << ", PID " << child.pid << ", up " << formatDuration(now - child.startedAtMs);
+        }
+        if (child.restarts > 0) {
+            out << ", " << child.restarts << " restarts";
+        }
+        out << std::endl;
+    }
+    if (block.lastErrorAtMs > 0) {
+        std::string error(block.lastError, strnlen(block.lastError, sizeof(block.lastError)));
+        out << "Last error (" << formatDuration(now - block.lastErrorAtMs) << " ago, " << block.errors
+            << " in total): " << error << std::endl;
+    } else if (restarts == 0) {
+        out << "No error since the start" << std::endl;
+    }
+}
+
+/**
+ * @brief Writes a string as a JSON string literal
+ *
+ * @param out The output
+ * @param value The string
+ */
+static void writeJsonString(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (size_t i = 0; i < value.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+/**
+ * @brief Writes a status block for pagestreamer status --json
+ *
+ * Durations are in seconds; rates the encoder has not reported yet are
+ * null.
+ *
+ * @param out The output
+ * @param instanceName The instance
+ * @param block A block read with readStatusBlock(), NULL if the stream
+ *        is not running
+ */
+void writeStatusJson(std::ostream& out, const std::string& instanceName, const StatusBlock* block) {
+    long long now = epochMs();
+    char number[64];
+    out << "{\"instance\":";
+    writeJsonString(out, instanceName);
+    if (!block) {
+        out << ",\"running\":false}" << std::endl;
+        return;
+    }
+    out << ",\"running\":true,\"supervisor_pid\":" << block->supervisorPid
+        << ",\"state\":\"" << phaseName(block->phase) << "\""
+        << ",\"uptime_s\":" << (now - block->startedAtMs) / 1000
+        << ",\"updated_ms_ago\":" << now - block->updatedAtMs
+        << ",\"stale\":" << (now - block->updatedAtMs > kStaleMs ? "true" : "false")
+        << ",\"encoder\":";
+    if (block->encoderReportAtMs > 0) {
+        snprintf(number, sizeof(number), "{\"fps\":%.2f,\"bitrate_kbps\":%.1f,\"speed\":%.3f,",
+                 block->fps, block->bitrateKbps, block->speed);
+        out << number << "\"report_age_s\":" << (now - block->encoderReportAtMs) / 1000 << "}";
+    } else {
+        out << "null";
+    }
+    out << ",\"children\":[";
+    for (uint32_t i = 0; i < block->childCount; i++) {
+        const StatusChild& child = block->children[i];
+        out << (i > 0 ? "," : "") << "{\"name\":";
+        writeJsonString(out, std::string(child.name, strnlen(child.name, sizeof(child.name))));
+        out << ",\"state\":\"" << childStateName(child.state) << "\",\"pid\":";
+        if (child.state == CHILD_RUNNING || child.state == CHILD_STARTING) {
+            out << child.pid << ",\"uptime_s\":" << (now - child.startedAtMs) / 1000;
+        } else {
+            out << "null,\"uptime_s\":null";
+        }
+        out << ",\"restarts\":" << child.restarts << "}";
+    }
+    out << "],\"errors\":" << block->errors << ",\"last_error\":";
+    if (block->lastErrorAtMs > 0) {
+        out << "{\"message\":";
+        writeJsonString(out, std::string(block->lastError, strnlen(block->lastError, sizeof(block->lastError))));
+        out << ",\"age_s\":" << (now - block->lastErrorAtMs) / 1000 << "}";
+    } else {
+        out << "null";
+    }
+    out << "}" << std::endl;
+}
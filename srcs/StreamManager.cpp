@@ -1,15 +1,66 @@
 #include "../includes/StreamManager.hpp"
+#include "../includes/ConfigManager.hpp"
+#include "../includes/ConfigWatcher.hpp"
+#include "../includes/Supervisor.hpp"
+#include "../includes/Fanout.hpp"
+#include "../includes/Capture.hpp"
+#include "../includes/Screencast.hpp"
+#include "../includes/Telemetry.hpp"
+#include "../includes/Control.hpp"
+#include "../includes/LogPipeline.hpp"
+#include "../includes/Tuner.hpp"
+#include "../includes/Watchdog.hpp"
+#include "../includes/Recycler.hpp"
+#include "../includes/Sync.hpp"
+#include "../includes/Status.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
 #include <cstdlib>
+#include <ctime>
 #include <fstream>
+#include <set>
+#include <sstream>
 #include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static const int kWidth = SCREEN_WIDTH;
+static const int kHeight = SCREEN_HEIGHT;
+static const int kFrameRate = 30;
+static const char* kDefaultBrowser = "/snap/bin/chromium";
+static const int kStopTimeoutMs = 8000;
+static const size_t kDestinationQueueBytes = 16 * 1024 * 1024;
+static const long long kReconnectBufferMs = 10000;
+static const int kProgressFd = 3;
+static const int kWatchdogFd = 4;
+static const int kFrameFd = 4;
+static const int kSyncFd = 5;
+static const int kReadyFd = 3;
+static const int kMinBitrateKbps = 300;
+static const int kMaxBitrateKbps = 20000;
+static const double kMinZoom = 0.25;
+static const double kMaxZoom = 5.0;
+static const char* kDefaultZoom = "1.1";
+static const long long kStandbyRefreshMs = 5 * 60 * 1000;
 
 /**
  * @brief Constructor
- * 
- * Initializes the StreamManager with the path to the scripts directory.
+ *
+ * Initializes the StreamManager with the paths used by the supervisor.
+ *
+ * @param instance The instance to manage
  */
-StreamManager::StreamManager() {
-    scriptPath = std::string(getenv("HOME")) + "/.pagestreamer/scripts";
+StreamManager::StreamManager(const Instance& instance) : instance(instance) {
+    scriptPath = pagestreamerDir() + "/scripts";
+    logDir = instance.logDir();
+    pidPath = instance.pidPath();
 }
 
 /**
@@ -19,81 +70,1465 @@ StreamManager::~StreamManager() {
 }
 
 /**
- * @brief Executes a shell command and returns the result
- * 
- * @param command The command to execute
- * @return int The exit code of the command
+ * @brief Checks that a PID belongs to a running pagestreamer process
+ *
+ * Reads /proc/<pid>/stat so a recycled PID is not mistaken for the
+ * supervisor. An exited supervisor not yet reaped by its parent (the
+ * scheduler) counts as dead.
+ *
+ * @param pid The process ID to check
+ * @return bool True if the process is a live supervisor
+ */
+static bool isSupervisorAlive(pid_t pid) {
+    std::ostringstream path;
+    path << "/proc/" << pid << "/stat";
+    std::ifstream statFile(path.str().c_str());
+    std::string stat;
+    return statFile.is_open() && std::getline(statFile, stat)
+           && stat.find(" (pagestreamer) ") != std::string::npos
+           && stat.compare(stat.rfind(')') + 2, 1, "Z") != 0;
+}
+
+/**
+ * @brief Reads the supervisor PID file
+ *
+ * @return pid_t The PID of the running supervisor, -1 if none
+ */
+pid_t StreamManager::readSupervisorPid() const {
+    std::ifstream pidFile(pidPath.c_str());
+    pid_t pid = -1;
+    if (!pidFile.is_open() || !(pidFile >> pid) || pid <= 0 || !isSupervisorAlive(pid)) {
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * @brief Removes the lock of an X display left behind by a dead server
+ *
+ * The lock is only removed when the PID it names no longer exists, so a
+ * live X server is never disturbed.
+ *
+ * @param display The display name, e.g. ":99"
+ * @return pid_t The PID of a live server holding the display, -1 if free
+ */
+static pid_t clearStaleDisplayLock(const std::string& display) {
+    std::string number = display.substr(1);
+    std::string lockPath = "/tmp/.X" + number + "-lock";
+    std::ifstream lockFile(lockPath.c_str());
+    pid_t pid = 0;
+    if (!lockFile.is_open() || !(lockFile >> pid) || pid <= 0) {
+        return -1;
+    }
+    if (kill(pid, 0) != 0 && errno == ESRCH) {
+        unlink(lockPath.c_str());
+        unlink(("/tmp/.X11-unix/X" + number).c_str());
+        return -1;
+    }
+    return pid;
+}
+
+/**
+ * @brief Builds the ffmpeg command line capturing the display and sink
+ *
+ * The video comes either from x11grab or, with CAPTURE=fbdir, as raw
+ * frames written to stdin by the framebuffer capture, timestamped on
+ * arrival like x11grab so it stays in sync with PulseAudio. Since the
+ * capture skips unchanged frames, its input is variable rate and -r with
+ * -vsync cfr duplicates frames back to a constant output rate. Those
+ * frames are already yuv420p at the output size; x11grab frames are
+ * converted and scaled by ffmpeg. With CAPTURE=screencast, stdin gets
+ * the JPEG screencast frames of the headless browser, which ffmpeg
+ * decodes; only this capture can exceed 1080p, which needs H.264 level
+ * 5.1 instead of 4.1. The encoded FLV stream goes to stdout,
+ * from where it is fanned out to every destination, progress reports
+ * go to descriptor 3 for the telemetry, silence reports to descriptor
+ * 4 for the watchdog and the frame timestamps of both streams to
+ * descriptor 5 for the sync monitor.
+ *
+ * The sound is kept on its capture timestamps by the resampler alone,
+ * which stretches or squeezes it by at most a few samples at a time,
+ * instead of -async, which inserts or drops whole chunks. The sync
+ * monitor's tempo filters follow it, before the probes, so the drift
+ * the monitor measures includes its own corrections.
+ *
+ * @param config The instance settings
+ * @param display The X display to capture
+ * @param sink The PulseAudio sink to capture
+ * @param syncTest True to probe the flashes and beeps of the sync test page
+ * @param tempoFilter The sync monitor's drift correction filters, or empty
+ * @return vector<string> The full argv
+ */
+static std::vector<std::string> encoderArgs(const StreamConfig& config, const std::string& display,
+                                            const std::string& sink, bool syncTest,
+                                            const std::string& tempoFilter) {
+    std::ostringstream bitrateStream;
+    std::ostringstream sizeStream;
+    std::ostringstream outputStream;
+    std::ostringstream rateStream;
+    bool aboveScreen = config.outputWidth > kWidth || config.outputHeight > kHeight;
+    sizeStream << kWidth << "x" << kHeight;
+    outputStream << config.outputWidth << "x" << config.outputHeight;
+    rateStream << kFrameRate;
+    bitrateStream << platformBounds(config.platform, config.outputHeight).defaultBitrateKbps << "k";
+    std::string bitrate = bitrateStream.str();
+    std::string filters = "[0:a]aresample=async=1000:min_hard_comp=1,"
+                          + (tempoFilter.empty() ? "" : tempoFilter + ",") + silenceFilter(kWatchdogFd) + ","
+                          + syncAudioProbe(kSyncFd, syncTest) + "[a];[1:v]" + syncVideoProbe(kSyncFd, syncTest) + "[v]";
+    std::string size = sizeStream.str();
+    std::string output = outputStream.str();
+    std::string rate = rateStream.str();
+    std::string input = display + ".0";
+    std::string monitor = sink + ".monitor";
+    const char* x11grabInput[] = {
+        "-thread_queue_size", "4096", "-f", "x11grab", "-probesize", "10M",
+        "-s", size.c_str(), "-r", rate.c_str(), "-i", input.c_str()
+    };
+    const char* framebufferInput[] = {
+        "-thread_queue_size", "4096", "-f", "rawvideo", "-pix_fmt", "yuv420p",
+        "-s", output.c_str(), "-framerate", rate.c_str(),
+        "-use_wallclock_as_timestamps", "1", "-i", "pipe:0"
+    };
+    const char* screencastInput[] = {
+        "-thread_queue_size", "4096", "-f", "image2pipe", "-c:v", "mjpeg", "-framerate", rate.c_str(),
+        "-use_wallclock_as_timestamps", "1", "-i", "pipe:0"
+    };
+    const char* head[] = {
+        "ffmpeg", "-hide_banner", "-nostats", "-progress", "pipe:3",
+        "-thread_queue_size", "4096", "-f", "pulse", "-i", monitor.c_str()
+    };
+    const char* args[] = {
+        "-filter_complex", filters.c_str(), "-map", "[a]", "-map", "[v]",
+        "-c:v", "libx264", "-preset", defaultPreset(), "-tune", "zerolatency",
+        "-pix_fmt", "yuv420p", "-s", output.c_str(), "-b:v", bitrate.c_str(), "-maxrate", bitrate.c_str(),
+        "-bufsize", "7000k", "-g", "60", "-keyint_min", "30", "-crf", "23",
+        "-profile:v", "main", "-level", aboveScreen ? "5.1" : "4.1",
+        "-c:a", "aac", "-b:a", "160k", "-ar", "48000", "-ac", "2",
+        "-r", rate.c_str(), "-vsync", "cfr",
+        "-fflags", "+genpts", "-max_interleave_delta", "0", "-shortest",
+        "-f", "flv", "-flvflags", "no_duration_filesize", "-xerror", "pipe:1"
+    };
+    std::vector<std::string> argv(head, head + sizeof(head) / sizeof(head[0]));
+    if (config.capture == CAPTURE_FBDIR) {
+        argv.insert(argv.end(), framebufferInput,
+                    framebufferInput + sizeof(framebufferInput) / sizeof(framebufferInput[0]));
+    } else if (config.capture == CAPTURE_SCREENCAST) {
+        argv.insert(argv.end(), screencastInput,
+                    screencastInput + sizeof(screencastInput) / sizeof(screencastInput[0]));
+    } else {
+        argv.insert(argv.end(), x11grabInput, x11grabInput + sizeof(x11grabInput) / sizeof(x11grabInput[0]));
+    }
+    argv.insert(argv.end(), args, args + sizeof(args) / sizeof(args[0]));
+    return argv;
+}
+
+/**
+ * @brief Lists the filters of the installed ffmpeg
+ *
+ * @return set<string> The filter names, empty if ffmpeg cannot be run
+ */
+static std::set<std::string> ffmpegFilters() {
+    std::set<std::string> filters;
+    FILE* list = popen("ffmpeg -hide_banner -filters 2>/dev/null", "r");
+    if (!list) {
+        return filters;
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), list)) {
+        std::istringstream fields(line);
+        std::string flags;
+        std::string name;
+        if (fields >> flags >> name) {
+            filters.insert(name);
+        }
+    }
+    pclose(list);
+    return filters;
+}
+
+/**
+ * @brief Replaces the value that follows an option in an argv
+ *
+ * @param argv The arguments
+ * @param option The option, e.g. -b:v
+ * @param value Its new value
+ */
+static void setOption(std::vector<std::string>& argv, const std::string& option, const std::string& value) {
+    for (size_t i = 0; i + 1 < argv.size(); i++) {
+        if (argv[i] == option) {
+            argv[i + 1] = value;
+        }
+    }
+}
+
+/**
+ * @brief Replaces every argument equal to a value
+ *
+ * @param argv The arguments
+ * @param from The argument to replace, e.g. an input
+ * @param to Its new value
+ */
+static void replaceArgument(std::vector<std::string>& argv, const std::string& from, const std::string& to) {
+    for (size_t i = 0; i < argv.size(); i++) {
+        if (argv[i] == from) {
+            argv[i] = to;
+        }
+    }
+}
+
+/**
+ * @brief Returns the name of a child of one display buffer
+ *
+ * The children of the first buffer keep their plain names, those of the
+ * spare buffer get a -2 suffix.
+ *
+ * @param name The plain name, e.g. browser
+ * @param buffer 0 or 1
+ * @return string The child name
+ */
+static std::string bufferChildName(const std::string& name, int buffer) {
+    return buffer == 0 ? name : name + "-2";
+}
+
+/**
+ * @brief Replaces or adds a KEY=VALUE entry of a child environment
+ *
+ * @param env The environment overrides
+ * @param key The variable name
+ * @param value Its new value
+ */
+static void setEnvironment(std::vector<std::string>& env, const std::string& key, const std::string& value) {
+    for (size_t i = 0; i < env.size(); i++) {
+        if (env[i].compare(0, key.size() + 1, key + "=") == 0) {
+            env[i] = key + "=" + value;
+            return;
+        }
+    }
+    env.push_back(key + "=" + value);
+}
+
+/**
+ * @brief Parses a number that must span the whole string
+ *
+ * @param text The text to parse
+ * @param value Receives the number
+ * @return bool False if the text is not a number
+ */
+static bool parseNumber(const std::string& text, double& value) {
+    char* end = NULL;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && end && *end == '\0';
+}
+
+/**
+ * @brief Applies the commands of the control socket to the running stream
+ *
+ * Page changes are sent to the driver, which loads them in the running
+ * browser, and kept in its spec so a restarted driver shows the same
+ * page. A bitrate change starts a second encoder that the fan-out
+ * switches to at its first keyframe, as do the preset and bitrate
+ * changes of the encoder tuner; a destination change restarts only that
+ * relay. Nothing is written to the profile. The controller also carries
+ * out the recovery actions of the watchdog.
+ *
+ * With browser recycling there are two display buffers, each with its
+ * display, sound sink, browser and driver, and the controller keeps
+ * track of the one being captured. Page changes go to both drivers.
+ *
+ * In standby the encoder is held by the supervisor until the live
+ * command (or the scheduled go-live) releases it. The controller
+ * observes the encoder to know when the stream went live and then stops
+ * the driver's standby page refreshes.
+ */
+class StreamController : public ControlHandler, public ChildObserver, public EncoderControl,
+                         public RecoveryControl, public BufferControl, public ConfigListener {
+private:
+    struct DisplayBuffer {
+        std::string display;
+        std::string sink;
+        std::string fbDir;
+    };
+
+    Supervisor& supervisor;
+    std::string logDir;
+    DriverControl drivers[2];
+    ChildSpec driverSpecs[2];
+    ChildSpec encoderSpec;
+    DisplayBuffer buffers[2];
+    int bufferCount;
+    int active;
+    std::vector<RtmpDestination*> destinations;
+    EncoderTuner* tuner;
+    FramebufferCapture* capture;
+    ScreencastCapture* screencast;
+    StreamWatchdog* watchdog;
+    std::mutex mutex;
+    bool live;
+
+    bool setPage(const std::string& key, const std::string& command, const std::string& value);
+    void setBufferHeld(int buffer, bool held);
+
+public:
+    StreamController(Supervisor& supervisor, const std::string& logDir);
+
+    DriverControl* driverObserver(int buffer);
+    void addBuffer(const std::string& display, const std::string& sink, const std::string& fbDir);
+    void track(const ChildSpec& spec);
+    void addDestination(RtmpDestination* destination);
+    void setTuner(EncoderTuner* encoderTuner);
+    void setCapture(FramebufferCapture* framebufferCapture, ScreencastCapture* screencastCapture,
+                    StreamWatchdog* streamWatchdog);
+    void applyEncoderSettings(const std::string& preset, int bitrateKbps);
+    void restartEncoder();
+    bool reloadPage();
+    void restartBrowser();
+    void restartStream();
+    void startSpare();
+    void switchToSpare();
+    void stopSpare();
+    bool handleCommand(const std::vector<std::string>& words, std::string& reply);
+    void configChanged(const StreamConfig& config, const std::vector<std::string>& changedKeys);
+    void childStarted(pid_t pid, const std::vector<int>& fds);
+    void childExited(int status);
+};
+
+/**
+ * @brief Constructor
+ *
+ * @param supervisor The supervisor running the stream
+ * @param logDir Directory for the relay logs
+ */
+StreamController::StreamController(Supervisor& supervisor, const std::string& logDir)
+    : supervisor(supervisor), logDir(logDir), bufferCount(0), active(0), tuner(NULL), capture(NULL),
+      screencast(NULL), watchdog(NULL), live(false) {
+}
+
+/**
+ * @brief Returns the observer that owns the stdin of a buffer's driver
+ *
+ * @param buffer 0 or 1
+ * @return DriverControl* The driver command channel
+ */
+DriverControl* StreamController::driverObserver(int buffer) {
+    return &drivers[buffer];
+}
+
+/**
+ * @brief Declares the next display buffer, the first one being captured
+ *
+ * @param display The X display of the buffer
+ * @param sink The PulseAudio sink its browser plays to
+ * @param fbDir The directory its X server keeps the framebuffer in, empty
+ *        without an X server
+ */
+void StreamController::addBuffer(const std::string& display, const std::string& sink, const std::string& fbDir) {
+    DisplayBuffer buffer = { display, sink, fbDir };
+    buffers[bufferCount++] = buffer;
+}
+
+/**
+ * @brief Remembers the spec of a child that commands can change
+ *
+ * @param spec A driver or the encoder spec, as registered
+ */
+void StreamController::track(const ChildSpec& spec) {
+    if (spec.name == bufferChildName("driver", 0)) {
+        driverSpecs[0] = spec;
+    } else if (spec.name == bufferChildName("driver", 1)) {
+        driverSpecs[1] = spec;
+    } else {
+        encoderSpec = spec;
+    }
+}
+
+/**
+ * @brief Adds a destination that the destination command can retarget
+ *
+ * @param destination The destination, which must outlive the controller
+ */
+void StreamController::addDestination(RtmpDestination* destination) {
+    destinations.push_back(destination);
+}
+
+/**
+ * @brief Sets the tuner that the bitrate command must inform
+ *
+ * @param encoderTuner The tuner, or NULL when tuning is off
+ */
+void StreamController::setTuner(EncoderTuner* encoderTuner) {
+    tuner = encoderTuner;
+}
+
+/**
+ * @brief Sets what captures the picture of the captured buffer
+ *
+ * @param framebufferCapture The framebuffer capture, or NULL
+ * @param screencastCapture The screencast capture, or NULL
+ * @param streamWatchdog The watchdog
+ */
+void StreamController::setCapture(FramebufferCapture* framebufferCapture, ScreencastCapture* screencastCapture,
+                                  StreamWatchdog* streamWatchdog) {
+    capture = framebufferCapture;
+    screencast = screencastCapture;
+    watchdog = streamWatchdog;
+}
+
+/**
+ * @brief Switches the encoder to the settings chosen by the tuner
+ *
+ * @param preset The x264 preset
+ * @param bitrateKbps The video bitrate
+ */
+void StreamController::applyEncoderSettings(const std::string& preset, int bitrateKbps) {
+    std::ostringstream bitrate;
+    bitrate << bitrateKbps << "k";
+    std::lock_guard<std::mutex> lock(mutex);
+    setOption(encoderSpec.argv, "-preset", preset);
+    setOption(encoderSpec.argv, "-b:v", bitrate.str());
+    setOption(encoderSpec.argv, "-maxrate", bitrate.str());
+    supervisor.replaceChild(encoderSpec, REPLACE_OVERLAPPING);
+}
+
+/**
+ * @brief Starts a fresh encoder for the sync monitor
+ *
+ * The fan-out hands over to it at its first keyframe, like for a
+ * settings change.
+ */
+void StreamController::restartEncoder() {
+    std::lock_guard<std::mutex> lock(mutex);
+    supervisor.replaceChild(encoderSpec, REPLACE_OVERLAPPING);
+}
+
+/**
+ * @brief Reloads the captured page for the watchdog
+ *
+ * @return bool False if the driver is not running
+ */
+bool StreamController::reloadPage() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return drivers[active].send("reload");
+}
+
+/**
+ * @brief Restarts the captured browser for the watchdog
+ *
+ * The driver exits with the browser and reconnects to the new one.
+ */
+void StreamController::restartBrowser() {
+    std::lock_guard<std::mutex> lock(mutex);
+    supervisor.restart(bufferChildName("browser", active));
+}
+
+/**
+ * @brief Restarts the display, sound, browser, driver and encoder
+ *
+ * The relays keep their connections; the fan-out continues the stream
+ * with the restarted encoder.
+ */
+void StreamController::restartStream() {
+    const char* names[] = { "xvfb", "pulseaudio", "browser", "driver", "ffmpeg" };
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        std::string name = names[i];
+        supervisor.restart(name == "pulseaudio" || name == "ffmpeg" ? name : bufferChildName(name, active));
+    }
+}
+
+/**
+ * @brief Releases or holds the display, browser and driver of a buffer
+ *
+ * @param buffer 0 or 1
+ * @param held True to stop them, false to start them
+ */
+void StreamController::setBufferHeld(int buffer, bool held) {
+    const char* names[] = { "xvfb", "browser", "driver" };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (held) {
+            supervisor.hold(bufferChildName(names[i], buffer));
+        } else {
+            supervisor.release(bufferChildName(names[i], buffer), 0);
+        }
+    }
+}
+
+/**
+ * @brief Starts a fresh browser on the spare display for the recycler
+ *
+ * Its driver spec already follows the page changes, so it loads the
+ * page being streamed.
+ */
+void StreamController::startSpare() {
+    std::lock_guard<std::mutex> lock(mutex);
+    logMessage("Starting a fresh browser on display " + buffers[1 - active].display);
+    setBufferHeld(1 - active, false);
+}
+
+/**
+ * @brief Captures the spare display and sink for the recycler
+ *
+ * The framebuffer or screencast capture and the watchdog move to it
+ * between two frames; a second encoder captures it, with x11grab for
+ * the picture and in any case for the sound, and the fan-out switches
+ * to that encoder at its first keyframe.
+ */
+void StreamController::switchToSpare() {
+    std::lock_guard<std::mutex> lock(mutex);
+    const DisplayBuffer& from = buffers[active];
+    const DisplayBuffer& to = buffers[1 - active];
+    logMessage("Capturing display " + to.display + " instead of " + from.display);
+    replaceArgument(encoderSpec.argv, from.display + ".0", to.display + ".0");
+    replaceArgument(encoderSpec.argv, from.sink + ".monitor", to.sink + ".monitor");
+    replaceArgument(encoderSpec.after, bufferChildName("xvfb", active), bufferChildName("xvfb", 1 - active));
+    replaceArgument(encoderSpec.after, bufferChildName("driver", active), bufferChildName("driver", 1 - active));
+    setEnvironment(encoderSpec.env, "DISPLAY", to.display);
+    if (capture) {
+        capture->setSource(to.fbDir);
+    }
+    if (screencast) {
+        screencast->setSource(1 - active);
+    }
+    if (watchdog && !to.fbDir.empty()) {
+        watchdog->setFramebuffer(to.fbDir);
+    }
+    supervisor.replaceChild(encoderSpec, REPLACE_OVERLAPPING);
+    active = 1 - active;
+}
+
+/**
+ * @brief Stops the display, browser and driver that are not captured
+ */
+void StreamController::stopSpare() {
+    std::lock_guard<std::mutex> lock(mutex);
+    setBufferHeld(1 - active, true);
+}
+
+/**
+ * @brief Sends a page setting to the drivers and keeps it for restarts
+ *
+ * @param key The driver environment variable holding the setting
+ * @param command The driver command applying it
+ * @param value The new value
+ * @return bool True if the driver of the captured page received it
  */
-static int executeCommand(const std::string& command) {
-    return system(command.c_str());
+bool StreamController::setPage(const std::string& key, const std::string& command, const std::string& value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bool sent = false;
+    for (int i = 0; i < bufferCount; i++) {
+        setEnvironment(driverSpecs[i].env, key, value);
+        supervisor.replaceChild(driverSpecs[i], REPLACE_ON_RESTART);
+        bool received = drivers[i].send(command + " " + value);
+        sent = sent || (i == active && received);
+    }
+    return sent;
+}
+
+/**
+ * @brief Marks the stream live once the encoder first starts
+ *
+ * Tells the drivers to stop refreshing the page, also for their restarts.
+ *
+ * @param pid The encoder process
+ * @param fds Unused, the encoder pipes belong to other observers
+ */
+void StreamController::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    (void)fds;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (live) {
+        return;
+    }
+    live = true;
+    logMessage("Stream is live");
+    for (int i = 0; i < bufferCount; i++) {
+        setEnvironment(driverSpecs[i].env, "PAGESTREAMER_STANDBY_REFRESH_MS", "0");
+        supervisor.replaceChild(driverSpecs[i], REPLACE_ON_RESTART);
+        drivers[i].send("live");
+    }
+}
+
+/**
+ * @brief Called when the encoder exits; it is restarted as usual
+ *
+ * @param status The wait status
+ */
+void StreamController::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Runs one control command
+ *
+ * @param words The command and its arguments
+ * @param reply Receives the message for the client
+ * @return bool True if the command was applied
+ */
+bool StreamController::handleCommand(const std::vector<std::string>& words, std::string& reply) {
+    const std::string& command = words[0];
+    double number = 0;
+    std::string error;
+    std::ostringstream msg;
+
+    if (command == "state" && words.size() == 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reply = live ? "live" : "standby";
+        return true;
+    }
+    if (command == "live" && words.size() == 1) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (live) {
+            reply = "the stream is already live";
+            return false;
+        }
+        supervisor.release(encoderSpec.name, 0);
+        reply = "going live";
+        return true;
+    }
+    if (command == "url" && words.size() == 2) {
+        if (!validateConfigValue("STREAM_URL", words[1], error) || words[1].empty()) {
+            reply = error;
+            return false;
+        }
+        reply = setPage("STREAM_URL", "navigate", words[1]) ? "loading " + words[1]
+                : "the page driver is restarting, it will load " + words[1];
+        return true;
+    }
+    if (command == "zoom" && words.size() == 2) {
+        if (!parseNumber(words[1], number) || number < kMinZoom || number > kMaxZoom) {
+            msg << "zoom must be a factor between " << kMinZoom << " and " << kMaxZoom;
+            reply = msg.str();
+            return false;
+        }
+        reply = setPage("PAGESTREAMER_ZOOM", "zoom", words[1]) ? "zoom set to " + words[1]
+                : "the page driver is restarting, it will use zoom " + words[1];
+        return true;
+    }
+    if (command == "bitrate" && words.size() == 2) {
+        if (!parseNumber(words[1], number) || number != static_cast<int>(number)
+            || number < kMinBitrateKbps || number > kMaxBitrateKbps) {
+            msg << "bitrate must be a whole number of kbit/s between " << kMinBitrateKbps
+                << " and " << kMaxBitrateKbps;
+            reply = msg.str();
+            return false;
+        }
+        std::string bitrate = words[1] + "k";
+        if (tuner) {
+            tuner->setBitrate(static_cast<int>(number));
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        setOption(encoderSpec.argv, "-b:v", bitrate);
+        setOption(encoderSpec.argv, "-maxrate", bitrate);
+        supervisor.replaceChild(encoderSpec, REPLACE_OVERLAPPING);
+        reply = "switching to " + bitrate + "bit/s at the next keyframe";
+        return true;
+    }
+    if (command == "destination" && words.size() == 3) {
+        if (!parseNumber(words[1], number) || number < 1 || number > destinations.size()
+            || number != static_cast<int>(number)) {
+            msg << "destination must be a number between 1 and " << destinations.size();
+            reply = msg.str();
+            return false;
+        }
+        if (!validateConfigValue("DESTINATIONS", words[2], error) || words[2].empty()) {
+            reply = error.empty() ? "missing RTMP URL" : error;
+            return false;
+        }
+        RtmpDestination* destination = destinations[static_cast<size_t>(number) - 1];
+        destination->setUrl(words[2]);
+        supervisor.replaceChild(destination->relaySpec(logDir), REPLACE_NOW);
+        reply = "reconnecting " + destination->label();
+        return true;
+    }
+    reply = "unknown command, expected live, state, url URL, zoom FACTOR, bitrate KBPS or destination N RTMP_URL";
+    return false;
+}
+
+/**
+ * @brief Applies the profile changes that a running stream can take
+ *
+ * A new STREAM_URL is loaded in place like the url command, and a
+ * changed PLATFORM, STREAM_KEY or DESTINATIONS entry reconnects only
+ * that relay like the destination command. The other settings, and
+ * destinations added or removed, wait for the next start.
+ *
+ * @param config The new settings
+ * @param changedKeys The settings whose value differs from before
+ */
+void StreamController::configChanged(const StreamConfig& config, const std::vector<std::string>& changedKeys) {
+    std::vector<std::string> urls = config.destinationUrls();
+    std::string pending;
+    for (size_t i = 0; i < changedKeys.size(); i++) {
+        const std::string& key = changedKeys[i];
+        if (key == "STREAM_URL" && !config.streamUrl.empty()) {
+            setPage("STREAM_URL", "navigate", config.streamUrl);
+            logMessage("Loading " + config.streamUrl + " from the changed configuration");
+        } else if (key != "PLATFORM" && key != "STREAM_KEY" && key != "DESTINATIONS") {
+            pending += (pending.empty() ? "" : ", ") + key;
+        }
+    }
+    for (size_t i = 0; i < destinations.size() && i < urls.size(); i++) {
+        if (destinations[i]->currentUrl() != urls[i]) {
+            destinations[i]->setUrl(urls[i]);
+            supervisor.replaceChild(destinations[i]->relaySpec(logDir), REPLACE_NOW);
+            logMessage("Reconnecting " + destinations[i]->label() + " to its changed destination");
+        }
+    }
+    if (urls.size() != destinations.size()) {
+        pending += std::string(pending.empty() ? "" : ", ") + "the number of destinations";
+    }
+    if (!pending.empty()) {
+        logMessage("Configuration changed (" + pending + "), applied at the next start");
+    }
+}
+
+/**
+ * @brief Registers every process of the stream with the supervisor
+ *
+ * The supervisor runs its own PulseAudio server on a private socket with
+ * the virt_output sink preloaded, so no pactl call or shared user daemon
+ * is involved and every instance gets its own sink. The browser is
+ * started directly with a DevTools port and stream.js attaches to it to
+ * drive the page. The encoder writes FLV to its stdout, which is read by
+ * the fan-out, its progress to a pipe read by the telemetry and its
+ * silence reports to a pipe read by the watchdog. Xvfb keeps its screen
+ * in a file under the run directory, which the watchdog samples; with a
+ * framebuffer capture, the capture also feeds the encoder's stdin from
+ * it. The driver reads
+ * live commands from its stdin. In standby the encoder is held and the
+ * driver keeps the page fresh by reloading it until the stream goes live.
+ *
+ * With CAPTURE=screencast there is no X server: the browser runs
+ * headless and the driver passes the screencast frames of the page on
+ * descriptor 4 to the screencast capture, which feeds the encoder's
+ * stdin.
+ *
+ * With browser recycling, a second held set of Xvfb, browser and driver
+ * on the spare display, with its own sink and browser profile, stands
+ * ready for the recycler.
+ *
+ * Startup follows readiness instead of delays: Xvfb and PulseAudio
+ * start together, Xvfb reports on descriptor 3 once it accepts clients
+ * (-displayfd) and PulseAudio is ready once its socket accepts
+ * connections, which it only opens after creating the sinks. The
+ * browser starts once both are ready and is ready once its DevTools
+ * port accepts connections; the driver then loads the page and reports
+ * on descriptor 3 once it is rendered, which starts the encoder.
+ *
+ * @param supervisor The supervisor to configure
+ * @param config The instance settings
+ * @param fanout The fan-out fed by the encoder
+ * @param telemetry The telemetry reading the encoder progress
+ * @param capture The framebuffer capture, or NULL
+ * @param screencast The screencast capture, or NULL
+ * @param watchdog The watchdog reading the encoder's silence reports
+ * @param recycler The browser recycler, NULL when recycling is off
+ * @param sync The sync monitor reading the encoder's frame timestamps
+ * @param controller Keeps the driver and encoder specs for live changes
+ * @param standby True to hold the encoder until the stream goes live
+ * @param syncTest True when streaming the sync test page
+ */
+void StreamManager::addStreamChildren(Supervisor& supervisor, const StreamConfig& config,
+                                      Fanout& fanout, EncoderTelemetry& telemetry,
+                                      FramebufferCapture* capture, ScreencastCapture* screencast,
+                                      StreamWatchdog& watchdog,
+                                      BrowserRecycler* recycler, SyncMonitor& sync,
+                                      StreamController& controller, bool standby, bool syncTest) const {
+    std::string runDir = instance.runDir();
+    std::string pulseServer = "unix:" + runDir + "/pulse/native";
+    std::ostringstream windowSize;
+    std::ostringstream screen;
+    std::ostringstream refresh;
+    std::ostringstream frameFd;
+    std::ostringstream frameSize;
+    std::ostringstream readyFd;
+    int bufferCount = recycler ? 2 : 1;
+    refresh << (standby ? kStandbyRefreshMs : 0);
+    if (screencast) {
+        windowSize << config.outputWidth << "," << config.outputHeight;
+    } else {
+        windowSize << kWidth << "," << kHeight;
+    }
+    screen << kWidth << "x" << kHeight << "x24";
+    frameFd << kFrameFd;
+    readyFd << kReadyFd;
+    frameSize << config.outputWidth << "x" << config.outputHeight;
+
+    ChildSpec pulse;
+    pulse.name = "pulseaudio";
+    pulse.logPath = logDir + "/pulseaudio.log";
+    pulse.env.push_back("PULSE_RUNTIME_PATH=" + runDir + "/pulse");
+    pulse.argv.push_back("pulseaudio");
+    pulse.argv.push_back("--daemonize=no");
+    pulse.argv.push_back("--exit-idle-time=-1");
+    pulse.argv.push_back("--disallow-exit");
+    pulse.argv.push_back("-n");
+    pulse.readySocket = pulseServer;
+
+    for (int buffer = 0; buffer < bufferCount; buffer++) {
+        std::string suffix = buffer == 0 ? "" : "-2";
+        std::string display = instance.display(buffer);
+        std::string sink = buffer == 0 ? "virt_output" : "virt_output_2";
+        std::string fbDir = screencast ? "" : runDir + "/fb" + suffix;
+        bool held = buffer > 0;
+        std::ostringstream port;
+        port << instance.debugPort(buffer);
+        controller.addBuffer(display, sink, fbDir);
+        pulse.argv.push_back("--load=module-null-sink sink_name=" + sink
+                             + " sink_properties=device.description=Virtual_Output" + suffix
+                             + " rate=48000 channels=2");
+
+        std::vector<std::string> commonEnv;
+        if (!screencast) {
+            commonEnv.push_back("DISPLAY=" + display);
+        }
+        commonEnv.push_back("PULSE_SERVER=" + pulseServer);
+        commonEnv.push_back("LIBGL_ALWAYS_SOFTWARE=1");
+        commonEnv.push_back("LIBGL_DEBUG=quiet");
+
+        ChildSpec xvfb;
+        xvfb.name = bufferChildName("xvfb", buffer);
+        xvfb.logPath = logDir + "/xvfb" + suffix + ".log";
+        xvfb.argv.push_back("Xvfb");
+        xvfb.argv.push_back(display);
+        xvfb.argv.push_back("-screen");
+        xvfb.argv.push_back("0");
+        xvfb.argv.push_back(screen.str());
+        xvfb.argv.push_back("-ac");
+        xvfb.argv.push_back("-nolisten");
+        xvfb.argv.push_back("tcp");
+        xvfb.argv.push_back("-dpi");
+        xvfb.argv.push_back("96");
+        xvfb.argv.push_back("-fbdir");
+        xvfb.argv.push_back(fbDir);
+        xvfb.argv.push_back("-displayfd");
+        xvfb.argv.push_back(readyFd.str());
+        xvfb.readyFd = kReadyFd;
+        if (capture) {
+            xvfb.observer = capture->serverObserver();
+        }
+        if (!screencast) {
+            supervisor.addChild(xvfb, held);
+        }
+
+        ChildSpec browser;
+        browser.name = bufferChildName("browser", buffer);
+        browser.logPath = logDir + "/browser" + suffix + ".log";
+        browser.env = commonEnv;
+        browser.env.push_back("PULSE_SINK=" + sink);
+        browser.argv.push_back(config.browserPath.empty() ? kDefaultBrowser : config.browserPath);
+        browser.argv.push_back("--remote-debugging-port=" + port.str());
+        browser.argv.push_back("--user-data-dir=" + instance.dir + "/browser-profile" + suffix);
+        browser.argv.push_back("--no-sandbox");
+        browser.argv.push_back("--disable-setuid-sandbox");
+        browser.argv.push_back("--no-first-run");
+        browser.argv.push_back("--no-default-browser-check");
+        browser.argv.push_back("--window-size=" + windowSize.str());
+        if (screencast) {
+            browser.argv.push_back("--headless=new");
+        } else {
+            browser.argv.push_back("--start-fullscreen");
+        }
+        browser.argv.push_back("--autoplay-policy=no-user-gesture-required");
+        browser.argv.push_back("--disable-infobars");
+        browser.argv.push_back("--disable-background-timer-throttling");
+        browser.argv.push_back("--disable-renderer-backgrounding");
+        browser.argv.push_back("about:blank");
+        browser.readySocket = "tcp:" + port.str();
+        browser.after.push_back("pulseaudio");
+        if (!screencast) {
+            browser.after.push_back(xvfb.name);
+        }
+        if (recycler) {
+            browser.observer = recycler->browserObserver(buffer);
+        }
+        supervisor.addChild(browser, held);
+
+        ChildSpec driver;
+        ChildPipe driverInput = { STDIN_FILENO, false, controller.driverObserver(buffer) };
+        driver.name = bufferChildName("driver", buffer);
+        driver.logPath = logDir + "/stream" + suffix + ".log";
+        driver.workDir = scriptPath;
+        driver.env = commonEnv;
+        driver.env.push_back("PAGESTREAMER_DEBUG_PORT=" + port.str());
+        driver.env.push_back("PAGESTREAMER_INSTANCE=" + instance.name);
+        driver.env.push_back("PAGESTREAMER_INSTANCE_DIR=" + instance.dir);
+        driver.env.push_back("PAGESTREAMER_LOG_DIR=" + logDir);
+        driver.env.push_back("STREAM_URL=" + config.streamUrl);
+        driver.env.push_back(std::string("PAGESTREAMER_ZOOM=") + kDefaultZoom);
+        driver.env.push_back("PAGESTREAMER_STANDBY_REFRESH_MS=" + refresh.str());
+        driver.env.push_back("PAGESTREAMER_READY_FD=" + readyFd.str());
+        driver.argv.push_back("node");
+        driver.argv.push_back("stream.js");
+        driver.pipes.push_back(driverInput);
+        driver.readyFd = kReadyFd;
+        driver.after.push_back(browser.name);
+        if (recycler) {
+            driver.observer = recycler->driverObserver(buffer);
+        }
+        if (screencast) {
+            ChildPipe driverFrames = { kFrameFd, true, screencast->frameObserver(buffer) };
+            driver.env.push_back("PAGESTREAMER_FRAME_FD=" + frameFd.str());
+            driver.env.push_back("PAGESTREAMER_FRAME_SIZE=" + frameSize.str());
+            driver.pipes.push_back(driverFrames);
+        }
+        supervisor.addChild(driver, held);
+        controller.track(driver);
+    }
+    pulse.argv.push_back("--load=module-native-protocol-unix socket=" + runDir + "/pulse/native auth-anonymous=1");
+    supervisor.addChild(pulse);
+
+    ChildSpec encoder;
+    ChildPipe encoderOutput = { STDOUT_FILENO, true, &fanout };
+    ChildPipe encoderInput = { STDIN_FILENO, false, capture };
+    ChildPipe screencastInput = { STDIN_FILENO, false, screencast };
+    ChildPipe encoderProgress = { kProgressFd, true, &telemetry };
+    ChildPipe encoderSilence = { kWatchdogFd, true, &watchdog };
+    ChildPipe encoderSync = { kSyncFd, true, &sync };
+    encoder.name = "ffmpeg";
+    encoder.observer = &controller;
+    encoder.logPath = logDir + "/ffmpeg.log";
+    if (!screencast) {
+        encoder.env.push_back("DISPLAY=" + instance.display());
+    }
+    encoder.env.push_back("PULSE_SERVER=" + pulseServer);
+    encoder.env.push_back("LIBGL_ALWAYS_SOFTWARE=1");
+    encoder.env.push_back("LIBGL_DEBUG=quiet");
+    encoder.argv = encoderArgs(config, instance.display(), "virt_output", syncTest, sync.tempoFilter());
+    encoder.pipes.push_back(encoderOutput);
+    encoder.pipes.push_back(encoderProgress);
+    encoder.pipes.push_back(encoderSilence);
+    encoder.pipes.push_back(encoderSync);
+    encoder.after.push_back("pulseaudio");
+    encoder.after.push_back("driver");
+    if (!screencast) {
+        encoder.after.push_back("xvfb");
+    }
+    if (capture) {
+        encoder.pipes.push_back(encoderInput);
+    }
+    if (screencast) {
+        encoder.pipes.push_back(screencastInput);
+    }
+    supervisor.addChild(encoder, standby);
+    controller.track(encoder);
+}
+
+/**
+ * @brief Body of the background supervisor process
+ *
+ * Detaches from the terminal, sends its own output to supervisor.log,
+ * applies the instance CPU pinning and supervises the stream until it
+ * receives SIGTERM. The single encoder is fanned out to one relay per
+ * destination, each with its own bounded queue. CAPTURE=fbdir replaces
+ * x11grab with the native framebuffer capture, and CAPTURE=screencast
+ * streams a headless browser from its screencast frames, without Xvfb. Encoder telemetry and
+ * capture counters are served on the instance's loopback metrics port.
+ * The profile is watched while the stream runs and a changed page or
+ * destination is applied in place, like the live changes taken on the
+ * instance control socket. Child output goes
+ * through the log pipeline, which also rotates supervisor.log. Unless
+ * ENCODER_TUNING is off, the encoder preset and bitrate follow the
+ * measured encoder speed, CPU usage and destination queues. A watchdog
+ * recovers from a frozen, blank or silent page, and a browser that grew
+ * past BROWSER_MEMORY_LIMIT or BROWSER_RECYCLE_HOURS is replaced by a
+ * fresh one on the spare display. The audio/video sync of the encoder is
+ * measured and drift is corrected by the sound's tempo when ffmpeg has
+ * the azmq and atempo filters; an encoder whose drift that does not
+ * absorb is replaced. The state of
+ * the children and the encoder is published in the status block.
+ *
+ * @param config The instance settings, validated by launch()
+ * @param liveInMs 0 to go live right away, otherwise the stream starts
+ *        in standby and goes live after that delay, or on the live
+ *        command only when negative
+ * @param syncTest True when streaming the sync test page
+ */
+void StreamManager::runSupervisor(const StreamConfig& config, long long liveInMs, bool syncTest) const {
+    std::string logPath = logDir + "/supervisor.log";
+    int devNull = open("/dev/null", O_RDONLY);
+    int logFd = open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    setsid();
+    if (devNull >= 0) {
+        dup2(devNull, STDIN_FILENO);
+        close(devNull);
+    }
+    if (logFd >= 0) {
+        dup2(logFd, STDOUT_FILENO);
+        dup2(logFd, STDERR_FILENO);
+        close(logFd);
+    }
+    if (!config.cpuSet.empty()) {
+        applyCpuSet(instance, config.cpuSet);
+    }
+    LogPipeline logs(logDir);
+    Supervisor supervisor;
+    Fanout fanout;
+    EncoderTelemetry telemetry;
+    StatusBoard status(instance.statusPath(), telemetry, "ffmpeg");
+    MetricsServer metrics(instance.name, instance.metricsPort());
+    StreamController controller(supervisor, logDir);
+    ConfigWatcher watcher(instance.envPath(), controller);
+    ControlServer control(instance.controlPath(), controller);
+    bool headless = config.capture == CAPTURE_SCREENCAST;
+    StreamWatchdog watchdog(headless ? "" : instance.runDir() + "/fb", kWidth, kHeight, controller, config.freezeTimeout);
+    std::set<std::string> filters = ffmpegFilters();
+    bool tempoCorrection = filters.count("azmq") && filters.count("atempo");
+    SyncMonitor sync(controller, tempoCorrection ? instance.runDir() + "/sync.zmq" : "", syncTest);
+    FramebufferCapture* capture = NULL;
+    ScreencastCapture* screencast = NULL;
+    EncoderTuner* tuner = NULL;
+    BrowserRecycler* recycler = NULL;
+    std::vector<std::string> urls = config.destinationUrls();
+    std::vector<RtmpDestination*> destinations;
+    if (config.capture == CAPTURE_FBDIR) {
+        capture = new FramebufferCapture(instance.runDir() + "/fb", kWidth, kHeight,
+                                         config.outputWidth, config.outputHeight, kFrameRate);
+    } else if (headless) {
+        screencast = new ScreencastCapture(kFrameRate, watchdog);
+    }
+    if (config.browserMemoryLimit > 0 || config.browserRecycleHours > 0) {
+        recycler = new BrowserRecycler(controller, config.browserMemoryLimit, config.browserRecycleHours);
+    }
+    controller.setCapture(capture, screencast, &watchdog);
+    addStreamChildren(supervisor, config, fanout, telemetry, capture, screencast, watchdog, recycler, sync,
+                      controller, liveInMs != 0, syncTest);
+    metrics.addSource(&telemetry);
+    metrics.addSource(&watchdog);
+    metrics.addSource(&sync);
+    if (capture) {
+        metrics.addSource(capture);
+    }
+    if (screencast) {
+        metrics.addSource(screencast);
+    }
+    if (recycler) {
+        metrics.addSource(recycler);
+    }
+    for (size_t i = 0; i < urls.size(); i++) {
+        std::ostringstream name;
+        name << "relay-" << (i + 1);
+        destinations.push_back(new RtmpDestination(name.str(), urls[i], kDestinationQueueBytes,
+                                                   kReconnectBufferMs));
+        fanout.addSink(destinations.back());
+        controller.addDestination(destinations.back());
+        supervisor.addChild(destinations.back()->relaySpec(logDir));
+    }
+    if (config.encoderTuning) {
+        TuningBounds bounds = platformBounds(config.platform, config.outputHeight);
+        tuner = new EncoderTuner(telemetry, controller, bounds, bounds.defaultBitrateKbps);
+        for (size_t i = 0; i < destinations.size(); i++) {
+            tuner->addDestination(destinations[i]);
+        }
+        controller.setTuner(tuner);
+        metrics.addSource(tuner);
+    }
+    if (liveInMs > 0) {
+        supervisor.release("ffmpeg", liveInMs);
+    }
+    logs.watchOutput(logPath);
+    supervisor.setLogRouter(&logs);
+    status.start();
+    supervisor.setStatusListener(&status);
+    logs.start();
+    logMessage(liveInMs != 0 ? "Supervisor started in standby" : "Supervisor started");
+    if (!tempoCorrection) {
+        logMessage("ffmpeg has no azmq or atempo filter: A/V drift is only corrected by starting a fresh encoder");
+    }
+    metrics.start();
+    watcher.start();
+    control.start();
+    if (tuner) {
+        tuner->start();
+    }
+    watchdog.start();
+    sync.start();
+    if (recycler) {
+        recycler->start();
+    }
+    supervisor.run();
+    if (recycler) {
+        recycler->shutdown();
+    }
+    sync.shutdown();
+    watchdog.shutdown();
+    if (tuner) {
+        tuner->shutdown();
+    }
+    control.shutdown();
+    watcher.shutdown();
+    metrics.shutdown();
+    status.shutdown();
+    telemetry.shutdown();
+    delete tuner;
+    delete recycler;
+    delete capture;
+    delete screencast;
+    fanout.shutdown();
+    for (size_t i = 0; i < destinations.size(); i++) {
+        delete destinations[i];
+    }
+    logs.shutdown();
+    logMessage("Supervisor stopped");
+}
+
+/**
+ * @brief Computes the delay until the next occurrence of a local time
+ *
+ * @param time The time of day, as HH:MM
+ * @param delayMs Receives the delay, up to one day
+ * @return bool False if time is not a valid HH:MM
+ */
+static bool delayUntil(const std::string& time, long long& delayMs) {
+    int hour = -1;
+    int minute = -1;
+    char extra;
+    if (sscanf(time.c_str(), "%d:%d%c", &hour, &minute, &extra) != 2
+        || hour < 0 || hour > 23 || minute < 0 || minute > 59) {
+        return false;
+    }
+    struct timespec now;
+    struct tm slot;
+    clock_gettime(CLOCK_REALTIME, &now);
+    localtime_r(&now.tv_sec, &slot);
+    slot.tm_hour = hour;
+    slot.tm_min = minute;
+    slot.tm_sec = 0;
+    slot.tm_isdst = -1;
+    long long nowMs = static_cast<long long>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+    for (int day = 0; day < 2; day++) {
+        struct tm candidate = slot;
+        candidate.tm_mday += day;
+        delayMs = static_cast<long long>(mktime(&candidate)) * 1000 - nowMs;
+        if (delayMs > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Verifies the configuration and forks the background supervisor
+ *
+ * @param liveInMs Passed to runSupervisor(): 0 to go live right away
+ * @param syncTest True to stream the sync test page instead of STREAM_URL
+ * @throws std::runtime_error If the configuration is invalid, the stream
+ *         already runs or the supervisor cannot be started
+ */
+void StreamManager::launch(long long liveInMs, bool syncTest) {
+    StreamConfig config;
+    std::vector<std::string> errors;
+    ConfigManager configManager(instance.envPath());
+    configManager.load(config, errors);
+    if (!errors.empty()) {
+        throw std::runtime_error("Invalid configuration: " + errors[0] + ". Run 'pagestreamer --config' to fix it.");
+    }
+    if (!config.isComplete()) {
+        throw std::runtime_error("Stream configuration incomplete. Run 'pagestreamer --config' first.");
+    }
+    if (readSupervisorPid() > 0) {
+        throw std::runtime_error("Stream is already running. Run 'pagestreamer stop' first.");
+    }
+    if (syncTest) {
+        config.streamUrl = "file://" + scriptPath + "/synctest.html";
+    }
+    bool headless = config.capture == CAPTURE_SCREENCAST;
+    pid_t displayOwner = headless ? 0 : clearStaleDisplayLock(instance.display());
+    if (displayOwner > 0) {
+        std::ostringstream msg;
+        msg << "Display " << instance.display() << " is already used by PID " << displayOwner << ".";
+        throw std::runtime_error(msg.str());
+    }
+    mkdir(logDir.c_str(), 0755);
+    mkdir(instance.runDir().c_str(), 0700);
+    mkdir((instance.runDir() + "/pulse").c_str(), 0700);
+    if (!headless) {
+        mkdir((instance.runDir() + "/fb").c_str(), 0700);
+    }
+    if (!headless && (config.browserMemoryLimit > 0 || config.browserRecycleHours > 0)) {
+        mkdir((instance.runDir() + "/fb-2").c_str(), 0700);
+        clearStaleDisplayLock(instance.display(1));
+    }
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid < 0) {
+        throw std::runtime_error(std::string("Failed to start stream: ") + strerror(errno));
+    }
+    if (pid == 0) {
+        int code = 0;
+        try {
+            runSupervisor(config, liveInMs, syncTest);
+        } catch (const std::exception &e) {
+            logMessage(std::string("Supervisor error: ") + e.what());
+            code = 1;
+        }
+        std::cout.flush();
+        _exit(code);
+    }
+    std::ofstream pidFile(pidPath.c_str());
+    if (!pidFile.is_open() || !(pidFile << pid << std::endl)) {
+        kill(pid, SIGTERM);
+        throw std::runtime_error("Failed to write " + pidPath);
+    }
+    std::cout << "Instance " << instance.name << ": supervisor started with PID " << pid
+              << " on display " << instance.display() << (liveInMs != 0 ? " in standby" : "")
+              << ", logs in " << logDir << std::endl;
 }
 
 /**
  * @brief Starts the stream
- * 
- * Executes the start_stream.sh script to initialize and start the stream.
- * Verifies that the configuration is complete before starting.
- * 
+ *
+ * Verifies that the configuration is valid and complete, then forks
+ * the background supervisor and records its PID. An instance in standby
+ * goes live instead, which only starts the encoder.
+ *
  * @return True if the stream started successfully, false otherwise
  * @throws std::runtime_error If an error occurs during execution
  */
 bool StreamManager::startStream() {
-    std::string envPath = std::string(getenv("HOME")) + "/.pagestreamer/.env";
-    std::ifstream envFile(envPath.c_str());
-    bool hasStreamKey = false;
-    bool hasPlatform = false;
-    
-    if (envFile.is_open()) {
-        std::string line;
-        while (std::getline(envFile, line)) {
-            if (line.find("STREAM_KEY=") == 0 && line.length() > 11) {
-                hasStreamKey = true;
-            }
-            if (line.find("PLATFORM=") == 0 && line.length() > 9) {
-                hasPlatform = true;
-            }
-        }
-        envFile.close();
-    }
-    if (!hasStreamKey || !hasPlatform) {
-        throw std::runtime_error("Stream configuration incomplete. Run 'pagestreamer --config' first.");
+    std::string reply;
+    if (readSupervisorPid() > 0 && sendControlCommand(instance.controlPath(), "live", reply)
+        && reply.compare(0, 3, "ok ") == 0) {
+        std::cout << "Instance " << instance.name << ": standby stream " << reply.substr(3) << std::endl;
+        return true;
+    }
+    launch(0);
+    return true;
+}
+
+/**
+ * @brief Starts the stream in standby
+ *
+ * Everything but the encoder is started: the page is loaded, kept fresh
+ * and ready to be captured, so going live later takes about as long as
+ * the encoder needs to produce its first keyframe.
+ *
+ * @param liveAt The local time (HH:MM) to go live at, empty to wait for
+ *        pagestreamer start
+ * @return True if the stream started successfully, false otherwise
+ * @throws std::runtime_error If the time is invalid or the stream cannot start
+ */
+bool StreamManager::startStandby(const std::string& liveAt) {
+    long long delayMs = -1;
+    if (!liveAt.empty() && !delayUntil(liveAt, delayMs)) {
+        throw std::runtime_error("Invalid go-live time " + liveAt + ", expected HH:MM");
     }
-    std::string command = "cd " + scriptPath + " && bash start_stream.sh";
-    int result = executeCommand(command);
-    if (result != 0) {
-        throw std::runtime_error("Failed to start stream. Check logs for details.");
+    launch(delayMs);
+    if (delayMs > 0) {
+        std::cout << "Going live at " << liveAt << ", in " << (delayMs + 999) / 1000 << " s" << std::endl;
     }
     return true;
 }
 
+/**
+ * @brief Starts the stream in standby for a given time
+ *
+ * @param liveInMs Delay before going live, negative to wait for
+ *        pagestreamer start
+ * @return True if the stream started successfully, false otherwise
+ * @throws std::runtime_error If the stream cannot start
+ */
+bool StreamManager::startStandby(long long liveInMs) {
+    launch(liveInMs);
+    return true;
+}
+
+/**
+ * @brief Starts the stream on the sync test page
+ *
+ * The page flashes white and beeps at the same time every two seconds,
+ * to all destinations as configured; pagestreamer stats then shows how
+ * far apart each flash and its beep ended up in the encoded stream.
+ *
+ * @return True if the stream started successfully, false otherwise
+ * @throws std::runtime_error If the stream cannot start
+ */
+bool StreamManager::startSyncTest() {
+    launch(0, true);
+    return true;
+}
+
 /**
  * @brief Stops the stream
- * 
- * Executes the stop_stream.sh script to properly terminate all stream processes.
- * 
+ *
+ * Signals the supervisor, which stops all stream processes in parallel,
+ * and waits for it to exit.
+ *
  * @return True if the stream stopped successfully, false otherwise
  * @throws std::runtime_error If an error occurs during execution
  */
 bool StreamManager::stopStream() {
-    std::string command = "cd " + scriptPath + " && bash stop_stream.sh";
-    int result = executeCommand(command);
-    if (result != 0) {
-        throw std::runtime_error("Failed to stop stream. Check logs for details.");
+    pid_t pid = readSupervisorPid();
+    if (pid <= 0) {
+        unlink(pidPath.c_str());
+        std::cout << "No running stream found." << std::endl;
+        return true;
     }
+    if (kill(pid, SIGTERM) != 0) {
+        throw std::runtime_error(std::string("Failed to stop stream: ") + strerror(errno));
+    }
+    long long deadline = monotonicMs() + kStopTimeoutMs;
+    while (isSupervisorAlive(pid) && monotonicMs() < deadline) {
+        usleep(20000);
+    }
+    if (isSupervisorAlive(pid)) {
+        kill(pid, SIGKILL);
+        std::cout << YELLOW "Supervisor did not exit in time and was killed." RESET << std::endl;
+    }
+    unlink(pidPath.c_str());
     return true;
 }
 
+/**
+ * @brief Lists the direct children of a process by scanning /proc
+ *
+ * @param parent The parent process ID
+ */
+static void printChildProcesses(pid_t parent) {
+    DIR* proc = opendir("/proc");
+    struct dirent* entry;
+    if (!proc) {
+        return;
+    }
+    while ((entry = readdir(proc)) != NULL) {
+        pid_t pid = static_cast<pid_t>(atoi(entry->d_name));
+        if (pid <= 0) {
+            continue;
+        }
+        std::ostringstream path;
+        path << "/proc/" << pid << "/stat";
+        std::ifstream statFile(path.str().c_str());
+        std::string stat;
+        if (!std::getline(statFile, stat) || stat.rfind(')') == std::string::npos) {
+            continue;
+        }
+        std::istringstream fields(stat.substr(stat.rfind(')') + 2));
+        char state;
+        pid_t ppid;
+        if (fields >> state >> ppid && ppid == parent) {
+            size_t open = stat.find('(');
+            std::cout << "  " << pid << " " << stat.substr(open + 1, stat.rfind(')') - open - 1)
+                      << " (" << state << ")" << std::endl;
+        }
+    }
+    closedir(proc);
+}
+
 /**
  * @brief Checks the status of the stream
- * 
- * Executes the status_stream.sh script to get information about the 
- * current stream status.
- * 
+ *
+ * Reports the supervisor and the processes it currently runs, read from
+ * the status block it publishes, without forking nor waiting for the
+ * supervisor. A supervisor without a status block is asked for its
+ * state on the control socket and its processes are listed from /proc.
+ *
+ * @param json True to print a single JSON object, also when stopped
  * @return True if the stream is running, false otherwise
- * @throws std::runtime_error If an error occurs during execution
  */
-bool StreamManager::getStreamStatus() {
-    std::string command = "cd " + scriptPath + " && bash status_stream.sh";
-    int result = executeCommand(command);
-    return (result == 0);
+bool StreamManager::getStreamStatus(bool json) {
+    pid_t pid = readSupervisorPid();
+    StatusBlock block;
+    bool published = pid > 0 && readStatusBlock(instance.statusPath(), block) && block.supervisorPid == pid;
+    if (json) {
+        writeStatusJson(std::cout, instance.name, published ? &block : NULL);
+        return pid > 0;
+    }
+    if (pid <= 0) {
+        return false;
+    }
+    std::cout << "Instance " << instance.name << " on display " << instance.display()
+              << ", supervisor running with PID " << pid << std::endl;
+    if (published) {
+        writeStatusText(std::cout, block);
+        std::cout << "Logs: " << logDir << std::endl;
+        return true;
+    }
+    std::string reply;
+    if (sendControlCommand(instance.controlPath(), "state", reply) && reply == "ok standby") {
+        std::cout << "State: standby, waiting to go live" << std::endl;
+    }
+    std::cout << "Processes:" << std::endl;
+    printChildProcesses(pid);
+    std::cout << "Logs: " << logDir << std::endl;
+    return true;
+}
+
+/**
+ * @brief Tells whether the stream is stopped, in standby or live
+ *
+ * Answered from the PID file and the status block, or the control
+ * socket for a supervisor without one, without forking. A supervisor
+ * whose control socket does not answer counts as live.
+ *
+ * @return string "stopped", "standby" or "live"
+ */
+std::string StreamManager::streamState() const {
+    std::string reply;
+    StatusBlock block;
+    pid_t pid = readSupervisorPid();
+    if (pid <= 0) {
+        return "stopped";
+    }
+    if (readStatusBlock(instance.statusPath(), block) && block.supervisorPid == pid) {
+        return block.phase == STREAM_STANDBY ? "standby" : "live";
+    }
+    if (sendControlCommand(instance.controlPath(), "state", reply) && reply == "ok standby") {
+        return "standby";
+    }
+    return "live";
+}
+
+/**
+ * @brief Prints the live encoder statistics of the stream
+ *
+ * Fetched from the supervisor's metrics endpoint, so the numbers are the
+ * supervisor's in-memory time series rather than anything from the logs.
+ *
+ * @return True if the stream is running, false otherwise
+ * @throws std::runtime_error If the metrics endpoint cannot be reached
+ */
+bool StreamManager::printStats() {
+    std::string body;
+    if (readSupervisorPid() <= 0) {
+        return false;
+    }
+    if (!fetchMetricsPage(instance.metricsPort(), "/stats", body)) {
+        std::ostringstream msg;
+        msg << "Cannot reach the metrics endpoint on 127.0.0.1:" << instance.metricsPort()
+            << ", see " << logDir << "/supervisor.log";
+        throw std::runtime_error(msg.str());
+    }
+    std::cout << "Instance " << instance.name << ", metrics on http://127.0.0.1:"
+              << instance.metricsPort() << "/metrics" << std::endl;
+    std::cout << body;
+    return true;
+}
+
+/**
+ * @brief Sends a live change to the running stream
+ *
+ * The reply of the supervisor is printed as is.
+ *
+ * @param words The command and its arguments, e.g. {"zoom", "1.25"}
+ * @return True if the stream applied the command, false if it refused it
+ * @throws std::runtime_error If no stream runs or its control socket cannot be reached
+ */
+bool StreamManager::sendCommand(const std::vector<std::string>& words) {
+    std::string command;
+    std::string reply;
+    for (size_t i = 0; i < words.size(); i++) {
+        command += (i > 0 ? " " : "") + words[i];
+    }
+    if (readSupervisorPid() <= 0) {
+        throw std::runtime_error("Stream is not running.");
+    }
+    if (!sendControlCommand(instance.controlPath(), command, reply)) {
+        throw std::runtime_error("Cannot reach the control socket " + instance.controlPath()
+                                 + ", see " + logDir + "/supervisor.log");
+    }
+    if (reply.compare(0, 3, "ok ") == 0) {
+        std::cout << B GREEN << reply.substr(3) << RESET << std::endl;
+        return true;
+    }
+    std::cerr << B RED "Error: " RESET RED << reply.substr(reply.find(' ') + 1) << RESET << std::endl;
+    return false;
 }
@@ -0,0 +1,1093 @@
+#include "../includes/Supervisor.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <stdint.h>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static const int kInitialBackoffMs = 50;
+static const int kMaxBackoffMs = 5000;
+static const long long kStableRunMs = 10000;
+static const int kStopDeadlineMs = 5000;
+static const long long kRetireDeadlineMs = 15000;
+static const uint64_t kSignalTag = ~static_cast<uint64_t>(0);
+static const uint64_t kWakeTag = kSignalTag - 1;
+static const uint64_t kReadyTag = static_cast<uint64_t>(1) << 32;
+static const int kFirstPrivateFd = 64;
+static const long long kReadyProbeMs = 20;
+static const long long kReadyWarningMs = 15000;
+
+/**
+ * @brief Constructor
+ *
+ * Initializes an empty spec that is restarted whenever it exits.
+ */
+ChildSpec::ChildSpec() : oneshot(false), maxBackoffMs(0), observer(NULL), readyFd(-1) {
+}
+
+/**
+ * @brief Constructor
+ *
+ * Blocks the signals the supervisor cares about and routes them through
+ * a signalfd so they can be handled in the same epoll loop as pidfds.
+ * SIGPIPE is ignored so a dead pipe reader surfaces as EPIPE. An
+ * eventfd wakes the loop when another thread queues a replacement.
+ *
+ * @throws std::runtime_error If epoll, signalfd or eventfd cannot be created
+ */
+Supervisor::Supervisor() : epollFd(-1), signalFd(-1), wakeFd(-1), stopping(false), runStartedAt(0),
+                           startupLogged(false), logRouter(NULL), statusListener(NULL) {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, &savedMask);
+    signal(SIGPIPE, SIG_IGN);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || signalFd < 0 || wakeFd < 0) {
+        throw std::runtime_error(std::string("Cannot set up supervisor: ") + strerror(errno));
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = kSignalTag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &ev);
+    ev.data.u64 = kWakeTag;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+}
+
+/**
+ * @brief Destructor
+ *
+ * Releases the event descriptors and restores the original signal mask.
+ */
+Supervisor::~Supervisor() {
+    for (size_t i = 0; i < children.size(); i++) {
+        if (children[i].pidfd >= 0) {
+            close(children[i].pidfd);
+        }
+        if (children[i].readyPipe >= 0) {
+            close(children[i].readyPipe);
+        }
+    }
+    if (signalFd >= 0) {
+        close(signalFd);
+    }
+    if (wakeFd >= 0) {
+        close(wakeFd);
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+    sigprocmask(SIG_SETMASK, &savedMask, NULL);
+    signal(SIGPIPE, SIG_DFL);
+}
+
+/**
+ * @brief Sends the output of every child with a logPath to a router
+ *
+ * @param router The router, which must outlive run()
+ */
+void Supervisor::setLogRouter(LogRouter* router) {
+    logRouter = router;
+}
+
+/**
+ * @brief Reports the state of every child to a listener
+ *
+ * @param listener The listener, which must outlive run()
+ */
+void Supervisor::setStatusListener(StatusListener* listener) {
+    statusListener = listener;
+}
+
+/**
+ * @brief Registers a child to be started by run()
+ *
+ * @param spec The description of the process
+ * @param held True to only start it once released with release()
+ */
+void Supervisor::addChild(const ChildSpec& spec, bool held) {
+    Child child;
+    child.spec = spec;
+    child.pid = -1;
+    child.pidfd = -1;
+    child.restarts = 0;
+    child.startedAt = 0;
+    child.restartAt = -1;
+    child.backoffMs = kInitialBackoffMs;
+    child.done = false;
+    child.replacing = false;
+    child.held = held;
+    child.ready = false;
+    child.readyWarned = false;
+    child.readyPipe = -1;
+    child.readyProbeAt = -1;
+    children.push_back(child);
+}
+
+/**
+ * @brief Wakes the supervisor loop to apply queued requests
+ */
+void Supervisor::wake() {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        logMessage(std::string("Cannot wake the supervisor: ") + strerror(errno));
+    }
+}
+
+/**
+ * @brief Replaces the spec of a child, from any thread
+ *
+ * The replacement is queued and applied by the supervisor loop. Specs
+ * are matched by name; unknown names are ignored.
+ *
+ * @param spec The new description of the process
+ * @param mode When and how the running process is replaced
+ */
+void Supervisor::replaceChild(const ChildSpec& spec, ReplaceMode mode) {
+    Replacement replacement;
+    replacement.spec = spec;
+    replacement.mode = mode;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        replacements.push_back(replacement);
+    }
+    wake();
+}
+
+/**
+ * @brief Starts a held child, from any thread
+ *
+ * Releasing a child that is not held, or again while its delay runs,
+ * has no effect beyond moving its start to the earliest requested time.
+ *
+ * @param name The name of the child
+ * @param delayMs How long to wait before starting it, 0 for right away
+ */
+void Supervisor::release(const std::string& name, long long delayMs) {
+    Release request;
+    request.name = name;
+    request.delayMs = delayMs;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        releases.push_back(request);
+    }
+    wake();
+}
+
+/**
+ * @brief Stops a running child so it starts again right away, from any thread
+ *
+ * A child that is not running is left alone.
+ *
+ * @param name The name of the child
+ */
+void Supervisor::restart(const std::string& name) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        restartRequests.push_back(name);
+    }
+    wake();
+}
+
+/**
+ * @brief Stops a child and keeps it stopped until release(), from any thread
+ *
+ * A child that is not running only stops being restarted. A child still
+ * stopping cannot be released yet.
+ *
+ * @param name The name of the child
+ */
+void Supervisor::hold(const std::string& name) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        holdRequests.push_back(name);
+    }
+    wake();
+}
+
+/**
+ * @brief Builds the environment of a child from ours plus its overrides
+ *
+ * @param overrides KEY=VALUE entries that replace or extend environ
+ * @return vector<string> The merged environment
+ */
+static std::vector<std::string> buildEnvironment(const std::vector<std::string>& overrides) {
+    std::vector<std::string> env;
+    for (char **entry = environ; entry && *entry; entry++) {
+        std::string current(*entry);
+        std::string key = current.substr(0, current.find('=') + 1);
+        bool overridden = false;
+        for (size_t i = 0; i < overrides.size() && !overridden; i++) {
+            overridden = overrides[i].compare(0, key.size(), key) == 0;
+        }
+        if (!overridden) {
+            env.push_back(current);
+        }
+    }
+    env.insert(env.end(), overrides.begin(), overrides.end());
+    return env;
+}
+
+/**
+ * @brief Converts a list of strings into a NULL terminated char* array
+ *
+ * @param strings The strings, which must outlive the returned array
+ * @return vector<char*> The pointer array
+ */
+static std::vector<char*> toCharArray(std::vector<std::string>& strings) {
+    std::vector<char*> result;
+    for (size_t i = 0; i < strings.size(); i++) {
+        result.push_back(&strings[i][0]);
+    }
+    result.push_back(NULL);
+    return result;
+}
+
+/**
+ * @brief Lists the distinct observers of a spec
+ *
+ * @param spec The child description
+ * @return vector<ChildObserver*> The spec observer and every pipe owner
+ */
+static std::vector<ChildObserver*> specObservers(const ChildSpec& spec) {
+    std::vector<ChildObserver*> observers;
+    if (spec.observer) {
+        observers.push_back(spec.observer);
+    }
+    for (size_t i = 0; i < spec.pipes.size(); i++) {
+        ChildObserver* owner = spec.pipes[i].observer;
+        bool known = false;
+        for (size_t j = 0; j < observers.size() && !known; j++) {
+            known = observers[j] == owner;
+        }
+        if (owner && !known) {
+            observers.push_back(owner);
+        }
+    }
+    return observers;
+}
+
+/**
+ * @brief Creates the pipes requested by a spec
+ *
+ * Both ends are close-on-exec; the child end is moved above the
+ * descriptors children use and dup2'ed into place after fork, which
+ * clears the flag on the copy.
+ *
+ * @param pipes The requested pipes
+ * @param childEnds Receives the ends given to the child
+ * @param ourEnds Receives the ends kept by the supervisor
+ * @return bool False if a pipe could not be created
+ */
+static bool createPipes(const std::vector<ChildPipe>& pipes,
+                        std::vector<int>& childEnds, std::vector<int>& ourEnds) {
+    for (size_t i = 0; i < pipes.size(); i++) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0) {
+            for (size_t j = 0; j < childEnds.size(); j++) {
+                close(childEnds[j]);
+                close(ourEnds[j]);
+            }
+            childEnds.clear();
+            ourEnds.clear();
+            return false;
+        }
+        int childEnd = pipes[i].childWrites ? fds[1] : fds[0];
+        int movedEnd = fcntl(childEnd, F_DUPFD_CLOEXEC, kFirstPrivateFd);
+        if (movedEnd >= 0) {
+            close(childEnd);
+            childEnd = movedEnd;
+        }
+        childEnds.push_back(childEnd);
+        ourEnds.push_back(pipes[i].childWrites ? fds[0] : fds[1]);
+    }
+    return true;
+}
+
+/**
+ * @brief Places a descriptor on the number a child expects, kept open across exec
+ *
+ * dup2() onto itself is a no-op that would leave O_CLOEXEC set, so that
+ * case clears the flag instead. Only called between fork and exec.
+ *
+ * @param fd The descriptor, opened with O_CLOEXEC
+ * @param target The number the child expects
+ */
+static void installChildFd(int fd, int target) {
+    if (fd == target) {
+        fcntl(fd, F_SETFD, 0);
+    } else {
+        dup2(fd, target);
+    }
+}
+
+/**
+ * @brief Tells whether a spec has a readiness signal of its own
+ *
+ * @param spec The child description
+ * @return bool True if the child is not ready as soon as it started
+ */
+static bool hasReadySignal(const ChildSpec& spec) {
+    return spec.readyFd >= 0 || !spec.readySocket.empty() || spec.oneshot;
+}
+
+/**
+ * @brief Tells whether a socket accepts connections
+ *
+ * @param address "unix:PATH", or "tcp:PORT" on the loopback
+ * @return bool True if a connection could be opened
+ */
+static bool socketAccepts(const std::string& address) {
+    int fd = -1;
+    int result = -1;
+    if (address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (address.size() - 5 >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        strcpy(addr.sun_path, address.c_str() + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        }
+    } else if (address.compare(0, 4, "tcp:") == 0) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(static_cast<uint16_t>(atoi(address.c_str() + 4)));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd >= 0) {
+            result = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return result == 0;
+}
+
+/**
+ * @brief Forks and executes a child in its own process group
+ *
+ * Everything the child needs is prepared before fork() so the child
+ * only calls async-signal-safe functions before exec. The log router,
+ * if any, rewrites a copy of the spec so its output goes through pipes.
+ * The readiness pipe, if any, is read by the supervisor loop.
+ *
+ * @param child The child to start
+ * @return bool True if the process was created
+ */
+bool Supervisor::spawn(Child& child) {
+    ChildSpec spec = child.spec;
+    if (logRouter && !spec.logPath.empty()) {
+        logRouter->route(spec);
+    }
+    std::vector<std::string> argvStrings = spec.argv;
+    std::vector<std::string> envStrings = buildEnvironment(spec.env);
+    std::vector<char*> argv = toCharArray(argvStrings);
+    std::vector<char*> envp = toCharArray(envStrings);
+    const char* workDir = spec.workDir.empty() ? NULL : spec.workDir.c_str();
+    const char* logPath = spec.logPath.empty() ? "/dev/null" : spec.logPath.c_str();
+    std::vector<int> childEnds;
+    std::vector<int> ourEnds;
+    std::vector<ChildPipe> readyPipes;
+    std::vector<int> readyChildEnds;
+    std::vector<int> readyOurEnds;
+
+    if (spec.readyFd >= 0) {
+        ChildPipe readyPipe = { spec.readyFd, true, NULL };
+        readyPipes.push_back(readyPipe);
+    }
+    closeReadyPipe(child);
+    if (!createPipes(spec.pipes, childEnds, ourEnds)) {
+        reportFailure("Cannot create pipes for " + spec.name + ": " + strerror(errno));
+        return false;
+    }
+    if (!createPipes(readyPipes, readyChildEnds, readyOurEnds)) {
+        reportFailure("Cannot create pipes for " + spec.name + ": " + strerror(errno));
+        for (size_t i = 0; i < childEnds.size(); i++) {
+            close(childEnds[i]);
+            close(ourEnds[i]);
+        }
+        return false;
+    }
+    childEnds.insert(childEnds.end(), readyChildEnds.begin(), readyChildEnds.end());
+    ourEnds.insert(ourEnds.end(), readyOurEnds.begin(), readyOurEnds.end());
+    pid_t pid = fork();
+    if (pid < 0) {
+        reportFailure("Cannot fork " + spec.name + ": " + strerror(errno));
+        for (size_t i = 0; i < childEnds.size(); i++) {
+            close(childEnds[i]);
+            close(ourEnds[i]);
+        }
+        return false;
+    }
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &savedMask, NULL);
+        signal(SIGPIPE, SIG_DFL);
+        setpgid(0, 0);
+        int devNull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+        int logFd = open(logPath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (devNull >= 0) {
+            installChildFd(devNull, STDIN_FILENO);
+        }
+        if (logFd >= 0) {
+            installChildFd(logFd, STDOUT_FILENO);
+            installChildFd(logFd, STDERR_FILENO);
+        }
+        for (size_t i = 0; i < childEnds.size(); i++) {
+            installChildFd(childEnds[i], i < spec.pipes.size() ? spec.pipes[i].childFd : spec.readyFd);
+        }
+        if (workDir && chdir(workDir) != 0) {
+            _exit(127);
+        }
+        execvpe(argv[0], &argv[0], &envp[0]);
+        _exit(127);
+    }
+    setpgid(pid, pid);
+    for (size_t i = 0; i < childEnds.size(); i++) {
+        close(childEnds[i]);
+    }
+    if (!readyOurEnds.empty()) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = kReadyTag | static_cast<uint64_t>(&child - &children[0]);
+        child.readyPipe = readyOurEnds[0];
+        ourEnds.pop_back();
+        fcntl(child.readyPipe, F_SETFL, fcntl(child.readyPipe, F_GETFL) | O_NONBLOCK);
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, child.readyPipe, &ev);
+    }
+    child.pid = pid;
+    child.startedAt = monotonicMs();
+    child.restartAt = -1;
+    child.ready = false;
+    child.readyWarned = false;
+    child.readyLine.clear();
+    child.readyProbeAt = spec.readySocket.empty() ? -1 : child.startedAt + kReadyProbeMs;
+#ifdef SYS_pidfd_open
+    child.pidfd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+#endif
+    if (child.pidfd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = static_cast<uint64_t>(&child - &children[0]);
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, child.pidfd, &ev);
+    }
+    std::ostringstream msg;
+    msg << "Started " << spec.name << " (PID " << pid << ")";
+    logMessage(msg.str());
+    std::vector<ChildObserver*> observers = specObservers(spec);
+    std::vector<bool> handedOver(ourEnds.size(), false);
+    for (size_t i = 0; i < observers.size(); i++) {
+        std::vector<int> fds;
+        for (size_t j = 0; j < ourEnds.size(); j++) {
+            ChildObserver* owner = spec.pipes[j].observer;
+            if ((owner ? owner : spec.observer) == observers[i]) {
+                fds.push_back(ourEnds[j]);
+                handedOver[j] = true;
+            }
+        }
+        observers[i]->childStarted(pid, fds);
+    }
+    for (size_t i = 0; i < ourEnds.size(); i++) {
+        if (!handedOver[i]) {
+            close(ourEnds[i]);
+        }
+    }
+    if (!hasReadySignal(spec)) {
+        markReady(child);
+    }
+    return true;
+}
+
+/**
+ * @brief Collects every child that has exited
+ *
+ * Retired processes are not watched through pidfds; their exit is seen
+ * through SIGCHLD. Their observers already follow the replacement, so
+ * they are only logged and their group cleaned up.
+ */
+void Supervisor::reapChildren() {
+    for (size_t i = 0; i < children.size(); i++) {
+        int status = 0;
+        if (children[i].pid > 0 && waitpid(children[i].pid, &status, WNOHANG) == children[i].pid) {
+            handleExit(children[i], status);
+        }
+    }
+    for (size_t i = 0; i < retired.size();) {
+        int status = 0;
+        if (waitpid(retired[i].pid, &status, WNOHANG) != retired[i].pid) {
+            i++;
+            continue;
+        }
+        std::ostringstream msg;
+        kill(-retired[i].pid, SIGKILL);
+        msg << "Replaced " << retired[i].name << " (PID " << retired[i].pid << ") ";
+        if (WIFSIGNALED(status)) {
+            msg << "killed by signal " << WTERMSIG(status);
+        } else {
+            msg << "exited with code " << WEXITSTATUS(status);
+        }
+        logMessage(msg.str());
+        retired.erase(retired.begin() + i);
+    }
+}
+
+/**
+ * @brief Records a child exit and schedules its restart
+ *
+ * Leftover members of the child's process group (e.g. browser helper
+ * processes) are killed with it. The restart delay doubles on each quick
+ * failure up to kMaxBackoffMs, or the spec's own cap, and resets once a
+ * child has run stably.
+ *
+ * @param child The child that exited
+ * @param status The wait status returned by waitpid
+ */
+void Supervisor::handleExit(Child& child, int status) {
+    std::ostringstream msg;
+    long long now = monotonicMs();
+
+    kill(-child.pid, SIGKILL);
+    if (child.pidfd >= 0) {
+        close(child.pidfd);
+        child.pidfd = -1;
+    }
+    child.pid = -1;
+    child.ready = false;
+    child.readyProbeAt = -1;
+    closeReadyPipe(child);
+    std::vector<ChildObserver*> observers = specObservers(child.spec);
+    for (size_t i = 0; i < observers.size(); i++) {
+        observers[i]->childExited(status);
+    }
+    msg << child.spec.name;
+    if (WIFSIGNALED(status)) {
+        msg << " killed by signal " << WTERMSIG(status);
+    } else {
+        msg << " exited with code " << WEXITSTATUS(status);
+    }
+    if (stopping) {
+        logMessage(msg.str());
+        return;
+    }
+    if (child.held) {
+        logMessage(msg.str() + ", held");
+        return;
+    }
+    if (child.replacing) {
+        child.replacing = false;
+        child.backoffMs = kInitialBackoffMs;
+        child.restartAt = now;
+        logMessage(msg.str() + ", starting its replacement");
+        return;
+    }
+    if (child.spec.oneshot && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        child.done = true;
+        logMessage(msg.str());
+        markReady(child);
+        return;
+    }
+    if (now - child.startedAt >= kStableRunMs) {
+        child.backoffMs = kInitialBackoffMs;
+    }
+    child.restartAt = now + child.backoffMs;
+    msg << ", restarting in " << child.backoffMs << " ms";
+    reportFailure(msg.str());
+    int maxBackoffMs = child.spec.maxBackoffMs > 0 ? child.spec.maxBackoffMs : kMaxBackoffMs;
+    child.backoffMs = child.backoffMs * 2 > maxBackoffMs ? maxBackoffMs : child.backoffMs * 2;
+}
+
+/**
+ * @brief Applies the requests queued by replaceChild(), release(), restart() and hold()
+ *
+ * An overlapping replacement retires the running process: it is no
+ * longer restarted nor reported to observers, and is stopped if it is
+ * still alive after kRetireDeadlineMs. A released child is scheduled
+ * like a pending restart, and a restarted one is stopped and started
+ * again without backoff, like a REPLACE_NOW replacement. A held child
+ * is stopped and not restarted when it exits.
+ */
+void Supervisor::applyRequests() {
+    std::vector<Replacement> queued;
+    std::vector<Release> released;
+    std::vector<std::string> restarted;
+    std::vector<std::string> holds;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queued.swap(replacements);
+        released.swap(releases);
+        restarted.swap(restartRequests);
+        holds.swap(holdRequests);
+    }
+    for (size_t i = 0; i < holds.size(); i++) {
+        for (size_t j = 0; j < children.size() && !stopping; j++) {
+            Child& child = children[j];
+            if (child.spec.name != holds[i] || child.done) {
+                continue;
+            }
+            child.held = true;
+            child.replacing = false;
+            child.restartAt = -1;
+            if (child.pid > 0 && kill(-child.pid, SIGTERM) != 0) {
+                kill(child.pid, SIGTERM);
+            }
+        }
+    }
+    for (size_t i = 0; i < restarted.size(); i++) {
+        for (size_t j = 0; j < children.size() && !stopping; j++) {
+            Child& child = children[j];
+            if (child.spec.name == restarted[i] && child.pid > 0 && !child.replacing) {
+                child.replacing = true;
+                if (kill(-child.pid, SIGTERM) != 0) {
+                    kill(child.pid, SIGTERM);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < released.size(); i++) {
+        long long at = monotonicMs() + released[i].delayMs;
+        for (size_t j = 0; j < children.size() && !stopping; j++) {
+            Child& child = children[j];
+            if (child.spec.name == released[i].name && child.held && child.pid <= 0
+                && (child.restartAt < 0 || at < child.restartAt)) {
+                child.restartAt = at;
+            }
+        }
+    }
+    for (size_t i = 0; i < queued.size(); i++) {
+        Child* child = NULL;
+        for (size_t j = 0; j < children.size() && !child; j++) {
+            if (children[j].spec.name == queued[i].spec.name) {
+                child = &children[j];
+            }
+        }
+        if (!child || stopping) {
+            continue;
+        }
+        child->spec = queued[i].spec;
+        if (child->pid <= 0 || queued[i].mode == REPLACE_ON_RESTART) {
+            continue;
+        }
+        if (queued[i].mode == REPLACE_NOW) {
+            child->replacing = true;
+            if (kill(-child->pid, SIGTERM) != 0) {
+                kill(child->pid, SIGTERM);
+            }
+            continue;
+        }
+        Retired old;
+        old.name = child->spec.name;
+        old.pid = child->pid;
+        old.deadline = monotonicMs() + kRetireDeadlineMs;
+        retired.push_back(old);
+        if (child->pidfd >= 0) {
+            close(child->pidfd);
+            child->pidfd = -1;
+        }
+        child->pid = -1;
+        child->backoffMs = kInitialBackoffMs;
+        if (!spawn(*child)) {
+            child->restartAt = monotonicMs() + child->backoffMs;
+        }
+    }
+}
+
+/**
+ * @brief Stops retired processes that outlived their deadline
+ */
+void Supervisor::stopOverdueRetired() {
+    long long now = monotonicMs();
+    for (size_t i = 0; i < retired.size(); i++) {
+        if (retired[i].deadline >= 0 && retired[i].deadline <= now) {
+            logMessage("Replaced " + retired[i].name + " is still running, stopping it");
+            kill(-retired[i].pid, SIGTERM);
+            retired[i].deadline = -1;
+        }
+    }
+}
+
+/**
+ * @brief Tells whether every child that a child starts after is ready
+ *
+ * Names of children that are not registered are ignored.
+ *
+ * @param child The child about to start
+ * @return bool True if it may start
+ */
+bool Supervisor::dependenciesReady(const Child& child) const {
+    for (size_t i = 0; i < child.spec.after.size(); i++) {
+        for (size_t j = 0; j < children.size(); j++) {
+            if (children[j].spec.name == child.spec.after[i] && !children[j].ready) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Records that a child is ready and tells its observers
+ *
+ * Logs how long the child took since it started and since the
+ * supervisor started, then once how long the whole startup took, i.e.
+ * until every child that is not held was ready.
+ *
+ * @param child The child that became ready
+ */
+void Supervisor::markReady(Child& child) {
+    if (child.ready) {
+        return;
+    }
+    long long now = monotonicMs();
+    child.ready = true;
+    child.readyProbeAt = -1;
+    if (hasReadySignal(child.spec) && !child.done) {
+        std::ostringstream msg;
+        msg << child.spec.name << " ready in " << now - child.startedAt << " ms, "
+            << now - runStartedAt << " ms after the supervisor started";
+        logMessage(msg.str());
+    }
+    std::vector<ChildObserver*> observers = specObservers(child.spec);
+    for (size_t i = 0; i < observers.size(); i++) {
+        observers[i]->childReady();
+    }
+    bool complete = !startupLogged;
+    for (size_t i = 0; i < children.size() && complete; i++) {
+        complete = children[i].ready || children[i].held;
+    }
+    if (complete) {
+        std::ostringstream msg;
+        msg << "Startup complete in " << now - runStartedAt << " ms";
+        logMessage(msg.str());
+        startupLogged = true;
+    }
+}
+
+/**
+ * @brief Reads what a child wrote on its readiness pipe
+ *
+ * The first complete line makes the child ready; later ones are
+ * ignored. The pipe is closed once the child closed its end.
+ *
+ * @param child The child whose pipe is readable
+ */
+void Supervisor::readReadyPipe(Child& child) {
+    char buffer[256];
+    ssize_t count;
+    while ((count = read(child.readyPipe, buffer, sizeof(buffer))) > 0) {
+        if (!child.ready) {
+            child.readyLine.append(buffer, static_cast<size_t>(count));
+        }
+    }
+    if (!child.ready && child.readyLine.find('\n') != std::string::npos) {
+        markReady(child);
+    }
+    if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR)) {
+        closeReadyPipe(child);
+    }
+}
+
+/**
+ * @brief Stops watching the readiness pipe of a child
+ *
+ * @param child The child
+ */
+void Supervisor::closeReadyPipe(Child& child) {
+    if (child.readyPipe >= 0) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, child.readyPipe, NULL);
+        close(child.readyPipe);
+        child.readyPipe = -1;
+    }
+}
+
+/**
+ * @brief Probes the readiness sockets that are due and warns about slow children
+ */
+void Supervisor::probeReadiness() {
+    long long now = monotonicMs();
+    for (size_t i = 0; i < children.size(); i++) {
+        Child& child = children[i];
+        if (child.pid <= 0 || child.ready) {
+            continue;
+        }
+        if (child.readyProbeAt >= 0 && child.readyProbeAt <= now) {
+            if (socketAccepts(child.spec.readySocket)) {
+                markReady(child);
+                continue;
+            }
+            child.readyProbeAt = now + kReadyProbeMs;
+        }
+        if (!child.readyWarned && hasReadySignal(child.spec) && now - child.startedAt >= kReadyWarningMs) {
+            std::ostringstream msg;
+            msg << child.spec.name << " is not ready after " << kReadyWarningMs / 1000 << " s";
+            logMessage(msg.str());
+            child.readyWarned = true;
+        }
+    }
+}
+
+/**
+ * @brief Starts every child that is due and whose dependencies are ready
+ *
+ * A child waiting for its dependencies keeps its start time and starts
+ * in the first loop iteration where they all are ready.
+ */
+void Supervisor::restartDueChildren() {
+    long long now = monotonicMs();
+    for (size_t i = 0; i < children.size(); i++) {
+        Child& child = children[i];
+        if (child.restartAt < 0 || child.restartAt > now || !dependenciesReady(child)) {
+            continue;
+        }
+        if (child.held) {
+            child.held = false;
+        } else if (child.startedAt > 0) {
+            child.restarts++;
+        }
+        if (!spawn(child)) {
+            child.restartAt = now + child.backoffMs;
+        }
+    }
+}
+
+/**
+ * @brief Computes how long the event loop may sleep
+ *
+ * Children waiting for their dependencies are left out: they can only
+ * start after an event of the loop made a dependency ready.
+ *
+ * @return int Milliseconds until the next pending restart, readiness
+ *         probe or retirement deadline, -1 if none
+ */
+int Supervisor::nextTimeoutMs() const {
+    long long now = monotonicMs();
+    long long timeout = -1;
+    std::vector<long long> due;
+    for (size_t i = 0; i < children.size(); i++) {
+        const Child& child = children[i];
+        if (dependenciesReady(child)) {
+            due.push_back(child.restartAt);
+        }
+        if (child.pid > 0 && !child.ready) {
+            due.push_back(child.readyProbeAt);
+        }
+        if (child.pid > 0 && !child.ready && !child.readyWarned && hasReadySignal(child.spec)) {
+            due.push_back(child.startedAt + kReadyWarningMs);
+        }
+    }
+    for (size_t i = 0; i < retired.size(); i++) {
+        due.push_back(retired[i].deadline);
+    }
+    for (size_t i = 0; i < due.size(); i++) {
+        if (due[i] < 0) {
+            continue;
+        }
+        long long delay = due[i] > now ? due[i] - now : 0;
+        if (timeout < 0 || delay < timeout) {
+            timeout = delay;
+        }
+    }
+    return static_cast<int>(timeout);
+}
+
+/**
+ * @brief Waits for child exits, signals or replacements and processes them
+ *
+ * @param timeoutMs Maximum time to wait, -1 for no limit
+ * @return bool False if the event loop failed irrecoverably
+ */
+bool Supervisor::waitEvents(int timeoutMs) {
+    struct epoll_event events[16];
+    int count = epoll_wait(epollFd, events, 16, timeoutMs);
+    if (count < 0) {
+        return errno == EINTR;
+    }
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.u64 == kWakeTag) {
+            uint64_t value;
+            if (read(wakeFd, &value, sizeof(value)) == static_cast<ssize_t>(sizeof(value))) {
+                applyRequests();
+            }
+            continue;
+        }
+        if (events[i].data.u64 != kSignalTag && (events[i].data.u64 & kReadyTag)) {
+            readReadyPipe(children[static_cast<size_t>(events[i].data.u64 & ~kReadyTag)]);
+            continue;
+        }
+        if (events[i].data.u64 != kSignalTag) {
+            continue;
+        }
+        struct signalfd_siginfo info;
+        while (read(signalFd, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+            if (info.ssi_signo != SIGCHLD && !stopping) {
+                logMessage(std::string("Received ") + strsignal(info.ssi_signo) + ", stopping");
+                stopping = true;
+            }
+        }
+    }
+    reapChildren();
+    return true;
+}
+
+/**
+ * @brief Counts the processes that are still alive
+ *
+ * @return size_t The number of running children, retired ones included
+ */
+size_t Supervisor::runningCount() const {
+    size_t count = retired.size();
+    for (size_t i = 0; i < children.size(); i++) {
+        if (children[i].pid > 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Logs an unexpected failure and reports it to the status listener
+ *
+ * @param message What happened
+ */
+void Supervisor::reportFailure(const std::string& message) {
+    logMessage(message);
+    if (statusListener) {
+        statusListener->childFailed(message);
+    }
+}
+
+/**
+ * @brief Sends the state of every child to the status listener
+ */
+void Supervisor::publishStatus() {
+    if (!statusListener) {
+        return;
+    }
+    std::vector<ChildStatus> statuses;
+    for (size_t i = 0; i < children.size(); i++) {
+        const Child& child = children[i];
+        ChildStatus status;
+        status.name = child.spec.name;
+        status.pid = child.pid;
+        status.restarts = child.restarts;
+        status.startedAt = child.startedAt;
+        if (child.pid > 0) {
+            status.state = child.ready ? CHILD_RUNNING : CHILD_STARTING;
+        } else if (child.done) {
+            status.state = CHILD_DONE;
+        } else if (child.held) {
+            status.state = CHILD_HELD;
+        } else if (child.restartAt >= 0 && !stopping) {
+            status.state = dependenciesReady(child) ? CHILD_RESTARTING : CHILD_WAITING;
+        } else {
+            status.state = CHILD_STOPPED;
+        }
+        statuses.push_back(status);
+    }
+    statusListener->childrenChanged(statuses);
+}
+
+/**
+ * @brief Starts every child and supervises them until asked to stop
+ *
+ * Children without dependencies start right away, the others as soon
+ * as their dependencies are ready. Held children wait for release().
+ * Returns once SIGTERM, SIGINT or SIGHUP was received and every child
+ * has been stopped.
+ */
+void Supervisor::run() {
+    runStartedAt = monotonicMs();
+    for (size_t i = 0; i < children.size(); i++) {
+        if (!children[i].held) {
+            children[i].restartAt = runStartedAt;
+        }
+    }
+    restartDueChildren();
+    publishStatus();
+    while (!stopping) {
+        if (!waitEvents(nextTimeoutMs())) {
+            logMessage(std::string("Event loop failed: ") + strerror(errno));
+            break;
+        }
+        stopOverdueRetired();
+        probeReadiness();
+        restartDueChildren();
+        publishStatus();
+    }
+    stopAll(kStopDeadlineMs);
+    publishStatus();
+}
+
+/**
+ * @brief Stops every child in parallel against a shared deadline
+ *
+ * All process groups receive SIGTERM at once. Groups still alive when
+ * the deadline expires are killed with SIGKILL.
+ *
+ * @param deadlineMs Time allowed for a graceful shutdown
+ */
+void Supervisor::stopAll(int deadlineMs) {
+    long long deadline = monotonicMs() + deadlineMs;
+
+    stopping = true;
+    for (size_t i = 0; i < children.size(); i++) {
+        children[i].restartAt = -1;
+        if (children[i].pid > 0 && kill(-children[i].pid, SIGTERM) != 0) {
+            kill(children[i].pid, SIGTERM);
+        }
+    }
+    for (size_t i = 0; i < retired.size(); i++) {
+        kill(-retired[i].pid, SIGTERM);
+    }
+    while (runningCount() > 0) {
+        long long remaining = deadline - monotonicMs();
+        if (remaining <= 0 || !waitEvents(static_cast<int>(remaining))) {
+            break;
+        }
+    }
+    for (size_t i = 0; i < children.size(); i++) {
+        Child& child = children[i];
+        if (child.pid <= 0) {
+            continue;
+        }
+        int status = 0;
+        logMessage(child.spec.name + " did not stop in time, killing it");
+        kill(-child.pid, SIGKILL);
+        kill(child.pid, SIGKILL);
+        waitpid(child.pid, &status, 0);
+        handleExit(child, status);
+    }
+    for (size_t i = 0; i < retired.size(); i++) {
+        int status = 0;
+        kill(-retired[i].pid, SIGKILL);
+        kill(retired[i].pid, SIGKILL);
+        waitpid(retired[i].pid, &status, 0);
+    }
+    retired.clear();
+}
@@ -0,0 +1,704 @@
+#include "../includes/Sync.hpp"
+#include "../includes/Utils.hpp"
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+static const int kPollIntervalMs = 250;
+static const long long kBucketMs = 5000;
+static const long long kWarmupMs = 15 * 1000;
+static const size_t kBaselineBuckets = 3;
+static const size_t kSmoothBuckets = 3;
+static const long long kCorrectDriftMs = 20;
+static const double kTempoStep = 0.005;
+static const long long kMaxDriftMs = 60;
+static const long long kDriftHoldMs = 60 * 1000;
+static const long long kRestartIntervalMs = 30 * 60 * 1000;
+static const int kCommandTimeoutMs = 1000;
+static const size_t kMaxFrameBytes = 64 * 1024;
+static const double kFlashLuma = 128.0;
+static const double kBeepLevel = -30.0;
+static const long long kMaxPairMs = 1000;
+static const long long kToleranceMs = 45;
+static const char* kAudioKey = "pagestreamer.audio";
+static const char* kVideoKey = "pagestreamer.video";
+static const char* kLevelKey = "lavfi.astats.Overall.RMS_level";
+static const char* kLumaKey = "lavfi.signalstats.YAVG";
+
+/**
+ * @brief Returns the filters reporting the audio frames to the monitor
+ *
+ * Normally every frame is tagged and its timestamp printed; in the sync
+ * test the sound is cut into 10 ms frames whose level is printed, so a
+ * beep is located to within 10 ms.
+ *
+ * @param fd The encoder descriptor connected to the monitor
+ * @param testMode True for the sync test
+ * @return string Filters to append to the encoder's audio chain
+ */
+std::string syncAudioProbe(int fd, bool testMode) {
+    std::ostringstream filter;
+    if (testMode) {
+        filter << "asetnsamples=n=480:p=0,astats=metadata=1:reset=1,ametadata=mode=print:key=" << kLevelKey;
+    } else {
+        filter << "ametadata=mode=add:key=" << kAudioKey << ":value=1,ametadata=mode=print:key=" << kAudioKey;
+    }
+    filter << ":file=/dev/fd/" << fd << ":direct=1";
+    return filter.str();
+}
+
+/**
+ * @brief Returns the filters reporting the video frames to the monitor
+ *
+ * In the sync test the mean brightness of each frame is printed, which
+ * signalstats computes for a few milliseconds per frame.
+ *
+ * @param fd The encoder descriptor connected to the monitor
+ * @param testMode True for the sync test
+ * @return string Filters to append to the encoder's video chain
+ */
+std::string syncVideoProbe(int fd, bool testMode) {
+    std::ostringstream filter;
+    if (testMode) {
+        filter << "signalstats,metadata=mode=print:key=" << kLumaKey;
+    } else {
+        filter << "metadata=mode=add:key=" << kVideoKey << ":value=1,metadata=mode=print:key=" << kVideoKey;
+    }
+    filter << ":file=/dev/fd/" << fd << ":direct=1";
+    return filter.str();
+}
+
+/**
+ * @brief Escapes a value for a filter option inside a filtergraph
+ *
+ * Options are separated by ':' and filters by ',' and ';', so special
+ * characters are escaped once for the option and once for the graph.
+ *
+ * @param value The raw value
+ * @return string The value to write after "option="
+ */
+static std::string escapeFilterValue(const std::string& value) {
+    std::string option;
+    std::string graph;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (strchr("\\':", value[i])) {
+            option += '\\';
+        }
+        option += value[i];
+    }
+    for (size_t i = 0; i < option.size(); i++) {
+        if (strchr("\\'[],;", option[i])) {
+            graph += '\\';
+        }
+        graph += option[i];
+    }
+    return graph;
+}
+
+/**
+ * @brief Reads exactly length bytes from a socket
+ *
+ * @param fd The socket, with a receive timeout
+ * @param data Receives the bytes
+ * @param length The number of bytes
+ * @return bool False on error, timeout or end of stream
+ */
+static bool readExactly(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t count = read(fd, data, length);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return false;
+        }
+        data += count;
+        length -= static_cast<size_t>(count);
+    }
+    return true;
+}
+
+/**
+ * @brief Encodes one ZMTP 3.0 frame
+ *
+ * @param flags 0x01 when more frames follow, 0x04 for a command
+ * @param body The frame body
+ * @return string The frame, with a short or long size
+ */
+static std::string zmtpFrame(unsigned char flags, const std::string& body) {
+    std::string frame;
+    if (body.size() > 255) {
+        frame += static_cast<char>(flags | 0x02);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame += static_cast<char>((static_cast<unsigned long long>(body.size()) >> shift) & 0xff);
+        }
+    } else {
+        frame += static_cast<char>(flags);
+        frame += static_cast<char>(body.size());
+    }
+    return frame + body;
+}
+
+/**
+ * @brief Reads one ZMTP 3.0 frame
+ *
+ * @param fd The socket
+ * @param flags Receives the frame flags
+ * @param body Receives the frame body
+ * @return bool False on error or if the frame is larger than kMaxFrameBytes
+ */
+static bool readZmtpFrame(int fd, unsigned char& flags, std::string& body) {
+    char header[8];
+    unsigned long long size = 0;
+    if (!readExactly(fd, header, 1)) {
+        return false;
+    }
+    flags = static_cast<unsigned char>(header[0]);
+    size_t sizeBytes = flags & 0x02 ? 8 : 1;
+    if (!readExactly(fd, header, sizeBytes)) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeBytes; i++) {
+        size = size << 8 | static_cast<unsigned char>(header[i]);
+    }
+    if (size > kMaxFrameBytes) {
+        return false;
+    }
+    body.assign(static_cast<size_t>(size), '\0');
+    return size == 0 || readExactly(fd, &body[0], body.size());
+}
+
+/**
+ * @brief Sends one filter command to the encoder's azmq filter
+ *
+ * azmq is a ZeroMQ REP socket, so this speaks the few bytes of ZMTP 3.0
+ * a REQ client needs: the greeting with the NULL mechanism, the READY
+ * handshake, then the request behind an empty delimiter frame. The
+ * filter answers "0 Success" once the command is applied.
+ *
+ * @param path The IPC socket the filter is bound to
+ * @param command "TARGET COMMAND ARGUMENT"
+ * @param reply Receives the answer, or the error
+ * @return bool True if the filter applied the command
+ */
+static bool sendFilterCommand(const std::string& path, const std::string& command, std::string& reply) {
+    struct sockaddr_un address;
+    if (path.size() >= sizeof(address.sun_path)) {
+        reply = "socket path too long";
+        return false;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        reply = strerror(errno);
+        return false;
+    }
+    struct timeval timeout = { kCommandTimeoutMs / 1000, (kCommandTimeoutMs % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size());
+    char greeting[64] = { 0 };
+    greeting[0] = static_cast<char>(0xff);
+    greeting[9] = 0x7f;
+    greeting[10] = 3;
+    memcpy(greeting + 12, "NULL", 4);
+    std::string ready = zmtpFrame(0x04, std::string("\x05READY\x0bSocket-Type\0\0\0\x03REQ", 25));
+    std::string request = zmtpFrame(0x01, "") + zmtpFrame(0x00, command);
+    char peer[64];
+    unsigned char flags = 0;
+    std::string body;
+    bool ok = false;
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0) {
+        reply = std::string("no filter listening: ") + strerror(errno);
+    } else if (!writeFully(fd, greeting, sizeof(greeting)) || !readExactly(fd, peer, sizeof(peer))
+               || static_cast<unsigned char>(peer[0]) != 0xff || peer[9] != 0x7f || peer[10] < 3) {
+        reply = "no ZMTP 3 greeting";
+    } else if (!writeFully(fd, ready.data(), ready.size()) || !readZmtpFrame(fd, flags, body) || !(flags & 0x04)
+               || body.compare(0, 6, "\x05READY") != 0) {
+        reply = "handshake refused";
+    } else {
+        ok = writeFully(fd, request.data(), request.size());
+        do {
+            ok = ok && readZmtpFrame(fd, flags, body);
+        } while (ok && (flags & 0x01));
+        reply = ok ? body : "no answer";
+    }
+    close(fd);
+    return ok && reply.compare(0, 2, "0 ") == 0;
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param control Starts a fresh encoder when the drift grows too large
+ * @param commandPath The IPC socket of the encoder's azmq filter, empty
+ *        if the encoder has no azmq or atempo filter
+ * @param testMode True when streaming the sync test page
+ */
+SyncMonitor::SyncMonitor(EncoderControl& control, const std::string& commandPath, bool testMode)
+    : control(control), commandPath(commandPath), testMode(testMode), shuttingDown(false), startedMs(-1),
+      bucketEndMs(-1), measuring(false), driftMs(0), driftSinceMs(-1), lastRestartMs(-1), restarts(0), tempo(1.0),
+      appliedTempo(1.0), correctionEndMs(-1), corrections(0), commandFailed(false), framePtsMs(0), lastLuma(0),
+      lastLevel(-HUGE_VAL), flashPtsMs(-1), beepPtsMs(-1), flashes(0), lastOffsetMs(0), offsetSumMs(0),
+      offsetMinMs(0), offsetMaxMs(0) {
+    audio.minMs = 0;
+    audio.frames = 0;
+    video = audio;
+}
+
+/**
+ * @brief Destructor
+ */
+SyncMonitor::~SyncMonitor() {
+    shutdown();
+}
+
+/**
+ * @brief Returns the filters that let the monitor correct the drift
+ *
+ * atempo changes the speed of the sound without changing its pitch and
+ * starts at 1, where it leaves the timing alone; azmq takes the tempo
+ * commands on the instance socket.
+ *
+ * @return string Filters to insert after the resampler, empty without
+ *         drift correction
+ */
+std::string SyncMonitor::tempoFilter() const {
+    if (commandPath.empty()) {
+        return "";
+    }
+    return "atempo=tempo=1,azmq=bind_address=" + escapeFilterValue("ipc://" + commandPath);
+}
+
+/**
+ * @brief Starts the thread reading the probes
+ */
+void SyncMonitor::start() {
+    worker = std::thread(&SyncMonitor::workerLoop, this);
+}
+
+/**
+ * @brief Stops the thread reading the probes
+ */
+void SyncMonitor::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        for (size_t i = 0; i < pendingFds.size(); i++) {
+            close(pendingFds[i]);
+        }
+        pendingFds.clear();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Starts measuring a freshly started encoder
+ *
+ * The previous encoder may still run until the fan-out hands over, so
+ * its pipe stays open and is read until it closes.
+ *
+ * @param pid The encoder process
+ * @param fds Our end of the encoder's probe reports
+ */
+void SyncMonitor::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fds.empty()) {
+        pendingFds.push_back(fds[0]);
+    }
+    startedMs = monotonicMs();
+    bucketEndMs = startedMs + kBucketMs;
+    audio.frames = 0;
+    video.frames = 0;
+    offsets.clear();
+    baseline.clear();
+    measuring = false;
+    driftSinceMs = -1;
+    tempo = 1.0;
+    appliedTempo = 1.0;
+    correctionEndMs = -1;
+    commandFailed = false;
+    flashPtsMs = -1;
+    beepPtsMs = -1;
+}
+
+/**
+ * @brief Stops measuring until the encoder runs again
+ *
+ * @param status The wait status
+ */
+void SyncMonitor::childExited(int status) {
+    (void)status;
+    std::lock_guard<std::mutex> lock(mutex);
+    measuring = false;
+    bucketEndMs = -1;
+}
+
+/**
+ * @brief Body of the probe reading thread
+ *
+ * Only the reports of the newest encoder are measured; those of an
+ * encoder being replaced are read and dropped so it never blocks.
+ */
+void SyncMonitor::workerLoop() {
+    std::vector<int> fds;
+    std::vector<std::string> pending;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                break;
+            }
+            for (size_t i = 0; i < pendingFds.size(); i++) {
+                fds.push_back(pendingFds[i]);
+                pending.push_back(std::string());
+            }
+            pendingFds.clear();
+        }
+        std::vector<struct pollfd> pfds;
+        for (size_t i = 0; i < fds.size(); i++) {
+            struct pollfd pfd = { fds[i], POLLIN, 0 };
+            pfds.push_back(pfd);
+        }
+        poll(pfds.empty() ? NULL : &pfds[0], pfds.size(), kPollIntervalMs);
+        for (size_t i = pfds.size(); i-- > 0;) {
+            if (pfds[i].revents && !readReports(fds[i], pending[i], i + 1 == fds.size())) {
+                close(fds[i]);
+                fds.erase(fds.begin() + i);
+                pending.erase(pending.begin() + i);
+            }
+        }
+        long long nowMs = monotonicMs();
+        bool restart = false;
+        double target = 1.0;
+        bool retune = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (bucketEndMs >= 0 && nowMs >= bucketEndMs) {
+                restart = closeBucket(nowMs);
+            }
+            if (correctionEndMs >= 0 && nowMs >= correctionEndMs) {
+                tempo = 1.0;
+                correctionEndMs = -1;
+                offsets.clear();
+            }
+            target = tempo;
+            retune = !restart && target != appliedTempo && !commandFailed;
+        }
+        if (restart) {
+            control.restartEncoder();
+        } else if (retune) {
+            applyTempo(target);
+        }
+    }
+    for (size_t i = 0; i < fds.size(); i++) {
+        close(fds[i]);
+    }
+}
+
+/**
+ * @brief Sends a tempo to the encoder's atempo filter
+ *
+ * A failed command ends drift correction for this encoder, which then
+ * only gets replaced when its drift grows too large.
+ *
+ * @param value The tempo, 1 for the normal speed
+ */
+void SyncMonitor::applyTempo(double value) {
+    std::ostringstream command;
+    std::string reply;
+    command << "atempo tempo " << value;
+    bool applied = sendFilterCommand(commandPath, command.str(), reply);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (applied) {
+        appliedTempo = value;
+        return;
+    }
+    if (value == tempo) {
+        logMessage("A/V sync: cannot set the sound tempo (" + reply + "), drift is only corrected by a fresh encoder");
+        commandFailed = true;
+        tempo = appliedTempo;
+        correctionEndMs = -1;
+    }
+}
+
+/**
+ * @brief Reads the reports printed by one encoder
+ *
+ * @param fd Our end of the report pipe
+ * @param pending Incomplete line left from the previous read
+ * @param current True for the newest encoder, whose reports are measured
+ * @return bool False once the encoder closed the pipe
+ */
+bool SyncMonitor::readReports(int fd, std::string& pending, bool current) {
+    char buffer[8192];
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR) {
+        return true;
+    }
+    if (count <= 0) {
+        return false;
+    }
+    if (!current) {
+        return true;
+    }
+    long long nowMs = monotonicMs();
+    pending.append(buffer, static_cast<size_t>(count));
+    size_t start = 0;
+    size_t end;
+    std::lock_guard<std::mutex> lock(mutex);
+    while ((end = pending.find('\n', start)) != std::string::npos) {
+        handleLine(pending.substr(start, end - start), nowMs);
+        start = end + 1;
+    }
+    pending.erase(0, start);
+    return true;
+}
+
+/**
+ * @brief Handles one report line, with the mutex held
+ *
+ * A "frame:N pts:P pts_time:T" line gives the timestamp of the frame
+ * described by the key=value line that follows it.
+ *
+ * @param line The line
+ * @param nowMs When it was read
+ */
+void SyncMonitor::handleLine(const std::string& line, long long nowMs) {
+    if (line.compare(0, 6, "frame:") == 0) {
+        size_t at = line.find("pts_time:");
+        if (at != std::string::npos) {
+            framePtsMs = llround(strtod(line.c_str() + at + 9, NULL) * 1000.0);
+        }
+        return;
+    }
+    size_t equals = line.find('=');
+    if (equals == std::string::npos || bucketEndMs < 0) {
+        return;
+    }
+    std::string key = line.substr(0, equals);
+    double value = strtod(line.c_str() + equals + 1, NULL);
+    bool isAudio = key == kAudioKey || key == kLevelKey;
+    if (!isAudio && key != kVideoKey && key != kLumaKey) {
+        return;
+    }
+    Latency& latency = isAudio ? audio : video;
+    long long lagMs = nowMs - framePtsMs;
+    if (latency.frames == 0 || lagMs < latency.minMs) {
+        latency.minMs = lagMs;
+    }
+    latency.frames++;
+    if (key == kLevelKey) {
+        if (value >= kBeepLevel && lastLevel < kBeepLevel) {
+            beepPtsMs = framePtsMs;
+            matchFlash();
+        }
+        lastLevel = value;
+    } else if (key == kLumaKey) {
+        if (value >= kFlashLuma && lastLuma < kFlashLuma) {
+            flashPtsMs = framePtsMs;
+            matchFlash();
+        }
+        lastLuma = value;
+    }
+}
+
+/**
+ * @brief Pairs a flash with its beep in the sync test, with the mutex held
+ *
+ * An onset without a partner within kMaxPairMs is dropped.
+ */
+void SyncMonitor::matchFlash() {
+    if (flashPtsMs < 0 || beepPtsMs < 0) {
+        return;
+    }
+    long long offsetMs = beepPtsMs - flashPtsMs;
+    if (std::llabs(offsetMs) > kMaxPairMs) {
+        (flashPtsMs < beepPtsMs ? flashPtsMs : beepPtsMs) = -1;
+        return;
+    }
+    if (flashes == 0 || offsetMs < offsetMinMs) {
+        offsetMinMs = offsetMs;
+    }
+    if (flashes == 0 || offsetMs > offsetMaxMs) {
+        offsetMaxMs = offsetMs;
+    }
+    flashes++;
+    offsetSumMs += offsetMs;
+    lastOffsetMs = offsetMs;
+    flashPtsMs = -1;
+    beepPtsMs = -1;
+    if (std::llabs(offsetMs) > kToleranceMs) {
+        std::ostringstream msg;
+        msg << "Sync test: sound " << offsetMs << " ms from its flash, beyond " << kToleranceMs << " ms";
+        logMessage(msg.str());
+    }
+}
+
+/**
+ * @brief Turns the latencies of the last bucket into drift, with the mutex held
+ *
+ * The first buckets after the warm-up give the baseline offset between
+ * the two streams; the drift is how far the last buckets moved from it.
+ * Since the probes follow atempo, the drift is measured net of the
+ * corrections. A drift beyond kCorrectDriftMs over a full smoothing
+ * window starts a correction. A fresh encoder is the last resort, for
+ * drift beyond kMaxDriftMs that correction did not bring back within
+ * kDriftHoldMs.
+ *
+ * @param nowMs The current monotonic time
+ * @return bool True if the drift has been too large for too long
+ */
+bool SyncMonitor::closeBucket(long long nowMs) {
+    bool complete = audio.frames > 0 && video.frames > 0;
+    long long offsetMs = video.minMs - audio.minMs;
+    bucketEndMs = nowMs + kBucketMs;
+    audio.frames = 0;
+    video.frames = 0;
+    if (!complete || nowMs - startedMs < kWarmupMs) {
+        return false;
+    }
+    if (baseline.size() < kBaselineBuckets) {
+        baseline.push_back(offsetMs);
+        return false;
+    }
+    offsets.push_back(offsetMs);
+    if (offsets.size() > kSmoothBuckets) {
+        offsets.erase(offsets.begin());
+    }
+    long long base = 0;
+    long long recent = 0;
+    for (size_t i = 0; i < baseline.size(); i++) {
+        base += baseline[i];
+    }
+    for (size_t i = 0; i < offsets.size(); i++) {
+        recent += offsets[i];
+    }
+    driftMs = recent / static_cast<long long>(offsets.size()) - base / static_cast<long long>(baseline.size());
+    measuring = true;
+    if (correctionEndMs < 0 && offsets.size() == kSmoothBuckets && std::llabs(driftMs) > kCorrectDriftMs
+        && !commandPath.empty() && !commandFailed) {
+        startCorrection(nowMs);
+    }
+    if (std::llabs(driftMs) <= kMaxDriftMs) {
+        driftSinceMs = -1;
+        return false;
+    }
+    if (driftSinceMs < 0) {
+        driftSinceMs = nowMs;
+    }
+    if (nowMs - driftSinceMs < kDriftHoldMs || (lastRestartMs >= 0 && nowMs - lastRestartMs < kRestartIntervalMs)) {
+        return false;
+    }
+    std::ostringstream msg;
+    msg << "A/V sync: sound " << (driftMs > 0 ? "behind" : "ahead of") << " the picture by " << std::llabs(driftMs)
+        << " ms for " << (nowMs - driftSinceMs) / 1000 << " s"
+        << (commandPath.empty() || commandFailed ? "" : " despite tempo correction") << ", starting a fresh encoder";
+    logMessage(msg.str());
+    lastRestartMs = nowMs;
+    restarts++;
+    return true;
+}
+
+/**
+ * @brief Plays the sound faster or slower until the drift is absorbed, with the mutex held
+ *
+ * At a tempo t the sound's timestamps advance 1/t as fast as the clock,
+ * so the correction lasts drift / |1 - 1/t|: 12 seconds for 60 ms at
+ * kTempoStep. The worker loop sends the tempo and restores 1 at the end.
+ *
+ * @param nowMs The current monotonic time
+ */
+void SyncMonitor::startCorrection(long long nowMs) {
+    tempo = driftMs > 0 ? 1.0 + kTempoStep : 1.0 - kTempoStep;
+    long long durationMs = llround(std::llabs(driftMs) / std::fabs(1.0 - 1.0 / tempo));
+    correctionEndMs = nowMs + durationMs;
+    corrections++;
+    std::ostringstream msg;
+    msg << "A/V sync: sound " << (driftMs > 0 ? "behind" : "ahead of") << " the picture by " << std::llabs(driftMs)
+        << " ms, playing it " << kTempoStep * 100 << "% " << (driftMs > 0 ? "faster" : "slower") << " for "
+        << (durationMs + 500) / 1000 << " s";
+    logMessage(msg.str());
+}
+
+/**
+ * @brief Writes the drift and the sync test results as metrics
+ *
+ * @param out The response body
+ * @param labels Label pairs to add to every sample
+ */
+void SyncMonitor::writeMetrics(std::ostream& out, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (measuring) {
+        writeMetricHeader(out, "pagestreamer_av_drift_seconds", "gauge",
+                          "Change of the sound delay behind the picture since the encoder started, net of tempo corrections");
+        writeMetricSample(out, "pagestreamer_av_drift_seconds", labels, driftMs / 1000.0);
+    }
+    if (!commandPath.empty()) {
+        writeMetricHeader(out, "pagestreamer_av_tempo_ratio", "gauge",
+                          "Speed the sound is played at to correct the drift, 1 when no correction runs");
+        writeMetricSample(out, "pagestreamer_av_tempo_ratio", labels, appliedTempo);
+        writeMetricHeader(out, "pagestreamer_av_drift_corrections_total", "counter",
+                          "Tempo corrections started because the sound drifted from the picture");
+        writeMetricSample(out, "pagestreamer_av_drift_corrections_total", labels,
+                          static_cast<unsigned long long>(corrections));
+    }
+    writeMetricHeader(out, "pagestreamer_av_encoder_restarts_total", "counter",
+                      "Encoders replaced because tempo correction could not absorb the drift");
+    writeMetricSample(out, "pagestreamer_av_encoder_restarts_total", labels, static_cast<unsigned long long>(restarts));
+    if (testMode && flashes > 0) {
+        writeMetricHeader(out, "pagestreamer_sync_test_flashes_total", "counter",
+                          "Flashes of the sync test page matched with their beep");
+        writeMetricSample(out, "pagestreamer_sync_test_flashes_total", labels,
+                          static_cast<unsigned long long>(flashes));
+        writeMetricHeader(out, "pagestreamer_sync_test_offset_seconds", "gauge",
+                          "Delay of the last beep behind its flash in the encoded stream");
+        writeMetricSample(out, "pagestreamer_sync_test_offset_seconds", labels, lastOffsetMs / 1000.0);
+    }
+}
+
+/**
+ * @brief Writes the drift and the sync test results for pagestreamer stats
+ *
+ * @param out The response body
+ */
+void SyncMonitor::writeReport(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    out << "A/V sync: ";
+    if (measuring) {
+        out << "drift " << (driftMs >= 0 ? "+" : "") << driftMs << " ms since the encoder started";
+    } else {
+        out << "measuring";
+    }
+    if (appliedTempo != 1.0) {
+        out << ", sound at " << appliedTempo * 100 << "% speed";
+    }
+    if (!commandPath.empty()) {
+        out << ", " << corrections << " tempo corrections";
+    }
+    out << ", " << restarts << " encoder restarts\n";
+    if (!testMode) {
+        return;
+    }
+    out << "  Sync test: ";
+    if (flashes == 0) {
+        out << "no flash matched yet\n";
+        return;
+    }
+    long long averageMs = offsetSumMs / static_cast<long long>(flashes);
+    out << flashes << " flashes, sound " << averageMs << " ms after the picture on average (" << offsetMinMs
+        << " to " << offsetMaxMs << " ms), "
+        << (std::llabs(offsetMinMs) <= kToleranceMs && std::llabs(offsetMaxMs) <= kToleranceMs ? "within" : "beyond")
+        << " " << kToleranceMs << " ms\n";
+}
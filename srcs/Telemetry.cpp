@@ -0,0 +1,716 @@
+#include "../includes/Telemetry.hpp"
+#include "../includes/Utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+static const size_t kRingCapacity = 2048;
+static const int kPollIntervalMs = 250;
+static const size_t kReadBufferSize = 4096;
+static const size_t kMaxRequestBytes = 4096;
+static const int kClientTimeoutMs = 1000;
+static const int kListenBacklog = 8;
+
+static const struct {
+    const char* label;
+    long long ms;
+} kWindows[] = {
+    { "1m", 60 * 1000 },
+    { "5m", 5 * 60 * 1000 },
+    { "15m", 15 * 60 * 1000 }
+};
+
+/**
+ * @brief Constructor
+ *
+ * @param capacity The number of samples kept
+ */
+SampleRing::SampleRing(size_t capacity) : samples(capacity), next(0), count(0) {
+}
+
+/**
+ * @brief Appends a sample, overwriting the oldest one when full
+ *
+ * @param sample The sample to store
+ */
+void SampleRing::push(const EncoderSample& sample) {
+    samples[next] = sample;
+    next = (next + 1) % samples.size();
+    if (count < samples.size()) {
+        count++;
+    }
+}
+
+/**
+ * @brief Returns the number of stored samples
+ *
+ * @return size_t At most the capacity
+ */
+size_t SampleRing::size() const {
+    return count;
+}
+
+/**
+ * @brief Returns the most recent sample; the ring must not be empty
+ *
+ * @return const EncoderSample& The sample
+ */
+const EncoderSample& SampleRing::latest() const {
+    return samples[(next + samples.size() - 1) % samples.size()];
+}
+
+/**
+ * @brief Returns the nearest-rank percentile of sorted values
+ *
+ * @param sorted The values in ascending order, not empty
+ * @param percent The percentile, 0 to 100
+ * @return double The value
+ */
+static double percentile(const std::vector<double>& sorted, double percent) {
+    size_t rank = static_cast<size_t>(std::ceil(percent / 100.0 * sorted.size()));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * @brief Computes the distribution of a field over recent samples
+ *
+ * Samples where the field is not available (negative) are ignored.
+ *
+ * @param field The EncoderSample member to summarize
+ * @param sinceMs Only samples taken at or after this monotonic time count
+ * @return WindowSummary The summary, with count 0 when no sample matched
+ */
+WindowSummary SampleRing::summarize(double EncoderSample::*field, long long sinceMs) const {
+    WindowSummary summary;
+    std::vector<double> values;
+    memset(&summary, 0, sizeof(summary));
+    for (size_t i = 0; i < count; i++) {
+        const EncoderSample& sample = samples[(next + samples.size() - 1 - i) % samples.size()];
+        if (sample.timeMs < sinceMs) {
+            break;
+        }
+        if (sample.*field >= 0) {
+            values.push_back(sample.*field);
+        }
+    }
+    if (values.empty()) {
+        return summary;
+    }
+    std::sort(values.begin(), values.end());
+    summary.count = values.size();
+    summary.min = values.front();
+    summary.p5 = percentile(values, 5);
+    summary.p50 = percentile(values, 50);
+    summary.p95 = percentile(values, 95);
+    summary.max = values.back();
+    return summary;
+}
+
+/**
+ * @brief Constructor
+ *
+ * Starts the reader thread, which idles until the encoder starts.
+ */
+EncoderTelemetry::EncoderTelemetry()
+    : pendingFd(-1), shuttingDown(false), ring(kRingCapacity), sessions(0) {
+    memset(&last, 0, sizeof(last));
+    reader = std::thread(&EncoderTelemetry::readerLoop, this);
+}
+
+/**
+ * @brief Destructor
+ */
+EncoderTelemetry::~EncoderTelemetry() {
+    shutdown();
+}
+
+/**
+ * @brief Hands the progress pipe of a freshly started encoder to the reader
+ *
+ * @param pid The encoder process
+ * @param fds Our end of the encoder's progress pipe
+ */
+void EncoderTelemetry::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pendingFd >= 0) {
+            close(pendingFd);
+        }
+        pendingFd = fds.empty() ? -1 : fds[0];
+    }
+    wakeup.notify_one();
+}
+
+/**
+ * @brief Called when the encoder exits; the reader sees EOF on its own
+ *
+ * @param status The wait status
+ */
+void EncoderTelemetry::childExited(int status) {
+    (void)status;
+}
+
+/**
+ * @brief Stops the reader thread
+ */
+void EncoderTelemetry::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        if (pendingFd >= 0) {
+            close(pendingFd);
+            pendingFd = -1;
+        }
+    }
+    wakeup.notify_all();
+    if (reader.joinable()) {
+        reader.join();
+    }
+}
+
+/**
+ * @brief Body of the reader thread: one session per encoder process
+ */
+void EncoderTelemetry::readerLoop() {
+    for (;;) {
+        int fd;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!shuttingDown && pendingFd < 0) {
+                wakeup.wait(lock);
+            }
+            if (shuttingDown) {
+                return;
+            }
+            fd = pendingFd;
+            pendingFd = -1;
+            sessions++;
+        }
+        readSession(fd);
+        close(fd);
+    }
+}
+
+/**
+ * @brief Summarizes one field of the recent samples
+ *
+ * @param field The EncoderSample member to summarize
+ * @param sinceMs Only samples taken at or after this monotonic time count
+ * @return WindowSummary The summary, with count 0 when no sample matched
+ */
+WindowSummary EncoderTelemetry::summary(double EncoderSample::*field, long long sinceMs) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ring.summarize(field, sinceMs);
+}
+
+/**
+ * @brief Returns the most recent sample
+ *
+ * @param sample Receives the sample
+ * @return bool False if the encoder has not reported yet
+ */
+bool EncoderTelemetry::latest(EncoderSample& sample) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ring.size() == 0) {
+        return false;
+    }
+    sample = ring.latest();
+    return true;
+}
+
+/**
+ * @brief Parses a progress value, e.g. "4000.5kbits/s" or "1.01x"
+ *
+ * @param value The text after '='
+ * @return double The leading number, -1 for N/A or garbage
+ */
+static double parseRate(const std::string& value) {
+    const char* start = value.c_str();
+    char* end = NULL;
+    double result = strtod(start, &end);
+    return end == start || result < 0 ? -1 : result;
+}
+
+/**
+ * @brief Parses a progress counter, e.g. "frame=1234"
+ *
+ * @param value The text after '='
+ * @return unsigned long long The value, 0 for N/A
+ */
+static unsigned long long parseCount(const std::string& value) {
+    return strtoull(value.c_str(), NULL, 10);
+}
+
+/**
+ * @brief Parses one encoder's progress blocks into samples
+ *
+ * ffmpeg writes key=value lines and ends each block with a progress=
+ * line. The per-process counters are added to the totals left by the
+ * previous encoders so the series stays monotonic across restarts.
+ *
+ * @param fd Our end of the encoder's progress pipe
+ */
+void EncoderTelemetry::readSession(int fd) {
+    EncoderSample start;
+    EncoderSample sample;
+    std::string pending;
+    char buffer[kReadBufferSize];
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        start = last;
+    }
+    sample = start;
+    sample.fps = -1;
+    sample.bitrateKbps = -1;
+    sample.speed = -1;
+
+    for (;;) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, kPollIntervalMs);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown || pendingFd >= 0) {
+                return;
+            }
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        ssize_t count = read(fd, buffer, sizeof(buffer));
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            return;
+        }
+        pending.append(buffer, static_cast<size_t>(count));
+        size_t lineStart = 0;
+        size_t lineEnd;
+        while ((lineEnd = pending.find('\n', lineStart)) != std::string::npos) {
+            std::string line = pending.substr(lineStart, lineEnd - lineStart);
+            size_t equals = line.find('=');
+            lineStart = lineEnd + 1;
+            if (equals == std::string::npos) {
+                continue;
+            }
+            std::string key = line.substr(0, equals);
+            std::string value = line.substr(equals + 1);
+            if (key == "fps") {
+                sample.fps = parseRate(value);
+            } else if (key == "bitrate") {
+                sample.bitrateKbps = parseRate(value);
+            } else if (key == "speed") {
+                sample.speed = parseRate(value);
+            } else if (key == "frame") {
+                sample.frames = start.frames + parseCount(value);
+            } else if (key == "total_size") {
+                sample.outputBytes = start.outputBytes + parseCount(value);
+            } else if (key == "dup_frames") {
+                sample.dupFrames = start.dupFrames + parseCount(value);
+            } else if (key == "drop_frames") {
+                sample.dropFrames = start.dropFrames + parseCount(value);
+            } else if (key == "progress") {
+                sample.timeMs = monotonicMs();
+                addSample(sample);
+            }
+        }
+        pending.erase(0, lineStart);
+    }
+}
+
+/**
+ * @brief Stores a complete sample
+ *
+ * @param sample The sample built from one progress block
+ */
+void EncoderTelemetry::addSample(const EncoderSample& sample) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ring.push(sample);
+    last = sample;
+}
+
+/**
+ * @brief Writes one Prometheus sample line
+ *
+ * @param out The response body
+ * @param name The metric name
+ * @param labels The label pairs, possibly empty
+ * @param value The value
+ */
+void writeMetricSample(std::ostream& out, const std::string& name, const std::string& labels, double value) {
+    out << name;
+    if (!labels.empty()) {
+        out << "{" << labels << "}";
+    }
+    out << " " << std::setprecision(6) << value << "\n";
+}
+
+/**
+ * @brief Writes one Prometheus counter line, without rounding
+ *
+ * @param out The response body
+ * @param name The metric name
+ * @param labels The label pairs, possibly empty
+ * @param value The value
+ */
+void writeMetricSample(std::ostream& out, const std::string& name, const std::string& labels,
+                       unsigned long long value) {
+    out << name;
+    if (!labels.empty()) {
+        out << "{" << labels << "}";
+    }
+    out << " " << value << "\n";
+}
+
+/**
+ * @brief Writes the HELP and TYPE lines of a metric
+ *
+ * @param out The response body
+ * @param name The metric name
+ * @param type gauge or counter
+ * @param help The description
+ */
+void writeMetricHeader(std::ostream& out, const std::string& name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+/**
+ * @brief Writes the encoder metrics
+ *
+ * Current values come from the latest progress report; the _window
+ * gauges give the 5th, 50th and 95th percentiles over the last 1, 5
+ * and 15 minutes, so a short dip below 1.0x speed stays visible even
+ * with a slow scrape interval.
+ *
+ * @param out The response body
+ * @param labels Label pairs added to every sample
+ */
+void EncoderTelemetry::writeMetrics(std::ostream& out, const std::string& labels) {
+    static const struct {
+        const char* name;
+        double EncoderSample::*field;
+        const char* help;
+    } rates[] = {
+        { "pagestreamer_encoder_fps", &EncoderSample::fps, "Frames encoded per second" },
+        { "pagestreamer_encoder_speed", &EncoderSample::speed, "Encoding speed relative to real time" },
+        { "pagestreamer_encoder_bitrate_kbps", &EncoderSample::bitrateKbps, "Output bitrate in kbit/s" }
+    };
+    static const struct {
+        const char* name;
+        unsigned long long EncoderSample::*field;
+        const char* help;
+    } counters[] = {
+        { "pagestreamer_encoder_frames_total", &EncoderSample::frames, "Frames encoded" },
+        { "pagestreamer_encoder_output_bytes_total", &EncoderSample::outputBytes, "Bytes of FLV output" },
+        { "pagestreamer_encoder_dup_frames_total", &EncoderSample::dupFrames, "Frames duplicated to keep the rate" },
+        { "pagestreamer_encoder_drop_frames_total", &EncoderSample::dropFrames, "Frames dropped to keep the rate" }
+    };
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string separator = labels.empty() ? "" : ",";
+    long long nowMs = monotonicMs();
+
+    writeMetricHeader(out, "pagestreamer_encoder_restarts_total", "counter", "Encoder processes started after the first");
+    writeMetricSample(out, "pagestreamer_encoder_restarts_total", labels,
+                static_cast<unsigned long long>(sessions > 0 ? sessions - 1 : 0));
+    if (ring.size() == 0) {
+        return;
+    }
+    const EncoderSample& latest = ring.latest();
+    writeMetricHeader(out, "pagestreamer_encoder_report_age_seconds", "gauge", "Time since the last progress report");
+    writeMetricSample(out, "pagestreamer_encoder_report_age_seconds", labels, (nowMs - latest.timeMs) / 1000.0);
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        writeMetricHeader(out, counters[i].name, "counter", counters[i].help);
+        writeMetricSample(out, counters[i].name, labels, latest.*counters[i].field);
+    }
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        std::string window = std::string(rates[i].name) + "_window";
+        if (latest.*rates[i].field >= 0) {
+            writeMetricHeader(out, rates[i].name, "gauge", rates[i].help);
+            writeMetricSample(out, rates[i].name, labels, latest.*rates[i].field);
+        }
+        writeMetricHeader(out, window, "gauge", "Percentiles over the trailing window");
+        for (size_t w = 0; w < sizeof(kWindows) / sizeof(kWindows[0]); w++) {
+            WindowSummary summary = ring.summarize(rates[i].field, nowMs - kWindows[w].ms);
+            if (summary.count == 0) {
+                continue;
+            }
+            std::string prefix = labels + separator + "window=\"" + kWindows[w].label + "\",quantile=";
+            writeMetricSample(out, window, prefix + "\"0.05\"", summary.p5);
+            writeMetricSample(out, window, prefix + "\"0.5\"", summary.p50);
+            writeMetricSample(out, window, prefix + "\"0.95\"", summary.p95);
+        }
+    }
+}
+
+/**
+ * @brief Formats a rate for the stats report
+ *
+ * @param value The value, negative when not available
+ * @param precision The number of decimals
+ * @return string The value, or "n/a"
+ */
+static std::string formatRate(double value, int precision) {
+    std::ostringstream text;
+    if (value < 0) {
+        return "n/a";
+    }
+    text << std::fixed << std::setprecision(precision) << value;
+    return text.str();
+}
+
+/**
+ * @brief Formats the 5th, 50th and 95th percentiles of a window
+ *
+ * @param summary The window summary
+ * @param precision The number of decimals
+ * @return string e.g. "29.97 / 30.00 / 30.00"
+ */
+static std::string formatSummary(const WindowSummary& summary, int precision) {
+    if (summary.count == 0) {
+        return "n/a";
+    }
+    return formatRate(summary.p5, precision) + " / " + formatRate(summary.p50, precision)
+           + " / " + formatRate(summary.p95, precision);
+}
+
+/**
+ * @brief Writes the encoder section of pagestreamer stats
+ *
+ * @param out The response body
+ */
+void EncoderTelemetry::writeReport(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    long long nowMs = monotonicMs();
+    if (ring.size() == 0) {
+        out << "Encoder: no progress report yet\n";
+        return;
+    }
+    const EncoderSample& latest = ring.latest();
+    out << "Encoder: last report " << formatRate((nowMs - latest.timeMs) / 1000.0, 1) << " s ago, "
+        << (sessions > 0 ? sessions - 1 : 0) << " restarts\n";
+    out << "  fps " << formatRate(latest.fps, 2) << ", speed " << formatRate(latest.speed, 2)
+        << "x, bitrate " << formatRate(latest.bitrateKbps, 0) << " kbit/s\n";
+    out << "  " << latest.frames << " frames (" << latest.dupFrames << " duplicated, "
+        << latest.dropFrames << " dropped), " << formatRate(latest.outputBytes / (1024.0 * 1024.0), 1)
+        << " MiB sent\n";
+    out << "  p5 / p50 / p95 over the last:\n";
+    for (size_t w = 0; w < sizeof(kWindows) / sizeof(kWindows[0]); w++) {
+        long long sinceMs = nowMs - kWindows[w].ms;
+        out << "  " << std::left << std::setw(4) << kWindows[w].label << std::right
+            << " fps " << formatSummary(ring.summarize(&EncoderSample::fps, sinceMs), 2)
+            << ", speed " << formatSummary(ring.summarize(&EncoderSample::speed, sinceMs), 2)
+            << ", kbit/s " << formatSummary(ring.summarize(&EncoderSample::bitrateKbps, sinceMs), 0) << "\n";
+    }
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param instanceName The instance, added as a label to every sample
+ * @param port The loopback port to listen on
+ */
+MetricsServer::MetricsServer(const std::string& instanceName, int port)
+    : instanceName(instanceName), port(port), listenFd(-1), shuttingDown(false) {
+}
+
+/**
+ * @brief Destructor
+ */
+MetricsServer::~MetricsServer() {
+    shutdown();
+}
+
+/**
+ * @brief Adds a source to every response; call before start()
+ *
+ * @param source The source, which must outlive the server
+ */
+void MetricsServer::addSource(MetricsSource* source) {
+    sources.push_back(source);
+}
+
+/**
+ * @brief Binds the port and starts the server thread
+ *
+ * A busy port is logged and leaves the stream running without metrics.
+ *
+ * @return bool True if the endpoint is listening
+ */
+bool MetricsServer::start() {
+    struct sockaddr_in address;
+    int reuse = 1;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0
+        || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) != 0
+        || bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listenFd, kListenBacklog) != 0) {
+        std::ostringstream msg;
+        msg << "Metrics endpoint disabled, cannot listen on 127.0.0.1:" << port << ": " << strerror(errno);
+        logMessage(msg.str());
+        if (listenFd >= 0) {
+            close(listenFd);
+            listenFd = -1;
+        }
+        return false;
+    }
+    std::ostringstream msg;
+    msg << "Metrics available on http://127.0.0.1:" << port << "/metrics";
+    logMessage(msg.str());
+    server = std::thread(&MetricsServer::serverLoop, this);
+    return true;
+}
+
+/**
+ * @brief Stops the server thread and closes the socket
+ */
+void MetricsServer::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+    }
+    if (server.joinable()) {
+        server.join();
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+    }
+}
+
+/**
+ * @brief Body of the server thread
+ */
+void MetricsServer::serverLoop() {
+    for (;;) {
+        struct pollfd pfd = { listenFd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, kPollIntervalMs);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                return;
+            }
+        }
+        if (ready <= 0) {
+            continue;
+        }
+        int client = accept4(listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if (client >= 0) {
+            serve(client);
+            close(client);
+        }
+    }
+}
+
+/**
+ * @brief Answers one HTTP request
+ *
+ * Only the request line is looked at; both directions time out after
+ * kClientTimeoutMs so a stuck client cannot block the endpoint.
+ *
+ * @param client The accepted connection
+ */
+void MetricsServer::serve(int client) {
+    struct timeval timeout = { kClientTimeoutMs / 1000, (kClientTimeoutMs % 1000) * 1000 };
+    std::string request;
+    char buffer[kReadBufferSize];
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestBytes) {
+        ssize_t count = recv(client, buffer, sizeof(buffer), 0);
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        request.append(buffer, static_cast<size_t>(count));
+    }
+    std::istringstream requestLine(request);
+    std::string method;
+    std::string path;
+    requestLine >> method >> path;
+    std::ostringstream body;
+    std::string status = "200 OK";
+    if (method != "GET") {
+        status = "405 Method Not Allowed";
+    } else if (path == "/metrics") {
+        std::string labels = "instance=\"" + instanceName + "\"";
+        for (size_t i = 0; i < sources.size(); i++) {
+            sources[i]->writeMetrics(body, labels);
+        }
+    } else if (path == "/stats") {
+        for (size_t i = 0; i < sources.size(); i++) {
+            sources[i]->writeReport(body);
+        }
+    } else {
+        status = "404 Not Found";
+    }
+    std::string content = body.str();
+    std::ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+             << "Content-Length: " << content.size() << "\r\n"
+             << "Connection: close\r\n\r\n" << content;
+    std::string text = response.str();
+    writeFully(client, text.c_str(), text.size());
+}
+
+/**
+ * @brief Fetches a page from the metrics endpoint of a running instance
+ *
+ * @param port The instance metrics port
+ * @param path The page, e.g. /stats
+ * @param body Receives the response body
+ * @return bool False if the endpoint cannot be reached or fails
+ */
+bool fetchMetricsPage(int port, const std::string& path, std::string& body) {
+    struct sockaddr_in address;
+    struct timeval timeout = { kClientTimeoutMs / 1000, (kClientTimeoutMs % 1000) * 1000 };
+    std::string response;
+    char buffer[kReadBufferSize];
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    std::string request = "GET " + path + " HTTP/1.0\r\nHost: 127.0.0.1\r\n\r\n";
+    bool sent = connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) == 0
+                && writeFully(fd, request.c_str(), request.size());
+    for (;;) {
+        ssize_t count = sent ? recv(fd, buffer, sizeof(buffer), 0) : 0;
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+        if (count <= 0) {
+            break;
+        }
+        response.append(buffer, static_cast<size_t>(count));
+    }
+    close(fd);
+    size_t headerEnd = response.find("\r\n\r\n");
+    if (response.compare(0, 12, "HTTP/1.0 200") != 0 || headerEnd == std::string::npos) {
+        return false;
+    }
+    body = response.substr(headerEnd + 4);
+    return true;
+}
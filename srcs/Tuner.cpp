@@ -0,0 +1,344 @@
+#include "../includes/Tuner.hpp"
+#include "../includes/Utils.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sched.h>
+
+static const char* kPresets[] = { "ultrafast", "superfast", "veryfast", "faster", "fast" };
+static const size_t kDefaultPreset = 2;
+static const size_t kPresetCount = sizeof(kPresets) / sizeof(kPresets[0]);
+static const int kIntervalMs = 5000;
+static const long long kSettleMs = 45 * 1000;
+static const long long kPressureWindowMs = 20 * 1000;
+static const long long kHeadroomWindowMs = 3 * 60 * 1000;
+static const size_t kMinSamples = 8;
+static const double kSlowSpeed = 0.97;
+static const double kRealTimeSpeed = 0.99;
+static const double kBusyCpu = 0.90;
+static const double kIdleCpu = 0.60;
+static const double kFullQueue = 0.5;
+static const double kEmptyQueue = 0.1;
+static const double kBitrateDown = 0.8;
+static const double kBitrateUp = 1.15;
+static const int kBitrateStepKbps = 100;
+
+/**
+ * @brief Returns the bitrate range suited to a platform
+ *
+ * Twitch caps ingest at 6 Mbit/s. YouTube recommends up to 9 Mbit/s
+ * for 1080p30 and 6 Mbit/s for 720p30; other platforms get the same
+ * limits as 720p.
+ *
+ * @param platform The PLATFORM RTMP URL
+ * @param outputHeight The encoded height
+ * @return TuningBounds The range and the starting bitrate
+ */
+TuningBounds platformBounds(const std::string& platform, int outputHeight) {
+    TuningBounds bounds = { 2500, 4000, 6000 };
+    if (platform.find("twitch.tv") != std::string::npos) {
+        bounds.defaultBitrateKbps = 6000;
+    } else if (platform.find("youtube.com") != std::string::npos && outputHeight > 720) {
+        bounds.maxBitrateKbps = 9000;
+    }
+    return bounds;
+}
+
+/**
+ * @brief Returns the preset the encoder starts with
+ *
+ * @return const char* The x264 preset name
+ */
+const char* defaultPreset() {
+    return kPresets[kDefaultPreset];
+}
+
+/**
+ * @brief Rounds a bitrate to a step and clamps it to the bounds
+ *
+ * @param kbps The bitrate
+ * @param bounds The allowed range
+ * @return int The bitrate to use
+ */
+static int clampBitrate(double kbps, const TuningBounds& bounds) {
+    int rounded = static_cast<int>(kbps / kBitrateStepKbps + 0.5) * kBitrateStepKbps;
+    return std::max(bounds.minBitrateKbps, std::min(bounds.maxBitrateKbps, rounded));
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param telemetry Source of the encoder speed
+ * @param control Applies the chosen settings
+ * @param bounds The bitrate range of the platform
+ * @param bitrateKbps The bitrate the encoder starts with
+ */
+EncoderTuner::EncoderTuner(EncoderTelemetry& telemetry, EncoderControl& control, const TuningBounds& bounds,
+                           int bitrateKbps)
+    : telemetry(telemetry), control(control), bounds(bounds), shuttingDown(false), preset(kDefaultPreset),
+      bitrateKbps(bitrateKbps), changedAtMs(monotonicMs()), changes(0), lastBusy(0), lastTotal(0) {
+}
+
+/**
+ * @brief Destructor
+ */
+EncoderTuner::~EncoderTuner() {
+    shutdown();
+}
+
+/**
+ * @brief Adds a destination whose queue counts as network pressure
+ *
+ * @param destination The destination, which must outlive the tuner
+ */
+void EncoderTuner::addDestination(RtmpDestination* destination) {
+    destinations.push_back(destination);
+}
+
+/**
+ * @brief Starts the tuning thread
+ */
+void EncoderTuner::start() {
+    worker = std::thread(&EncoderTuner::workerLoop, this);
+}
+
+/**
+ * @brief Stops the tuning thread
+ */
+void EncoderTuner::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+    }
+    wakeup.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Takes a bitrate chosen with pagestreamer bitrate
+ *
+ * The chosen bitrate becomes the most the tuner raises to, and the
+ * tuner waits for the switch to settle as after its own changes.
+ *
+ * @param kbps The new bitrate
+ */
+void EncoderTuner::setBitrate(int kbps) {
+    std::lock_guard<std::mutex> lock(mutex);
+    bitrateKbps = kbps;
+    bounds.maxBitrateKbps = kbps;
+    bounds.defaultBitrateKbps = kbps;
+    bounds.minBitrateKbps = std::min(bounds.minBitrateKbps, kbps);
+    changedAtMs = monotonicMs();
+}
+
+/**
+ * @brief Body of the tuning thread
+ */
+void EncoderTuner::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!shuttingDown) {
+        wakeup.wait_for(lock, std::chrono::milliseconds(kIntervalMs));
+        if (shuttingDown) {
+            return;
+        }
+        long long nowMs = monotonicMs();
+        sampleCpu(nowMs);
+        evaluate(nowMs);
+    }
+}
+
+/**
+ * @brief Measures the CPU usage since the previous call
+ *
+ * Only the CPUs the supervisor may run on count, so a stream pinned
+ * with CPUSET is tuned on its own CPUs and not on the whole host.
+ *
+ * @param nowMs The current monotonic time
+ */
+void EncoderTuner::sampleCpu(long long nowMs) {
+    std::ifstream stat("/proc/stat");
+    std::string line;
+    cpu_set_t allowed;
+    unsigned long long busy = 0;
+    unsigned long long total = 0;
+    bool haveMask = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+    while (std::getline(stat, line) && line.compare(0, 3, "cpu") == 0) {
+        unsigned long long fields[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+        int index = -1;
+        if (line[3] == ' ' || sscanf(line.c_str() + 3, "%d", &index) != 1
+            || (haveMask && (index >= CPU_SETSIZE || !CPU_ISSET(index, &allowed)))) {
+            continue;
+        }
+        std::istringstream values(line.substr(line.find(' ')));
+        for (size_t i = 0; i < 8 && values >> fields[i]; i++) {
+        }
+        for (size_t i = 0; i < 8; i++) {
+            total += fields[i];
+        }
+        busy += fields[0] + fields[1] + fields[2] + fields[5] + fields[6] + fields[7];
+    }
+    if (lastTotal > 0 && total > lastTotal) {
+        CpuReading reading = { nowMs, static_cast<double>(busy - lastBusy) / (total - lastTotal) };
+        cpu.push_back(reading);
+    }
+    lastBusy = busy;
+    lastTotal = total;
+    while (!cpu.empty() && cpu.front().timeMs < nowMs - kHeadroomWindowMs) {
+        cpu.pop_front();
+    }
+}
+
+/**
+ * @brief Averages the CPU readings taken since a time
+ *
+ * @param sinceMs The monotonic time of the oldest reading to count
+ * @return double The busy fraction, -1 without readings
+ */
+double EncoderTuner::averageCpu(long long sinceMs) const {
+    double sum = 0;
+    size_t count = 0;
+    for (size_t i = 0; i < cpu.size(); i++) {
+        if (cpu[i].timeMs >= sinceMs) {
+            sum += cpu[i].busy;
+            count++;
+        }
+    }
+    return count > 0 ? sum / count : -1;
+}
+
+/**
+ * @brief Returns the fill level of the fullest destination queue
+ *
+ * @return double The queued bytes as a fraction of the budget
+ */
+double EncoderTuner::maxQueueFill() const {
+    double fill = 0;
+    for (size_t i = 0; i < destinations.size(); i++) {
+        fill = std::max(fill, destinations[i]->queueFill());
+    }
+    return fill;
+}
+
+/**
+ * @brief Decides whether the encoder settings should change
+ *
+ * Only samples taken after the last switch has settled count, so the
+ * overlap of two encoders during a switch is never mistaken for load.
+ *
+ * @param nowMs The current monotonic time
+ */
+void EncoderTuner::evaluate(long long nowMs) {
+    if (nowMs - changedAtMs < kSettleMs) {
+        return;
+    }
+    long long settledMs = changedAtMs + kSettleMs;
+    long long pressureSince = std::max(nowMs - kPressureWindowMs, settledMs);
+    WindowSummary speed = telemetry.summary(&EncoderSample::speed, pressureSince);
+    double busy = averageCpu(pressureSince);
+    double fill = maxQueueFill();
+    std::ostringstream reason;
+    if (speed.count < kMinSamples / 2) {
+        return;
+    }
+    reason << std::fixed << std::setprecision(2) << "speed " << speed.p50 << "x, CPU " << std::setprecision(0)
+           << std::max(busy, 0.0) * 100 << "%, queue " << fill * 100 << "%";
+    if (speed.p50 < kSlowSpeed || busy > kBusyCpu) {
+        if (preset > 0) {
+            change(preset - 1, bitrateKbps, reason.str());
+        } else if (bitrateKbps > bounds.minBitrateKbps) {
+            change(preset, clampBitrate(bitrateKbps * kBitrateDown, bounds), reason.str());
+        }
+        return;
+    }
+    if (fill > kFullQueue) {
+        if (bitrateKbps > bounds.minBitrateKbps) {
+            change(preset, clampBitrate(bitrateKbps * kBitrateDown, bounds), reason.str());
+        }
+        return;
+    }
+    if (nowMs - settledMs < kHeadroomWindowMs) {
+        return;
+    }
+    WindowSummary calm = telemetry.summary(&EncoderSample::speed, nowMs - kHeadroomWindowMs);
+    double calmCpu = averageCpu(nowMs - kHeadroomWindowMs);
+    if (calm.count < kMinSamples || calm.p5 < kRealTimeSpeed || calmCpu < 0 || calmCpu > kIdleCpu
+        || fill > kEmptyQueue) {
+        return;
+    }
+    if (bitrateKbps < bounds.defaultBitrateKbps) {
+        change(preset, std::min(bounds.defaultBitrateKbps, clampBitrate(bitrateKbps * kBitrateUp, bounds)),
+               reason.str());
+    } else if (preset + 1 < kPresetCount) {
+        change(preset + 1, bitrateKbps, reason.str());
+    } else if (bitrateKbps < bounds.maxBitrateKbps) {
+        change(preset, clampBitrate(bitrateKbps * kBitrateUp, bounds), reason.str());
+    }
+}
+
+/**
+ * @brief Switches the encoder to new settings and logs why
+ *
+ * @param newPreset Index of the new preset
+ * @param newBitrateKbps The new bitrate
+ * @param reason The measurements that led to the change
+ */
+void EncoderTuner::change(size_t newPreset, int newBitrateKbps, const std::string& reason) {
+    std::ostringstream msg;
+    msg << "Encoder tuning: " << reason << ", switching from " << kPresets[preset] << " at " << bitrateKbps
+        << " kbit/s to " << kPresets[newPreset] << " at " << newBitrateKbps << " kbit/s";
+    logMessage(msg.str());
+    preset = newPreset;
+    bitrateKbps = newBitrateKbps;
+    changedAtMs = monotonicMs();
+    changes++;
+    lastReason = reason;
+    control.applyEncoderSettings(kPresets[preset], bitrateKbps);
+}
+
+/**
+ * @brief Writes the current settings and the CPU usage as metrics
+ *
+ * @param out The response body
+ * @param labels Label pairs to add to every sample
+ */
+void EncoderTuner::writeMetrics(std::ostream& out, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string separator = labels.empty() ? "" : ",";
+    double busy = averageCpu(monotonicMs() - kPressureWindowMs);
+    writeMetricHeader(out, "pagestreamer_encoder_target_bitrate_kbps", "gauge", "Video bitrate chosen by the tuner");
+    writeMetricSample(out, "pagestreamer_encoder_target_bitrate_kbps", labels, static_cast<double>(bitrateKbps));
+    writeMetricHeader(out, "pagestreamer_encoder_preset", "gauge", "x264 preset in use, 1 for the current one");
+    writeMetricSample(out, "pagestreamer_encoder_preset",
+                      labels + separator + "preset=\"" + kPresets[preset] + "\"", 1.0);
+    writeMetricHeader(out, "pagestreamer_encoder_tuning_changes_total", "counter", "Settings changes made by the tuner");
+    writeMetricSample(out, "pagestreamer_encoder_tuning_changes_total", labels,
+                      static_cast<unsigned long long>(changes));
+    if (busy >= 0) {
+        writeMetricHeader(out, "pagestreamer_cpu_busy_ratio", "gauge", "Busy fraction of the stream's CPUs");
+        writeMetricSample(out, "pagestreamer_cpu_busy_ratio", labels, busy);
+    }
+}
+
+/**
+ * @brief Writes the current settings for pagestreamer stats
+ *
+ * @param out The response body
+ */
+void EncoderTuner::writeReport(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    double busy = averageCpu(monotonicMs() - kPressureWindowMs);
+    out << "Tuning: preset " << kPresets[preset] << ", " << bitrateKbps << " kbit/s (" << bounds.minBitrateKbps
+        << "-" << bounds.maxBitrateKbps << "), " << changes << " changes";
+    if (busy >= 0) {
+        out << ", CPU " << static_cast<int>(busy * 100 + 0.5) << "%";
+    }
+    out << "\n";
+    if (!lastReason.empty()) {
+        out << "  last change: " << lastReason << "\n";
+    }
+}
@@ -0,0 +1,86 @@
+#include "../includes/Utils.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/time.h>
+
+/**
+ * @brief Returns a monotonic clock reading in milliseconds
+ *
+ * Unaffected by wall clock changes, used for timeouts and backoff.
+ *
+ * @return long long Milliseconds since an arbitrary fixed point
+ */
+long long monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief Formats the current UTC time as an ISO 8601 string
+ *
+ * @return string The timestamp, e.g. 2024-05-01T20:55:00.123Z
+ */
+std::string isoTimestamp() {
+    struct timeval tv;
+    struct tm tmUtc;
+    char buffer[32];
+    char result[40];
+    gettimeofday(&tv, NULL);
+    gmtime_r(&tv.tv_sec, &tmUtc);
+    strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tmUtc);
+    snprintf(result, sizeof(result), "%s.%03dZ", buffer, static_cast<int>(tv.tv_usec / 1000));
+    return result;
+}
+
+/**
+ * @brief Returns the PageStreamer home directory (~/.pagestreamer)
+ *
+ * @return string The absolute directory path
+ */
+std::string pagestreamerDir() {
+    const char* home = getenv("HOME");
+    return std::string(home ? home : ".") + "/.pagestreamer";
+}
+
+/**
+ * @brief Logs a message with ISO timestamp
+ *
+ * Safe to call from any thread; lines are never interleaved.
+ *
+ * @param message The message to log
+ */
+void logMessage(const std::string& message) {
+    static std::mutex logMutex;
+    std::string line = "[" + isoTimestamp() + "] " + message + "\n";
+    std::lock_guard<std::mutex> lock(logMutex);
+    std::cout << line << std::flush;
+}
+
+/**
+ * @brief Writes a whole buffer to a descriptor, retrying short writes
+ *
+ * @param fd The descriptor
+ * @param data The bytes to write
+ * @param length The number of bytes
+ * @return bool False if the descriptor failed (e.g. EPIPE)
+ */
+bool writeFully(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+    return true;
+}
@@ -0,0 +1,458 @@
+#include "../includes/Watchdog.hpp"
+#include "../includes/Utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <sstream>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const int kColumns = 32;
+static const int kRows = 18;
+static const int kPixelStep = 4;
+static const int kTileThreshold = 2;
+static const int kUniformSpread = 4;
+static const int kBlackLevel = 24;
+static const int kWhiteLevel = 232;
+static const int kPollIntervalMs = 250;
+static const long long kSampleIntervalMs = 1000;
+static const long long kBlankMs = 20 * 1000;
+static const int kSilenceSeconds = 30;
+static const long long kAudioGraceMs = 5 * 1000;
+static const long long kRecoveryGraceMs = 60 * 1000;
+static const long long kStreamRestartIntervalMs = 10 * 60 * 1000;
+static const long long kHealthyMs = 15 * 60 * 1000;
+static const char* kActions[] = { "reloading the page", "restarting the browser", "restarting the stream" };
+static const char* kActionLabels[] = { "reload", "browser", "stream" };
+
+/**
+ * @brief Returns the audio filters reporting silence to the watchdog
+ *
+ * silencedetect tags the audio once it has been silent for a while and
+ * again when sound comes back; ametadata prints those tags unbuffered
+ * to the given descriptor of the encoder.
+ *
+ * @param fd The encoder descriptor connected to the watchdog
+ * @return string Filters to append to the encoder's audio chain
+ */
+std::string silenceFilter(int fd) {
+    std::ostringstream filter;
+    filter << "silencedetect=noise=-60dB:d=" << kSilenceSeconds
+           << ",ametadata=mode=print:file=/dev/fd/" << fd << ":direct=1";
+    return filter.str();
+}
+
+/**
+ * @brief Reduces a bgr0 frame to the mean luma of each tile
+ *
+ * Reads every kPixelStep-th pixel of every kPixelStep-th row, which is
+ * plenty to tell a changing or blank picture apart.
+ *
+ * @param pixels The frame
+ * @param stride Bytes per row
+ * @param width Frame width
+ * @param height Frame height
+ * @param tiles Receives kColumns * kRows values, row by row
+ */
+static void tileLuma(const unsigned char* pixels, size_t stride, int width, int height,
+                     std::vector<unsigned char>& tiles) {
+    int tileWidth = width / kColumns;
+    int tileHeight = height / kRows;
+    unsigned int samples = static_cast<unsigned int>(((tileWidth + kPixelStep - 1) / kPixelStep)
+                                                     * ((tileHeight + kPixelStep - 1) / kPixelStep));
+    std::vector<unsigned int> sums(kColumns * kRows, 0);
+    for (int y = 0; y < tileHeight * kRows; y += kPixelStep) {
+        const unsigned char* row = pixels + static_cast<size_t>(y) * stride;
+        unsigned int* rowSums = &sums[(y / tileHeight) * kColumns];
+        for (int x = 0; x < tileWidth * kColumns; x += kPixelStep) {
+            const unsigned char* pixel = row + x * 4;
+            rowSums[x / tileWidth] += (pixel[2] * 77 + pixel[1] * 150 + pixel[0] * 29) >> 8;
+        }
+    }
+    tiles.resize(sums.size());
+    for (size_t i = 0; i < sums.size(); i++) {
+        tiles[i] = static_cast<unsigned char>(sums[i] / samples);
+    }
+}
+
+/**
+ * @brief Constructor
+ *
+ * @param fbDir The directory where Xvfb keeps its framebuffer, empty
+ *        when the capture reports picture changes with pictureChanged()
+ * @param width Screen width
+ * @param height Screen height
+ * @param control Takes the recovery actions
+ * @param freezeTimeoutSeconds How long an unchanged picture is normal, 0 for ever
+ */
+StreamWatchdog::StreamWatchdog(const std::string& fbDir, int width, int height, RecoveryControl& control,
+                               int freezeTimeoutSeconds)
+    : framebuffer(fbDir + "/Xvfb_screen0"), sampled(!fbDir.empty()), framebufferPath(fbDir + "/Xvfb_screen0"),
+      sourcePath(framebufferPath), control(control),
+      width(width), height(height), freezeMs(freezeTimeoutSeconds * 1000LL), pendingFd(-1), shuttingDown(false),
+      framebufferInode(0), watchingSinceMs(-1), changedAtMs(0), blankSinceMs(-1), blank(PROBLEM_NONE),
+      silentSinceMs(-1), audioHeard(false), level(0), lastActionMs(-1) {
+    recoveries[0] = 0;
+    recoveries[1] = 0;
+    recoveries[2] = 0;
+}
+
+/**
+ * @brief Destructor
+ */
+StreamWatchdog::~StreamWatchdog() {
+    shutdown();
+}
+
+/**
+ * @brief Starts the sampling thread
+ */
+void StreamWatchdog::start() {
+    worker = std::thread(&StreamWatchdog::workerLoop, this);
+}
+
+/**
+ * @brief Stops the sampling thread
+ */
+void StreamWatchdog::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        shuttingDown = true;
+        if (pendingFd >= 0) {
+            close(pendingFd);
+            pendingFd = -1;
+        }
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/**
+ * @brief Samples another X server from the next second on
+ *
+ * @param fbDir The directory that X server was given with -fbdir
+ */
+void StreamWatchdog::setFramebuffer(const std::string& fbDir) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sourcePath = fbDir + "/Xvfb_screen0";
+}
+
+/**
+ * @brief Records a change of the picture seen by the capture
+ *
+ * Used instead of sampling when there is no framebuffer.
+ */
+void StreamWatchdog::pictureChanged() {
+    std::lock_guard<std::mutex> lock(mutex);
+    changedAtMs = monotonicMs();
+}
+
+/**
+ * @brief Starts watching a freshly started encoder
+ *
+ * @param pid The encoder process
+ * @param fds Our end of the encoder's silence reports
+ */
+void StreamWatchdog::childStarted(pid_t pid, const std::vector<int>& fds) {
+    (void)pid;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pendingFd >= 0) {
+        close(pendingFd);
+    }
+    pendingFd = fds.empty() ? -1 : fds[0];
+    watchingSinceMs = monotonicMs();
+    changedAtMs = watchingSinceMs;
+    blankSinceMs = -1;
+    silentSinceMs = -1;
+}
+
+/**
+ * @brief Stops watching until the encoder runs again
+ *
+ * @param status The wait status
+ */
+void StreamWatchdog::childExited(int status) {
+    (void)status;
+    std::lock_guard<std::mutex> lock(mutex);
+    watchingSinceMs = -1;
+}
+
+/**
+ * @brief Body of the sampling thread
+ *
+ * Waits on the silence reports between two frame samples.
+ */
+void StreamWatchdog::workerLoop() {
+    int audioFd = -1;
+    long long nextSampleMs = 0;
+    for (;;) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (shuttingDown) {
+                break;
+            }
+            if (pendingFd >= 0) {
+                if (audioFd >= 0) {
+                    close(audioFd);
+                }
+                audioFd = pendingFd;
+                pendingFd = -1;
+                audioLine.clear();
+            }
+        }
+        struct pollfd pfd = { audioFd, POLLIN, 0 };
+        if (poll(&pfd, 1, kPollIntervalMs) > 0 && pfd.revents && !readAudio(audioFd, monotonicMs())) {
+            close(audioFd);
+            audioFd = -1;
+        }
+        long long nowMs = monotonicMs();
+        if (nowMs < nextSampleMs) {
+            continue;
+        }
+        nextSampleMs = nowMs + kSampleIntervalMs;
+        sampleFrame(nowMs);
+        long long sinceMs = 0;
+        Problem problem;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            problem = detect(nowMs, sinceMs);
+        }
+        if (problem != PROBLEM_NONE) {
+            recover(problem, sinceMs, nowMs);
+        }
+    }
+    if (audioFd >= 0) {
+        close(audioFd);
+    }
+}
+
+/**
+ * @brief Reads the silence reports printed by the encoder
+ *
+ * @param fd Our end of the report pipe
+ * @param nowMs The current monotonic time
+ * @return bool False once the encoder closed the pipe
+ */
+bool StreamWatchdog::readAudio(int fd, long long nowMs) {
+    char buffer[4096];
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count < 0 && errno == EINTR) {
+        return true;
+    }
+    if (count <= 0) {
+        return false;
+    }
+    audioLine.append(buffer, static_cast<size_t>(count));
+    size_t start = 0;
+    size_t end;
+    while ((end = audioLine.find('\n', start)) != std::string::npos) {
+        std::string line = audioLine.substr(start, end - start);
+        start = end + 1;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (line.compare(0, 19, "lavfi.silence_start") == 0) {
+            silentSinceMs = nowMs - kSilenceSeconds * 1000LL;
+        } else if (line.compare(0, 17, "lavfi.silence_end") == 0) {
+            silentSinceMs = -1;
+            audioHeard = true;
+        }
+    }
+    audioLine.erase(0, start);
+    return true;
+}
+
+/**
+ * @brief Samples the framebuffer and updates the picture state
+ *
+ * Xvfb recreates its framebuffer file when it restarts, so the file is
+ * mapped again whenever its inode changes, or when setFramebuffer()
+ * moved the watchdog to another X server. No frame counts as a change:
+ * a missing picture is the X server's problem, not the page's.
+ *
+ * @param nowMs The current monotonic time
+ */
+void StreamWatchdog::sampleFrame(long long nowMs) {
+    struct stat info;
+    if (!sampled) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (sourcePath != framebufferPath) {
+            framebufferPath = sourcePath;
+            framebuffer.setPath(framebufferPath);
+        }
+    }
+    bool present = stat(framebufferPath.c_str(), &info) == 0;
+    if (framebuffer.isOpen() && (!present || info.st_ino != framebufferInode)) {
+        framebuffer.close();
+    }
+    if (!framebuffer.isOpen() && present) {
+        std::string error;
+        if (framebuffer.open(width, height, error)) {
+            framebufferInode = info.st_ino;
+            previous.clear();
+            lastError.clear();
+        } else if (error != lastError) {
+            logMessage("Watchdog cannot read the picture: " + error);
+            lastError = error;
+        }
+    }
+    const unsigned char* frame = framebuffer.data();
+    bool changed = true;
+    Problem kind = PROBLEM_NONE;
+    if (frame) {
+        tileLuma(frame, framebuffer.rowBytes(), width, height, current);
+        unsigned char low = *std::min_element(current.begin(), current.end());
+        unsigned char high = *std::max_element(current.begin(), current.end());
+        changed = previous.size() != current.size();
+        for (size_t i = 0; i < current.size() && !changed; i++) {
+            changed = std::abs(current[i] - previous[i]) > kTileThreshold;
+        }
+        if (high - low <= kUniformSpread && high <= kBlackLevel) {
+            kind = PROBLEM_BLACK;
+        } else if (high - low <= kUniformSpread && low >= kWhiteLevel) {
+            kind = PROBLEM_WHITE;
+        }
+        previous.swap(current);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (changed) {
+        changedAtMs = nowMs;
+    }
+    if (kind != blank) {
+        blank = kind;
+        blankSinceMs = kind == PROBLEM_NONE ? -1 : nowMs;
+    }
+}
+
+/**
+ * @brief Tells whether the stream shows a problem, with the mutex held
+ *
+ * @param nowMs The current monotonic time
+ * @param sinceMs Receives when the problem started
+ * @return Problem The problem found, PROBLEM_NONE if the stream looks fine
+ */
+StreamWatchdog::Problem StreamWatchdog::detect(long long nowMs, long long& sinceMs) {
+    if (watchingSinceMs < 0) {
+        return PROBLEM_NONE;
+    }
+    if (!audioHeard && silentSinceMs < 0 && nowMs - watchingSinceMs >= kSilenceSeconds * 1000LL + kAudioGraceMs) {
+        audioHeard = true;
+    }
+    if (blankSinceMs >= 0 && nowMs - blankSinceMs >= kBlankMs) {
+        sinceMs = blankSinceMs;
+        return blank;
+    }
+    if (freezeMs > 0 && nowMs - changedAtMs >= freezeMs) {
+        sinceMs = changedAtMs;
+        return PROBLEM_FROZEN;
+    }
+    if (silentSinceMs >= 0 && audioHeard) {
+        sinceMs = silentSinceMs;
+        return PROBLEM_SILENT;
+    }
+    if (level > 0 && nowMs - lastActionMs >= kHealthyMs) {
+        level = 0;
+        logMessage("Watchdog: no problem since the last recovery, back to reloading the page first");
+    }
+    return PROBLEM_NONE;
+}
+
+/**
+ * @brief Takes the next recovery action for a problem
+ *
+ * Actions are spaced by kRecoveryGraceMs so the page has time to come
+ * back, and stream restarts by kStreamRestartIntervalMs. The problem
+ * timers start over, and the sound only counts again once the page has
+ * played some.
+ *
+ * @param problem The problem found
+ * @param sinceMs When it started
+ * @param nowMs The current monotonic time
+ */
+void StreamWatchdog::recover(Problem problem, long long sinceMs, long long nowMs) {
+    static const char* descriptions[] = { "", "picture unchanged", "black picture", "blank white picture",
+                                          "no sound" };
+    int action;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        long long spacing = level >= 2 ? kStreamRestartIntervalMs : kRecoveryGraceMs;
+        if (lastActionMs >= 0 && nowMs - lastActionMs < spacing) {
+            return;
+        }
+        action = level;
+        level = std::min(level + 1, 2);
+        lastActionMs = nowMs;
+        watchingSinceMs = nowMs;
+        changedAtMs = nowMs;
+        blankSinceMs = -1;
+        blank = PROBLEM_NONE;
+        audioHeard = false;
+    }
+    std::ostringstream msg;
+    msg << "Watchdog: " << descriptions[problem] << " for " << (nowMs - sinceMs) / 1000 << " s, "
+        << kActions[action];
+    logMessage(msg.str());
+    if (action == 0 && !control.reloadPage()) {
+        logMessage("Watchdog: the page driver is not running, restarting the browser instead");
+        action = 1;
+    }
+    if (action == 1) {
+        control.restartBrowser();
+    } else if (action == 2) {
+        control.restartStream();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    recoveries[action]++;
+}
+
+/**
+ * @brief Writes the page state and the recoveries as metrics
+ *
+ * @param out The response body
+ * @param labels Label pairs to add to every sample
+ */
+void StreamWatchdog::writeMetrics(std::ostream& out, const std::string& labels) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string separator = labels.empty() ? "" : ",";
+    long long nowMs = monotonicMs();
+    if (watchingSinceMs >= 0) {
+        writeMetricHeader(out, "pagestreamer_picture_unchanged_seconds", "gauge",
+                          "Time since the streamed picture last changed");
+        writeMetricSample(out, "pagestreamer_picture_unchanged_seconds", labels, (nowMs - changedAtMs) / 1000.0);
+        writeMetricHeader(out, "pagestreamer_audio_silent", "gauge", "1 while the streamed sound is silent");
+        writeMetricSample(out, "pagestreamer_audio_silent", labels, silentSinceMs >= 0 ? 1.0 : 0.0);
+    }
+    writeMetricHeader(out, "pagestreamer_watchdog_recoveries_total", "counter",
+                      "Recovery actions taken by the watchdog");
+    for (size_t i = 0; i < 3; i++) {
+        writeMetricSample(out, "pagestreamer_watchdog_recoveries_total",
+                          labels + separator + "action=\"" + kActionLabels[i] + "\"",
+                          static_cast<unsigned long long>(recoveries[i]));
+    }
+}
+
+/**
+ * @brief Writes the page state for pagestreamer stats
+ *
+ * @param out The response body
+ */
+void StreamWatchdog::writeReport(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(mutex);
+    long long nowMs = monotonicMs();
+    out << "Watchdog: ";
+    if (watchingSinceMs < 0) {
+        out << "idle until the encoder runs";
+    } else {
+        out << "picture changed " << (nowMs - changedAtMs) / 1000 << " s ago, sound "
+            << (silentSinceMs >= 0 ? "silent" : audioHeard ? "playing" : "not heard yet");
+        if (blankSinceMs >= 0) {
+            out << ", " << (blank == PROBLEM_BLACK ? "black" : "white") << " for " << (nowMs - blankSinceMs) / 1000
+                << " s";
+        }
+    }
+    out << "\n  " << recoveries[0] << " page reloads, " << recoveries[1] << " browser restarts, " << recoveries[2]
+        << " stream restarts\n";
+}
@@ -1,8 +1,12 @@
 #include <iostream>
 #include <stdexcept>
+#include <vector>
 #include "../includes/StreamManager.hpp"
 #include "../includes/ConfigManager.hpp"
 #include "../includes/Colors.hpp"
+#include "../includes/Instance.hpp"
+#include "../includes/Schedule.hpp"
+#include "../includes/Utils.hpp"
 
 /**
  * @brief Displays the usage instructions for the program
@@ -12,68 +16,138 @@
 void displayUsage(const char* programName) {
     std::cerr << B BLUE "PageStreamer - Stream web pages to platforms" RESET << std::endl;
     std::cerr << B CYAN "Usage: " RESET CYAN << programName 
-              << B " [start|stop|status|--config [PLATFORM|STREAM_KEY|STREAM_URL|see]|--schedule]" RESET << std::endl;
+              << B " [--instance NAME] [start|standby [HH:MM]|synctest|stop|status [--json]|stats|url|zoom|bitrate|destination|list|scheduler|in-window|--config [PLATFORM|STREAM_KEY|STREAM_URL|DESTINATIONS|CPUSET|CAPTURE|OUTPUT_RESOLUTION|see|set KEY=VALUE...]|--schedule]" RESET << std::endl;
+    std::cerr << "Options:" << std::endl;
+    std::cerr << "  -i, --instance NAME  Act on the named stream instance (default: " DEFAULT_INSTANCE ")" << std::endl;
     std::cerr << "Commands:" << std::endl;
-    std::cerr << "  start         Start streaming" << std::endl;
+    std::cerr << "  start         Start streaming, or go live from standby" << std::endl;
+    std::cerr << "  standby [HH:MM] Load the page without encoding, go live at HH:MM or on start" << std::endl;
+    std::cerr << "  synctest      Stream a flashing, beeping test page and measure A/V sync" << std::endl;
     std::cerr << "  stop          Stop streaming" << std::endl;
-    std::cerr << "  status        Check stream status" << std::endl;
+    std::cerr << "  status [--json] Check stream status, as JSON for health checks" << std::endl;
+    std::cerr << "  stats         Show live encoder statistics" << std::endl;
+    std::cerr << "  url URL       Show another page in the running stream" << std::endl;
+    std::cerr << "  zoom FACTOR   Change the page zoom of the running stream" << std::endl;
+    std::cerr << "  bitrate KBPS  Change the video bitrate of the running stream" << std::endl;
+    std::cerr << "  destination N RTMP_URL  Send output N of the running stream elsewhere" << std::endl;
+    std::cerr << "  list          List instances and their state" << std::endl;
+    std::cerr << "  scheduler     Run every instance on its schedule (foreground, start at boot)" << std::endl;
+    std::cerr << "  in-window     Exit 0 if the schedule is live now and the stream runs" << std::endl;
     std::cerr << "  --config      Configure all stream settings" << std::endl;
     std::cerr << "  --config PLATFORM    Configure streaming platform" << std::endl;
     std::cerr << "  --config STREAM_KEY  Configure stream key" << std::endl;
     std::cerr << "  --config STREAM_URL  Configure website URL to stream" << std::endl;
+    std::cerr << "  --config DESTINATIONS Add RTMP URLs to simulcast to" << std::endl;
+    std::cerr << "  --config CPUSET      Pin the instance to CPUs (e.g. 0-3)" << std::endl;
+    std::cerr << "  --config CAPTURE     Choose x11grab, the mapped framebuffer (fbdir) or headless screencast" << std::endl;
+    std::cerr << "  --config OUTPUT_RESOLUTION Stream at 1080p or 720p" << std::endl;
     std::cerr << "  --config see         View current configuration" << std::endl;
-    std::cerr << "  --schedule     Configure automatic scheduling" << std::endl;
+    std::cerr << "  --config set KEY=VALUE... Change settings at once, without prompting" << std::endl;
+    std::cerr << "  --schedule     Show and check the streaming schedule" << std::endl;
 }
 
 /**
- * @brief Handles the scheduling setup using crontab
+ * @brief Shows the schedule of an instance and checks it
  * 
- * This function shows the path to the crontab.txt file and waits for
- * user confirmation to update the crontab.
+ * Creates the schedule file with the default weekend slot if the
+ * instance has none yet, then prints where it is, whether it is valid
+ * and what the scheduler will do next.
  * 
- * @return bool True if scheduling was successful
+ * @param instance The instance
+ * @return bool True if the schedule is valid
  */
-bool handleSchedule() {
-    std::string homeDir = getenv("HOME");
-    std::string crontabPath = homeDir + "/stream/scripts/cron/crontab.txt";
-    std::string updateScriptPath = homeDir + "/stream/scripts/cron/update_crontab.sh";
+bool handleSchedule(const Instance& instance) {
+    std::string path = instance.schedulePath();
+    Schedule schedule;
+    std::vector<std::string> errors;
     
     std::cout << B CYAN "Schedule Configuration" RESET << std::endl;
-    std::cout << "You can edit the crontab file to customize your streaming schedule." << std::endl;
-    std::cout << CYAN "Crontab file location: " RESET << crontabPath << std::endl;
-    std::cout << std::endl;
-    std::cout << "Default schedule:" << std::endl;
-    std::cout << "- Start: Friday, Saturday, Sunday at 20:30 (Paris time)" << std::endl;
-    std::cout << "- Stop: Saturday, Sunday, Monday at 03:30 (Paris time)" << std::endl;
-    std::cout << std::endl;
-    std::cout << YELLOW "Once you've edited the crontab file, type 'yes' to update" << std::endl;
-    std::cout << "or 'no' to cancel: " RESET;
-    
-    std::string response;
-    std::cin >> response;
-    
-    if (response == "yes" || response == "YES" || response == "Yes") {
-        std::cout << "Updating crontab..." << std::endl;
-        
-        // Make sure the update script is executable
-        std::string chmodCmd = "chmod +x \"" + updateScriptPath + "\"";
-        system(chmodCmd.c_str());
-        
-        // Execute the update script
-        std::string updateCmd = "bash \"" + updateScriptPath + "\"";
-        int result = system(updateCmd.c_str());
-        
-        if (result == 0) {
-            std::cout << GREEN "Schedule updated successfully!" RESET << std::endl;
-            return true;
-        } else {
-            std::cout << RED "Failed to update schedule. Check permissions and try again." RESET << std::endl;
-            return false;
+    if (!writeDefaultSchedule(path)) {
+        std::cout << RED "Cannot create " << path << ". Check permissions and try again." RESET << std::endl;
+        return false;
+    }
+    std::cout << CYAN "Schedule file: " RESET << path << std::endl;
+    if (!loadSchedule(path, schedule, errors)) {
+        for (size_t i = 0; i < errors.size(); i++) {
+            std::cout << RED << errors[i] << RESET << std::endl;
         }
-    } else {
-        std::cout << "Schedule update cancelled." << std::endl;
         return false;
     }
+    
+    time_t now = time(NULL);
+    time_t liveAt = 0;
+    time_t next = schedule.nextBoundary(now);
+    int state = schedule.stateAt(now, liveAt);
+    std::cout << "Timezone: " << (schedule.timezone.empty() ? "system" : schedule.timezone)
+              << ", standby " << schedule.leadMinutes << " min before each window" << std::endl;
+    std::cout << "Now: " << (state == SCHEDULE_LIVE ? "live" : state == SCHEDULE_STANDBY ? "standby" : "stopped");
+    if (next > 0) {
+        std::cout << ", next change " << schedule.format(next);
+    }
+    std::cout << std::endl << std::endl;
+    std::cout << "Edit the file to change the windows; the scheduler picks up changes within seconds." << std::endl;
+    std::cout << "It runs as " B "pagestreamer scheduler" RESET ", started at boot by the crontab line:" << std::endl;
+    std::cout << "  @reboot " << pagestreamerDir() << "/pagestreamer scheduler >> "
+              << pagestreamerDir() << "/logs/scheduler.log 2>&1" << std::endl;
+    return true;
+}
+
+/**
+ * @brief Tells whether an instance is inside a window and streaming
+ * 
+ * Used by the maintenance scripts, so it only reads the schedule file,
+ * the PID file and the control socket.
+ * 
+ * @param instance The instance
+ * @return int 0 if the schedule asks for the stream and it is running
+ */
+int checkInWindow(const Instance& instance) {
+    Schedule schedule;
+    std::vector<std::string> errors;
+    time_t now = time(NULL);
+    time_t liveAt = 0;
+    if (!loadSchedule(instance.schedulePath(), schedule, errors)) {
+        std::cout << "No valid schedule: " << errors[0] << std::endl;
+        return 1;
+    }
+    bool inWindow = schedule.stateAt(now, liveAt) == SCHEDULE_LIVE;
+    bool running = StreamManager(instance).streamState() != "stopped";
+    if (inWindow && running) {
+        std::cout << "Within streaming period and process is running." << std::endl;
+        return 0;
+    }
+    if (!inWindow) {
+        std::cout << "Outside streaming period (" << schedule.format(now) << ")." << std::endl;
+    }
+    if (!running) {
+        std::cout << "Stream process is not running." << std::endl;
+    }
+    return 1;
+}
+
+/**
+ * @brief Lists every instance with its display and state
+ * 
+ * @return bool Always returns true
+ */
+bool listInstanceStates() {
+    std::vector<Instance> instances = listInstances();
+    if (instances.empty()) {
+        std::cout << "No instance configured yet." << std::endl;
+        return true;
+    }
+    for (size_t i = 0; i < instances.size(); i++) {
+        std::cout << B << instances[i].name << RESET;
+        if (instances[i].slot >= 0) {
+            std::cout << "  display " << instances[i].display();
+        }
+        std::cout << std::endl;
+        StreamManager streamManager(instances[i]);
+        if (!streamManager.getStreamStatus()) {
+            std::cout << "  " YELLOW "not running" RESET << std::endl;
+        }
+    }
+    return true;
 }
 
 /**
@@ -87,32 +161,64 @@ bool handleSchedule() {
  */
 int main(int argc, char **argv) {
     try {
-        if (argc < 2) {
+        std::string instanceName = DEFAULT_INSTANCE;
+        int first = 1;
+        if (getenv("PAGESTREAMER_INSTANCE")) {
+            instanceName = getenv("PAGESTREAMER_INSTANCE");
+        }
+        if (argc > 2 && (std::string(argv[1]) == "--instance" || std::string(argv[1]) == "-i")) {
+            instanceName = argv[2];
+            first = 3;
+        }
+        if (argc <= first) {
             displayUsage(argv[0]);
             return 1;
         }
         
-        std::string action = argv[1];
+        std::string action = argv[first];
         
+        if (action == "list") {
+            return listInstanceStates() ? 0 : 1;
+        } else if (action == "scheduler") {
+            Scheduler scheduler;
+            scheduler.run();
+            return 0;
+        }
+        
+        Instance instance = openInstance(instanceName);
+        if (action == "--schedule") {
+            return handleSchedule(instance) ? 0 : 1;
+        } else if (action == "in-window") {
+            return checkInWindow(instance);
+        }
         if (action == "--config") {
-            ConfigManager configManager;
-            if (argc > 2) {
-                return configManager.handleConfig(argv[2]) ? 0 : 1;
+            ConfigManager configManager(instance.envPath());
+            if (argc > first + 1 && std::string(argv[first + 1]) == "set") {
+                std::vector<std::string> assignments(argv + first + 2, argv + argc);
+                return configManager.handleSet(assignments) ? 0 : 1;
+            } else if (argc > first + 1) {
+                return configManager.handleConfig(argv[first + 1]) ? 0 : 1;
             } else {
                 return configManager.handleConfig("") ? 0 : 1;
             }
-        } else if (action == "--schedule") {
-            return handleSchedule() ? 0 : 1;
         }
         
-        StreamManager streamManager;
+        StreamManager streamManager(instance);
         
         if (action == "start") {
             streamManager.startStream();
             std::cout << B GREEN "Stream started successfully." RESET << std::endl;
+        } else if (action == "standby") {
+            streamManager.startStandby(argc > first + 1 ? argv[first + 1] : "");
+            std::cout << B GREEN "Stream is in standby." RESET << std::endl;
+        } else if (action == "synctest") {
+            streamManager.startSyncTest();
+            std::cout << B GREEN "Sync test started, see pagestreamer stats." RESET << std::endl;
         } else if (action == "stop") {
             streamManager.stopStream();
             std::cout << B GREEN "Stream stopped successfully." RESET << std::endl;
+        } else if (action == "status" && argc > first + 1 && std::string(argv[first + 1]) == "--json") {
+            return streamManager.getStreamStatus(true) ? 0 : 3;
         } else if (action == "status") {
             bool isRunning = streamManager.getStreamStatus();
             if (isRunning) {
@@ -120,6 +226,14 @@ int main(int argc, char **argv) {
             } else {
                 std::cout << B YELLOW "Stream is not running." RESET << std::endl;
             }
+        } else if (action == "stats") {
+            if (!streamManager.printStats()) {
+                std::cout << B YELLOW "Stream is not running." RESET << std::endl;
+                return 1;
+            }
+        } else if (action == "url" || action == "zoom" || action == "bitrate" || action == "destination") {
+            std::vector<std::string> words(argv + first, argv + argc);
+            return streamManager.sendCommand(words) ? 0 : 1;
         } else {
             displayUsage(argv[0]);
             return 1;
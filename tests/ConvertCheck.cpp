@@ -0,0 +1,224 @@
+#include "../includes/Convert.hpp"
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Output buffers get this many guard bytes so a kernel writing past the
+// end of a row is caught like any other mismatch.
+static const size_t kGuardBytes = 64;
+static const unsigned char kGuardByte = 0xa5;
+static const int kMaxWeight = 256;
+static const int kSourceWidth = 1920;
+static const int kSourceHeight = 1080;
+static const int kScaledWidth = 1280;
+static const int kScaledHeight = 720;
+
+/**
+ * @brief Input patterns: the extremes, alternating extremes and noise
+ */
+enum FillPattern {
+    FILL_ZERO,
+    FILL_FULL,
+    FILL_ALTERNATE,
+    FILL_RANDOM,
+    FILL_PATTERNS
+};
+
+/**
+ * @brief Fills a buffer with one of the input patterns
+ *
+ * @param bytes The buffer
+ * @param pattern The pattern
+ * @param seed The pseudo-random state, advanced for FILL_RANDOM
+ */
+static void fill(std::vector<unsigned char>& bytes, FillPattern pattern, uint32_t& seed) {
+    for (size_t i = 0; i < bytes.size(); i++) {
+        if (pattern == FILL_ZERO) {
+            bytes[i] = 0;
+        } else if (pattern == FILL_FULL) {
+            bytes[i] = 255;
+        } else if (pattern == FILL_ALTERNATE) {
+            bytes[i] = (i / 4 + i / 8) % 2 ? 255 : 0;
+        } else {
+            seed = seed * 1103515245 + 12345;
+            bytes[i] = static_cast<unsigned char>(seed >> 16);
+        }
+    }
+}
+
+/**
+ * @brief Reports a mismatch against the scalar reference
+ *
+ * @param kernel The kernel that differs
+ * @param what The case that failed
+ * @return bool Always false
+ */
+static bool mismatch(const ConvertKernel& kernel, const std::string& what) {
+    std::cout << "FAILED " << kernel.name << ": " << what << std::endl;
+    return false;
+}
+
+/**
+ * @brief Row widths to check, in pixels
+ *
+ * Below one vector, exact multiples of the 8 and 16 pixel vectors, those
+ * plus 2, 6 and 14 pixels of tail, and the output widths.
+ *
+ * @return vector<int> Even widths
+ */
+static std::vector<int> convertWidths() {
+    const int widths[] = { 2, 4, 6, 8, 10, 14, 16, 18, 22, 30, 32, 34, 38, 46, 64, 66, 70, 78, 198,
+                           kScaledWidth, kSourceWidth };
+    return std::vector<int>(widths, widths + sizeof(widths) / sizeof(widths[0]));
+}
+
+/**
+ * @brief Row lengths to check for the blend, in bytes
+ *
+ * Below one vector, exact multiples of the 16 and 32 byte vectors, those
+ * plus 2, 6 and 14 bytes of tail, and the lengths of bgr0 output rows.
+ *
+ * @return vector<size_t> Lengths
+ */
+static std::vector<size_t> blendLengths() {
+    const size_t lengths[] = { 1, 2, 6, 14, 15, 16, 18, 22, 30, 32, 34, 38, 46, 64, 66, 70, 78,
+                               kScaledWidth * 4, kSourceWidth * 4 };
+    return std::vector<size_t>(lengths, lengths + sizeof(lengths) / sizeof(lengths[0]));
+}
+
+/**
+ * @brief Checks convertRows against the reference at every width
+ *
+ * @param kernel The kernel to check
+ * @param reference The scalar kernel
+ * @return bool True if every output byte matches
+ */
+static bool checkConvertRows(const ConvertKernel& kernel, const ConvertKernel& reference) {
+    std::vector<int> widths = convertWidths();
+    uint32_t seed = 0x12345678;
+    for (size_t w = 0; w < widths.size(); w++) {
+        int width = widths[w];
+        size_t rowBytes = static_cast<size_t>(width) * 4;
+        std::vector<unsigned char> rows(rowBytes * 2);
+        for (int pattern = 0; pattern < FILL_PATTERNS; pattern++) {
+            fill(rows, static_cast<FillPattern>(pattern), seed);
+            std::vector<unsigned char> expected(width * 3 + kGuardBytes, kGuardByte);
+            std::vector<unsigned char> actual(expected);
+            const ConvertKernel* kernels[2] = { &reference, &kernel };
+            unsigned char* out[2] = { &expected[0], &actual[0] };
+            for (int k = 0; k < 2; k++) {
+                unsigned char* p = out[k];
+                kernels[k]->convertRows(&rows[0], &rows[rowBytes], width, p, p + width, p + width * 2,
+                                        p + width * 2 + width / 2);
+            }
+            if (expected != actual) {
+                std::ostringstream what;
+                what << "convertRows, width " << width << ", pattern " << pattern;
+                return mismatch(kernel, what.str());
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks blendRows against the reference at every length and weight
+ *
+ * Inputs are also read one byte off alignment, as scaled rows are.
+ *
+ * @param kernel The kernel to check
+ * @param reference The scalar kernel
+ * @return bool True if every output byte matches
+ */
+static bool checkBlendRows(const ConvertKernel& kernel, const ConvertKernel& reference) {
+    std::vector<size_t> lengths = blendLengths();
+    uint32_t seed = 0x9e3779b9;
+    for (size_t l = 0; l < lengths.size(); l++) {
+        size_t length = lengths[l];
+        std::vector<unsigned char> rows((length + 1) * 2);
+        for (int pattern = 0; pattern < FILL_PATTERNS; pattern++) {
+            fill(rows, static_cast<FillPattern>(pattern), seed);
+            for (int offset = 0; offset < 2; offset++) {
+                const unsigned char* a = &rows[offset];
+                const unsigned char* b = &rows[length + 1 + offset];
+                for (int weight = 0; weight <= kMaxWeight; weight++) {
+                    std::vector<unsigned char> expected(length + kGuardBytes, kGuardByte);
+                    std::vector<unsigned char> actual(expected);
+                    reference.blendRows(a, b, length, weight, &expected[0]);
+                    kernel.blendRows(a, b, length, weight, &actual[0]);
+                    if (expected != actual) {
+                        std::ostringstream what;
+                        what << "blendRows, length " << length << ", weight " << weight << ", pattern "
+                             << pattern << ", offset " << offset;
+                        return mismatch(kernel, what.str());
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Checks whole frames through FrameConverter against the reference
+ *
+ * Covers the 1080p to 720p scale path, where every row goes through the
+ * blend, and the unscaled 1080p conversion, on a padded stride.
+ *
+ * @param kernel The kernel to check
+ * @param reference The scalar kernel
+ * @return bool True if every output byte matches
+ */
+static bool checkFrames(const ConvertKernel& kernel, const ConvertKernel& reference) {
+    const int sizes[][2] = { { kScaledWidth, kScaledHeight }, { kSourceWidth, kSourceHeight } };
+    size_t stride = kSourceWidth * 4 + 64;
+    std::vector<unsigned char> pixels(stride * kSourceHeight);
+    uint32_t seed = 0x2545f491;
+    for (int pattern = 0; pattern < FILL_PATTERNS; pattern++) {
+        fill(pixels, static_cast<FillPattern>(pattern), seed);
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            FrameConverter expectedConverter(kSourceWidth, kSourceHeight, sizes[s][0], sizes[s][1], reference);
+            FrameConverter actualConverter(kSourceWidth, kSourceHeight, sizes[s][0], sizes[s][1], kernel);
+            std::vector<unsigned char> expected(expectedConverter.frameSize() + kGuardBytes, kGuardByte);
+            std::vector<unsigned char> actual(expected);
+            expectedConverter.convert(&pixels[0], stride, &expected[0]);
+            actualConverter.convert(&pixels[0], stride, &actual[0]);
+            if (expected != actual) {
+                std::ostringstream what;
+                what << "frame " << kSourceWidth << "x" << kSourceHeight << " to " << sizes[s][0] << "x"
+                     << sizes[s][1] << ", pattern " << pattern;
+                return mismatch(kernel, what.str());
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Entry point of the conversion kernel check
+ *
+ * Runs every kernel this CPU supports against the scalar reference, the
+ * first entry of availableConvertKernels(), and prints one line per kernel.
+ *
+ * @return int 0 if every kernel is bit-exact, 1 otherwise
+ */
+int main() {
+    std::vector<ConvertKernel> kernels = availableConvertKernels();
+    const ConvertKernel& reference = kernels[0];
+    int failures = 0;
+    for (size_t i = 1; i < kernels.size(); i++) {
+        bool passed = checkConvertRows(kernels[i], reference) && checkBlendRows(kernels[i], reference)
+                      && checkFrames(kernels[i], reference);
+        if (passed) {
+            std::cout << "ok " << kernels[i].name << std::endl;
+        } else {
+            failures++;
+        }
+    }
+    if (kernels.size() == 1) {
+        std::cout << "ok scalar only, no SIMD kernel to check on this CPU" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+#include "../includes/Schedule.hpp"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Fixed instants, in seconds since the epoch, named after their local
+// time in Europe/Paris unless stated otherwise. 2026-03-29 02:00 CET
+// jumps to 03:00 CEST and 2026-10-25 03:00 CEST falls back to 02:00 CET.
+static const time_t kThu26At2200 = 1774558800;
+static const time_t kFri27At1200 = 1774609200;
+static const time_t kFri27At2054 = 1774641299;
+static const time_t kFri27At2055 = 1774641300;
+static const time_t kFri27At2100 = 1774641600;
+static const time_t kFri27At2300 = 1774648800;
+static const time_t kSat28At0329 = 1774664999;
+static const time_t kSat28At0330 = 1774665000;
+static const time_t kSat28At2100 = 1774728000;
+static const time_t kSun29At0100 = 1774742400;
+static const time_t kSun29At0329Cest = 1774747799;
+static const time_t kSun29At0330Cest = 1774747800;
+static const time_t kMon30At0200 = 1774828800;
+static const time_t kMon30At0400 = 1774836000;
+static const time_t kSat24OctAt2100Cest = 1792868400;
+static const time_t kSun25OctAt0230Cest = 1792888200;
+static const time_t kSun25OctAt0230Cet = 1792891800;
+static const time_t kSun25OctAt0330Cet = 1792895400;
+// 10:30 local time from Friday 2026-03-27 to Thursday 2026-04-02
+static const time_t kWeekAt1030[] = { 1774603800, 1774690200, 1774773000, 1774859400,
+                                      1774945800, 1775032200, 1775118600 };
+static const char* kWeekNames[] = { "fri", "sat", "sun", "mon", "tue", "wed", "thu" };
+// 2026-03-30 in America/New_York, on daylight saving time
+static const time_t kNewYorkMon30At0630 = 1774866600;
+static const time_t kNewYorkMon30At1030 = 1774881000;
+
+static int failures = 0;
+
+/**
+ * @brief Records the outcome of one expectation
+ *
+ * @param passed True if the expectation held
+ * @param what The expectation, as reported on failure
+ */
+static void expect(bool passed, const std::string& what) {
+    if (!passed) {
+        std::cout << "FAILED schedule: " << what << std::endl;
+        failures++;
+    }
+}
+
+/**
+ * @brief Loads a schedule from text through a temporary file
+ *
+ * @param text The schedule file content
+ * @param schedule Receives the schedule
+ * @param errors Receives the parse errors
+ * @return bool The result of loadSchedule()
+ */
+static bool load(const std::string& text, Schedule& schedule, std::vector<std::string>& errors) {
+    char path[] = "/tmp/pagestreamer-schedule-check-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        errors.push_back("cannot create a temporary file");
+        return false;
+    }
+    close(fd);
+    std::ofstream file(path);
+    file << text;
+    file.close();
+    bool loaded = loadSchedule(path, schedule, errors);
+    unlink(path);
+    return loaded;
+}
+
+/**
+ * @brief Loads a schedule that must be valid
+ *
+ * @param text The schedule file content
+ * @return Schedule The schedule, empty if it did not load
+ */
+static Schedule loadValid(const std::string& text) {
+    Schedule schedule;
+    std::vector<std::string> errors;
+    expect(load(text, schedule, errors), "valid schedule rejected: " + text
+           + (errors.empty() ? "" : " (" + errors[0] + ")"));
+    return schedule;
+}
+
+/**
+ * @brief Checks the state of a schedule at one instant
+ *
+ * @param schedule The schedule
+ * @param now The instant
+ * @param expected SCHEDULE_STOPPED, SCHEDULE_STANDBY or SCHEDULE_LIVE
+ * @param what The case, as reported on failure
+ */
+static void expectState(const Schedule& schedule, time_t now, int expected, const std::string& what) {
+    time_t liveAt = 0;
+    int state = schedule.stateAt(now, liveAt);
+    std::ostringstream message;
+    message << what << ": state " << state << " at " << now << ", expected " << expected;
+    expect(state == expected, message.str());
+}
+
+/**
+ * @brief Checks the next boundary after one instant
+ *
+ * @param schedule The schedule
+ * @param now The instant
+ * @param expected The expected boundary
+ * @param what The case, as reported on failure
+ */
+static void expectBoundary(const Schedule& schedule, time_t now, time_t expected, const std::string& what) {
+    time_t boundary = schedule.nextBoundary(now);
+    std::ostringstream message;
+    message << what << ": next boundary " << boundary << " after " << now << ", expected " << expected;
+    expect(boundary == expected, message.str());
+}
+
+/**
+ * @brief Checks a window that crosses midnight, with its lead time
+ */
+static void checkMidnightWindow() {
+    Schedule schedule = loadValid("timezone Europe/Paris\nlead 5\nfri-sun 21:00-03:30\n");
+    time_t liveAt = 0;
+
+    expectState(schedule, kThu26At2200, SCHEDULE_STOPPED, "thursday evening");
+    expectState(schedule, kFri27At2054, SCHEDULE_STOPPED, "just before the lead time");
+    expectState(schedule, kFri27At2055, SCHEDULE_STANDBY, "lead time");
+    expect(schedule.stateAt(kFri27At2055, liveAt) == SCHEDULE_STANDBY && liveAt == kFri27At2100,
+           "standby reports the window start");
+    expectState(schedule, kFri27At2100, SCHEDULE_LIVE, "window start");
+    expectState(schedule, kFri27At2300, SCHEDULE_LIVE, "before midnight");
+    expectState(schedule, kSat28At0329, SCHEDULE_LIVE, "after midnight");
+    expectState(schedule, kSat28At0330, SCHEDULE_STOPPED, "window end");
+    expectState(schedule, kMon30At0200, SCHEDULE_LIVE, "sunday window on monday morning");
+    expectState(schedule, kMon30At0400, SCHEDULE_STOPPED, "monday after the sunday window");
+    expectBoundary(schedule, kFri27At1200, kFri27At2055, "lead time is the first boundary");
+    expectBoundary(schedule, kFri27At2055, kFri27At2100, "window start follows the lead time");
+    expectBoundary(schedule, kFri27At2300, kSat28At0330, "window end after midnight");
+    expect(schedule.format(kFri27At2100) == "Fri 21:00 CET", "format: " + schedule.format(kFri27At2100));
+}
+
+/**
+ * @brief Checks windows across both DST changes of Europe/Paris
+ *
+ * Windows keep their wall-clock times, so the night of the spring
+ * change is an hour shorter and the night of the autumn change an hour
+ * longer.
+ */
+static void checkDaylightSaving() {
+    Schedule schedule = loadValid("timezone Europe/Paris\nsat 21:00-03:30\n");
+
+    expectState(schedule, kSat28At2100, SCHEDULE_LIVE, "spring: window start, CET");
+    expectState(schedule, kSun29At0100, SCHEDULE_LIVE, "spring: before the change");
+    expectState(schedule, kSun29At0329Cest, SCHEDULE_LIVE, "spring: after the change");
+    expectState(schedule, kSun29At0330Cest, SCHEDULE_STOPPED, "spring: window end, CEST");
+    expectBoundary(schedule, kSun29At0100, kSun29At0330Cest, "spring: end at 03:30 CEST");
+
+    expectState(schedule, kSat24OctAt2100Cest, SCHEDULE_LIVE, "autumn: window start, CEST");
+    expectState(schedule, kSun25OctAt0230Cest, SCHEDULE_LIVE, "autumn: first 02:30");
+    expectState(schedule, kSun25OctAt0230Cet, SCHEDULE_LIVE, "autumn: repeated 02:30");
+    expectState(schedule, kSun25OctAt0330Cet, SCHEDULE_STOPPED, "autumn: window end, CET");
+    expectBoundary(schedule, kSun25OctAt0230Cest, kSun25OctAt0330Cet, "autumn: end at 03:30 CET");
+}
+
+/**
+ * @brief Checks day lists and ranges, including one wrapping the week
+ */
+static void checkDays() {
+    const char* lists[] = { "fri-mon", "sat-sun,wed", "daily", "mon,tue,wed,thu,fri" };
+    // One character per day of kWeekAt1030, from Friday: L live, - stopped
+    const char* expected[] = { "LLLL---", "-LL--L-", "LLLLLLL", "L--LLLL" };
+    for (size_t i = 0; i < sizeof(lists) / sizeof(lists[0]); i++) {
+        Schedule schedule = loadValid(std::string("timezone Europe/Paris\n") + lists[i] + " 10:00-11:00\n");
+        for (int day = 0; day < 7; day++) {
+            expectState(schedule, kWeekAt1030[day], expected[i][day] == 'L' ? SCHEDULE_LIVE : SCHEDULE_STOPPED,
+                        std::string(lists[i]) + " on " + kWeekNames[day]);
+        }
+    }
+    Schedule newYork = loadValid("timezone America/New_York\ndaily 10:00-11:00\n");
+    expectState(newYork, kNewYorkMon30At1030, SCHEDULE_LIVE, "window in the schedule's timezone");
+    expectState(newYork, kNewYorkMon30At0630, SCHEDULE_STOPPED, "window not in UTC");
+    Schedule empty = loadValid("# nothing scheduled\n\ntimezone Europe/Paris\n");
+    expectState(empty, kFri27At2100, SCHEDULE_STOPPED, "schedule without windows");
+    expectBoundary(empty, kFri27At2100, 0, "schedule without windows");
+}
+
+/**
+ * @brief Checks that invalid schedules are rejected line by line
+ */
+static void checkErrors() {
+    const char* invalid[] = {
+        "timezone Mars/Olympus\n",
+        "timezone ../../etc/passwd\n",
+        "timezone Europe\n",
+        "funday 10:00-11:00\n",
+        "mon-fun 10:00-11:00\n",
+        "mon 24:00-25:00\n",
+        "mon 10:60-11:00\n",
+        "mon 10:00\n",
+        "mon 10:00-11:00x\n",
+        "mon 10:00-11:00 extra\n",
+        "lead -1\n",
+        "lead 1441\n",
+        "lead 5m\n",
+        "lead\n",
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        Schedule schedule;
+        std::vector<std::string> errors;
+        std::string text = invalid[i];
+        expect(!load(text, schedule, errors) && errors.size() == 1,
+               "invalid schedule accepted: " + text.substr(0, text.size() - 1));
+    }
+    Schedule schedule;
+    std::vector<std::string> errors;
+    load("timezone Europe/Paris\nfunday 10:00-11:00\nlead 5\nmon 10:00\n", schedule, errors);
+    expect(errors.size() == 2 && errors[0].find(":2: ") != std::string::npos
+           && errors[1].find(":4: ") != std::string::npos, "errors name their line");
+    expect(!loadSchedule("/nonexistent/schedule", schedule, errors), "missing schedule file accepted");
+}
+
+/**
+ * @brief Entry point of the schedule check
+ *
+ * Runs the schedule logic on fixed instants, independently of the
+ * current date and of the host's timezone.
+ *
+ * @return int 0 if every expectation held, 1 otherwise
+ */
+int main() {
+    checkMidnightWindow();
+    checkDaylightSaving();
+    checkDays();
+    checkErrors();
+    if (failures == 0) {
+        std::cout << "ok schedule" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}